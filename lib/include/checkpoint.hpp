@@ -0,0 +1,153 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "model_io.hpp"
+#include "optimizer.hpp"
+
+
+// Checkpoint files, in dir, named <prefix>-<seq>.ckpt (full) and <prefix>-<seq>.delta.
+//
+// A full checkpoint is a model file (model_io.hpp, loadable on its own) followed by a trailer:
+//     CheckpointTrailer    64 bytes
+//     optimizer state      state_size floats
+//
+// A delta checkpoint holds only the blocks of the image (params then optimizer state) that changed
+// since checkpoint base_seq, which is the one written just before it:
+//     CheckpointHeader     128 bytes
+//     block indices        num_blocks uint64, padded to 64 bytes
+//     blocks               num_blocks x block_floats floats (the last block of the image may be short)
+//
+// Restoring loads the newest full checkpoint and applies the deltas after it in order.
+
+#define CHECKPOINT_MAGIC "SNNCKPT"
+#define CHECKPOINT_DELTA_MAGIC "SNNDELT"
+#define CHECKPOINT_VERSION 1
+
+struct CheckpointTrailer
+{
+    char     magic[8];          // CHECKPOINT_MAGIC
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t seq;
+    uint64_t step;              // training step given to save
+    uint64_t opt_step;          // optimizer steps taken
+    uint64_t state_size;        // floats of optimizer state after the trailer
+    uint64_t checksum;          // of the state
+    uint64_t reserved2;
+};
+
+struct CheckpointHeader
+{
+    char     magic[8];          // CHECKPOINT_DELTA_MAGIC
+    uint32_t version;
+    uint32_t block_floats;
+    uint64_t seq;
+    uint64_t base_seq;
+    uint64_t step;
+    uint64_t opt_step;
+    uint64_t image_size;        // floats: params + optimizer state
+    uint64_t num_blocks;
+    uint64_t checksum;          // of everything after the header
+    uint64_t reserved[7];
+};
+
+static_assert(sizeof(CheckpointTrailer) == 64, "checkpoint trailer must be 64 bytes");
+static_assert(sizeof(CheckpointHeader) == 128, "checkpoint header must be 128 bytes");
+
+
+struct CheckpointConfig
+{
+    std::string dir = ".";
+    std::string prefix = "ckpt";
+    uint32_t keep = 3;                  // newest checkpoints kept (plus whatever their deltas need)
+    bool delta = false;                 // write only the changed blocks between full checkpoints
+    uint32_t full_every = 8;            // with delta: every full_every-th checkpoint is a full one
+    uint32_t block_floats = 16384;      // delta block, 64 KiB
+    bool skip_if_busy = true;           // save returns at once if the previous one is still being written
+};
+
+struct CheckpointStats
+{
+    uint64_t written = 0;
+    uint64_t skipped = 0;               // save called while the previous checkpoint was still being written
+    uint64_t failed = 0;
+    double   last_snapshot_ms = 0;      // time save blocked the caller
+    double   last_write_ms = 0;         // background write + fsync + rename
+    uint64_t last_bytes = 0;
+};
+
+
+// Background checkpoint writer.
+//
+// save() only copies the flat parameter buffer and the optimizer state into a staging buffer
+// (a memcpy at memory bandwidth) and returns; a dedicated thread then writes the copy with a few
+// large sequential writes, fsyncs it, renames it into place (so a checkpoint is either complete
+// or not there) and deletes the checkpoints that fell out of the rotation.
+//
+// With delta enabled the writer keeps the image it last wrote and compares block by block,
+// writing only the blocks that differ. That pays off when most of the parameters don't move between
+// checkpoints (frozen layers, sparse updates, plain SGD on sparse inputs); Adam moments change
+// everywhere on every step, so with Adam the optimizer state part is mostly rewritten anyway.
+class CheckpointWriter
+{
+    private:
+        CheckpointConfig cfg;
+
+        std::mutex lock;
+        std::condition_variable cond;
+        std::thread writer;
+        bool pending = false;               // a snapshot is waiting for / being written
+        bool stop = false;
+        int last_status = 0;
+        CheckpointStats stats;
+
+        // the job, owned by the writer while pending
+        std::vector<LayerRecord> topology;
+        std::vector<float> staging;         // params then optimizer state
+        std::vector<float> reference;       // last image written (delta)
+        size_t num_params = 0;
+        uint64_t step = 0;
+        uint64_t opt_step = 0;
+        uint64_t seq = 0;                   // of the next checkpoint
+        uint64_t since_full = 0;
+        bool have_reference = false;
+
+        void writer_loop();
+        int write_job(size_t* bytes);
+        int write_full(const std::string& path, size_t* bytes);
+        int write_delta(const std::string& path, size_t* bytes);
+        void rotate();
+
+    public:
+        explicit CheckpointWriter(const CheckpointConfig& cfg);
+        ~CheckpointWriter();
+
+        CheckpointWriter(const CheckpointWriter& other) = delete;
+        CheckpointWriter& operator=(const CheckpointWriter& other) = delete;
+
+        // Snapshot nn's parameters and opt's state (opt may be null) at training step step and queue the
+        // write. Returns 0 when queued, 1 when skipped because the previous write is still running, -1 on error.
+        int save(FullyConnectedNetwork& nn, Optimizer* opt, uint64_t step);
+
+        // Block until the queued checkpoint is on disk. Returns -1 if writing it failed.
+        int wait();
+
+        CheckpointStats get_stats();
+
+        // Rebuild the newest checkpoint in dir that can be restored (full + its deltas).
+        // The network is writable (training can go on), opt (if given) gets its state back and step is set.
+        // Returns nullptr when there is nothing to restore.
+        static FullyConnectedNetwork* restore(const std::string& dir, const std::string& prefix, Optimizer* opt,
+                                              uint64_t* step);
+};
+
+
+#endif
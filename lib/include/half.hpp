@@ -0,0 +1,134 @@
+#ifndef __HALF_H__
+#define __HALF_H__
+#pragma once
+
+// 16-bit float storage formats, kept as raw uint16_t bits:
+//
+//   bf16: the top half of a float32 (8 bit exponent, 7 bit mantissa). Same range as float,
+//         converting is a shift, ~3 significant digits.
+//   fp16: IEEE half (5 bit exponent, 10 bit mantissa). More precise but only up to 65504,
+//         converted in hardware with F16C (or NEON), with integer tricks otherwise.
+//
+// Only storage is 16-bit: the load_* functions widen to a Vec of float32 in registers
+// and all arithmetic stays in float32.
+
+#include <stdint.h>
+#include <cstring>
+#include "simd.hpp"
+
+
+static inline uint32_t float_bits(float f) { uint32_t u; std::memcpy(&u, &f, 4); return u; }
+static inline float bits_float(uint32_t u) { float f; std::memcpy(&f, &u, 4); return f; }
+
+// round to nearest even, NaN stays NaN
+static inline uint16_t float_to_bf16(float f)
+{
+    uint32_t u = float_bits(f);
+    if ((u & 0x7fffffff) > 0x7f800000)
+        return uint16_t((u >> 16) | 0x40);
+    u += 0x7fff + ((u >> 16) & 1);
+    return uint16_t(u >> 16);
+}
+
+static inline float bf16_to_float(uint16_t h) { return bits_float(uint32_t(h) << 16); }
+
+// round to nearest even, overflow to inf, small values to subnormals / 0
+static inline uint16_t float_to_fp16(float f)
+{
+    uint32_t u = float_bits(f);
+    uint16_t sign = uint16_t((u >> 16) & 0x8000);
+    u &= 0x7fffffff;
+
+    if (u > 0x7f800000)                         // NaN
+        return sign | 0x7e00;
+    if (u >= 0x477ff000)                        // rounds to >= 65536: inf
+        return sign | 0x7c00;
+    if (u < 0x38800000) {                       // below the smallest normal (2^-14): subnormal
+        // the float's 24 bit mantissa shifted into place, rounding at the cut
+        uint32_t e = u >> 23;
+        if (e < 102)
+            return sign;
+        uint32_t m = (u & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - e;
+        uint32_t half = m >> shift;
+        uint32_t rest = m & ((1u << shift) - 1), mid = 1u << (shift - 1);
+        if (rest > mid || (rest == mid && (half & 1)))
+            half++;
+        return sign | uint16_t(half);
+    }
+
+    u += 0x0fff + ((u >> 13) & 1);
+    return sign | uint16_t((u - 0x38000000) >> 13);
+}
+
+// The magnitude bits moved into a float's place and scaled by 2^112 fix up the exponent bias,
+// which also normalizes subnormals. Inf / NaN get their exponent forced to all ones.
+static inline float fp16_to_float(uint16_t h)
+{
+    uint32_t mag = uint32_t(h & 0x7fff) << 13;
+    float f = bits_float(mag) * bits_float(0x77800000);
+    uint32_t u = float_bits(f);
+    if (mag >= 0x0f800000)
+        u |= 0x7f800000;
+    return bits_float(u | (uint32_t(h & 0x8000) << 16));
+}
+
+
+static inline Scalar load_bf16(const uint16_t* p, Scalar) { return {bf16_to_float(*p)}; }
+static inline Scalar load_fp16(const uint16_t* p, Scalar) { return {fp16_to_float(*p)}; }
+
+#if defined(__SSE2__)
+// 4 halves (low 64 bits of h, zero extended to 32 bits each) to floats
+static inline __m128 bf16x4_sse2(__m128i h32) { return _mm_castsi128_ps(_mm_slli_epi32(h32, 16)); }
+static inline __m128 fp16x4_sse2(__m128i h32)
+{
+    __m128i mag = _mm_slli_epi32(_mm_and_si128(h32, _mm_set1_epi32(0x7fff)), 13);
+    __m128 f = _mm_mul_ps(_mm_castsi128_ps(mag), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+    __m128i inf = _mm_and_si128(_mm_cmpgt_epi32(mag, _mm_set1_epi32(0x0f7fffff)), _mm_set1_epi32(0x7f800000));
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(h32, _mm_set1_epi32(0x8000)), 16);
+    return _mm_or_ps(f, _mm_castsi128_ps(_mm_or_si128(inf, sign)));
+}
+#endif
+
+#if defined(__AVX__)
+static inline Vec load_bf16(const uint16_t* p, Vec)
+{
+#if defined(__AVX2__)
+    __m256i h = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    return {_mm256_castsi256_ps(_mm256_slli_epi32(h, 16))};
+#else
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero = _mm_setzero_si128();
+    return {_mm256_set_m128(bf16x4_sse2(_mm_unpackhi_epi16(h, zero)), bf16x4_sse2(_mm_unpacklo_epi16(h, zero)))};
+#endif
+}
+
+static inline Vec load_fp16(const uint16_t* p, Vec)
+{
+#if defined(__F16C__)
+    return {_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)))};
+#else
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero = _mm_setzero_si128();
+    return {_mm256_set_m128(fp16x4_sse2(_mm_unpackhi_epi16(h, zero)), fp16x4_sse2(_mm_unpacklo_epi16(h, zero)))};
+#endif
+}
+
+#elif defined(__SSE2__)
+static inline Vec load_bf16(const uint16_t* p, Vec)
+{
+    __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return {bf16x4_sse2(_mm_unpacklo_epi16(h, _mm_setzero_si128()))};
+}
+
+static inline Vec load_fp16(const uint16_t* p, Vec)
+{
+    __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return {fp16x4_sse2(_mm_unpacklo_epi16(h, _mm_setzero_si128()))};
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static inline Vec load_bf16(const uint16_t* p, Vec) { return {vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(p), 16))}; }
+static inline Vec load_fp16(const uint16_t* p, Vec) { return {vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(p)))}; }
+#endif
+
+
+#endif
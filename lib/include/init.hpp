@@ -0,0 +1,39 @@
+#ifndef __INIT_H__
+#define __INIT_H__
+#pragma once
+
+#include <stdint.h>
+#include "nn.hpp"
+#include "philox.hpp"
+
+
+enum class InitScheme
+{
+    AUTO,               // HE_UNIFORM for RELU layers, XAVIER_UNIFORM for the others
+    XAVIER_UNIFORM,     // U(-r, r), r = gain * sqrt(6 / (n_in + n))
+    XAVIER_NORMAL,      // N(0, s^2), s = gain * sqrt(2 / (n_in + n))
+    HE_UNIFORM,         // U(-r, r), r = gain * sqrt(6 / n_in)
+    HE_NORMAL,          // N(0, s^2), s = gain * sqrt(2 / n_in)
+    ORTHOGONAL,         // gain * a random matrix with orthonormal rows (or columns if n > n_in)
+};
+
+struct InitConfig
+{
+    uint64_t seed = 0;
+    InitScheme scheme = InitScheme::AUTO;
+    float gain = 1.0f;
+    tpool_t* pool = nullptr;
+    size_t num_threads = 1;
+};
+
+
+// Initialize the weights of every trainable layer of nn and zero the biases. Layer k draws from Philox
+// stream k of cfg.seed, so the same seed gives bit-identical weights for any number of threads.
+// The weights are written through mutable_weights (copied first if shared).
+int init_weights(FullyConnectedNetwork& nn, const InitConfig& cfg=InitConfig());
+
+// The same for one layer, from stream (cfg.seed, stream)
+int init_weights(Layer& layer, uint32_t stream, const InitConfig& cfg=InitConfig());
+
+
+#endif
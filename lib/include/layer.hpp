@@ -8,85 +8,168 @@
 #include <algorithm>
 #include <string>
 #include <random>
+#include <memory>
+#include <span>
+#include <cmath>
 #include "matrix.hpp"
 #include "perceptron.hpp"
+#include "philox.hpp"
+#include "log.hpp"
+#include "param_buffer.hpp"
 
 using std::vector;
 using std::string;
 
+class FullyConnectedNetwork;
+class PerceptronStore;
+
+
+enum class Activation
+{
+    NONE,           // identity, the layer outputs w•x+b
+    SIGMOID,
+    RELU,
+    SOFTMAX,        // output layer only, trained with cross entropy (see FullyConnectedNetwork::backprop)
+};
+
 class Layer
 {
     private:
         uint32_t n = 0;              // total number of perceptrons
-        uint32_t edges = 0;          // total number of edges between this layer and the next
+        uint32_t n_in = 0;           // number of inputs, the perceptrons of the previous layer (0 for the input layer)
+        uint32_t edges = 0;          // total number of edges between the previous layer and this one (n * n_in)
         uint32_t layer_n = 0;        // index of this layer within the whole network
         string name = "";            // name of the layer
+        Activation act = Activation::SIGMOID;
+
+        // Storage the views below point into. A standalone layer owns its own buffers,
+        // a layer of a network shares the network's flat buffers (see bind).
+        // params may also be shared with copies of the layer / network: it is only written
+        // through mutable_weights / mutable_biases, which copy it first if needed.
+        std::shared_ptr<ParamBuffer> params;
+        std::shared_ptr<ParamBuffer> grads;
+        size_t offset = 0;           // where this layer starts within params / grads
+        FullyConnectedNetwork* net = nullptr;   // network this layer belongs to, nullptr when standalone
 
         vector<float> x;             // Inputs
-        vector<float> w;             // Weights
-        vector<float> b;             // Biases
+        std::span<float> w;          // Weights, row major [n][n_in]: row i holds the inputs of perceptron i
+        std::span<float> b;          // Biases
+        std::span<float> dw;         // Gradient of the weights, same layout as w
+        std::span<float> db;         // Gradient of the biases
         vector<float> y;             // output: activation_func(w•a + b)
 
+        void set_views();
+        void own_params();
+
+        Layer(const Layer &other, FullyConnectedNetwork* net, std::shared_ptr<ParamBuffer> grads);
+
+        friend class FullyConnectedNetwork;
+
     public:
-        Layer(uint32_t n, bool init_random=true, uint32_t layer_n=0, string name="default"):
+        Layer(uint32_t n, bool init_random=true, uint32_t layer_n=0, string name="default", uint32_t n_in=0,
+              Activation act=Activation::SIGMOID):
                                                                                             n(n),
+                                                                                            n_in(n_in),
+                                                                                            edges(n * n_in),
                                                                                             layer_n(layer_n),
-                                                                                            name(name)
+                                                                                            name(name),
+                                                                                            act(act)
         {
-            // TODO: take out the random number generator. it should be an input from the hihgher level NN.
-
-            // Create a random device to seed the generator
-            std::random_device rd;
-            // Create a Mersenne Twister random number engine
-            std::mt19937 gen(rd());
-            // Create a uniform distribution between 0 and 1
-            std::uniform_real_distribution<float> dist(0.0, 1.0);
-
-            // Vector is resized to 'n' elements, all initialized to 0
-            x.resize(n);
-            w.resize(n);
-            b.resize(n);
+            // Create a uniform distribution in [-r, r] (Xavier / Glorot), so the initial outputs
+            // neither saturate the sigmoid nor all point the same way.
+            // The seed is random here, init_weights (init.hpp) initializes a whole network from a given seed.
+            float r = n_in > 0 ? std::sqrt(6.0f / float(n + n_in)) : 0.0f;
+
+            // The input layer has no incoming edges and therefore nothing to train
+            this->params = std::make_shared<ParamBuffer>(param_count(n, n_in));
+            this->grads = std::make_shared<ParamBuffer>(param_count(n, n_in));
+            set_views();
+
+            // Vectors are resized and all elements initialized to 0
+            x.resize(n_in > 0 ? n_in : n);
             y.resize(n);
 
             if (init_random) {
-                printf("Creating mlp units with random weights for layer: %s\n", name.c_str());
-                for (auto i = 0; i < n; i++)
-                    w[i] = dist(gen);
+                LOG_DEBUG("Creating mlp units with random weights for layer: %s", name.c_str());
+                std::random_device rd;
+                PhiloxStream stream{(uint64_t(rd()) << 32) | rd(), layer_n};
+                philox_fill_uniform(w.data(), w.size(), -r, r, stream);
             } else {
-                printf("Created mlp units with weights initialize to 0 for layer: %s\n", name.c_str());
+                LOG_DEBUG("Created mlp units with weights initialize to 0 for layer: %s", name.c_str());
             }
         }
 
-        // Copy constructor declaration
+        // The copy shares the parameters of other (copy on write) and gets gradient buffers of its own.
+        // The copy is standalone, even when other belongs to a network.
         Layer(const Layer &other);
+        Layer& operator=(const Layer &other) = delete;
+
+        Layer(Layer &&other) noexcept;
+        Layer& operator=(Layer &&other) noexcept;
 
 
         ~Layer()
         {
-            printf("~Layer()\n");
             // Requests the removal of unused capacity.
             // Basically de-allocates all memory that was allocated to the vector
             x.resize(0);
             x.shrink_to_fit();
-            w.resize(0);
-            w.shrink_to_fit();
-            b.resize(0);
-            b.shrink_to_fit();
             y.resize(0);
             y.shrink_to_fit();
 
-            // delete the connections to next layer's perceptrons
+            // the parameter buffers go away with their last owner (this layer or the network)
         }
-    
+
+        // Number of floats a layer of n perceptrons with n_in inputs takes in a flat buffer.
+        // Weights and biases each start on a cache line.
+        static size_t param_count(uint32_t n, uint32_t n_in)
+        {
+            if (n_in == 0)
+                return 0;
+            return ParamBuffer::aligned_size(size_t(n) * n_in) + ParamBuffer::aligned_size(n);
+        }
+
+        // Move the parameters into the given buffers at offset and make the views point there.
+        // Current values are copied over so a layer keeps its weights when a network repacks,
+        // unless copy_values is false (the buffers already hold them, e.g. a loaded model).
+        void bind(std::shared_ptr<ParamBuffer> params, std::shared_ptr<ParamBuffer> grads, size_t offset,
+                  bool copy_values=true);
+
         template <class T>
         int copy_vector(const vector<T>& src, vector<T>& dst);
         int copy_vector(const vector<float>& src, vector<mlp_t* >& dst);
+        int copy_vector(const vector<float>& src, PerceptronStore& dst, uint32_t first);
         float compute_layer();
-        float grad_descent();
+        int set_input(const vector<float>& in);
+        const vector<float>& get_output() { return this->y; }
+
+        // y = act(w•x + b) for one sample, x holds n_in floats and y n floats.
+        // Only reads the layer, so any number of threads can run it with their own buffers.
+        void forward(const float* x, float* y) const;
+
+        // Backward pass of one sample through this layer.
+        // On entry delta holds dL/dy (for SOFTMAX: dL/d(w•x+b) already), it is turned into dL/d(w•x+b) in place.
+        // The weight and bias gradients are added to grads, a flat buffer with the layout of the network's
+        // parameters, and dL/dx is written to delta_in (n_in floats) unless it is null.
+        void backward(const float* x, const float* y, float* delta, float* delta_in, float* grads) const;
+
         void print_layer(const string content);
         string get_name();
         uint32_t get_n();
+        uint32_t get_n_in();
         uint32_t get_num_edges();
+        size_t num_params();
+        size_t get_offset() const { return this->offset; }
+        Activation get_activation() const { return this->act; }
+
+        std::span<const float> weights() const { return this->w; }
+        std::span<const float> biases() const { return this->b; }
+        // Writable views. If the parameters are shared they are copied first, so take these again
+        // after copying the layer or its network.
+        std::span<float> mutable_weights();
+        std::span<float> mutable_biases();
+        std::span<float> weight_grads() { return this->dw; }
+        std::span<float> bias_grads() { return this->db; }
 
 };
 
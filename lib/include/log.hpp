@@ -0,0 +1,96 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+#pragma once
+
+// Leveled logging.
+//
+// Levels below NN_LOG_LEVEL (compile time, DEBUG by default) expand to nothing: their arguments are never
+// compiled or evaluated. The others check the runtime level (log_set_level, INFO by default) with one
+// relaxed load and skip the formatting when below it.
+//
+// An enabled message is formatted straight into a slot of a lock-free ring (any number of producers,
+// one consumer) and written out by a background thread, so the calling thread never waits on the
+// output. WARN and ERROR wake the writer right away, the other levels go out within LOG_FLUSH_MS.
+// When the ring is full messages are dropped and counted, log_flush writes out everything queued.
+//
+//     LOG_INFO("loaded %u samples", n);
+//     LOG_ERROR("cannot open %s: %s", path.c_str(), strerror(errno));
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cstdio>
+#include <atomic>
+
+
+enum class LogLevel : int
+{
+    TRACE = 0,
+    DEBUG = 1,
+    INFO = 2,
+    WARN = 3,
+    ERROR = 4,
+    OFF = 5,
+};
+
+#ifndef NN_LOG_LEVEL
+#define NN_LOG_LEVEL 1
+#endif
+
+static constexpr size_t LOG_MSG_MAX = 240;      // longer messages are truncated
+static constexpr size_t LOG_RING_SLOTS = 4096;
+static constexpr int LOG_FLUSH_MS = 20;
+
+extern std::atomic<int> log_level;
+
+static inline bool log_enabled(LogLevel level) { return int(level) >= log_level.load(std::memory_order_relaxed); }
+
+void log_set_level(LogLevel level);
+LogLevel log_get_level();
+
+// Where the writer thread puts the messages, stdout by default. Writes out what is queued first.
+void log_set_output(FILE* out);
+
+// Queue one message (a newline is added). Use the LOG_* macros, they skip disabled levels.
+void log_write(LogLevel level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Write out every message queued so far and flush the output
+void log_flush();
+
+// Messages lost to a full ring since the start
+uint64_t log_dropped();
+
+
+#define NN_LOG_AT(level, ...) do { if (log_enabled(level)) log_write(level, __VA_ARGS__); } while (0)
+
+#if NN_LOG_LEVEL <= 0
+#define LOG_TRACE(...) NN_LOG_AT(LogLevel::TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) ((void)0)
+#endif
+
+#if NN_LOG_LEVEL <= 1
+#define LOG_DEBUG(...) NN_LOG_AT(LogLevel::DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if NN_LOG_LEVEL <= 2
+#define LOG_INFO(...) NN_LOG_AT(LogLevel::INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if NN_LOG_LEVEL <= 3
+#define LOG_WARN(...) NN_LOG_AT(LogLevel::WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if NN_LOG_LEVEL <= 4
+#define LOG_ERROR(...) NN_LOG_AT(LogLevel::ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+
+#endif
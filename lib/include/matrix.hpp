@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <cstdio>
+#include <string>
 
 using std::vector;
 
@@ -11,7 +11,7 @@
 
 #define MNIST_ROWS 28
 #define MNIST_COLS 28
-#define MNIST_IMAGE_SIZE 748 // 28 x 28
+#define MNIST_IMAGE_SIZE 784 // 28 x 28
 
 using std::vector;
 using std::string;
@@ -33,6 +33,10 @@ class MNSITLoader
         // Read an image "lazily"
         void read_mnist_cv();
         void read_img(char* out, uint32_t index);
+
+        // Read all the images (pixels scaled to [0, 1], MNIST_IMAGE_SIZE floats each) and labels
+        // into flat arrays, at most max_items of them (0 for all). Returns the number of samples read.
+        uint32_t load(vector<float>& images, vector<uint32_t>& labels, uint32_t max_items=0);
         uint32_t swap_endian(uint32_t val);
 };
 
@@ -0,0 +1,79 @@
+#ifndef __MODEL_IO_H__
+#define __MODEL_IO_H__
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "nn.hpp"
+
+
+// Binary model format, version 1. All integers little endian.
+//
+//     offset 0      ModelHeader                      64 bytes
+//     offset 64     LayerRecord x num_layers         64 bytes each
+//     params_offset parameter blob                   params_size floats, 64-byte aligned
+//
+// The parameter blob is the network's flat parameter buffer as is: every layer's weights
+// and biases start on a cache line (see Layer::param_count), so once the file is mapped the
+// layers point straight into the mapping. Processes mapping the same file share one copy
+// of the weights in the page cache.
+//
+// meta_checksum covers the header (with meta_checksum itself 0) and the layer records,
+// every layer record carries the checksum of its own part of the blob.
+
+#define MODEL_MAGIC "SNNMODEL"
+#define MODEL_VERSION 1
+#define MODEL_BYTE_ORDER 0x01020304u
+#define MODEL_NAME_LEN 24
+
+struct ModelHeader
+{
+    char     magic[8];          // MODEL_MAGIC, no terminator
+    uint32_t version;           // MODEL_VERSION
+    uint32_t byte_order;        // MODEL_BYTE_ORDER as written by the saving host
+    uint32_t header_size;       // sizeof(ModelHeader)
+    uint32_t record_size;       // sizeof(LayerRecord)
+    uint32_t num_layers;
+    uint32_t flags;             // 0, reserved
+    uint64_t params_offset;     // file offset of the parameter blob, multiple of 64
+    uint64_t params_size;       // floats in the blob
+    uint64_t meta_checksum;
+    uint64_t reserved;
+};
+
+struct LayerRecord
+{
+    uint32_t n;                 // perceptrons
+    uint32_t n_in;              // inputs (0 for the input layer)
+    uint32_t layer_n;
+    uint32_t activation;        // Activation
+    uint64_t offset;            // floats from the start of the blob
+    uint64_t count;             // floats, Layer::param_count(n, n_in)
+    uint64_t checksum;          // hash_bytes of the layer's floats
+    char     name[MODEL_NAME_LEN];  // zero terminated, truncated
+};
+
+static_assert(sizeof(ModelHeader) == 64, "model header must be 64 bytes");
+static_assert(sizeof(LayerRecord) == 64, "layer record must be 64 bytes");
+
+
+// Write nn in the model format to fd at its current position, with the parameter values taken
+// from params (nn.num_params() floats laid out like nn.param_data(), e.g. a snapshot of them).
+// One write for the header and records, one for the blob. Returns the bytes written or -1.
+int64_t model_write(int fd, FullyConnectedNetwork& nn, const float* params);
+
+// Same from a topology taken earlier (see model_topology), so the network itself
+// is not needed at write time (e.g. on a background thread while training goes on)
+int64_t model_write(int fd, std::vector<LayerRecord> layers, const float* params, size_t num_params);
+
+// Layer records of nn, the checksums are left for model_write to fill in
+std::vector<LayerRecord> model_topology(FullyConnectedNetwork& nn);
+
+// Checksum used for the layer blobs and the metadata
+uint64_t model_checksum(const void* data, size_t len);
+
+// write() until all len bytes are out, retrying short writes and EINTR. Returns 0 / -1 (errno set).
+int write_all(int fd, const void* data, size_t len);
+
+
+#endif
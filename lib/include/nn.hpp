@@ -7,21 +7,53 @@
 #include <cmath>
 
 
+// Scratch space of one forward / backward pass, so any number of threads can run passes
+// against the same (read only) network, each with its own workspace.
+struct Workspace
+{
+    std::vector<std::vector<float>> a;       // output of every layer, a[0] is the input sample
+    std::vector<std::vector<float>> delta;   // dL/dy of every layer
+};
+
+
+class Profiler;
+
 class FullyConnectedNetwork 
 {
     private:
         uint32_t depth = 0;         // Network depth
         std::vector<Layer* > layers;     // input layer & hidden layers & output layer
+
+        // Every trainable parameter of the network in one flat buffer, and the gradients in another
+        // with the same layout. Layers only hold views into these.
+        // params is shared with the copies of this network and copied on the first write (see own_params),
+        // grads always belongs to this network alone.
+        std::shared_ptr<ParamBuffer> params;
+        std::shared_ptr<ParamBuffer> grads;
+
+        // Set by Profiler::attach, passes are timed per layer while it is
+        Profiler* profiler = nullptr;
+
+        void pack_params();
+        void release_layers();
         // Layer * in = nullptr;    // convinience pointer to input layer
         // Layer * out = nullptr;   // convinience pointer to output layer
 
 
+        friend class Profiler;
+
     public:
         // Constructor with initialization list
         FullyConnectedNetwork();
 
-        // Copy constructor declaration
+        // The copy shares the parameters with other until either of them writes to them, only its
+        // layers (activation scratch) and an untouched gradient buffer are new. That makes inference
+        // replicas cheap: any number of them read the one copy of the weights.
         FullyConnectedNetwork(const FullyConnectedNetwork &other);
+        FullyConnectedNetwork& operator=(const FullyConnectedNetwork &other) = delete;
+
+        FullyConnectedNetwork(FullyConnectedNetwork &&other) noexcept;
+        FullyConnectedNetwork& operator=(FullyConnectedNetwork &&other) noexcept;
 
         // Destructor (cleaup routine)
         ~FullyConnectedNetwork();
@@ -29,14 +61,58 @@ class FullyConnectedNetwork
         // Forward propagation through a typical deep neural network
         int forward_propagation(std::vector<float>& x, std::vector<float>& y);
 
+        // Workspace sized for this network
+        Workspace make_workspace();
+
+        // Forward pass of one sample (num_inputs floats), the output ends up in ws.a.back()
+        int forward(const float* x, Workspace& ws);
+
         float loss();
 
         std::vector<float> softmax(const std::vector<float>& input);
 
-        int backprop();
+        // Forward and backward pass of one sample with its class label.
+        // The gradients are added to grads (same layout as param_data), the loss is returned.
+        // With a SOFTMAX output layer the loss is the cross entropy, otherwise the squared error
+        // against the one-hot label. Returns -1 on invalid input.
+        float backprop(const float* x, uint32_t label, Workspace& ws, float* grads);
 
         // add fully connected layer with a given number of mlps
-        Layer* add_layer(uint32_t n, bool init_random, uint32_t layer_num,  std::string layer_name);
+        Layer* add_layer(uint32_t n, bool init_random, uint32_t layer_num,  std::string layer_name,
+                         Activation act=Activation::SIGMOID);
+
+        uint32_t num_inputs() { return this->layers.empty() ? 0 : this->layers.front()->get_n(); }
+        uint32_t num_outputs() { return this->layers.empty() ? 0 : this->layers.back()->get_n(); }
+
+        uint32_t get_depth() { return this->depth; }
+        Layer* get_layer(uint32_t i) { return this->layers[i]; }
+
+        // Flat views of all parameters / gradients, in layer order
+        size_t num_params() const { return this->params ? this->params->size() : 0; }
+        const float* param_data() const { return this->params ? this->params->data() : nullptr; }
+        float* grad_data() { return this->grads ? this->grads->data() : nullptr; }
+
+        // Writable parameters, copied first if they are shared (or a read only mapping).
+        // Pointers taken earlier from param_data or the layers' views may point to the old copy.
+        float* mutable_param_data();
+
+        // Give this network a private, writable copy of the parameters unless it has one already.
+        // Not thread safe against copying this network at the same time.
+        void own_params();
+        bool shares_params() const;
+
+        void zero_grads();
+
+        Profiler* get_profiler() const { return this->profiler; }
+
+        // Save to / load from the binary model format (see model_io.hpp). Returns 0 / -1.
+        int save(const std::string& path);
+        // The parameters of the loaded network point straight into a private mapping of the file.
+        // Without writable the mapping is read only (inference): the first write through
+        // mutable_param_data / mutable_weights copies the parameters to memory.
+        // verify checks the weight checksums, which reads the whole file once.
+        // Returns nullptr on a missing, corrupt or incompatible file.
+        static FullyConnectedNetwork* load(const std::string& path, bool writable=false, bool verify=true);
 };
 
 
@@ -0,0 +1,111 @@
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include "param_buffer.hpp"
+#include "nn.hpp"
+#include "../../utils/tpool.h"
+
+
+enum class OptimizerType
+{
+    SGD,            // plain SGD, or heavy ball momentum when momentum > 0
+    NESTEROV,       // SGD with Nesterov momentum
+    ADAM,
+    ADAMW,          // Adam with decoupled weight decay
+};
+
+enum class LrSchedule
+{
+    CONSTANT,
+    STEP,           // lr * gamma^(step / step_size)
+    COSINE,         // cosine decay from lr to min_lr over total_steps
+};
+
+struct OptimizerConfig
+{
+    OptimizerType type = OptimizerType::SGD;
+    float lr = 0.01f;
+    float momentum = 0.9f;          // SGD / NESTEROV
+    float beta1 = 0.9f;             // ADAM / ADAMW
+    float beta2 = 0.999f;
+    float eps = 1e-8f;
+
+    // L2 penalty added to the gradient, except for ADAMW where it is applied to the weights directly
+    float weight_decay = 0.0f;
+
+    // Gradient clipping, 0 disables. clip_value clamps every element.
+    // clip_norm rescales the whole gradient when its L2 norm is larger, which needs the norm
+    // before the update can start: that is one extra read of the gradients (and only of them).
+    float clip_value = 0.0f;
+    float clip_norm = 0.0f;
+
+    LrSchedule schedule = LrSchedule::CONSTANT;
+    uint32_t warmup_steps = 0;      // linear warmup from 0, before the schedule kicks in
+    uint32_t step_size = 1000;      // STEP
+    float gamma = 0.1f;             // STEP
+    uint32_t total_steps = 0;       // COSINE
+    float min_lr = 0.0f;            // COSINE
+
+    // Write 0 to the gradients on the way, so no separate pass is needed before the next backprop
+    bool zero_grads = true;
+};
+
+
+// Applies one update to a whole flat parameter buffer per step.
+//
+// Each step is a single fused pass: every element of the params, grads and optimizer state is
+// read once and written once, with clipping, weight decay, bias correction and the learning rate
+// schedule all folded into that pass (the schedule and bias corrections are per step scalars).
+// The pass is split over the thread pool in cache line aligned chunks and each chunk is SIMD vectorized.
+class Optimizer
+{
+    private:
+        OptimizerConfig cfg;
+        tpool_t* pool = nullptr;
+        size_t num_threads = 1;
+        uint64_t t = 0;                         // steps taken so far
+
+        size_t n = 0;                           // number of parameters the state was sized for
+        std::unique_ptr<ParamBuffer> m;         // first moment / momentum
+        std::unique_ptr<ParamBuffer> v;         // second moment (ADAM / ADAMW)
+
+        int alloc_state(size_t n);
+        float grad_norm(const float* grads, size_t n);
+
+    public:
+        // Without a pool the step runs on the calling thread only
+        Optimizer(const OptimizerConfig& cfg, tpool_t* pool=nullptr, size_t num_threads=1);
+
+        Optimizer(const Optimizer& other) = delete;
+        Optimizer& operator=(const Optimizer& other) = delete;
+
+        // Update n params in place from their gradients.
+        // The state is sized on the first call, later calls must pass the same n.
+        int step(float* params, float* grads, size_t n);
+        int step(FullyConnectedNetwork& nn);
+
+        // Learning rate the given step (counting from 0) runs with
+        float learning_rate(uint64_t step) const;
+        uint64_t get_step() const { return this->t; }
+        const OptimizerConfig& get_config() const { return this->cfg; }
+
+        // Flat copy of the state for checkpoints: m then v, state_size() floats (0 before the first step)
+        size_t state_size() const;
+        size_t num_params() const { return this->n; }
+        void export_state(float* out) const;
+        // Put back a state of len floats taken with export_state for n params, after t steps.
+        // Fails when len doesn't match what this optimizer keeps for n params.
+        int import_state(const float* in, size_t len, size_t n, uint64_t t);
+
+        // Count updates applied without step (asynchronous training), so the schedule moves on
+        void skip_steps(uint64_t steps) { this->t += steps; }
+
+        // Forget the state and the step count
+        void reset();
+};
+
+
+#endif
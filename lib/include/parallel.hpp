@@ -0,0 +1,87 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include "../../utils/tpool.h"
+
+
+// Run f(begin, end) over [0, n) split into at most num_threads contiguous chunks on the pool.
+//
+// Chunks hold at least min_chunk elements and their boundaries are multiples of align
+// (so two threads never write to the same cache line). The calling thread runs the last chunk
+// itself instead of idling in tpool_wait. With no pool, or not enough work to split, f runs inline.
+//
+// The pool must not be running other work at the same time, tpool_wait waits for all of it.
+template <class F>
+void parallel_for(tpool_t* pool, size_t num_threads, size_t n, size_t min_chunk, size_t align, F&& f)
+{
+    if (n == 0)
+        return;
+
+    size_t chunks = min_chunk > 0 ? n / min_chunk : n;
+    if (chunks > num_threads)
+        chunks = num_threads;
+    if (pool == nullptr || chunks <= 1) {
+        f(size_t(0), n);
+        return;
+    }
+
+    size_t per = (n + chunks - 1) / chunks;
+    per = (per + align - 1) / align * align;
+
+    struct Task {
+        F*     f;
+        size_t begin;
+        size_t end;
+    };
+    std::vector<Task> tasks;
+    for (size_t begin = 0; begin < n; begin += per)
+        tasks.push_back(Task{&f, begin, begin + per < n ? begin + per : n});
+
+    auto run = [](void* arg) {
+        Task* t = static_cast<Task*>(arg);
+        (*t->f)(t->begin, t->end);
+    };
+    for (size_t i = 0; i + 1 < tasks.size(); i++)
+        tpool_add_work(pool, run, &tasks[i]);
+    run(&tasks.back());
+    tpool_wait(pool);
+}
+
+
+// Run f(i) for every i in [0, num_tasks) on the pool, the calling thread runs the last one.
+// For work that is split by worker rather than by range (each task owns some per worker state).
+template <class F>
+void parallel_run(tpool_t* pool, size_t num_tasks, F&& f)
+{
+    if (num_tasks == 0)
+        return;
+    if (pool == nullptr || num_tasks == 1) {
+        for (size_t i = 0; i < num_tasks; i++)
+            f(i);
+        return;
+    }
+
+    struct Task {
+        F*     f;
+        size_t i;
+    };
+    std::vector<Task> tasks;
+    for (size_t i = 0; i < num_tasks; i++)
+        tasks.push_back(Task{&f, i});
+
+    auto run = [](void* arg) {
+        Task* t = static_cast<Task*>(arg);
+        (*t->f)(t->i);
+    };
+    for (size_t i = 0; i + 1 < num_tasks; i++)
+        tpool_add_work(pool, run, &tasks[i]);
+    run(&tasks.back());
+    tpool_wait(pool);
+}
+
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef __PARAM_BUFFER_H__
+#define __PARAM_BUFFER_H__
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+#include <span>
+
+
+// One flat, 64-byte aligned, zero initialized float buffer.
+//
+// All the trainable parameters of a network live in one of these and all the gradients in another.
+// Every layer only holds views (std::span) into them, so anything that treats the parameters
+// as a whole (optimizer steps, gradient reductions, checkpoints) is a single loop over
+// one contiguous array instead of a loop over layers of small vectors.
+//
+// Large buffers come straight from mmap: the kernel hands out zeroed pages on first touch,
+// so allocating a big buffer that is never (or only partly) written costs nothing.
+// A buffer can also wrap memory it doesn't own, like a model file mapping (see model_io.hpp).
+//
+// Parameter buffers are shared between copies of a network and treated as immutable while shared:
+// whoever wants to write to one first makes a private copy (see FullyConnectedNetwork::own_params).
+class ParamBuffer
+{
+    private:
+        float* buf = nullptr;
+        size_t len = 0;
+        size_t bytes = 0;
+        bool mapped = false;                // anonymous mapping, munmap on destruction
+        bool writable = true;               // false for a read only mapping, writers copy it first
+        std::shared_ptr<void> owner;        // set when wrapping someone else's memory
+
+    public:
+        static constexpr size_t ALIGN = 64;                          // bytes, one cache line
+        static constexpr size_t ALIGN_FLOATS = ALIGN / sizeof(float);
+        static constexpr size_t MMAP_MIN = 1 << 20;                  // bytes, mmap from here on
+
+        explicit ParamBuffer(size_t n);
+
+        // Wrap n floats at data (64-byte aligned) that owner keeps alive, nothing is copied
+        ParamBuffer(float* data, size_t n, std::shared_ptr<void> owner, bool writable=true);
+
+        ~ParamBuffer();
+
+        ParamBuffer(const ParamBuffer& other) = delete;
+        ParamBuffer& operator=(const ParamBuffer& other) = delete;
+
+        float* data() { return this->buf; }
+        const float* data() const { return this->buf; }
+        size_t size() const { return this->len; }
+        bool is_writable() const { return this->writable; }
+
+        std::span<float> view(size_t offset, size_t n) { return std::span<float>(this->buf + offset, n); }
+
+        // n rounded up so the next view starts on a cache line
+        static size_t aligned_size(size_t n) { return (n + ALIGN_FLOATS - 1) / ALIGN_FLOATS * ALIGN_FLOATS; }
+};
+
+
+#endif
@@ -16,7 +16,9 @@ struct perceptron {
 
 
 // Function declarations
+// For many units use PerceptronStore (perceptron_store.hpp), which keeps them in contiguous arrays
 mlp_t* mlp_create(bool init_random);
+void mlp_destroy(mlp_t* p);
 int perc_eq (const void *p1, const void *p2);
 
 #endif
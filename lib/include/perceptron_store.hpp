@@ -0,0 +1,91 @@
+#ifndef __PERCEPTRON_STORE_H__
+#define __PERCEPTRON_STORE_H__
+#pragma once
+
+#include <stdint.h>
+#include <span>
+#include <utility>
+#include <vector>
+#include "layer.hpp"
+
+
+// Reference to one unit of a PerceptronStore with the fields of mlp_t, for code written against the
+// pointer-linked perceptrons. Valid until units are added to the store or its edges are rebuilt.
+struct PerceptronRef
+{
+    float& w;
+    float& b;
+    float& a;
+    float& y;
+    std::span<const uint32_t> next_layer_perc;     // indices of the next layer perceptrons
+};
+
+
+// Perceptrons as a structure of arrays: unit i is w[i], b[i], a[i], y[i], and its connections to the
+// next layer perceptrons are edge_dst[edge_ptr[i] .. edge_ptr[i+1]) (compressed sparse rows).
+//
+// Units are created in bulk from one generator (mlp_create mallocs every unit), and a pass
+// over all units or all edges is a linear scan of a few contiguous arrays instead of a pointer chase.
+// Edges are collected with add_edge / connect_dense and folded into the CSR arrays by build_edges.
+class PerceptronStore
+{
+    private:
+        std::vector<float> w;                       // Weights
+        std::vector<float> b;                       // Biases
+        std::vector<float> a;                       // Inputs
+        std::vector<float> y;                       // y = activation_func(w•a + b)
+
+        std::vector<uint32_t> edge_ptr{0};          // num_units + 1 edge starts, covers the built edges only
+        std::vector<uint32_t> edge_dst;
+        std::vector<std::pair<uint32_t, uint32_t>> pending;    // edges added since the last build_edges
+
+    public:
+        PerceptronStore() = default;
+        explicit PerceptronStore(size_t reserve_units);
+
+        // Append count units with a = y = 0, and w, b uniform in [-1, 1) (init_random) or 0.
+        // Unit i gets element i of the seed's Philox streams, whether it is added alone or in a batch.
+        // Returns the index of the first new unit.
+        uint32_t add_units(size_t count, bool init_random, uint32_t seed=1);
+
+        void add_edge(uint32_t from, uint32_t to) { this->pending.emplace_back(from, to); }
+
+        // Connect each of n_from units starting at from to each of n_to units starting at to
+        void connect_dense(uint32_t from, uint32_t n_from, uint32_t to, uint32_t n_to);
+
+        // Move the pending edges into the CSR arrays, grouped by source in the order they were added
+        // (one counting sort over all edges). Returns -1, dropping the pending edges, if one of them
+        // names a unit that doesn't exist.
+        int build_edges();
+
+        size_t num_units() const { return this->w.size(); }
+        size_t num_edges() const { return this->edge_dst.size(); }
+        size_t num_pending_edges() const { return this->pending.size(); }
+
+        std::span<const uint32_t> next_units(uint32_t unit) const;
+        PerceptronRef unit(uint32_t i);
+
+        std::span<float> weights() { return this->w; }
+        std::span<float> biases() { return this->b; }
+        std::span<float> inputs() { return this->a; }
+        std::span<float> outputs() { return this->y; }
+        std::span<const float> outputs() const { return this->y; }
+
+        // y = act(w•a + b) for count units starting at first (softmax across the range)
+        int compute(uint32_t first, uint32_t count, Activation act);
+
+        // a[v] += y[u] for every edge u -> v out of count units starting at first
+        int propagate(uint32_t first, uint32_t count);
+
+        // Copy count floats from src into the inputs of the units starting at first
+        int set_inputs(uint32_t first, std::span<const float> src);
+
+        // Adapter from pointer-linked perceptrons: the non-null units keep their order, units reachable through
+        // next_layer_perc but not in the list are appended after them, and every pointer becomes an edge.
+        static PerceptronStore from_mlp(const std::vector<mlp_t*>& units);
+
+        size_t size_bytes() const;
+};
+
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef __PHILOX_H__
+#define __PHILOX_H__
+#pragma once
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"), a counter based generator:
+// the 4 words of block c are a keyed bijection of c, with no state carried from one block to the next.
+// Any range of a stream can be generated on its own, by any thread, in any order, and gives the same numbers.
+//
+// The key is a 64-bit seed and the counter is (block lo, block hi, stream, 0). Element i of a stream
+// is word i % 4 of block i / 4. Blocks are generated PHILOX_LANES at a time in SIMD registers (AVX2: 8,
+// SSE2: 4), every value goes through the same batch code whatever the range, so a range split between
+// threads in any way comes out bit-identical.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+#include "parallel.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+struct PhiloxStream
+{
+    uint64_t seed = 0;
+    uint32_t stream = 0;        // independent sequences under one seed, e.g. one per layer
+};
+
+static constexpr uint32_t PHILOX_M0 = 0xD2511F53, PHILOX_M1 = 0xCD9E8D57;
+static constexpr uint32_t PHILOX_W0 = 0x9E3779B9, PHILOX_W1 = 0xBB67AE85;
+
+// One block, the reference the SIMD versions have to match
+static inline void philox4x32_10(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4])
+{
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int r = 0; r < 10; r++) {
+        if (r > 0) {
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        uint64_t p0 = uint64_t(PHILOX_M0) * c0, p1 = uint64_t(PHILOX_M1) * c2;
+        c0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+        c1 = uint32_t(p1);
+        c2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+        c3 = uint32_t(p0);
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+
+#if defined(__AVX2__)
+static constexpr size_t PHILOX_LANES = 8;
+
+// 32x32 -> 64 bit products of every lane: _mm256_mul_epu32 does the even lanes, the odd ones are shifted down
+static inline void philox_mulhilo(__m256i a, __m256i m, __m256i& hi, __m256i& lo)
+{
+    __m256i even = _mm256_mul_epu32(a, m);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    const __m256i low = _mm256_set1_epi64x(0xffffffff);
+    lo = _mm256_or_si256(_mm256_and_si256(even, low), _mm256_slli_epi64(odd, 32));
+    hi = _mm256_or_si256(_mm256_srli_epi64(even, 32), _mm256_andnot_si256(low, odd));
+}
+
+// Blocks block .. block + 7 of the stream, 32 words in element order
+static inline void philox_batch(uint64_t block, const PhiloxStream& s, uint32_t* out)
+{
+    alignas(32) uint32_t lo[8], hi[8];
+    for (int i = 0; i < 8; i++) {
+        lo[i] = uint32_t(block + i);
+        hi[i] = uint32_t((block + i) >> 32);
+    }
+    __m256i c0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(lo));
+    __m256i c1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(hi));
+    __m256i c2 = _mm256_set1_epi32(int(s.stream));
+    __m256i c3 = _mm256_setzero_si256();
+    __m256i k0 = _mm256_set1_epi32(int(uint32_t(s.seed)));
+    __m256i k1 = _mm256_set1_epi32(int(uint32_t(s.seed >> 32)));
+    const __m256i m0 = _mm256_set1_epi32(int(PHILOX_M0)), m1 = _mm256_set1_epi32(int(PHILOX_M1));
+
+    for (int r = 0; r < 10; r++) {
+        if (r > 0) {
+            k0 = _mm256_add_epi32(k0, _mm256_set1_epi32(int(PHILOX_W0)));
+            k1 = _mm256_add_epi32(k1, _mm256_set1_epi32(int(PHILOX_W1)));
+        }
+        __m256i hi0, lo0, hi1, lo1;
+        philox_mulhilo(c0, m0, hi0, lo0);
+        philox_mulhilo(c2, m1, hi1, lo1);
+        c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), k0);
+        c1 = lo1;
+        c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), k1);
+        c3 = lo0;
+    }
+
+    // 4x4 transposes in each 128-bit half: r0 holds blocks 0 and 4, r1 1 and 5, ...
+    __m256i t0 = _mm256_unpacklo_epi32(c0, c1), t1 = _mm256_unpackhi_epi32(c0, c1);
+    __m256i t2 = _mm256_unpacklo_epi32(c2, c3), t3 = _mm256_unpackhi_epi32(c2, c3);
+    __m256i r0 = _mm256_unpacklo_epi64(t0, t2), r1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i r2 = _mm256_unpacklo_epi64(t1, t3), r3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i* o = reinterpret_cast<__m256i*>(out);
+    _mm256_storeu_si256(o, _mm256_permute2x128_si256(r0, r1, 0x20));
+    _mm256_storeu_si256(o + 1, _mm256_permute2x128_si256(r2, r3, 0x20));
+    _mm256_storeu_si256(o + 2, _mm256_permute2x128_si256(r0, r1, 0x31));
+    _mm256_storeu_si256(o + 3, _mm256_permute2x128_si256(r2, r3, 0x31));
+}
+
+#elif defined(__SSE2__)
+static constexpr size_t PHILOX_LANES = 4;
+
+static inline void philox_mulhilo(__m128i a, __m128i m, __m128i& hi, __m128i& lo)
+{
+    __m128i even = _mm_mul_epu32(a, m);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    const __m128i low = _mm_set_epi32(0, -1, 0, -1);
+    lo = _mm_or_si128(_mm_and_si128(even, low), _mm_slli_epi64(odd, 32));
+    hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(low, odd));
+}
+
+// Blocks block .. block + 3 of the stream, 16 words in element order
+static inline void philox_batch(uint64_t block, const PhiloxStream& s, uint32_t* out)
+{
+    __m128i c0 = _mm_set_epi32(int(uint32_t(block + 3)), int(uint32_t(block + 2)), int(uint32_t(block + 1)),
+                               int(uint32_t(block)));
+    __m128i c1 = _mm_set_epi32(int(uint32_t((block + 3) >> 32)), int(uint32_t((block + 2) >> 32)),
+                               int(uint32_t((block + 1) >> 32)), int(uint32_t(block >> 32)));
+    __m128i c2 = _mm_set1_epi32(int(s.stream));
+    __m128i c3 = _mm_setzero_si128();
+    __m128i k0 = _mm_set1_epi32(int(uint32_t(s.seed)));
+    __m128i k1 = _mm_set1_epi32(int(uint32_t(s.seed >> 32)));
+    const __m128i m0 = _mm_set1_epi32(int(PHILOX_M0)), m1 = _mm_set1_epi32(int(PHILOX_M1));
+
+    for (int r = 0; r < 10; r++) {
+        if (r > 0) {
+            k0 = _mm_add_epi32(k0, _mm_set1_epi32(int(PHILOX_W0)));
+            k1 = _mm_add_epi32(k1, _mm_set1_epi32(int(PHILOX_W1)));
+        }
+        __m128i hi0, lo0, hi1, lo1;
+        philox_mulhilo(c0, m0, hi0, lo0);
+        philox_mulhilo(c2, m1, hi1, lo1);
+        c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), k0);
+        c1 = lo1;
+        c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), k1);
+        c3 = lo0;
+    }
+
+    __m128i t0 = _mm_unpacklo_epi32(c0, c1), t1 = _mm_unpackhi_epi32(c0, c1);
+    __m128i t2 = _mm_unpacklo_epi32(c2, c3), t3 = _mm_unpackhi_epi32(c2, c3);
+    __m128i* o = reinterpret_cast<__m128i*>(out);
+    _mm_storeu_si128(o, _mm_unpacklo_epi64(t0, t2));
+    _mm_storeu_si128(o + 1, _mm_unpackhi_epi64(t0, t2));
+    _mm_storeu_si128(o + 2, _mm_unpacklo_epi64(t1, t3));
+    _mm_storeu_si128(o + 3, _mm_unpackhi_epi64(t1, t3));
+}
+
+#else
+static constexpr size_t PHILOX_LANES = 1;
+
+static inline void philox_batch(uint64_t block, const PhiloxStream& s, uint32_t* out)
+{
+    const uint32_t ctr[4] = {uint32_t(block), uint32_t(block >> 32), s.stream, 0};
+    const uint32_t key[2] = {uint32_t(s.seed), uint32_t(s.seed >> 32)};
+    philox4x32_10(ctr, key, out);
+}
+#endif
+
+
+// Words per batch, and per call of the range kernels below
+static constexpr size_t PHILOX_BATCH = 4 * PHILOX_LANES;
+
+// The words of elements [offset, offset + n) of stream s through f(float* out, const uint32_t* words),
+// which turns one batch of PHILOX_BATCH words into as many floats. Partial batches at the ends are made
+// whole in a scratch buffer, so each element always sees the same words at the same position.
+template <class F>
+static inline void philox_range(float* out, size_t n, uint64_t offset, const PhiloxStream& s, F&& f)
+{
+    alignas(32) uint32_t words[PHILOX_BATCH];
+    alignas(32) float vals[PHILOX_BATCH];
+
+    uint64_t i = offset, end = offset + n;
+    while (i < end) {
+        uint64_t base = i / PHILOX_BATCH * PHILOX_BATCH;
+        philox_batch(base / 4, s, words);
+        if (i == base && end - base >= PHILOX_BATCH) {
+            f(out + (i - offset), words);
+            i += PHILOX_BATCH;
+        } else {
+            f(vals, words);
+            uint64_t stop = base + PHILOX_BATCH < end ? base + PHILOX_BATCH : end;
+            std::memcpy(out + (i - offset), vals + (i - base), (stop - i) * sizeof(float));
+            i = stop;
+        }
+    }
+}
+
+// One batch of floats uniform in [lo, hi): the top 24 bits of each word as a fraction of 2^24
+static inline void philox_to_uniform(float* out, const uint32_t* words, float lo, float hi)
+{
+    const float span = hi - lo;
+    size_t j = 0;
+#if defined(__AVX2__)
+    const __m256 vs = _mm256_set1_ps(span), vl = _mm256_set1_ps(lo), v24 = _mm256_set1_ps(1.0f / 16777216.0f);
+    for (; j < PHILOX_BATCH; j += 8) {
+        __m256i wv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + j));
+        __m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(wv, 8)), v24);
+        _mm256_storeu_ps(out + j, _mm256_add_ps(vl, _mm256_mul_ps(vs, u)));
+    }
+#elif defined(__SSE2__)
+    const __m128 vs = _mm_set1_ps(span), vl = _mm_set1_ps(lo), v24 = _mm_set1_ps(1.0f / 16777216.0f);
+    for (; j < PHILOX_BATCH; j += 4) {
+        __m128i wv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + j));
+        __m128 u = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(wv, 8)), v24);
+        _mm_storeu_ps(out + j, _mm_add_ps(vl, _mm_mul_ps(vs, u)));
+    }
+#else
+    for (; j < PHILOX_BATCH; j++)
+        out[j] = lo + span * (float(words[j] >> 8) * (1.0f / 16777216.0f));
+#endif
+}
+
+// One batch of floats N(mean, stddev^2) by Box-Muller on word pairs (0, 1) and (2, 3) of every block
+static inline void philox_to_normal(float* out, const uint32_t* words, float mean, float stddev)
+{
+    for (size_t j = 0; j < PHILOX_BATCH; j += 2) {
+        float u1 = float((words[j] >> 8) + 1) * (1.0f / 16777216.0f);      // (0, 1], log is finite
+        float u2 = float(words[j + 1] >> 8) * (1.0f / 16777216.0f);
+        float r = std::sqrt(-2.0f * std::log(u1)) * stddev;
+        float th = 6.28318530717958647692f * u2;
+        out[j] = mean + r * std::cos(th);
+        out[j + 1] = mean + r * std::sin(th);
+    }
+}
+
+
+// Fill out[0 .. n) with elements [offset, offset + n) of stream s, uniform in [lo, hi).
+// With a pool the range is split between num_threads, the result doesn't depend on the split.
+static inline void philox_fill_uniform(float* out, size_t n, float lo, float hi, const PhiloxStream& s,
+                                       uint64_t offset=0, tpool_t* pool=nullptr, size_t num_threads=1)
+{
+    parallel_for(pool, num_threads, n, size_t(1) << 16, 64, [&](size_t begin, size_t end) {
+        philox_range(out + begin, end - begin, offset + begin, s, [&](float* o, const uint32_t* w) {
+            philox_to_uniform(o, w, lo, hi);
+        });
+    });
+}
+
+static inline void philox_fill_normal(float* out, size_t n, float mean, float stddev, const PhiloxStream& s,
+                                      uint64_t offset=0, tpool_t* pool=nullptr, size_t num_threads=1)
+{
+    parallel_for(pool, num_threads, n, size_t(1) << 16, 64, [&](size_t begin, size_t end) {
+        philox_range(out + begin, end - begin, offset + begin, s, [&](float* o, const uint32_t* w) {
+            philox_to_normal(o, w, mean, stddev);
+        });
+    });
+}
+
+
+#endif
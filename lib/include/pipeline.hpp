@@ -0,0 +1,104 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "nn.hpp"
+#include "../../utils/spsc_queue.hpp"
+
+
+struct PipelineStats
+{
+    size_t micro_batches = 0;
+    double mean_us = 0;     // submit to collect latency of a micro-batch
+    double p50_us = 0;
+    double p99_us = 0;
+    double max_us = 0;
+};
+
+
+// Pipeline-parallel inference (GPipe style) over a trained network.
+//
+// The layers are cut into contiguous groups of about equal cost (number of weights), one per stage,
+// and every stage runs on its own thread. Requests are split into micro-batches that stream through
+// the stages, so while stage 2 works on micro-batch i, stage 1 already works on i + 1. Each stage only
+// ever touches its own layers' weights, which stay hot in that core's cache, and it runs its layers
+// over the whole micro-batch one layer at a time to reuse them across the rows.
+//
+// Stages hand micro-batches to each other through lock free SPSC queues of slot indices. A slot holds
+// the activations of one micro-batch at every stage boundary and is allocated once up front,
+// so nothing is allocated or locked on the way through.
+//
+// A stage with an empty queue spins PIPELINE_SPIN times and then parks on a condition variable,
+// so an idle pipeline doesn't burn a core per stage. submit, the stage before it and the destructor
+// take its lock to wake it only while it is parked.
+//
+// submit / collect / run must all be called from the same thread (it is the producer of the first
+// queue and the consumer of the last one). The network must not change while the executor exists.
+class PipelineExecutor
+{
+    private:
+        struct Stage {
+            uint32_t first = 0;             // layers [first, last)
+            uint32_t last = 0;
+            std::vector<float> scratch[2];  // activations between the stage's own layers
+            std::thread thread;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::atomic<bool> parked{false};
+        };
+
+        struct Slot {
+            size_t rows = 0;
+            std::chrono::steady_clock::time_point start;
+            std::vector<std::vector<float>> acts;   // acts[s]: input of stage s, acts.back(): network output
+        };
+
+        FullyConnectedNetwork& nn;
+        size_t micro_batch;
+        std::vector<Stage> stages;
+        std::vector<Slot> slots;
+        std::vector<std::unique_ptr<SpscQueue<uint32_t>>> queues;  // queues[s] feeds stage s, the last one the caller
+        std::vector<uint32_t> free_slots;
+        std::atomic<bool> stop{false};
+        std::vector<double> latencies_us;
+
+        void stage_loop(size_t s);
+        void push(size_t q, uint32_t idx);
+
+    public:
+        // max_in_flight: micro-batches in the pipeline at once (0: two per stage)
+        PipelineExecutor(FullyConnectedNetwork& nn, size_t num_stages, size_t micro_batch=8, size_t max_in_flight=0);
+        ~PipelineExecutor();
+
+        PipelineExecutor(const PipelineExecutor& other) = delete;
+        PipelineExecutor& operator=(const PipelineExecutor& other) = delete;
+
+        // Queue rows (<= micro_batch) samples. Returns false when the pipeline is full.
+        bool submit(const float* x, size_t rows);
+
+        // Copy out the oldest finished micro-batch, micro-batches finish in submission order.
+        // Returns the number of rows, 0 when none is ready.
+        size_t collect(float* y);
+
+        // Run n samples through the pipeline, y receives n * num_outputs floats
+        int run(const float* x, size_t n, float* y);
+
+        size_t get_num_stages() const { return this->stages.size(); }
+        // Layers [first, last) of stage s
+        uint32_t stage_first(size_t s) const { return this->stages[s].first; }
+        uint32_t stage_last(size_t s) const { return this->stages[s].last; }
+
+        PipelineStats get_stats() const;
+        void reset_stats() { this->latencies_us.clear(); }
+};
+
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nn.hpp"
+
+
+// Peak single thread compute and memory bandwidth of the host, the two roofs of the roofline model:
+// a kernel doing I flops per byte can reach at most min(peak_gflops, I * peak_gbps).
+struct HostRoofline
+{
+    double peak_gflops = 0;         // float multiply-adds in the widest SIMD the build has (simd.hpp)
+    double peak_gbps = 0;           // streaming reads from a buffer well beyond the caches
+    double ridge() const { return this->peak_gbps > 0 ? this->peak_gflops / this->peak_gbps : 0; }
+};
+
+// Measure both roofs with short micro benchmarks (~100 ms)
+HostRoofline measure_roofline();
+
+// The work of one pass through a layer, from its shape. Matrix-vector products only: bias adds,
+// activations and the like are O(n) next to the O(n * n_in) weights and left out. Bytes are the
+// weights (and weight gradients) moved once per sample, layers small enough to stay in cache
+// can beat the memory roof.
+//   forward:  y = W x               2 n n_in flops, reads W
+//   backward: dW += delta x^T       2 n n_in flops, reads and writes dW
+//             delta_in = W^T delta  2 n n_in flops, reads W (not for the first trainable layer)
+struct LayerProfile
+{
+    uint32_t index = 0;
+    std::string name;
+    uint32_t n = 0;
+    uint32_t n_in = 0;
+
+    uint64_t forward_calls = 0;
+    uint64_t forward_ns = 0;
+    uint64_t backward_calls = 0;
+    uint64_t backward_ns = 0;
+    uint64_t input_grad_calls = 0;  // backward calls that also computed delta_in
+
+    double forward_flops() const;
+    double forward_bytes() const;
+    double backward_flops() const;
+    double backward_bytes() const;
+};
+
+
+// Opt-in per layer profiler of FullyConnectedNetwork::forward and backprop.
+//
+// attach points the network at the profiler, which then times every layer's forward and backward
+// with steady_clock. Detached (the default) the network pays one branch per pass, taken together with
+// the check for span tracing (trace.h).
+// Counters are atomics, so any number of threads can run passes through a profiled network.
+// report prints achieved GFLOP/s and GB/s per layer against the roofline of the host, write_json
+// the same as a JSON document.
+class Profiler
+{
+    private:
+        struct Counters
+        {
+            std::atomic<uint64_t> forward_calls{0};
+            std::atomic<uint64_t> forward_ns{0};
+            std::atomic<uint64_t> backward_calls{0};
+            std::atomic<uint64_t> backward_ns{0};
+            std::atomic<uint64_t> input_grad_calls{0};
+        };
+
+        HostRoofline host;
+        FullyConnectedNetwork* nn = nullptr;
+        std::vector<LayerProfile> shapes;           // index, name and shape of every layer at attach
+        std::unique_ptr<Counters[]> counters;
+
+    public:
+        explicit Profiler(const HostRoofline& host=measure_roofline());
+        ~Profiler();
+
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        // Profile nn (detaching from any network profiled before). The counters start at 0.
+        // Returns -1 if nn is being profiled by another profiler.
+        int attach(FullyConnectedNetwork& nn);
+        void detach();
+        void reset();
+
+        static uint64_t now_ns();
+
+        void add_forward(uint32_t k, uint64_t ns)
+        {
+            if (k >= this->shapes.size())
+                return;
+            this->counters[k].forward_calls.fetch_add(1, std::memory_order_relaxed);
+            this->counters[k].forward_ns.fetch_add(ns, std::memory_order_relaxed);
+        }
+
+        void add_backward(uint32_t k, uint64_t ns, bool input_grad)
+        {
+            if (k >= this->shapes.size())
+                return;
+            this->counters[k].backward_calls.fetch_add(1, std::memory_order_relaxed);
+            this->counters[k].backward_ns.fetch_add(ns, std::memory_order_relaxed);
+            if (input_grad)
+                this->counters[k].input_grad_calls.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        const HostRoofline& get_host() const { return this->host; }
+
+        // Counters of the trainable layers so far
+        std::vector<LayerProfile> snapshot() const;
+
+        void report(FILE* out=stdout) const;
+
+        // Returns -1 if path can't be written
+        int write_json(const std::string& path) const;
+        std::string to_json() const;
+};
+
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef __QUANTIZE_H__
+#define __QUANTIZE_H__
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "nn.hpp"
+
+
+// One dense layer in 8 bits.
+//
+// Weights are symmetric int8 with one scale per output (per channel): w[i][j] ~ w_scale[i] * qw[i][j].
+// The input is asymmetric 7-bit: x[j] ~ in_scale * (qx[j] - in_zero), qx in [0, 127].
+// So w•x + b = w_scale[i] * in_scale * (qw•qx - in_zero * sum(qw[i]) + b[i] / (w_scale[i] * in_scale)),
+// where everything in the brackets is an integer known up front except qw•qx: that goes into bias
+// and the layer is one int32 dot product per output plus a float epilogue (scale, activation,
+// requantize to the next layer's input).
+struct QuantizedLayer
+{
+    uint32_t n = 0;
+    uint32_t n_in = 0;
+    uint32_t n_in_pad = 0;          // rows padded with zero weights to a multiple of 32
+    Activation act = Activation::SIGMOID;
+
+    std::vector<int8_t> w;          // [n][n_in_pad]
+    std::vector<float> w_scale;     // per output
+    std::vector<int32_t> bias;      // the bias and the input zero point correction, in accumulator units
+    std::vector<float> acc_scale;   // w_scale[i] * in_scale: accumulator to float
+
+    float in_scale = 1.0f;
+    uint8_t in_zero = 0;
+};
+
+// Scratch of one quantized forward pass
+struct QuantWorkspace
+{
+    std::vector<std::vector<uint8_t>> a;    // quantized input of every layer, padded
+    std::vector<float> out;                 // float output of the last layer
+};
+
+struct QuantReport
+{
+    size_t samples = 0;
+    float float_accuracy = 0;
+    float int8_accuracy = 0;
+    float agreement = 0;            // fraction of samples where both predict the same class
+    float max_abs_diff = 0;         // largest difference of any output
+    float mean_abs_diff = 0;
+    double float_us = 0;            // mean time of one forward pass
+    double int8_us = 0;
+    size_t float_bytes = 0;         // weights and biases
+    size_t int8_bytes = 0;
+};
+
+
+// Post-training INT8 quantization of a trained network for CPU inference.
+//
+// calibrate runs the float network over sample inputs and records the range of every layer's input,
+// which gives the activation scales; weight scales come from the weights themselves. No retraining.
+// The quantized network is a separate, read only copy: 4x smaller weights, and the inner loop is
+// simd_dot_u8s8 (VNNI dpbusd or pmaddubsw), 32 multiply-adds per instruction on AVX2.
+class QuantizedNetwork
+{
+    private:
+        std::vector<QuantizedLayer> layers;     // the trainable layers, the input layer has no entry
+        uint32_t n_inputs = 0;
+        uint32_t n_outputs = 0;
+
+    public:
+        // Quantize nn with activation ranges taken from num_samples inputs at x (num_inputs floats each).
+        // Returns nullptr if nn has nothing to quantize or no samples are given.
+        static QuantizedNetwork* calibrate(FullyConnectedNetwork& nn, const float* x, size_t num_samples);
+
+        QuantWorkspace make_workspace() const;
+
+        // One sample: x holds num_inputs floats, y gets num_outputs floats. Returns 0 / -1.
+        int forward(const float* x, float* y, QuantWorkspace& ws) const;
+
+        uint32_t num_inputs() const { return this->n_inputs; }
+        uint32_t num_outputs() const { return this->n_outputs; }
+        const std::vector<QuantizedLayer>& get_layers() const { return this->layers; }
+
+        // Bytes of weights, biases and scales
+        size_t size_bytes() const;
+
+        // Run both networks over n labeled samples and compare predictions, outputs and speed
+        static QuantReport compare(FullyConnectedNetwork& nn, const QuantizedNetwork& q, const float* x,
+                                   const uint32_t* labels, size_t n);
+};
+
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __REDUCED_PRECISION_H__
+#define __REDUCED_PRECISION_H__
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "nn.hpp"
+
+
+enum class WeightFormat
+{
+    BF16,
+    FP16,
+};
+
+// One dense layer with 16-bit weights, biases stay float32
+struct HalfLayer
+{
+    uint32_t n = 0;
+    uint32_t n_in = 0;
+    uint32_t n_in_pad = 0;          // rows padded with zeros to a multiple of 16
+    Activation act = Activation::SIGMOID;
+    std::vector<uint16_t> w;        // [n][n_in_pad]
+    std::vector<float> b;
+};
+
+// Activations of a batch at every layer boundary, [rows][n_pad] each
+struct HalfWorkspace
+{
+    size_t max_rows = 0;
+    std::vector<std::vector<float>> a;
+};
+
+
+// Inference copy of a network with weights stored as bf16 or fp16.
+//
+// Large MLPs at inference are bound by the bandwidth of streaming the weights, so halving their size
+// roughly halves the time of a forward pass (and the model footprint). The kernels widen the weights
+// to float32 in registers (half.hpp) and accumulate in float32, activations stay float32.
+// forward runs the batch through each weight row up to 4 samples at a time, so every weight
+// fetched from memory is used for 4 multiply-adds.
+class ReducedPrecisionNetwork
+{
+    private:
+        WeightFormat format = WeightFormat::BF16;
+        std::vector<HalfLayer> layers;      // the trainable layers, the input layer has no entry
+        uint32_t n_inputs = 0;
+        uint32_t n_outputs = 0;
+
+    public:
+        // Convert the weights of nn, nn itself is left as it is
+        static ReducedPrecisionNetwork* convert(FullyConnectedNetwork& nn, WeightFormat format);
+
+        // Convert while loading a model file (model_io.hpp), the float32 weights are only read through
+        // the file mapping and never kept. Returns nullptr if the file can't be loaded.
+        static ReducedPrecisionNetwork* load(const std::string& path, WeightFormat format);
+
+        HalfWorkspace make_workspace(size_t max_rows=1) const;
+
+        // rows samples of num_inputs floats at x, rows x num_outputs floats out to y.
+        // Returns -1 if rows is more than the workspace was made for.
+        int forward(const float* x, size_t rows, float* y, HalfWorkspace& ws) const;
+
+        WeightFormat get_format() const { return this->format; }
+        uint32_t num_inputs() const { return this->n_inputs; }
+        uint32_t num_outputs() const { return this->n_outputs; }
+        const std::vector<HalfLayer>& get_layers() const { return this->layers; }
+
+        // Bytes of weights and biases
+        size_t size_bytes() const;
+};
+
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+#pragma once
+
+// A tiny vector type so kernels can be written once and compiled for the widest SIMD the target has:
+// Vec is AVX (8 lanes, FMA when available), SSE2 or AArch64 NEON (4 lanes), or plain float.
+// Scalar has the same interface with one lane, for loop tails.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+
+struct Scalar
+{
+    static constexpr size_t W = 1;
+    float v;
+
+    static Scalar load(const float* p) { return {*p}; }
+    static Scalar set1(float x) { return {x}; }
+    void store(float* p) const { *p = v; }
+};
+static inline Scalar operator+(Scalar a, Scalar b) { return {a.v + b.v}; }
+static inline Scalar operator-(Scalar a, Scalar b) { return {a.v - b.v}; }
+static inline Scalar operator*(Scalar a, Scalar b) { return {a.v * b.v}; }
+static inline Scalar operator/(Scalar a, Scalar b) { return {a.v / b.v}; }
+static inline Scalar vmin(Scalar a, Scalar b) { return {std::min(a.v, b.v)}; }
+static inline Scalar vmax(Scalar a, Scalar b) { return {std::max(a.v, b.v)}; }
+static inline Scalar vsqrt(Scalar a) { return {std::sqrt(a.v)}; }
+static inline Scalar vfma(Scalar a, Scalar b, Scalar c) { return {a.v * b.v + c.v}; }
+
+
+#if defined(__AVX__)
+struct Vec
+{
+    static constexpr size_t W = 8;
+    __m256 v;
+
+    static Vec load(const float* p) { return {_mm256_loadu_ps(p)}; }
+    static Vec set1(float x) { return {_mm256_set1_ps(x)}; }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+static inline Vec operator+(Vec a, Vec b) { return {_mm256_add_ps(a.v, b.v)}; }
+static inline Vec operator-(Vec a, Vec b) { return {_mm256_sub_ps(a.v, b.v)}; }
+static inline Vec operator*(Vec a, Vec b) { return {_mm256_mul_ps(a.v, b.v)}; }
+static inline Vec operator/(Vec a, Vec b) { return {_mm256_div_ps(a.v, b.v)}; }
+static inline Vec vmin(Vec a, Vec b) { return {_mm256_min_ps(a.v, b.v)}; }
+static inline Vec vmax(Vec a, Vec b) { return {_mm256_max_ps(a.v, b.v)}; }
+static inline Vec vsqrt(Vec a) { return {_mm256_sqrt_ps(a.v)}; }
+#if defined(__FMA__)
+static inline Vec vfma(Vec a, Vec b, Vec c) { return {_mm256_fmadd_ps(a.v, b.v, c.v)}; }
+#else
+static inline Vec vfma(Vec a, Vec b, Vec c) { return {_mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v)}; }
+#endif
+
+#elif defined(__SSE2__)
+struct Vec
+{
+    static constexpr size_t W = 4;
+    __m128 v;
+
+    static Vec load(const float* p) { return {_mm_loadu_ps(p)}; }
+    static Vec set1(float x) { return {_mm_set1_ps(x)}; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+static inline Vec operator+(Vec a, Vec b) { return {_mm_add_ps(a.v, b.v)}; }
+static inline Vec operator-(Vec a, Vec b) { return {_mm_sub_ps(a.v, b.v)}; }
+static inline Vec operator*(Vec a, Vec b) { return {_mm_mul_ps(a.v, b.v)}; }
+static inline Vec operator/(Vec a, Vec b) { return {_mm_div_ps(a.v, b.v)}; }
+static inline Vec vmin(Vec a, Vec b) { return {_mm_min_ps(a.v, b.v)}; }
+static inline Vec vmax(Vec a, Vec b) { return {_mm_max_ps(a.v, b.v)}; }
+static inline Vec vsqrt(Vec a) { return {_mm_sqrt_ps(a.v)}; }
+static inline Vec vfma(Vec a, Vec b, Vec c) { return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)}; }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+struct Vec
+{
+    static constexpr size_t W = 4;
+    float32x4_t v;
+
+    static Vec load(const float* p) { return {vld1q_f32(p)}; }
+    static Vec set1(float x) { return {vdupq_n_f32(x)}; }
+    void store(float* p) const { vst1q_f32(p, v); }
+};
+static inline Vec operator+(Vec a, Vec b) { return {vaddq_f32(a.v, b.v)}; }
+static inline Vec operator-(Vec a, Vec b) { return {vsubq_f32(a.v, b.v)}; }
+static inline Vec operator*(Vec a, Vec b) { return {vmulq_f32(a.v, b.v)}; }
+static inline Vec operator/(Vec a, Vec b) { return {vdivq_f32(a.v, b.v)}; }
+static inline Vec vmin(Vec a, Vec b) { return {vminq_f32(a.v, b.v)}; }
+static inline Vec vmax(Vec a, Vec b) { return {vmaxq_f32(a.v, b.v)}; }
+static inline Vec vsqrt(Vec a) { return {vsqrtq_f32(a.v)}; }
+static inline Vec vfma(Vec a, Vec b, Vec c) { return {vfmaq_f32(c.v, a.v, b.v)}; }
+
+#else
+typedef Scalar Vec;
+#endif
+
+static inline float hsum(Scalar a) { return a.v; }
+#if defined(__AVX__)
+static inline float hsum(Vec a)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#elif defined(__SSE2__)
+static inline float hsum(Vec a)
+{
+    __m128 s = _mm_add_ps(a.v, _mm_movehl_ps(a.v, a.v));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static inline float hsum(Vec a) { return vaddvq_f32(a.v); }
+#endif
+
+
+// sum of x[i] * y[i], two accumulators to hide the add latency
+static inline float simd_dot(const float* x, const float* y, size_t n)
+{
+    Vec acc0 = Vec::set1(0.0f), acc1 = Vec::set1(0.0f);
+    size_t i = 0;
+    for (; i + 2 * Vec::W <= n; i += 2 * Vec::W) {
+        acc0 = vfma(Vec::load(x + i), Vec::load(y + i), acc0);
+        acc1 = vfma(Vec::load(x + i + Vec::W), Vec::load(y + i + Vec::W), acc1);
+    }
+    for (; i + Vec::W <= n; i += Vec::W)
+        acc0 = vfma(Vec::load(x + i), Vec::load(y + i), acc0);
+    float sum = hsum(acc0 + acc1);
+    for (; i < n; i++)
+        sum += x[i] * y[i];
+    return sum;
+}
+
+// y[i] += a * x[i]
+static inline void simd_axpy(float a, const float* x, float* y, size_t n)
+{
+    Vec av = Vec::set1(a);
+    size_t i = 0;
+    for (; i + Vec::W <= n; i += Vec::W)
+        vfma(av, Vec::load(x + i), Vec::load(y + i)).store(y + i);
+    for (; i < n; i++)
+        y[i] += a * x[i];
+}
+
+
+// sum of x[i] * w[i] for unsigned x in [0, 127] and signed w, n a multiple of 32 (the quantized layers
+// pad their rows). x is kept to 7 bits so the pairwise 16-bit sums of pmaddubsw can't saturate
+// (2 * 127 * 127 < 32767); VNNI accumulates straight into 32 bits and gives the same result.
+static inline int32_t simd_dot_u8s8(const uint8_t* x, const int8_t* w, size_t n)
+{
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+#if !defined(__AVXVNNI__) && !(defined(__AVX512VNNI__) && defined(__AVX512VL__))
+    const __m256i ones = _mm256_set1_epi16(1);
+#endif
+    for (size_t i = 0; i < n; i += 32) {
+        __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+        __m256i wv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+        acc = _mm256_dpbusd_epi32(acc, xv, wv);
+#elif defined(__AVXVNNI__)
+        acc = _mm256_dpbusd_avx_epi32(acc, xv, wv);
+#else
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(xv, wv), ones));
+#endif
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+#elif defined(__SSSE3__)
+    __m128i acc = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    for (size_t i = 0; i < n; i += 16) {
+        __m128i xv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128i wv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_maddubs_epi16(xv, wv), ones));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#elif defined(__SSE2__)
+    // no pmaddubsw: widen both to 16 bits (w sign extended) and use pmaddwd
+    __m128i acc = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += 16) {
+        __m128i xv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128i wv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+        __m128i wlo = _mm_srai_epi16(_mm_unpacklo_epi8(wv, wv), 8);
+        __m128i whi = _mm_srai_epi16(_mm_unpackhi_epi8(wv, wv), 8);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(xv, zero), wlo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(xv, zero), whi));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#else
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += int32_t(x[i]) * int32_t(w[i]);
+    return sum;
+#endif
+}
+
+
+#endif
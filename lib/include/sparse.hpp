@@ -0,0 +1,90 @@
+#ifndef __SPARSE_H__
+#define __SPARSE_H__
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "nn.hpp"
+
+
+enum class PruneMode
+{
+    MAGNITUDE,      // the smallest weights of the layer, one by one
+    BLOCK_4x1,      // blocks of 4 consecutive outputs at one input, the ones with the smallest sum of |w|
+};
+
+// Zero the smallest weights of every trainable layer of nn, so that a fraction sparsity of each layer is 0.
+// The weights are written through mutable_weights (copied first if shared). Returns -1 if sparsity is not in [0, 1).
+int prune(FullyConnectedNetwork& nn, float sparsity, PruneMode mode=PruneMode::MAGNITUDE);
+
+
+enum class SparseFormat
+{
+    DENSE,
+    CSR,            // compressed sparse rows
+    BSR_4x1,        // CSR over 4-row block rows, every block is 4 outputs at one input
+};
+
+struct SparseLayer
+{
+    uint32_t n = 0;
+    uint32_t n_in = 0;
+    Activation act = Activation::SIGMOID;
+    SparseFormat format = SparseFormat::DENSE;
+    size_t nnz = 0;                     // nonzero weights
+
+    std::vector<float> dense;           // DENSE: [n][n_in]
+    std::vector<uint32_t> ptr;          // CSR: n + 1 row starts, BSR_4x1: (n + 3) / 4 + 1 block row starts
+    std::vector<uint32_t> col;          // input of every nonzero / block
+    std::vector<float> val;             // CSR: the nonzeros, BSR_4x1: 4 per block (rows 4r .. 4r+3)
+    std::vector<float> b;
+};
+
+struct SparseConfig
+{
+    float min_sparsity = 0.7f;          // layers with fewer zeros stay dense, sparse kernels don't pay below that
+    float min_block_fill = 0.75f;       // BSR_4x1 when at least this fraction of the stored block weights is nonzero
+};
+
+// Activations at every layer boundary. One sample: [n] per layer; a batch: [n][max_rows], feature major,
+// so every nonzero weight scales a contiguous run of the batch.
+struct SparseWorkspace
+{
+    size_t max_rows = 0;
+    std::vector<std::vector<float>> a;
+};
+
+
+// Inference copy of a (pruned) network with its weights in sparse formats.
+//
+// One sample is a SpMV per layer; a batch is a SpMM where the activations are kept transposed and each
+// stored weight does a vector axpy over the batch. 4x1 blocks load one input and update 4 outputs with
+// a single 4-wide multiply-add, and need a quarter of the column indices of CSR.
+// Each layer picks its own format: DENSE below min_sparsity, else BSR_4x1 if the zeros come in
+// blocks (structured pruning), else CSR.
+class SparseNetwork
+{
+    private:
+        std::vector<SparseLayer> layers;    // the trainable layers, the input layer has no entry
+        uint32_t n_inputs = 0;
+        uint32_t n_outputs = 0;
+
+    public:
+        static SparseNetwork* convert(FullyConnectedNetwork& nn, const SparseConfig& cfg=SparseConfig());
+
+        SparseWorkspace make_workspace(size_t max_rows=1) const;
+
+        // rows samples of num_inputs floats at x, rows x num_outputs floats out to y.
+        // Returns -1 if rows is more than the workspace was made for.
+        int forward(const float* x, size_t rows, float* y, SparseWorkspace& ws) const;
+
+        uint32_t num_inputs() const { return this->n_inputs; }
+        uint32_t num_outputs() const { return this->n_outputs; }
+        const std::vector<SparseLayer>& get_layers() const { return this->layers; }
+
+        // Bytes of weights, indices and biases
+        size_t size_bytes() const;
+};
+
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __TOPK_H__
+#define __TOPK_H__
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "matrix.hpp"
+
+using std::vector;
+
+
+// Top-k selection over every row of a (rows x cols) row-major score matrix.
+// idx and vals receive (rows x k) entries, each row ordered best first
+// (ties go to the lower index). Returns 0 on success, -1 on invalid arguments.
+int topk(const float* scores, uint32_t rows, uint32_t cols, uint32_t k, uint32_t* idx, float* vals);
+
+// Same for the output of a layer or network (one vector per row).
+int topk(const matrix_f32_t& scores, uint32_t k, vector<vector<uint32_t>>& idx, matrix_f32_t& vals);
+
+#endif
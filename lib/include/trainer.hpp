@@ -0,0 +1,102 @@
+#ifndef __TRAINER_H__
+#define __TRAINER_H__
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <random>
+#include <vector>
+#include "nn.hpp"
+#include "optimizer.hpp"
+#include "param_buffer.hpp"
+#include "../../utils/tpool.h"
+
+
+enum class TrainMode
+{
+    SYNC,       // one optimizer step per mini-batch, after all workers are done (default)
+    HOGWILD,    // workers update the shared weights on their own, without locks or barriers
+};
+
+// Measured over the last train_epoch call
+struct TrainStats
+{
+    double   seconds = 0;
+    size_t   samples = 0;
+    size_t   updates = 0;           // weight updates applied (optimizer steps in SYNC mode)
+    double   mean_staleness = 0;    // HOGWILD: updates other workers applied while one computed its gradient
+    uint64_t max_staleness = 0;
+
+    double samples_per_sec() const { return seconds > 0 ? samples / seconds : 0; }
+    double updates_per_sec() const { return seconds > 0 ? updates / seconds : 0; }
+};
+
+
+// Data-parallel training on one machine.
+//
+// Every mini-batch is split into one shard per worker. Each worker runs forward / backward
+// over its shard against the network's weights (shared, only read during the pass) with its own
+// workspace, and accumulates into its own private gradient buffer, so the workers never touch the
+// same cache line. The private buffers are then reduced into the network's flat gradient buffer
+// and a single optimizer step is taken.
+//
+// The reduction is the reduce-scatter half of a ring all-reduce: the gradient is cut into one
+// cache line aligned chunk per worker and worker k sums chunk k over all the buffers, writes the mean
+// to the network and clears the chunk in the private buffers for the next batch. Every byte is read
+// once, by one thread, in a streaming pattern. All the replicas share memory, so the
+// all-gather half is not needed, the result already sits in the one buffer the optimizer reads.
+//
+// In HOGWILD mode there is no reduction and no step barrier. Every worker walks its own part of the
+// epoch and after each mini-batch applies a plain SGD update straight to the shared weights with
+// relaxed atomic stores (plain stores on x86 and ARM). Workers read weights other workers are
+// halfway through updating and may overwrite each other's updates, that is the price paid for never
+// waiting; with sparse gradients (most zero, which the update skips) collisions are rare and SGD
+// converges anyway. Only the learning rate, schedule, weight decay and clip_value of the optimizer
+// config are used, there is no momentum or Adam state in this mode.
+class DataParallelTrainer
+{
+    private:
+        FullyConnectedNetwork& nn;
+        Optimizer& opt;
+        tpool_t* pool = nullptr;
+        size_t num_workers = 1;
+
+        std::vector<Workspace> ws;                          // per worker
+        std::vector<std::unique_ptr<ParamBuffer>> grads;    // per worker
+        std::vector<uint32_t> order;                        // sample order of the current epoch
+        std::mt19937 gen;
+        TrainMode mode = TrainMode::SYNC;
+        TrainStats stats;
+
+        void reduce_grads(float scale);
+        float hogwild_epoch(const float* x, const uint32_t* labels, size_t n, size_t batch_size);
+
+    public:
+        // Without a pool everything runs on the calling thread
+        DataParallelTrainer(FullyConnectedNetwork& nn, Optimizer& opt, tpool_t* pool=nullptr, size_t num_workers=1,
+                            uint32_t seed=0);
+
+        DataParallelTrainer(const DataParallelTrainer& other) = delete;
+        DataParallelTrainer& operator=(const DataParallelTrainer& other) = delete;
+
+        void set_mode(TrainMode mode) { this->mode = mode; }
+        TrainMode get_mode() const { return this->mode; }
+        const TrainStats& get_stats() const { return this->stats; }
+
+        // One optimizer step on a mini-batch (SYNC mode only). x holds the samples (num_inputs floats each) back to back,
+        // idx optionally picks which ones (batch entries), otherwise the first batch samples are used.
+        // Returns the mean loss of the batch or -1.
+        float train_batch(const float* x, const uint32_t* labels, size_t batch, const uint32_t* idx=nullptr);
+
+        // One pass over n samples in shuffled mini-batches, returns the mean loss.
+        // In HOGWILD mode the loss of every sample is taken against the weights of the moment.
+        float train_epoch(const float* x, const uint32_t* labels, size_t n, size_t batch_size);
+
+        // Fraction of the n samples whose highest output is their label
+        float accuracy(const float* x, const uint32_t* labels, size_t n);
+
+        size_t get_num_workers() const { return this->num_workers; }
+};
+
+
+#endif
@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/checkpoint.hpp"
+#include "../include/log.hpp"
+
+using namespace std;
+
+
+struct CheckpointFile
+{
+    uint64_t seq;
+    bool     delta;
+    string   path;
+};
+
+// Checkpoints of prefix in dir, oldest first
+static vector<CheckpointFile> checkpoint_scan(const string& dir, const string& prefix)
+{
+    vector<CheckpointFile> files;
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr)
+        return files;
+
+    string start = prefix + "-";
+    struct dirent* e;
+    while ((e = readdir(d)) != nullptr) {
+        string name = e->d_name;
+        if (name.compare(0, start.size(), start) != 0)
+            continue;
+
+        size_t dot = name.find('.', start.size());
+        if (dot == string::npos || dot == start.size())
+            continue;
+        string digits = name.substr(start.size(), dot - start.size());
+        string ext = name.substr(dot);
+        if (digits.find_first_not_of("0123456789") != string::npos || (ext != ".ckpt" && ext != ".delta"))
+            continue;
+
+        files.push_back(CheckpointFile{strtoull(digits.c_str(), nullptr, 10), ext == ".delta", dir + "/" + name});
+    }
+    closedir(d);
+
+    sort(files.begin(), files.end(), [](const CheckpointFile& a, const CheckpointFile& b) { return a.seq < b.seq; });
+    return files;
+}
+
+static string checkpoint_path(const CheckpointConfig& cfg, uint64_t seq, bool delta)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "-%010llu", (unsigned long long)seq);
+    return cfg.dir + "/" + cfg.prefix + name + (delta ? ".delta" : ".ckpt");
+}
+
+// the rename is only durable once the directory is synced too
+static void sync_dir(const string& dir)
+{
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static bool read_all(const string& path, vector<char>& out)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok) {
+        out.resize(st.st_size);
+        ok = pread(fd, out.data(), out.size(), 0) == ssize_t(out.size());
+    }
+    close(fd);
+    return ok;
+}
+
+
+CheckpointWriter::CheckpointWriter(const CheckpointConfig& cfg): cfg(cfg)
+{
+    if (this->cfg.keep == 0)
+        this->cfg.keep = 1;
+    if (this->cfg.full_every == 0)
+        this->cfg.full_every = 1;
+    if (this->cfg.block_floats == 0)
+        this->cfg.block_floats = 16384;
+
+    // carry on numbering after whatever is in dir already
+    vector<CheckpointFile> files = checkpoint_scan(this->cfg.dir, this->cfg.prefix);
+    if (!files.empty())
+        this->seq = files.back().seq + 1;
+
+    this->writer = thread(&CheckpointWriter::writer_loop, this);
+}
+
+
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->stop = true;
+    }
+    this->cond.notify_all();
+    // a queued checkpoint is still written out
+    this->writer.join();
+}
+
+
+int CheckpointWriter::save(FullyConnectedNetwork& nn, Optimizer* opt, uint64_t step)
+{
+    if (nn.num_params() == 0) {
+        LOG_ERROR("nothing to checkpoint, the network has no parameters");
+        return -1;
+    }
+
+    unique_lock<mutex> lk(this->lock);
+    if (this->pending) {
+        if (this->cfg.skip_if_busy) {
+            this->stats.skipped++;
+            return 1;
+        }
+        this->cond.wait(lk, [&] { return !this->pending; });
+    }
+
+    // the writer is idle, the staging buffer is ours until pending is set
+    auto start = chrono::steady_clock::now();
+    size_t state = opt != nullptr ? opt->state_size() : 0;
+    this->num_params = nn.num_params();
+    this->staging.resize(this->num_params + state);
+    memcpy(this->staging.data(), nn.param_data(), this->num_params * sizeof(float));
+    if (state > 0)
+        opt->export_state(this->staging.data() + this->num_params);
+    this->topology = model_topology(nn);
+    this->step = step;
+    this->opt_step = opt != nullptr ? opt->get_step() : 0;
+
+    this->pending = true;
+    this->stats.last_snapshot_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    lk.unlock();
+    this->cond.notify_all();
+
+    return 0;
+}
+
+
+int CheckpointWriter::wait()
+{
+    unique_lock<mutex> lk(this->lock);
+    this->cond.wait(lk, [&] { return !this->pending; });
+    return this->last_status;
+}
+
+
+CheckpointStats CheckpointWriter::get_stats()
+{
+    lock_guard<mutex> guard(this->lock);
+    return this->stats;
+}
+
+
+void CheckpointWriter::writer_loop()
+{
+    unique_lock<mutex> lk(this->lock);
+
+    while (true) {
+        this->cond.wait(lk, [&] { return this->pending || this->stop; });
+        if (!this->pending)
+            break;
+
+        lk.unlock();
+        auto start = chrono::steady_clock::now();
+        size_t bytes = 0;
+        int status = write_job(&bytes);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        lk.lock();
+
+        this->last_status = status;
+        this->stats.last_write_ms = ms;
+        if (status == 0) {
+            this->stats.last_bytes = bytes;
+            this->stats.written++;
+        } else {
+            this->stats.failed++;
+        }
+        this->pending = false;
+        this->cond.notify_all();
+    }
+}
+
+
+int CheckpointWriter::write_full(const string& path, size_t* bytes)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    size_t state = this->staging.size() - this->num_params;
+    const float* state_data = this->staging.data() + this->num_params;
+
+    CheckpointTrailer t;
+    memset(&t, 0, sizeof(t));
+    memcpy(t.magic, CHECKPOINT_MAGIC, sizeof(t.magic));
+    t.version = CHECKPOINT_VERSION;
+    t.seq = this->seq;
+    t.step = this->step;
+    t.opt_step = this->opt_step;
+    t.state_size = state;
+    t.checksum = model_checksum(state_data, state * sizeof(float));
+
+    int64_t model_bytes = model_write(fd, this->topology, this->staging.data(), this->num_params);
+    bool ok = model_bytes >= 0 &&
+              write_all(fd, &t, sizeof(t)) == 0 &&
+              write_all(fd, state_data, state * sizeof(float)) == 0 &&
+              fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    *bytes = ok ? model_bytes + sizeof(t) + state * sizeof(float) : 0;
+    return ok ? 0 : -1;
+}
+
+
+int CheckpointWriter::write_delta(const string& path, size_t* bytes)
+{
+    const size_t block = this->cfg.block_floats;
+    const size_t size = this->staging.size();
+    const size_t num_blocks = (size + block - 1) / block;
+    vector<uint64_t> changed;
+
+    for (size_t b = 0; b < num_blocks; b++) {
+        size_t off = b * block;
+        size_t len = min(block, size - off);
+        if (memcmp(this->staging.data() + off, this->reference.data() + off, len * sizeof(float)) != 0)
+            changed.push_back(b);
+    }
+
+    // indices and blocks gathered so they go out in one sequential write
+    size_t index_bytes = (changed.size() * sizeof(uint64_t) + 63) / 64 * 64;
+    vector<char> body(index_bytes, 0);
+    memcpy(body.data(), changed.data(), changed.size() * sizeof(uint64_t));
+    for (uint64_t b : changed) {
+        size_t off = b * block;
+        size_t len = min(block, size - off);
+        const char* src = reinterpret_cast<const char*>(this->staging.data() + off);
+        body.insert(body.end(), src, src + len * sizeof(float));
+    }
+
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CHECKPOINT_DELTA_MAGIC, sizeof(h.magic));
+    h.version = CHECKPOINT_VERSION;
+    h.block_floats = block;
+    h.seq = this->seq;
+    h.base_seq = this->seq - 1;
+    h.step = this->step;
+    h.opt_step = this->opt_step;
+    h.image_size = size;
+    h.num_blocks = changed.size();
+    h.checksum = model_checksum(body.data(), body.size());
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    bool ok = write_all(fd, &h, sizeof(h)) == 0 && write_all(fd, body.data(), body.size()) == 0 && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    *bytes = sizeof(h) + body.size();
+    return ok ? 0 : -1;
+}
+
+
+// Runs on the writer thread without the lock, the size written goes back through bytes
+int CheckpointWriter::write_job(size_t* bytes)
+{
+    bool delta = this->cfg.delta && this->have_reference && this->reference.size() == this->staging.size() &&
+                 this->since_full + 1 < this->cfg.full_every;
+    string path = checkpoint_path(this->cfg, this->seq, delta);
+    string tmp = path + ".tmp";
+
+    int status = delta ? write_delta(tmp, bytes) : write_full(tmp, bytes);
+    if (status == 0 && rename(tmp.c_str(), path.c_str()) != 0)
+        status = -1;
+    if (status != 0) {
+        LOG_ERROR("writing checkpoint %s failed: %s", path.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return -1;
+    }
+    sync_dir(this->cfg.dir);
+
+    // what was just written is the base of the next delta, the old reference becomes the next staging buffer
+    swap(this->staging, this->reference);
+    this->have_reference = true;
+    this->since_full = delta ? this->since_full + 1 : 0;
+    this->seq++;
+
+    rotate();
+    return 0;
+}
+
+
+// Keep the newest cfg.keep checkpoints, and the full one and deltas the oldest kept delta builds on
+void CheckpointWriter::rotate()
+{
+    vector<CheckpointFile> files = checkpoint_scan(this->cfg.dir, this->cfg.prefix);
+    if (files.size() <= this->cfg.keep)
+        return;
+
+    size_t first = files.size() - this->cfg.keep;
+    while (first > 0 && files[first].delta)
+        first--;
+
+    for (size_t i = 0; i < first; i++)
+        unlink(files[i].path.c_str());
+}
+
+
+// The trailer and optimizer state behind the model part of a full checkpoint.
+// Only the header, the trailer and the state are read, the parameters are left to FullyConnectedNetwork::load.
+// Sizes are checked against what is left of the file, so huge values can't wrap around.
+static bool checkpoint_read_trailer(const string& path, CheckpointTrailer& t, vector<float>& state)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    ModelHeader h;
+    bool ok = fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(h) && pread(fd, &h, sizeof(h), 0) == ssize_t(sizeof(h));
+    size_t size = ok ? st.st_size : 0;
+    ok = ok && h.params_offset <= size && h.params_size <= (size - h.params_offset) / sizeof(float);
+
+    size_t at = ok ? h.params_offset + h.params_size * sizeof(float) : 0;
+    ok = ok && size - at >= sizeof(t) && pread(fd, &t, sizeof(t), at) == ssize_t(sizeof(t));
+    at += sizeof(t);
+
+    ok = ok && memcmp(t.magic, CHECKPOINT_MAGIC, sizeof(t.magic)) == 0 && t.version <= CHECKPOINT_VERSION &&
+         t.state_size <= (size - at) / sizeof(float);
+    if (ok) {
+        state.resize(t.state_size);
+        size_t bytes = state.size() * sizeof(float);
+        ok = bytes == 0 || pread(fd, state.data(), bytes, at) == ssize_t(bytes);
+    }
+    close(fd);
+
+    return ok && model_checksum(state.data(), state.size() * sizeof(float)) == t.checksum;
+}
+
+// Apply one delta on top of params and state, which hold the image of checkpoint base_seq.
+// The whole delta is checked before anything is written, so a bad one leaves params and state as they were.
+static bool checkpoint_apply_delta(const string& path, uint64_t base_seq, float* params, size_t num_params,
+                                   vector<float>& state, uint64_t& step, uint64_t& opt_step)
+{
+    vector<char> data;
+    if (!read_all(path, data) || data.size() < sizeof(CheckpointHeader))
+        return false;
+
+    CheckpointHeader h;
+    memcpy(&h, data.data(), sizeof(h));
+    size_t body = data.size() - sizeof(h);
+    if (memcmp(h.magic, CHECKPOINT_DELTA_MAGIC, sizeof(h.magic)) != 0 || h.version > CHECKPOINT_VERSION ||
+        h.base_seq != base_seq || h.image_size != num_params + state.size() || h.block_floats == 0 ||
+        h.num_blocks > body / sizeof(uint64_t) || (h.num_blocks > 0 && h.image_size == 0) ||
+        model_checksum(data.data() + sizeof(h), body) != h.checksum)
+        return false;
+    size_t index_bytes = (h.num_blocks * sizeof(uint64_t) + 63) / 64 * 64;
+    if (index_bytes > body)
+        return false;
+
+    const uint64_t* idx = reinterpret_cast<const uint64_t*>(data.data() + sizeof(h));
+    size_t left = body - index_bytes;
+    for (uint64_t i = 0; i < h.num_blocks; i++) {
+        if (idx[i] > (h.image_size - 1) / h.block_floats)
+            return false;
+        size_t len = min<size_t>(h.block_floats, h.image_size - idx[i] * h.block_floats);
+        if (len > left / sizeof(float))
+            return false;
+        left -= len * sizeof(float);
+    }
+
+    const char* src = data.data() + sizeof(h) + index_bytes;
+    for (uint64_t i = 0; i < h.num_blocks; i++) {
+        size_t off = idx[i] * h.block_floats;
+        size_t len = min<size_t>(h.block_floats, h.image_size - off);
+
+        // a block may straddle the params / state boundary
+        for (size_t j = 0; j < len; j++) {
+            float v;
+            memcpy(&v, src + j * sizeof(float), sizeof(v));
+            if (off + j < num_params)
+                params[off + j] = v;
+            else
+                state[off + j - num_params] = v;
+        }
+        src += len * sizeof(float);
+    }
+
+    step = h.step;
+    opt_step = h.opt_step;
+    return true;
+}
+
+
+FullyConnectedNetwork* CheckpointWriter::restore(const string& dir, const string& prefix, Optimizer* opt, uint64_t* step)
+{
+    vector<CheckpointFile> files = checkpoint_scan(dir, prefix);
+
+    // newest full checkpoint that loads, then as many of the deltas after it as apply cleanly
+    for (size_t f = files.size(); f-- > 0; ) {
+        if (files[f].delta)
+            continue;
+
+        CheckpointTrailer t;
+        vector<float> state;
+        if (!checkpoint_read_trailer(files[f].path, t, state))
+            continue;
+        FullyConnectedNetwork* nn = FullyConnectedNetwork::load(files[f].path, true, true);
+        if (nn == nullptr)
+            continue;
+
+        // the deltas go into one staging image, copied into the network once at the end.
+        // A bad delta is rejected before it changes anything, so the image stays at the last good one.
+        uint64_t seq = t.seq, at_step = t.step, opt_step = t.opt_step;
+        vector<float> params;
+        for (size_t d = f + 1; d < files.size() && files[d].delta; d++) {
+            if (params.empty())
+                params.assign(nn->param_data(), nn->param_data() + nn->num_params());
+            if (!checkpoint_apply_delta(files[d].path, seq, params.data(), params.size(), state, at_step, opt_step)) {
+                LOG_WARN("checkpoint %s is damaged, restoring up to the one before", files[d].path.c_str());
+                break;
+            }
+            seq = files[d].seq;
+        }
+        if (!params.empty())
+            copy(params.begin(), params.end(), nn->mutable_param_data());
+
+        if (opt != nullptr && opt->import_state(state.data(), state.size(),
+                                                state.empty() ? 0 : nn->num_params(), opt_step) != 0) {
+            delete nn;
+            return nullptr;
+        }
+        if (step != nullptr)
+            *step = at_step;
+        return nn;
+    }
+
+    LOG_ERROR("no checkpoint of %s in %s to restore", prefix.c_str(), dir.c_str());
+    return nullptr;
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "../include/init.hpp"
+#include "../include/log.hpp"
+#include "../include/simd.hpp"
+
+using namespace std;
+
+
+// Modified Gram-Schmidt over the rows of m ([rows][cols], rows <= cols), two passes so the rows stay
+// orthogonal in float. Sequential, so the result is the same for any thread count.
+static void orthonormalize_rows(float* m, size_t rows, size_t cols)
+{
+    for (size_t i = 0; i < rows; i++) {
+        float* ri = m + i * cols;
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t k = 0; k < i; k++) {
+                const float* rk = m + k * cols;
+                float d = simd_dot(ri, rk, cols);
+                simd_axpy(-d, rk, ri, cols);
+            }
+        }
+        float norm = sqrt(simd_dot(ri, ri, cols));
+        // a zero row is as likely as drawing the same float twice in a row of a normal, keep it then
+        if (norm > 0.0f)
+            for (size_t j = 0; j < cols; j++)
+                ri[j] /= norm;
+    }
+}
+
+static void init_orthogonal(span<float> w, uint32_t n, uint32_t n_in, float gain, const PhiloxStream& s,
+                            const InitConfig& cfg)
+{
+    if (n <= n_in) {
+        philox_fill_normal(w.data(), w.size(), 0.0f, 1.0f, s, 0, cfg.pool, cfg.num_threads);
+        orthonormalize_rows(w.data(), n, n_in);
+    } else {
+        // more rows than inputs: orthonormal columns, done as the rows of the transpose
+        vector<float> t(w.size());
+        philox_fill_normal(t.data(), t.size(), 0.0f, 1.0f, s, 0, cfg.pool, cfg.num_threads);
+        orthonormalize_rows(t.data(), n_in, n);
+        for (uint32_t i = 0; i < n; i++)
+            for (uint32_t j = 0; j < n_in; j++)
+                w[size_t(i) * n_in + j] = t[size_t(j) * n + i];
+    }
+    if (gain != 1.0f)
+        for (auto &v : w)
+            v *= gain;
+}
+
+
+int init_weights(Layer& layer, uint32_t stream, const InitConfig& cfg)
+{
+    uint32_t n = layer.get_n(), n_in = layer.get_n_in();
+    if (n_in == 0) {
+        LOG_ERROR("layer %s has no weights to initialize", layer.get_name().c_str());
+        return -1;
+    }
+
+    InitScheme scheme = cfg.scheme;
+    if (scheme == InitScheme::AUTO)
+        scheme = layer.get_activation() == Activation::RELU ? InitScheme::HE_UNIFORM : InitScheme::XAVIER_UNIFORM;
+
+    span<float> w = layer.mutable_weights();
+    span<float> b = layer.mutable_biases();
+    PhiloxStream s{cfg.seed, stream};
+    float fan_avg = float(n_in + n), r;
+
+    switch (scheme) {
+    case InitScheme::XAVIER_UNIFORM:
+        r = cfg.gain * sqrt(6.0f / fan_avg);
+        philox_fill_uniform(w.data(), w.size(), -r, r, s, 0, cfg.pool, cfg.num_threads);
+        break;
+    case InitScheme::XAVIER_NORMAL:
+        philox_fill_normal(w.data(), w.size(), 0.0f, cfg.gain * sqrt(2.0f / fan_avg), s, 0, cfg.pool, cfg.num_threads);
+        break;
+    case InitScheme::HE_UNIFORM:
+        r = cfg.gain * sqrt(6.0f / float(n_in));
+        philox_fill_uniform(w.data(), w.size(), -r, r, s, 0, cfg.pool, cfg.num_threads);
+        break;
+    case InitScheme::HE_NORMAL:
+        philox_fill_normal(w.data(), w.size(), 0.0f, cfg.gain * sqrt(2.0f / float(n_in)), s, 0, cfg.pool, cfg.num_threads);
+        break;
+    case InitScheme::ORTHOGONAL:
+        init_orthogonal(w, n, n_in, cfg.gain, s, cfg);
+        break;
+    case InitScheme::AUTO:
+        break;
+    }
+
+    fill(b.begin(), b.end(), 0.0f);
+    return 0;
+}
+
+
+int init_weights(FullyConnectedNetwork& nn, const InitConfig& cfg)
+{
+    if (nn.get_depth() < 2) {
+        LOG_ERROR("nothing to initialize, the network has no trainable layers");
+        return -1;
+    }
+
+    for (uint32_t k = 1; k < nn.get_depth(); k++)
+        if (init_weights(*nn.get_layer(k), k, cfg) != 0)
+            return -1;
+    return 0;
+}
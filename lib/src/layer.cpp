@@ -1,4 +1,9 @@
+#include <utility>
 #include "../include/layer.hpp"
+#include "../include/log.hpp"
+#include "../include/nn.hpp"
+#include "../include/perceptron_store.hpp"
+#include "../include/simd.hpp"
 
 using namespace std;
 
@@ -26,23 +31,145 @@ string Layer::get_name(){ return this->name; }
 
 uint32_t Layer::get_n(){ return this->n; }
 
+uint32_t Layer::get_n_in(){ return this->n_in; }
+
 uint32_t Layer::get_num_edges(){ return this->edges; }
 
-// Copy constructor implementation
-Layer::Layer(const Layer& other)
+size_t Layer::num_params(){ return this->w.size() + this->b.size(); }
+
+// Point w, b, dw, db at this layer's part of params / grads.
+void Layer::set_views()
+{
+    if (this->n_in == 0) {
+        this->w = this->b = this->dw = this->db = std::span<float>();
+        return;
+    }
+
+    size_t w_len = size_t(this->n) * this->n_in;
+    size_t b_off = this->offset + ParamBuffer::aligned_size(w_len);
+
+    this->w = this->params->view(this->offset, w_len);
+    this->b = this->params->view(b_off, this->n);
+    this->dw = this->grads->view(this->offset, w_len);
+    this->db = this->grads->view(b_off, this->n);
+}
+
+void Layer::bind(shared_ptr<ParamBuffer> params, shared_ptr<ParamBuffer> grads, size_t offset, bool copy_values)
+{
+    std::span<float> old_w = this->w, old_b = this->b, old_dw = this->dw, old_db = this->db;
+    // keep the old storage alive until the values are copied over
+    shared_ptr<ParamBuffer> old_params = this->params, old_grads = this->grads;
+
+    this->params = params;
+    this->grads = grads;
+    this->offset = offset;
+    set_views();
+    if (!copy_values)
+        return;
+
+    std::copy(old_w.begin(), old_w.end(), this->w.begin());
+    std::copy(old_b.begin(), old_b.end(), this->b.begin());
+    std::copy(old_dw.begin(), old_dw.end(), this->dw.begin());
+    std::copy(old_db.begin(), old_db.end(), this->db.begin());
+}
+
+// Shares the parameters of other, the gradients are the given buffer (laid out like other's)
+Layer::Layer(const Layer& other, FullyConnectedNetwork* net, shared_ptr<ParamBuffer> grads): n(other.n),
+                                                                                           n_in(other.n_in),
+                                                                                           edges(other.edges),
+                                                                                           layer_n(other.layer_n),
+                                                                                           name(other.name),
+                                                                                           act(other.act),
+                                                                                           params(other.params),
+                                                                                           grads(grads),
+                                                                                           offset(other.offset),
+                                                                                           net(net),
+                                                                                           x(other.x),
+                                                                                           y(other.y)
 {
-    // Copy each member of other to this
-    this->n = other.n;
-    this->edges = other.edges;
+    set_views();
+}
+
+// The gradients are as large as other's so that other's offset holds for both buffers.
+// For a layer of a big network that is an untouched mapping (see ParamBuffer), it costs no memory.
+Layer::Layer(const Layer& other): Layer(other, nullptr,
+                                        make_shared<ParamBuffer>(other.grads ? other.grads->size() : 0))
+{
+}
+
+
+// The moved to layer is standalone: a network only knows the layers it created
+Layer::Layer(Layer&& other) noexcept: n(exchange(other.n, 0)),
+                                      n_in(exchange(other.n_in, 0)),
+                                      edges(exchange(other.edges, 0)),
+                                      layer_n(other.layer_n),
+                                      name(std::move(other.name)),
+                                      act(other.act),
+                                      params(std::move(other.params)),
+                                      grads(std::move(other.grads)),
+                                      offset(exchange(other.offset, 0)),
+                                      x(std::move(other.x)),
+                                      w(exchange(other.w, std::span<float>())),
+                                      b(exchange(other.b, std::span<float>())),
+                                      dw(exchange(other.dw, std::span<float>())),
+                                      db(exchange(other.db, std::span<float>())),
+                                      y(std::move(other.y))
+{
+    other.net = nullptr;
+}
+
+
+Layer& Layer::operator=(Layer&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    this->n = exchange(other.n, 0);
+    this->n_in = exchange(other.n_in, 0);
+    this->edges = exchange(other.edges, 0);
     this->layer_n = other.layer_n;
-    this->name = other.name;
+    this->name = std::move(other.name);
+    this->act = other.act;
+    this->params = std::move(other.params);
+    this->grads = std::move(other.grads);
+    this->offset = exchange(other.offset, 0);
+    this->net = nullptr;
+    other.net = nullptr;
+    this->x = std::move(other.x);
+    this->w = exchange(other.w, std::span<float>());
+    this->b = exchange(other.b, std::span<float>());
+    this->dw = exchange(other.dw, std::span<float>());
+    this->db = exchange(other.db, std::span<float>());
+    this->y = std::move(other.y);
+    return *this;
+}
 
-    // TODO: ensure this:
-    // that's actually a deep copy. New memory is allocated for dst vector
-    this->x = other.x;
-    this->w = other.w;
-    this->b = other.b;
-    this->y = other.y;
+
+// Make params safe to write: a layer of a network has the network copy its whole buffer,
+// a standalone layer copies just its own part.
+void Layer::own_params()
+{
+    if (this->net != nullptr) {
+        this->net->own_params();
+        return;
+    }
+    if (!this->params || (this->params.use_count() == 1 && this->params->is_writable()))
+        return;
+
+    size_t count = param_count(this->n, this->n_in);
+    bind(make_shared<ParamBuffer>(count), make_shared<ParamBuffer>(count), 0);
+}
+
+std::span<float> Layer::mutable_weights()
+{
+    own_params();
+    return this->w;
+}
+
+std::span<float> Layer::mutable_biases()
+{
+    own_params();
+    return this->b;
 }
 
 
@@ -59,12 +186,12 @@ int Layer::copy_vector(const vector<T>& src, vector<T>& dst)
 int Layer::copy_vector(const vector<float>& src, vector<mlp_t* >& dst)
 {
     if (dst.size() == 0 || src.size() == 0) {
-        printf("size of src or dst vector is 0\n");
+        LOG_ERROR("size of src or dst vector is 0");
         return -1;
     }
 
     if (dst.size() != src.size()) {
-        printf("sizes of vectors don't match\n");
+        LOG_ERROR("sizes of vectors don't match");
         return -1;
     }
 
@@ -75,13 +202,46 @@ int Layer::copy_vector(const vector<float>& src, vector<mlp_t* >& dst)
     return 0;
 }
 
+
+// Copy float src input to the inputs of the perceptrons of a store, starting at unit first
+int Layer::copy_vector(const vector<float>& src, PerceptronStore& dst, uint32_t first)
+{
+    if (src.size() == 0) {
+        LOG_ERROR("size of src vector is 0");
+        return -1;
+    }
+    return dst.set_inputs(first, src);
+}
+
+int Layer::set_input(const vector<float>& in)
+{
+    if (in.size() != this->x.size()) {
+        LOG_ERROR("input has %zu values, layer %s expects %zu", in.size(), this->name.c_str(), this->x.size());
+        return -1;
+    }
+    this->x = in;
+    return 0;
+}
+
 void Layer::print_layer(const string content)
 {
-    printf("\n%s: w•x+b = y \n\n", content.c_str());
-    printf("w      x      b      y\n");
-    printf("-------------------------\n");
-    for (auto i = 0; i < this->n; i++)
-        printf("%.2f • %.2f + %.2f = %.2f\n", this->w[i], this->x[i], this->b[i], this->y[i]);
+    if (this->n_in == 0) {
+        // input layer: nothing to train, y is just the input
+        printf("\n%s: y = x \n\n", content.c_str());
+        for (auto i = 0; i < this->n; i++)
+            printf("%.2f\n", this->y[i]);
+        printf("\n");
+        return;
+    }
+
+    printf("\n%s: w•x+b = y  (%u x %u)\n\n", content.c_str(), this->n, this->n_in);
+    printf("w                                b      y\n");
+    printf("------------------------------------------\n");
+    for (auto i = 0; i < this->n; i++) {
+        for (auto j = 0; j < this->n_in; j++)
+            printf("%.2f ", this->w[i * this->n_in + j]);
+        printf("| %.2f = %.2f\n", this->b[i], this->y[i]);
+    }
 
     printf("\n");
 }
@@ -108,17 +268,83 @@ void Layer::print_layer(const string content)
 // 
 float Layer::compute_layer()
 {
-    // vector<float> * x;
-
+    if (this->n_in == 0) {
+        // input layer: passes its input through
+        std::copy(this->x.begin(), this->x.begin() + this->n, this->y.begin());
+        return 0;
+    }
 
+    forward(this->x.data(), this->y.data());
+    return 0;
+}
 
 
+void Layer::forward(const float* x, float* y) const
+{
+    for (uint32_t i = 0; i < this->n; i++)
+        y[i] = simd_dot(this->w.data() + size_t(i) * this->n_in, x, this->n_in) + this->b[i];
 
-    return 0;
+    switch (this->act) {
+    case Activation::SIGMOID:
+        for (uint32_t i = 0; i < this->n; i++)
+            y[i] = sigmoid(y[i]);
+        break;
+    case Activation::RELU:
+        for (uint32_t i = 0; i < this->n; i++)
+            y[i] = relu(y[i]);
+        break;
+    case Activation::SOFTMAX: {
+        // shifted by the max so exp can't overflow
+        float mx = *max_element(y, y + this->n);
+        float sum = 0;
+        for (uint32_t i = 0; i < this->n; i++) {
+            y[i] = exp(y[i] - mx);
+            sum += y[i];
+        }
+        for (uint32_t i = 0; i < this->n; i++)
+            y[i] /= sum;
+        break;
+    }
+    case Activation::NONE:
+        break;
+    }
 }
 
 
-float Layer::grad_descent()
+void Layer::backward(const float* x, const float* y, float* delta, float* delta_in, float* grads) const
 {
-    return 0;
+    if (this->n_in == 0)
+        return;
+
+    // dL/dz = dL/dy * act'(z), written in terms of y
+    switch (this->act) {
+    case Activation::SIGMOID:
+        for (uint32_t i = 0; i < this->n; i++)
+            delta[i] *= y[i] * (1.0f - y[i]);
+        break;
+    case Activation::RELU:
+        for (uint32_t i = 0; i < this->n; i++)
+            delta[i] = y[i] > 0.0f ? delta[i] : 0.0f;
+        break;
+    case Activation::SOFTMAX:
+    case Activation::NONE:
+        break;
+    }
+
+    float* gw = grads + this->offset;
+    float* gb = grads + this->offset + ParamBuffer::aligned_size(size_t(this->n) * this->n_in);
+
+    // dL/dw[i][j] = dL/dz[i] * x[j], dL/db[i] = dL/dz[i]
+    for (uint32_t i = 0; i < this->n; i++) {
+        simd_axpy(delta[i], x, gw + size_t(i) * this->n_in, this->n_in);
+        gb[i] += delta[i];
+    }
+
+    // dL/dx[j] = sum over i of w[i][j] * dL/dz[i]
+    if (delta_in != nullptr) {
+        fill(delta_in, delta_in + this->n_in, 0.0f);
+        for (uint32_t i = 0; i < this->n; i++)
+            simd_axpy(delta[i], this->w.data() + size_t(i) * this->n_in, delta_in, this->n_in);
+    }
 }
+
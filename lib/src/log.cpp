@@ -0,0 +1,195 @@
+#include <cstdarg>
+#include <cstdlib>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "../include/log.hpp"
+
+using namespace std;
+
+
+std::atomic<int> log_level{int(LogLevel::INFO)};
+
+// Bounded queue after D. Vyukov: slot i is free for the producer of position p when seq == p, holds a
+// message for the consumer when seq == p + 1, and is handed back for position p + SLOTS after reading.
+struct alignas(64) LogSlot
+{
+    std::atomic<uint64_t> seq;
+    LogLevel level;
+    char msg[LOG_MSG_MAX];
+};
+
+struct Logger
+{
+    LogSlot ring[LOG_RING_SLOTS];
+    alignas(64) std::atomic<uint64_t> enqueue_pos{0};
+    alignas(64) uint64_t dequeue_pos = 0;            // under drain_lock
+    std::atomic<uint64_t> dropped{0};
+
+    std::mutex drain_lock;                          // one consumer at a time: the writer thread or log_flush
+    FILE* out = stdout;
+
+    std::mutex wake_lock;
+    std::condition_variable wake;
+    std::atomic<bool> stop{false};
+    std::thread writer;
+
+    Logger()
+    {
+        for (size_t i = 0; i < LOG_RING_SLOTS; i++)
+            this->ring[i].seq.store(i, std::memory_order_relaxed);
+    }
+};
+
+static Logger* logger = nullptr;
+static std::once_flag logger_once;
+static std::atomic<bool> logger_down{false};
+
+
+static const char* level_prefix(LogLevel level)
+{
+    switch (level) {
+    case LogLevel::WARN:
+        return "warning: ";
+    case LogLevel::ERROR:
+        return "error: ";
+    default:
+        return "";
+    }
+}
+
+// Write out the published messages in order, stops at a slot that is claimed but not written yet.
+// Called with drain_lock held.
+static size_t drain(Logger* lg)
+{
+    size_t n = 0;
+    for (;;) {
+        LogSlot& s = lg->ring[lg->dequeue_pos & (LOG_RING_SLOTS - 1)];
+        if (s.seq.load(std::memory_order_acquire) != lg->dequeue_pos + 1)
+            break;
+        fprintf(lg->out, "%s%s\n", level_prefix(s.level), s.msg);
+        s.seq.store(lg->dequeue_pos + LOG_RING_SLOTS, std::memory_order_release);
+        lg->dequeue_pos++;
+        n++;
+    }
+    if (n > 0)
+        fflush(lg->out);
+    return n;
+}
+
+static void writer_loop(Logger* lg)
+{
+    while (!lg->stop.load(std::memory_order_acquire)) {
+        size_t n;
+        {
+            lock_guard<mutex> g(lg->drain_lock);
+            n = drain(lg);
+        }
+        if (n == 0) {
+            unique_lock<mutex> g(lg->wake_lock);
+            lg->wake.wait_for(g, chrono::milliseconds(LOG_FLUSH_MS));
+        }
+    }
+}
+
+// At exit: stop the writer and write out the rest. Messages logged after this (destructors of
+// statics) are written directly.
+static void logger_shutdown()
+{
+    Logger* lg = logger;
+    lg->stop.store(true, std::memory_order_release);
+    lg->wake.notify_one();
+    lg->writer.join();
+    lock_guard<mutex> g(lg->drain_lock);
+    drain(lg);
+    logger_down.store(true, std::memory_order_release);
+}
+
+static Logger* get_logger()
+{
+    std::call_once(logger_once, [] {
+        // never freed, so it outlives every static that might log from its destructor
+        logger = new Logger();
+        logger->writer = std::thread(writer_loop, logger);
+        atexit(logger_shutdown);
+    });
+    return logger;
+}
+
+
+void log_set_level(LogLevel level)
+{
+    log_level.store(int(level), std::memory_order_relaxed);
+}
+
+LogLevel log_get_level()
+{
+    return LogLevel(log_level.load(std::memory_order_relaxed));
+}
+
+void log_set_output(FILE* out)
+{
+    Logger* lg = get_logger();
+    lock_guard<mutex> g(lg->drain_lock);
+    drain(lg);
+    lg->out = out;
+}
+
+
+void log_write(LogLevel level, const char* fmt, ...)
+{
+    Logger* lg = get_logger();
+    va_list args;
+    va_start(args, fmt);
+
+    if (logger_down.load(std::memory_order_acquire)) {
+        lock_guard<mutex> g(lg->drain_lock);
+        fputs(level_prefix(level), lg->out);
+        vfprintf(lg->out, fmt, args);
+        fputc('\n', lg->out);
+        va_end(args);
+        return;
+    }
+
+    uint64_t pos = lg->enqueue_pos.load(std::memory_order_relaxed);
+    LogSlot* s;
+    for (;;) {
+        s = &lg->ring[pos & (LOG_RING_SLOTS - 1)];
+        int64_t dif = int64_t(s->seq.load(std::memory_order_acquire)) - int64_t(pos);
+        if (dif == 0) {
+            if (lg->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            // the writer is a whole ring behind
+            lg->dropped.fetch_add(1, std::memory_order_relaxed);
+            va_end(args);
+            return;
+        } else {
+            pos = lg->enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    s->level = level;
+    vsnprintf(s->msg, LOG_MSG_MAX, fmt, args);
+    va_end(args);
+    s->seq.store(pos + 1, std::memory_order_release);
+
+    if (level >= LogLevel::WARN)
+        lg->wake.notify_one();
+}
+
+
+void log_flush()
+{
+    Logger* lg = get_logger();
+    lock_guard<mutex> g(lg->drain_lock);
+    drain(lg);
+    fflush(lg->out);
+}
+
+
+uint64_t log_dropped()
+{
+    return get_logger()->dropped.load(std::memory_order_relaxed);
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include "../include/matrix.hpp"
+#include "../include/log.hpp"
 
 using namespace std;
 
@@ -10,7 +11,7 @@ using namespace std;
 int matmul(const matrix_f32_t& A, const matrix_f32_t& B, matrix_f32_t& C)
 {
     if (A.empty() || B.empty() || C.empty()) {
-        cout << "Error: empty matrices given" << endl;
+        LOG_ERROR("empty matrices given");
         return -1;
     }
 
@@ -24,7 +25,7 @@ int matmul(const matrix_f32_t& A, const matrix_f32_t& B, matrix_f32_t& C)
     // Input matrices A,B should have correct dimensions.
     // Resulting matrix C should have dimensions rowsA x colsB
     if (colsA != rowsB || rowsC != rowsA || colsC != colsB) {
-        cout << "Invalid matrices dimensions for multiplication operation" << endl;
+        LOG_ERROR("Invalid matrices dimensions for multiplication operation");
         return -1;
     }
 
@@ -44,11 +45,11 @@ int matmul(const matrix_f32_t& A, const matrix_f32_t& B, matrix_f32_t& C)
 int transpose_mat(const matrix_f32_t &matrix, matrix_f32_t &out)
 {
     if (matrix.empty()) {
-        cout << "Error: empty input matrix" << endl;
+        LOG_ERROR("empty input matrix");
         return -1;
     }
     if (out.empty()) {
-        cout << "Error: empty output matrix" << endl;
+        LOG_ERROR("empty output matrix");
         return -1;
     }
 
@@ -57,7 +58,7 @@ int transpose_mat(const matrix_f32_t &matrix, matrix_f32_t &out)
 
     // Output matrix should have dimensions: (input cols) x (input rows)
     if (out[0].size() != rows || out.size() != cols) {
-        cout << "Invalid output matrix dimensions for transpose operation" << endl;
+        LOG_ERROR("Invalid output matrix dimensions for transpose operation");
         return -1;
     }
 
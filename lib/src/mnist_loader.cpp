@@ -1,4 +1,6 @@
 #include "../include/mnist_loader.hpp"
+#include "../include/log.hpp"
+#include "../../utils/trace.h"
 #include "opencv2/opencv.hpp"
 
 
@@ -35,7 +37,7 @@ void MNSITLoader::read_mnist_cv()
     if(magic != 2051){
         throw std::runtime_error("Incorrect image file magic: " + std::to_string(magic));
     } else {
-        cout << "Correct image magic: " << magic << endl;
+        LOG_INFO("Correct image magic: %u", magic);
     }
 
     this->labels_file.read(reinterpret_cast<char* >(&magic), 4);
@@ -43,7 +45,7 @@ void MNSITLoader::read_mnist_cv()
     if(magic != 2049){
         throw std::runtime_error("Incorrect label file magic: " + std::to_string(magic));
     } else {
-        cout << "Correct label magic: " << magic << endl;
+        LOG_INFO("Correct label magic: %u", magic);
     }
 
     this->images_file.read(reinterpret_cast<char* >(&num_items), 4);
@@ -53,14 +55,14 @@ void MNSITLoader::read_mnist_cv()
     if(num_items != num_labels){
         throw std::runtime_error("Number of images in images file should equal to number of labels in labels file");
     } else {
-        cout << "Number of images equals to number of labels: " << num_items << endl;
+        LOG_INFO("Number of images equals to number of labels: %u", num_items);
     }
 
     this->images_file.read(reinterpret_cast<char* >(&rows), 4);
     rows = swap_endian(rows);
     this->images_file.read(reinterpret_cast<char* >(&cols), 4);
     cols = swap_endian(cols);
-    cout << "Image rows:  "<< rows << ", cols: " << cols << endl;
+    LOG_INFO("Image rows:  %u, cols: %u", rows, cols);
     if (rows != cols) {
         throw std::runtime_error("Number of rows not equal to number of columns");
     }
@@ -76,7 +78,7 @@ void MNSITLoader::read_mnist_cv()
         this->labels_file.read(&label, 1);
 
         string sLabel = std::to_string(int(label));
-        cout << "lable is: " << sLabel << endl;
+        LOG_TRACE("lable is: %s", sLabel.c_str());
 
         // convert it to cv Mat, and show it
         cv::Mat image_tmp(rows, cols, CV_8UC1, pixels);
@@ -89,6 +91,54 @@ void MNSITLoader::read_mnist_cv()
     delete[] pixels;
 }
 
+uint32_t MNSITLoader::load(vector<float>& images, vector<uint32_t>& labels, uint32_t max_items)
+{
+    TRACE_SPAN("loader", "load");
+    uint32_t header[4];
+    uint32_t label_header[2];
+
+    this->images_file.seekg(0);
+    this->labels_file.seekg(0);
+    this->images_file.read(reinterpret_cast<char* >(header), sizeof(header));
+    this->labels_file.read(reinterpret_cast<char* >(label_header), sizeof(label_header));
+    for (auto &h : header)
+        h = swap_endian(h);
+    for (auto &h : label_header)
+        h = swap_endian(h);
+
+    if (header[0] != 2051)
+        throw std::runtime_error("Incorrect image file magic: " + std::to_string(header[0]));
+    if (label_header[0] != 2049)
+        throw std::runtime_error("Incorrect label file magic: " + std::to_string(label_header[0]));
+    if (header[1] != label_header[1])
+        throw std::runtime_error("Number of images in images file should equal to number of labels in labels file");
+    if (header[2] * header[3] != MNIST_IMAGE_SIZE)
+        throw std::runtime_error("Unexpected image size: " + std::to_string(header[2]) + "x" + std::to_string(header[3]));
+
+    uint32_t num_items = header[1];
+    if (max_items != 0 && max_items < num_items)
+        num_items = max_items;
+
+    // one read for all the pixels and one for all the labels
+    vector<uint8_t> pixels(size_t(num_items) * MNIST_IMAGE_SIZE);
+    vector<uint8_t> raw_labels(num_items);
+    {
+        TRACE_SPAN("loader", "read", "samples", num_items);
+        this->images_file.read(reinterpret_cast<char* >(pixels.data()), pixels.size());
+        this->labels_file.read(reinterpret_cast<char* >(raw_labels.data()), raw_labels.size());
+    }
+    if (!this->images_file || !this->labels_file)
+        throw std::runtime_error("MNIST files are shorter than their headers say");
+
+    TRACE_SPAN("loader", "convert", "samples", num_items);
+    images.resize(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++)
+        images[i] = pixels[i] / 255.0f;
+    labels.assign(raw_labels.begin(), raw_labels.end());
+
+    return num_items;
+}
+
 /**
  * Seek to and read the i'th image in the sequence of images within images file.
  * The 28x28 image will be read into the given ouptut pointer.
@@ -0,0 +1,256 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "../include/model_io.hpp"
+#include "../include/log.hpp"
+#include "../../utils/hash.h"
+
+using namespace std;
+
+
+static const uint64_t MODEL_CHECKSUM_SEED = 0x736e6e6d6f64656cULL;
+
+
+uint64_t model_checksum(const void* data, size_t len)
+{
+    return hash_bytes(data, len, MODEL_CHECKSUM_SEED);
+}
+
+
+int write_all(int fd, const void* data, size_t len)
+{
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += w;
+        len -= w;
+    }
+    return 0;
+}
+
+
+vector<LayerRecord> model_topology(FullyConnectedNetwork& nn)
+{
+    vector<LayerRecord> layers(nn.get_depth());
+
+    for (uint32_t k = 0; k < nn.get_depth(); k++) {
+        Layer* l = nn.get_layer(k);
+        LayerRecord& rec = layers[k];
+        memset(&rec, 0, sizeof(rec));
+        rec.n = l->get_n();
+        rec.n_in = l->get_n_in();
+        rec.layer_n = k;
+        rec.activation = static_cast<uint32_t>(l->get_activation());
+        rec.offset = l->get_offset();
+        rec.count = Layer::param_count(rec.n, rec.n_in);
+        strncpy(rec.name, l->get_name().c_str(), MODEL_NAME_LEN - 1);
+    }
+
+    return layers;
+}
+
+
+int64_t model_write(int fd, FullyConnectedNetwork& nn, const float* params)
+{
+    return model_write(fd, model_topology(nn), params, nn.num_params());
+}
+
+
+int64_t model_write(int fd, vector<LayerRecord> layers, const float* params, size_t num_params)
+{
+    if (layers.empty() || params == nullptr) {
+        LOG_ERROR("nothing to write, the network is empty");
+        return -1;
+    }
+
+    // header and records go out in one piece
+    vector<char> meta(sizeof(ModelHeader) + layers.size() * sizeof(LayerRecord), 0);
+    ModelHeader* h = reinterpret_cast<ModelHeader*>(meta.data());
+    LayerRecord* rec = reinterpret_cast<LayerRecord*>(meta.data() + sizeof(ModelHeader));
+
+    memcpy(h->magic, MODEL_MAGIC, sizeof(h->magic));
+    h->version = MODEL_VERSION;
+    h->byte_order = MODEL_BYTE_ORDER;
+    h->header_size = sizeof(ModelHeader);
+    h->record_size = sizeof(LayerRecord);
+    h->num_layers = layers.size();
+    h->params_offset = ParamBuffer::aligned_size(meta.size() / sizeof(float)) * sizeof(float);
+    h->params_size = num_params;
+
+    for (size_t k = 0; k < layers.size(); k++) {
+        rec[k] = layers[k];
+        rec[k].checksum = model_checksum(params + rec[k].offset, rec[k].count * sizeof(float));
+    }
+    h->meta_checksum = model_checksum(meta.data(), meta.size());
+
+    meta.resize(h->params_offset, 0);
+    if (write_all(fd, meta.data(), meta.size()) != 0 ||
+        write_all(fd, params, h->params_size * sizeof(float)) != 0) {
+        LOG_ERROR("writing model failed: %s", strerror(errno));
+        return -1;
+    }
+
+    return int64_t(meta.size() + h->params_size * sizeof(float));
+}
+
+
+int FullyConnectedNetwork::save(const string& path)
+{
+    if (this->depth == 0) {
+        LOG_ERROR("nothing to save, the network is empty");
+        return -1;
+    }
+
+    // written next to the target and renamed over it, so a reader never sees half a model
+    string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("cannot create %s: %s", tmp.c_str(), strerror(errno));
+        return -1;
+    }
+
+    bool ok = model_write(fd, *this, this->params->data()) >= 0 && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("saving %s failed: %s", path.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// Everything but the blob checksums, which only verify reads
+static bool model_check_meta(const char* base, size_t size)
+{
+    if (size < sizeof(ModelHeader)) {
+        LOG_ERROR("model file too small");
+        return false;
+    }
+
+    ModelHeader h;
+    memcpy(&h, base, sizeof(h));
+    if (memcmp(h.magic, MODEL_MAGIC, sizeof(h.magic)) != 0) {
+        LOG_ERROR("not a model file");
+        return false;
+    }
+    if (h.version > MODEL_VERSION || h.byte_order != MODEL_BYTE_ORDER) {
+        LOG_ERROR("model file version %u / byte order %x is not supported", h.version, h.byte_order);
+        return false;
+    }
+    if (h.header_size != sizeof(ModelHeader) || h.record_size != sizeof(LayerRecord) || h.num_layers == 0) {
+        LOG_ERROR("model file has an unexpected layout");
+        return false;
+    }
+
+    // subtracted from size rather than added up, so huge values can't wrap around and pass
+    size_t meta_size = sizeof(ModelHeader) + size_t(h.num_layers) * sizeof(LayerRecord);
+    if (meta_size > size || h.params_offset < meta_size || h.params_offset % ParamBuffer::ALIGN != 0 ||
+        h.params_offset > size || h.params_size > (size - h.params_offset) / sizeof(float)) {
+        LOG_ERROR("model file is truncated or its offsets are wrong");
+        return false;
+    }
+
+    vector<char> meta(base, base + meta_size);
+    reinterpret_cast<ModelHeader*>(meta.data())->meta_checksum = 0;
+    if (model_checksum(meta.data(), meta.size()) != h.meta_checksum) {
+        LOG_ERROR("model file header checksum mismatch");
+        return false;
+    }
+
+    // the topology must be a chain and the blob laid out the way the network packs it.
+    // Every layer has to fit in what is left of params_size, so neither param_count nor offset can overflow.
+    const LayerRecord* rec = reinterpret_cast<const LayerRecord*>(base + sizeof(ModelHeader));
+    uint64_t offset = 0;
+    for (uint32_t k = 0; k < h.num_layers; k++) {
+        uint32_t expected_in = k == 0 ? 0 : rec[k - 1].n;
+        if (rec[k].n == 0 || rec[k].n_in != expected_in || rec[k].offset != offset ||
+            uint64_t(rec[k].n) * rec[k].n_in > h.params_size || rec[k].count > h.params_size - offset ||
+            rec[k].count != Layer::param_count(rec[k].n, rec[k].n_in) ||
+            rec[k].activation > static_cast<uint32_t>(Activation::SOFTMAX)) {
+            LOG_ERROR("model file layer %u is inconsistent", k);
+            return false;
+        }
+        offset += rec[k].count;
+    }
+    if (offset != h.params_size) {
+        LOG_ERROR("model file parameter count mismatch");
+        return false;
+    }
+
+    return true;
+}
+
+
+FullyConnectedNetwork* FullyConnectedNetwork::load(const string& path, bool writable, bool verify)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("cannot open %s: %s", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        LOG_ERROR("cannot stat %s or it is empty", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+
+    // MAP_PRIVATE: with writable, written pages are copied for this process only
+    size_t size = st.st_size;
+    int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+    void* base = mmap(nullptr, size, prot, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        LOG_ERROR("cannot map %s: %s", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    shared_ptr<void> mapping(base, [size](void* p) { munmap(p, size); });
+
+    const char* bytes = static_cast<const char*>(base);
+    if (!model_check_meta(bytes, size))
+        return nullptr;
+
+    const ModelHeader* h = reinterpret_cast<const ModelHeader*>(bytes);
+    const LayerRecord* rec = reinterpret_cast<const LayerRecord*>(bytes + sizeof(ModelHeader));
+    float* blob = reinterpret_cast<float*>(static_cast<char*>(base) + h->params_offset);
+
+    if (verify) {
+        madvise(base, size, MADV_SEQUENTIAL);
+        for (uint32_t k = 0; k < h->num_layers; k++) {
+            if (model_checksum(blob + rec[k].offset, rec[k].count * sizeof(float)) != rec[k].checksum) {
+                LOG_ERROR("model file checksum mismatch in layer %u", k);
+                return nullptr;
+            }
+        }
+    }
+
+    FullyConnectedNetwork* nn = new FullyConnectedNetwork();
+    for (uint32_t k = 0; k < h->num_layers; k++) {
+        string name(rec[k].name, strnlen(rec[k].name, MODEL_NAME_LEN));
+        nn->layers.push_back(new Layer(rec[k].n, false, rec[k].layer_n, name, rec[k].n_in,
+                                       static_cast<Activation>(rec[k].activation)));
+        nn->layers.back()->net = nn;
+        nn->depth++;
+    }
+
+    // no copy: the layers view the mapping directly, the gradients are only paged in if used
+    nn->params = make_shared<ParamBuffer>(blob, h->params_size, mapping, writable);
+    nn->grads = make_shared<ParamBuffer>(h->params_size);
+    for (uint32_t k = 0; k < h->num_layers; k++)
+        nn->layers[k]->bind(nn->params, nn->grads, rec[k].offset, false);
+
+    return nn;
+}
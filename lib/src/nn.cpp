@@ -1,9 +1,23 @@
+#include <cstdio>
+#include <utility>
 #include "../include/nn.hpp"
+#include "../include/log.hpp"
+#include "../include/profiler.hpp"
+#include "../../utils/trace.h"
 
 
 using namespace std;
 
 
+// One layer's kernel as a span named like "hidden-2 fwd"
+static void trace_layer(Layer* layer, uint32_t k, const char* pass, uint64_t begin)
+{
+    char name[TRACE_NAME_MAX + 1];
+    snprintf(name, sizeof(name), "%s %s", layer->get_name().c_str(), pass);
+    trace_complete("layer", name, begin, trace_now(), "layer", k);
+}
+
+
 vector<float> FullyConnectedNetwork::softmax(const vector<float>& input) {
     float sum = 0.0;
     vector<float> output(input.size());
@@ -30,27 +44,77 @@ FullyConnectedNetwork::FullyConnectedNetwork()
 
 
 // Copy constructor
-FullyConnectedNetwork::FullyConnectedNetwork(const FullyConnectedNetwork& other)
+FullyConnectedNetwork::FullyConnectedNetwork(const FullyConnectedNetwork& other): depth(other.depth),
+                                                                                params(other.params)
+{
+    // zero pages until the copy is trained
+    if (other.grads)
+        this->grads = make_shared<ParamBuffer>(other.grads->size());
+
+    for (auto &layer : other.layers)
+        this->layers.push_back(new Layer(*layer, this, this->grads));
+}
+
+
+FullyConnectedNetwork::FullyConnectedNetwork(FullyConnectedNetwork&& other) noexcept: depth(exchange(other.depth, 0)),
+                                                                                    layers(std::move(other.layers)),
+                                                                                    params(std::move(other.params)),
+                                                                                    grads(std::move(other.grads))
+{
+    other.layers.clear();
+    for (auto &layer : this->layers)
+        layer->net = this;
+    // the profile is of the other network's layers
+    if (other.profiler != nullptr)
+        other.profiler->detach();
+}
+
+
+FullyConnectedNetwork& FullyConnectedNetwork::operator=(FullyConnectedNetwork&& other) noexcept
 {
-    // Copy layers (deep copy)
+    if (this == &other)
+        return *this;
+
+    if (this->profiler != nullptr)
+        this->profiler->detach();
+    if (other.profiler != nullptr)
+        other.profiler->detach();
+    release_layers();
+    this->depth = exchange(other.depth, 0);
+    this->layers = std::move(other.layers);
+    other.layers.clear();
+    this->params = std::move(other.params);
+    this->grads = std::move(other.grads);
+    for (auto &layer : this->layers)
+        layer->net = this;
+
+    return *this;
 }
 
 
 FullyConnectedNetwork::~FullyConnectedNetwork()
 {
-    printf("~FullyConnectedNetwork\n");
-    for (auto i = depth - 1; i >= 0; i--)
+    if (this->profiler != nullptr)
+        this->profiler->detach();
+    release_layers();
+}
+
+
+void FullyConnectedNetwork::release_layers()
+{
+    for (auto i = this->layers.size(); i-- > 0; )
     {
         // delete each layer beginning from the output (last layer)
         try {
             delete layers[i];
         }
         catch(const exception& e) {
-            cerr << e.what() << '\n';
+            LOG_ERROR("%s", e.what());
         }
                 
     }
-            
+    this->layers.clear();
+    this->depth = 0;
 }
 
 // Calculate the loss function over all the outputs from a single training epoch run.
@@ -90,36 +154,189 @@ float FullyConnectedNetwork::loss()
 int FullyConnectedNetwork::forward_propagation(vector<float>& x, vector<float>& y)
 {
     if (this->layers.size() == 0) {
-        printf("Network depth is 0\n");
+        LOG_ERROR("Network depth is 0");
+        return -1;
+    }
+    if (x.size() != num_inputs()) {
+        LOG_ERROR("input has %zu values, the network expects %u", x.size(), num_inputs());
+        return -1;
+    }
+
+    Workspace ws = make_workspace();
+    forward(x.data(), ws);
+
+    y = ws.a.back();
+    return 0;
+}
+
+
+Workspace FullyConnectedNetwork::make_workspace()
+{
+    Workspace ws;
+    for (auto &layer : this->layers) {
+        ws.a.emplace_back(layer->get_n());
+        ws.delta.emplace_back(layer->get_n());
+    }
+    return ws;
+}
+
+
+int FullyConnectedNetwork::forward(const float* x, Workspace& ws)
+{
+    if (this->layers.size() == 0) {
+        LOG_ERROR("Network depth is 0");
         return -1;
     }
 
     // assign input x into first layer
-    
-    
+    copy(x, x + num_inputs(), ws.a[0].begin());
+
+    bool tracing = trace_enabled();
+    if (this->profiler == nullptr && !tracing) {
+        for (uint32_t k = 1; k < this->depth; k++)
+            this->layers[k]->forward(ws.a[k - 1].data(), ws.a[k].data());
+        return 0;
+    }
+
+    for (uint32_t k = 1; k < this->depth; k++) {
+        uint64_t start = this->profiler ? Profiler::now_ns() : 0;
+        uint64_t begin = tracing ? trace_now() : 0;
+        this->layers[k]->forward(ws.a[k - 1].data(), ws.a[k].data());
+        if (tracing)
+            trace_layer(this->layers[k], k, "fwd", begin);
+        if (this->profiler)
+            this->profiler->add_forward(k, Profiler::now_ns() - start);
+    }
+    return 0;
+}
+
+
+// For the output layer the two losses give the same simple dL/dz:
+// softmax + cross entropy: dL/dz = p - onehot(label) (the softmax jacobian cancels out)
+// squared error:           dL/dy = y - onehot(label), times act'(z) inside Layer::backward
+float FullyConnectedNetwork::backprop(const float* x, uint32_t label, Workspace& ws, float* grads)
+{
+    if (this->depth < 2 || label >= num_outputs() || grads == nullptr) {
+        LOG_ERROR("backprop needs at least 2 layers, a label below %u and a gradient buffer", num_outputs());
+        return -1;
+    }
+
+    forward(x, ws);
+
+    const vector<float>& out = ws.a.back();
+    vector<float>& d = ws.delta.back();
+    float loss = 0;
+
+    if (this->layers.back()->get_activation() == Activation::SOFTMAX) {
+        loss = -log(max(out[label], 1e-30f));
+        for (uint32_t i = 0; i < out.size(); i++)
+            d[i] = out[i] - (i == label ? 1.0f : 0.0f);
+    } else {
+        for (uint32_t i = 0; i < out.size(); i++) {
+            d[i] = out[i] - (i == label ? 1.0f : 0.0f);
+            loss += 0.5f * d[i] * d[i];
+        }
+    }
+
+    // the input layer (k = 0) has nothing to train and nothing to propagate to
+    bool tracing = trace_enabled();
+    if (this->profiler == nullptr && !tracing) {
+        for (uint32_t k = this->depth - 1; k >= 1; k--) {
+            float* delta_in = k > 1 ? ws.delta[k - 1].data() : nullptr;
+            this->layers[k]->backward(ws.a[k - 1].data(), ws.a[k].data(), ws.delta[k].data(), delta_in, grads);
+        }
+        return loss;
+    }
 
+    for (uint32_t k = this->depth - 1; k >= 1; k--) {
+        float* delta_in = k > 1 ? ws.delta[k - 1].data() : nullptr;
+        uint64_t start = this->profiler ? Profiler::now_ns() : 0;
+        uint64_t begin = tracing ? trace_now() : 0;
+        this->layers[k]->backward(ws.a[k - 1].data(), ws.a[k].data(), ws.delta[k].data(), delta_in, grads);
+        if (tracing)
+            trace_layer(this->layers[k], k, "bwd", begin);
+        if (this->profiler)
+            this->profiler->add_backward(k, Profiler::now_ns() - start, delta_in != nullptr);
+    }
 
+    return loss;
+}
+
+
+// Lay the parameters of all layers out back to back in a new pair of flat buffers
+// and point the layers at them. Values are carried over.
+void FullyConnectedNetwork::pack_params()
+{
+    size_t total = 0;
     for (auto &layer : this->layers)
-    {
-        layer->compute_layer();
+        total += Layer::param_count(layer->get_n(), layer->get_n_in());
+
+    auto new_params = make_shared<ParamBuffer>(total);
+    auto new_grads = make_shared<ParamBuffer>(total);
+
+    size_t offset = 0;
+    for (auto &layer : this->layers) {
+        layer->bind(new_params, new_grads, offset);
+        offset += Layer::param_count(layer->get_n(), layer->get_n_in());
     }
 
-    // Layer * y_result = out;
-    return 0;
+    this->params = new_params;
+    this->grads = new_grads;
 }
 
 
-int FullyConnectedNetwork::backprop()
+// Besides this network each of its layers holds a reference to params, any more are copies
+// of the network (or of its layers) reading the same buffer.
+bool FullyConnectedNetwork::shares_params() const
 {
-    return 0;
+    return this->params && this->params.use_count() > long(1 + this->layers.size());
+}
+
+
+void FullyConnectedNetwork::own_params()
+{
+    if (!this->params || (!shares_params() && this->params->is_writable()))
+        return;
+
+    auto own = make_shared<ParamBuffer>(this->params->size());
+    copy(this->params->data(), this->params->data() + this->params->size(), own->data());
+    for (auto &layer : this->layers)
+        layer->bind(own, this->grads, layer->get_offset(), false);
+    this->params = own;
 }
 
 
-Layer* FullyConnectedNetwork::add_layer(uint32_t n, bool init_random, uint32_t layer_num,  string layer_name)
+float* FullyConnectedNetwork::mutable_param_data()
+{
+    own_params();
+    return this->params ? this->params->data() : nullptr;
+}
+
+
+void FullyConnectedNetwork::zero_grads()
+{
+    if (this->grads)
+        fill(this->grads->data(), this->grads->data() + this->grads->size(), 0.0f);
+}
+
+
+// The new layer is fully connected to the current last layer (the first one added is the input layer)
+// and the flat parameter buffers are repacked to make room for its weights.
+Layer* FullyConnectedNetwork::add_layer(uint32_t n, bool init_random, uint32_t layer_num,  string layer_name,
+                                        Activation act)
 {
     if (n == 0) {
-        printf("cannot add new layer with 0 perceptrons\n");
+        LOG_ERROR("cannot add new layer with 0 perceptrons");
         return nullptr;
     }
-    return new Layer(n, init_random, layer_num, layer_name);
+
+    uint32_t n_in = this->layers.empty() ? 0 : this->layers.back()->get_n();
+    Layer* layer = new Layer(n, init_random, layer_num, layer_name, n_in, act);
+    layer->net = this;
+
+    this->layers.push_back(layer);
+    this->depth++;
+    pack_params();
+
+    return layer;
 }
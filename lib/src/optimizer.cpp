@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include "../include/optimizer.hpp"
+#include "../include/log.hpp"
+#include "../include/parallel.hpp"
+#include "../include/simd.hpp"
+
+
+using namespace std;
+
+
+// An optimizer step is pure streaming: a handful of flops per element against 12 to 20 bytes
+// of loads and stores. It is bound by memory bandwidth, so the only things that matter are
+// touching every byte exactly once (one fused pass, no temporaries, no separate passes for
+// clipping / decay / zeroing) and keeping enough loads in flight (SIMD and all the cores).
+//
+// The kernels are written once against Vec (simd.hpp), the widest SIMD the target has,
+// plus the one lane Scalar for the tail of each chunk.
+
+// Chunks given to one thread: big enough to amortize the pool, aligned to whole cache lines
+static const size_t OPT_MIN_CHUNK = 1 << 15;
+
+
+// Everything a kernel needs besides the arrays, computed once per step
+struct StepScalars
+{
+    float lr;
+    float mu;           // momentum
+    float b1, b2;
+    float step_size;    // Adam: lr with both bias corrections folded in
+    float eps_hat;      // Adam: eps scaled to match
+    float wd;           // L2 coefficient added to the gradient
+    float decay;        // AdamW: weights are multiplied by this
+    float gscale;       // global norm clipping factor (1 when off)
+    float clip;         // element clipping bound (inf when off)
+    bool  zero_grads;
+};
+
+enum class Kernel { SGD, MOMENTUM, NESTEROV, ADAM, ADAMW };
+
+
+// The gradient as the update sees it: rescaled, clamped and with the L2 term added
+template <class V>
+static inline V effective_grad(V g, V p, const StepScalars& s)
+{
+    V c = V::set1(s.clip);
+    g = vmax(vmin(g * V::set1(s.gscale), c), V::set1(-s.clip));
+    return vfma(V::set1(s.wd), p, g);
+}
+
+// Update elements [i, i + V::W)
+template <Kernel K, class V>
+static inline void update(float* __restrict p, float* __restrict g, float* __restrict m, float* __restrict v,
+                          size_t i, const StepScalars& s)
+{
+    V pv = V::load(p + i);
+    V gv = effective_grad(V::load(g + i), pv, s);
+
+    if constexpr (K == Kernel::SGD) {
+        pv = pv - V::set1(s.lr) * gv;
+    } else if constexpr (K == Kernel::MOMENTUM || K == Kernel::NESTEROV) {
+        V mv = vfma(V::set1(s.mu), V::load(m + i), gv);
+        if constexpr (K == Kernel::NESTEROV)
+            gv = vfma(V::set1(s.mu), mv, gv);
+        else
+            gv = mv;
+        pv = pv - V::set1(s.lr) * gv;
+        mv.store(m + i);
+    } else {
+        if constexpr (K == Kernel::ADAMW)
+            pv = pv * V::set1(s.decay);
+        V mv = vfma(V::set1(s.b1), V::load(m + i), V::set1(1.0f - s.b1) * gv);
+        V vv = vfma(V::set1(s.b2), V::load(v + i), V::set1(1.0f - s.b2) * gv * gv);
+        pv = pv - V::set1(s.step_size) * mv / (vsqrt(vv) + V::set1(s.eps_hat));
+        mv.store(m + i);
+        vv.store(v + i);
+    }
+
+    pv.store(p + i);
+    if (s.zero_grads)
+        V::set1(0.0f).store(g + i);
+}
+
+template <Kernel K>
+static void update_range(float* __restrict p, float* __restrict g, float* __restrict m, float* __restrict v,
+                         size_t begin, size_t end, const StepScalars& s)
+{
+    size_t i = begin;
+    for (; i + Vec::W <= end; i += Vec::W)
+        update<K, Vec>(p, g, m, v, i, s);
+    for (; i < end; i++)
+        update<K, Scalar>(p, g, m, v, i, s);
+}
+
+
+Optimizer::Optimizer(const OptimizerConfig& cfg, tpool_t* pool, size_t num_threads): cfg(cfg),
+                                                                                     pool(pool),
+                                                                                     num_threads(num_threads > 0 ? num_threads : 1)
+{
+}
+
+
+void Optimizer::reset()
+{
+    this->t = 0;
+    this->n = 0;
+    this->m.reset();
+    this->v.reset();
+}
+
+
+int Optimizer::alloc_state(size_t n)
+{
+    if (this->n != 0) {
+        if (n != this->n) {
+            LOG_ERROR("optimizer state is for %zu params, got %zu", this->n, n);
+            return -1;
+        }
+        return 0;
+    }
+
+    bool has_m = cfg.type != OptimizerType::SGD || cfg.momentum != 0.0f;
+    bool has_v = cfg.type == OptimizerType::ADAM || cfg.type == OptimizerType::ADAMW;
+    if (has_m)
+        this->m = make_unique<ParamBuffer>(n);
+    if (has_v)
+        this->v = make_unique<ParamBuffer>(n);
+    this->n = n;
+    return 0;
+}
+
+
+size_t Optimizer::state_size() const
+{
+    return (this->m ? this->n : 0) + (this->v ? this->n : 0);
+}
+
+
+void Optimizer::export_state(float* out) const
+{
+    if (this->m)
+        out = copy(this->m->data(), this->m->data() + this->n, out);
+    if (this->v)
+        copy(this->v->data(), this->v->data() + this->n, out);
+}
+
+
+int Optimizer::import_state(const float* in, size_t len, size_t n, uint64_t t)
+{
+    reset();
+    if (n > 0 && alloc_state(n) != 0)
+        return -1;
+    if (state_size() != len) {
+        LOG_ERROR("optimizer state has %zu floats, expected %zu", len, state_size());
+        reset();
+        return -1;
+    }
+
+    if (this->m) {
+        copy(in, in + n, this->m->data());
+        in += n;
+    }
+    if (this->v)
+        copy(in, in + n, this->v->data());
+    this->t = t;
+    return 0;
+}
+
+
+float Optimizer::learning_rate(uint64_t step) const
+{
+    if (step < cfg.warmup_steps)
+        return cfg.lr * float(step + 1) / float(cfg.warmup_steps);
+    step -= cfg.warmup_steps;
+
+    switch (cfg.schedule) {
+    case LrSchedule::STEP:
+        return cfg.lr * powf(cfg.gamma, float(step / max<uint32_t>(cfg.step_size, 1)));
+    case LrSchedule::COSINE: {
+        if (cfg.total_steps == 0 || step >= cfg.total_steps)
+            return cfg.total_steps == 0 ? cfg.lr : cfg.min_lr;
+        float c = 0.5f * (1.0f + cosf(float(M_PI) * float(step) / float(cfg.total_steps)));
+        return cfg.min_lr + (cfg.lr - cfg.min_lr) * c;
+    }
+    case LrSchedule::CONSTANT:
+    default:
+        return cfg.lr;
+    }
+}
+
+
+// L2 norm of the gradients, summed per chunk in double so long buffers don't lose precision
+float Optimizer::grad_norm(const float* grads, size_t n)
+{
+    double total = 0;
+    mutex lock;
+
+    parallel_for(this->pool, this->num_threads, n, OPT_MIN_CHUNK, ParamBuffer::ALIGN_FLOATS,
+                 [&](size_t begin, size_t end) {
+        double sum = 0;
+        for (size_t i = begin; i < end; i++)
+            sum += double(grads[i]) * grads[i];
+        lock_guard<mutex> guard(lock);
+        total += sum;
+    });
+
+    return float(sqrt(total));
+}
+
+
+int Optimizer::step(float* params, float* grads, size_t n)
+{
+    if (params == nullptr || grads == nullptr || n == 0) {
+        LOG_ERROR("optimizer step with no parameters");
+        return -1;
+    }
+    if (alloc_state(n) != 0)
+        return -1;
+
+    float lr = learning_rate(this->t);
+    this->t++;
+
+    StepScalars s;
+    s.lr = lr;
+    s.mu = cfg.momentum;
+    s.b1 = cfg.beta1;
+    s.b2 = cfg.beta2;
+    s.wd = cfg.type == OptimizerType::ADAMW ? 0.0f : cfg.weight_decay;
+    s.decay = 1.0f - lr * cfg.weight_decay;
+    s.clip = cfg.clip_value > 0.0f ? cfg.clip_value : numeric_limits<float>::infinity();
+    s.zero_grads = cfg.zero_grads;
+
+    // bias corrections: lr * sqrt(1 - b2^t) / (1 - b1^t), eps * sqrt(1 - b2^t)
+    double c1 = 1.0 - pow(double(cfg.beta1), double(this->t));
+    double c2 = sqrt(1.0 - pow(double(cfg.beta2), double(this->t)));
+    s.step_size = float(lr * c2 / c1);
+    s.eps_hat = float(cfg.eps * c2);
+
+    s.gscale = 1.0f;
+    if (cfg.clip_norm > 0.0f) {
+        float norm = grad_norm(grads, n);
+        if (norm > cfg.clip_norm)
+            s.gscale = cfg.clip_norm / norm;
+    }
+
+    Kernel k;
+    switch (cfg.type) {
+    case OptimizerType::NESTEROV: k = Kernel::NESTEROV; break;
+    case OptimizerType::ADAM:     k = Kernel::ADAM; break;
+    case OptimizerType::ADAMW:    k = Kernel::ADAMW; break;
+    case OptimizerType::SGD:
+    default:                      k = cfg.momentum != 0.0f ? Kernel::MOMENTUM : Kernel::SGD; break;
+    }
+
+    float* m = this->m ? this->m->data() : nullptr;
+    float* v = this->v ? this->v->data() : nullptr;
+
+    parallel_for(this->pool, this->num_threads, n, OPT_MIN_CHUNK, ParamBuffer::ALIGN_FLOATS,
+                 [&](size_t begin, size_t end) {
+        switch (k) {
+        case Kernel::SGD:      update_range<Kernel::SGD>(params, grads, m, v, begin, end, s); break;
+        case Kernel::MOMENTUM: update_range<Kernel::MOMENTUM>(params, grads, m, v, begin, end, s); break;
+        case Kernel::NESTEROV: update_range<Kernel::NESTEROV>(params, grads, m, v, begin, end, s); break;
+        case Kernel::ADAM:     update_range<Kernel::ADAM>(params, grads, m, v, begin, end, s); break;
+        case Kernel::ADAMW:    update_range<Kernel::ADAMW>(params, grads, m, v, begin, end, s); break;
+        }
+    });
+
+    return 0;
+}
+
+
+int Optimizer::step(FullyConnectedNetwork& nn)
+{
+    return step(nn.mutable_param_data(), nn.grad_data(), nn.num_params());
+}
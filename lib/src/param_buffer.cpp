@@ -0,0 +1,47 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include "../include/param_buffer.hpp"
+
+
+ParamBuffer::ParamBuffer(size_t n)
+{
+    // aligned_alloc wants the size to be a multiple of the alignment
+    this->bytes = aligned_size(n > 0 ? n : 1) * sizeof(float);
+
+    if (this->bytes >= MMAP_MIN) {
+        void* p = mmap(nullptr, this->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        // already zero, page aligned
+        this->buf = static_cast<float*>(p);
+        this->mapped = true;
+    } else {
+        this->buf = static_cast<float*>(std::aligned_alloc(ALIGN, this->bytes));
+        if (this->buf == nullptr)
+            throw std::bad_alloc();
+        std::memset(this->buf, 0, this->bytes);
+    }
+    this->len = n;
+}
+
+
+ParamBuffer::ParamBuffer(float* data, size_t n, std::shared_ptr<void> owner, bool writable): buf(data),
+                                                                                              len(n),
+                                                                                              bytes(n * sizeof(float)),
+                                                                                              writable(writable),
+                                                                                              owner(std::move(owner))
+{
+}
+
+
+ParamBuffer::~ParamBuffer()
+{
+    if (this->owner)
+        return;
+    if (this->mapped)
+        munmap(this->buf, this->bytes);
+    else
+        std::free(this->buf);
+}
@@ -1,7 +1,9 @@
 #include <cstdlib>
 #include <ctime>
+#include <new>
 #include <string>
 #include "../include/perceptron.hpp"
+#include "../include/log.hpp"
 
 
 // Definition of appropriate equality callback between 2 given mlp.
@@ -20,21 +22,27 @@ int perc_eq (const void *p1, const void *p2)
 // Create a single perceptron unit and intialize it
 mlp_t* mlp_create(bool init_random)
 {
-    // Basic initialization
+    // Basic initialization, constructed in place: next_layer_perc has to be a valid vector
     mlp_t* p;
-    p = (mlp_t* )malloc(sizeof(*p));
+    void* mem = malloc(sizeof(*p));
 
-    if (p == nullptr) {
-        printf("Error creating mlp with malloc\n");
-        return p;
+    if (mem == nullptr) {
+        LOG_ERROR("creating mlp with malloc failed");
+        return nullptr;
     }
+    p = new (mem) mlp_t();
 
     // Initialize Input and result parameters
     p->a = 0;
     p->y = 0;
 
-    // Use current time as seed for random generator
-    std::srand(std::time(nullptr));
+    // Use current time as seed for random generator, once: reseeding on every call gave all units
+    // created within the same second the same weights
+    static bool seeded = false;
+    if (!seeded) {
+        std::srand(std::time(nullptr));
+        seeded = true;
+    }
     // Initialize perceptron weight and bias accordingly
     // Should be normalized values
     if (init_random) {
@@ -46,3 +54,13 @@ mlp_t* mlp_create(bool init_random)
     }
     return p;
 }
+
+
+// Destroy a perceptron made by mlp_create
+void mlp_destroy(mlp_t* p)
+{
+    if (p == nullptr)
+        return;
+    p->~mlp_t();
+    free(p);
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include "../include/perceptron_store.hpp"
+#include "../include/log.hpp"
+#include "../../utils/hash_map.hpp"
+
+using namespace std;
+
+
+PerceptronStore::PerceptronStore(size_t reserve_units)
+{
+    this->w.reserve(reserve_units);
+    this->b.reserve(reserve_units);
+    this->a.reserve(reserve_units);
+    this->y.reserve(reserve_units);
+    this->edge_ptr.reserve(reserve_units + 1);
+}
+
+
+uint32_t PerceptronStore::add_units(size_t count, bool init_random, uint32_t seed)
+{
+    uint32_t first = uint32_t(this->w.size());
+    size_t total = this->w.size() + count;
+
+    this->a.resize(total, 0.0f);
+    this->y.resize(total, 0.0f);
+    // new units have no built edges yet
+    this->edge_ptr.resize(total + 1, this->edge_ptr.back());
+
+    if (!init_random) {
+        this->w.resize(total, 0.0f);
+        this->b.resize(total, 0.0f);
+        return first;
+    }
+
+    // weights from Philox stream 0 and biases from stream 1 of the seed, at the positions of the units
+    this->w.resize(total);
+    this->b.resize(total);
+    philox_fill_uniform(this->w.data() + first, count, -1.0f, 1.0f, PhiloxStream{seed, 0}, first);
+    philox_fill_uniform(this->b.data() + first, count, -1.0f, 1.0f, PhiloxStream{seed, 1}, first);
+    return first;
+}
+
+
+void PerceptronStore::connect_dense(uint32_t from, uint32_t n_from, uint32_t to, uint32_t n_to)
+{
+    this->pending.reserve(this->pending.size() + size_t(n_from) * n_to);
+    for (uint32_t i = 0; i < n_from; i++)
+        for (uint32_t j = 0; j < n_to; j++)
+            this->pending.emplace_back(from + i, to + j);
+}
+
+
+int PerceptronStore::build_edges()
+{
+    const size_t n = this->num_units();
+    for (auto &e : this->pending) {
+        if (e.first >= n || e.second >= n) {
+            LOG_ERROR("edge %u -> %u names a unit out of range (%zu units)", e.first, e.second, n);
+            this->pending.clear();
+            return -1;
+        }
+    }
+    if (this->pending.empty())
+        return 0;
+
+    // counting sort by source, the built edges of a unit stay ahead of its pending ones
+    vector<uint32_t> ptr(n + 1, 0);
+    for (size_t u = 0; u < n; u++)
+        ptr[u + 1] = this->edge_ptr[u + 1] - this->edge_ptr[u];
+    for (auto &e : this->pending)
+        ptr[e.first + 1]++;
+    for (size_t u = 0; u < n; u++)
+        ptr[u + 1] += ptr[u];
+
+    vector<uint32_t> dst(ptr[n]);
+    vector<uint32_t> fill(ptr.begin(), ptr.end() - 1);
+    for (size_t u = 0; u < n; u++)
+        for (uint32_t k = this->edge_ptr[u]; k < this->edge_ptr[u + 1]; k++)
+            dst[fill[u]++] = this->edge_dst[k];
+    for (auto &e : this->pending)
+        dst[fill[e.first]++] = e.second;
+
+    this->edge_ptr = std::move(ptr);
+    this->edge_dst = std::move(dst);
+    this->pending.clear();
+    this->pending.shrink_to_fit();
+    return 0;
+}
+
+
+std::span<const uint32_t> PerceptronStore::next_units(uint32_t unit) const
+{
+    if (unit >= this->num_units())
+        return {};
+    return std::span<const uint32_t>(this->edge_dst.data() + this->edge_ptr[unit],
+                                     this->edge_ptr[unit + 1] - this->edge_ptr[unit]);
+}
+
+
+PerceptronRef PerceptronStore::unit(uint32_t i)
+{
+    return PerceptronRef{this->w[i], this->b[i], this->a[i], this->y[i], this->next_units(i)};
+}
+
+
+int PerceptronStore::compute(uint32_t first, uint32_t count, Activation act)
+{
+    if (size_t(first) + count > this->num_units()) {
+        LOG_ERROR("units %u .. %u out of range (%zu units)", first, first + count, this->num_units());
+        return -1;
+    }
+
+    const float* w = this->w.data() + first;
+    const float* b = this->b.data() + first;
+    const float* a = this->a.data() + first;
+    float* y = this->y.data() + first;
+
+    for (uint32_t i = 0; i < count; i++)
+        y[i] = w[i] * a[i] + b[i];
+
+    switch (act) {
+    case Activation::SIGMOID:
+        for (uint32_t i = 0; i < count; i++)
+            y[i] = 1.0f / (1.0f + exp(-y[i]));
+        break;
+    case Activation::RELU:
+        for (uint32_t i = 0; i < count; i++)
+            y[i] = max(0.0f, y[i]);
+        break;
+    case Activation::SOFTMAX: {
+        if (count == 0)
+            break;
+        float mx = *max_element(y, y + count);
+        float sum = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            y[i] = exp(y[i] - mx);
+            sum += y[i];
+        }
+        for (uint32_t i = 0; i < count; i++)
+            y[i] /= sum;
+        break;
+    }
+    case Activation::NONE:
+        break;
+    }
+    return 0;
+}
+
+
+int PerceptronStore::propagate(uint32_t first, uint32_t count)
+{
+    if (size_t(first) + count > this->num_units()) {
+        LOG_ERROR("units %u .. %u out of range (%zu units)", first, first + count, this->num_units());
+        return -1;
+    }
+
+    const uint32_t* ptr = this->edge_ptr.data();
+    const uint32_t* dst = this->edge_dst.data();
+    float* a = this->a.data();
+    for (uint32_t u = first; u < first + count; u++) {
+        float yu = this->y[u];
+        for (uint32_t k = ptr[u]; k < ptr[u + 1]; k++)
+            a[dst[k]] += yu;
+    }
+    return 0;
+}
+
+
+int PerceptronStore::set_inputs(uint32_t first, std::span<const float> src)
+{
+    if (size_t(first) + src.size() > this->num_units()) {
+        LOG_ERROR("%zu inputs at unit %u don't fit the %zu units", src.size(), first, this->num_units());
+        return -1;
+    }
+    copy(src.begin(), src.end(), this->a.begin() + first);
+    return 0;
+}
+
+
+struct PtrHash
+{
+    uint32_t operator()(const mlp_t* p) const { return HashMix<uintptr_t>{}(reinterpret_cast<uintptr_t>(p)); }
+};
+
+PerceptronStore PerceptronStore::from_mlp(const vector<mlp_t*>& units)
+{
+    PerceptronStore s(units.size());
+    HashMap<const mlp_t*, uint32_t, PtrHash> index;
+    vector<const mlp_t*> order;
+    index.reserve(units.size());
+    order.reserve(units.size());
+
+    auto index_of = [&](const mlp_t* p) {
+        const uint32_t* i = index.find(p);
+        if (i != nullptr)
+            return *i;
+        uint32_t id = uint32_t(order.size());
+        index.insert(p, id);
+        order.push_back(p);
+        return id;
+    };
+
+    for (auto p : units)
+        if (p != nullptr)
+            index_of(p);
+
+    // order grows while it is walked: units only reachable through pointers are appended
+    for (size_t i = 0; i < order.size(); i++) {
+        const mlp_t* p = order[i];
+        for (auto next : p->next_layer_perc)
+            if (next != nullptr)
+                s.pending.emplace_back(uint32_t(i), index_of(next));
+    }
+
+    s.add_units(order.size(), false);
+    for (size_t i = 0; i < order.size(); i++) {
+        s.w[i] = order[i]->w;
+        s.b[i] = order[i]->b;
+        s.a[i] = order[i]->a;
+        s.y[i] = order[i]->y;
+    }
+    s.build_edges();
+    return s;
+}
+
+
+size_t PerceptronStore::size_bytes() const
+{
+    return 4 * this->w.size() * sizeof(float) + this->edge_ptr.size() * sizeof(uint32_t)
+         + this->edge_dst.size() * sizeof(uint32_t);
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstdio>
+#include "../include/pipeline.hpp"
+#include "../include/log.hpp"
+#include "../../utils/trace.h"
+
+using namespace std;
+
+
+// Spins this many times on an empty queue before parking (stages) or yielding (run)
+static const int PIPELINE_SPIN = 256;
+
+
+PipelineExecutor::PipelineExecutor(FullyConnectedNetwork& nn, size_t num_stages, size_t micro_batch, size_t max_in_flight):
+                                                                                        nn(nn),
+                                                                                        micro_batch(max<size_t>(micro_batch, 1))
+{
+    uint32_t depth = nn.get_depth();
+    if (depth < 2) {
+        LOG_ERROR("pipeline needs a network with at least 2 layers");
+        return;
+    }
+
+    // the input layer does no work, layers 1 .. depth-1 are split
+    num_stages = clamp<size_t>(num_stages, 1, depth - 1);
+    uint64_t total = 0;
+    for (uint32_t k = 1; k < depth; k++)
+        total += nn.get_layer(k)->get_num_edges();
+
+    // greedy cut at every 1/num_stages of the total cost, each stage keeps at least one layer
+    this->stages = vector<Stage>(num_stages);
+    uint32_t k = 1;
+    uint64_t acc = 0;
+    for (size_t s = 0; s < num_stages; s++) {
+        Stage& st = this->stages[s];
+        st.first = k;
+        uint64_t target = total * (s + 1) / num_stages;
+        size_t stages_left = num_stages - s - 1;
+        do {
+            acc += nn.get_layer(k)->get_num_edges();
+            k++;
+        } while (k < depth - stages_left && acc + nn.get_layer(k)->get_num_edges() / 2 <= target);
+        if (s == num_stages - 1)
+            k = depth;
+        st.last = k;
+
+        uint32_t widest = 0;
+        for (uint32_t l = st.first; l < st.last; l++)
+            widest = max(widest, nn.get_layer(l)->get_n());
+        st.scratch[0].resize(this->micro_batch * widest);
+        st.scratch[1].resize(this->micro_batch * widest);
+    }
+
+    if (max_in_flight == 0)
+        max_in_flight = 2 * num_stages;
+    this->slots = vector<Slot>(max_in_flight);
+    for (uint32_t i = 0; i < max_in_flight; i++) {
+        Slot& sl = this->slots[i];
+        sl.acts.emplace_back(this->micro_batch * nn.num_inputs());
+        for (auto &st : this->stages)
+            sl.acts.emplace_back(this->micro_batch * nn.get_layer(st.last - 1)->get_n());
+        this->free_slots.push_back(max_in_flight - 1 - i);
+    }
+
+    // every queue can hold all the slots, so a push never fails
+    for (size_t s = 0; s <= num_stages; s++)
+        this->queues.push_back(make_unique<SpscQueue<uint32_t>>(max_in_flight));
+
+    for (size_t s = 0; s < num_stages; s++)
+        this->stages[s].thread = thread(&PipelineExecutor::stage_loop, this, s);
+}
+
+
+PipelineExecutor::~PipelineExecutor()
+{
+    this->stop.store(true, memory_order_release);
+    for (auto &st : this->stages) {
+        lock_guard<mutex> guard(st.lock);
+        st.wake.notify_one();
+    }
+    for (auto &st : this->stages) {
+        if (st.thread.joinable())
+            st.thread.join();
+    }
+}
+
+
+/**
+ * Push to queue q and wake the stage reading it if it is parked.
+ * The fence pairs with the one in stage_loop: either the stage sees the slot before it waits
+ * or we see it parked and notify under its lock, so no wakeup is lost.
+*/
+void PipelineExecutor::push(size_t q, uint32_t idx)
+{
+    this->queues[q]->push(idx);
+    if (q == this->stages.size())
+        return;
+
+    Stage& st = this->stages[q];
+    atomic_thread_fence(memory_order_seq_cst);
+    if (st.parked.load(memory_order_relaxed)) {
+        lock_guard<mutex> guard(st.lock);
+        st.wake.notify_one();
+    }
+}
+
+
+void PipelineExecutor::stage_loop(size_t s)
+{
+    Stage& st = this->stages[s];
+    SpscQueue<uint32_t>& in = *this->queues[s];
+    int idle = 0;
+    uint32_t idx;
+    char thread_name[32];
+
+    snprintf(thread_name, sizeof(thread_name), "pipeline stage %zu", s);
+    trace_set_thread_name(thread_name);
+
+    while (true) {
+        if (!in.pop(idx)) {
+            if (this->stop.load(memory_order_acquire))
+                break;
+            if (++idle > PIPELINE_SPIN) {
+                unique_lock<mutex> guard(st.lock);
+                st.parked.store(true, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+                st.wake.wait(guard, [&] { return in.size() > 0 || this->stop.load(memory_order_acquire); });
+                st.parked.store(false, memory_order_relaxed);
+                idle = 0;
+            }
+            continue;
+        }
+        idle = 0;
+
+        TRACE_SPAN("pipeline", "stage", "slot", idx);
+        bool tracing = trace_enabled();
+        Slot& sl = this->slots[idx];
+        const float* src = sl.acts[s].data();
+        uint32_t width_in = this->nn.get_layer(st.first)->get_n_in();
+
+        // one layer at a time over all the rows, so its weights are reused while in cache
+        for (uint32_t l = st.first; l < st.last; l++) {
+            Layer* layer = this->nn.get_layer(l);
+            uint32_t width_out = layer->get_n();
+            float* dst = l + 1 == st.last ? sl.acts[s + 1].data() : st.scratch[(l - st.first) & 1].data();
+            uint64_t begin = tracing ? trace_now() : 0;
+
+            for (size_t r = 0; r < sl.rows; r++)
+                layer->forward(src + r * width_in, dst + r * width_out);
+            // the name is copied before the temporary from get_name goes away
+            if (tracing)
+                trace_complete("layer", layer->get_name().c_str(), begin, trace_now(), "rows", sl.rows);
+
+            src = dst;
+            width_in = width_out;
+        }
+
+        push(s + 1, idx);
+    }
+}
+
+
+bool PipelineExecutor::submit(const float* x, size_t rows)
+{
+    if (this->stages.empty() || rows == 0 || rows > this->micro_batch || this->free_slots.empty())
+        return false;
+
+    TRACE_SPAN("pipeline", "submit", "rows", rows);
+    uint32_t idx = this->free_slots.back();
+    this->free_slots.pop_back();
+
+    Slot& sl = this->slots[idx];
+    sl.rows = rows;
+    sl.start = chrono::steady_clock::now();
+    copy(x, x + rows * this->nn.num_inputs(), sl.acts[0].begin());
+
+    push(0, idx);
+    return true;
+}
+
+
+size_t PipelineExecutor::collect(float* y)
+{
+    uint32_t idx;
+
+    if (this->queues.empty() || !this->queues.back()->pop(idx))
+        return 0;
+
+    TRACE_SPAN("pipeline", "collect", "slot", idx);
+    Slot& sl = this->slots[idx];
+    size_t rows = sl.rows;
+    copy(sl.acts.back().begin(), sl.acts.back().begin() + rows * this->nn.num_outputs(), y);
+    this->latencies_us.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - sl.start).count());
+
+    this->free_slots.push_back(idx);
+    return rows;
+}
+
+
+int PipelineExecutor::run(const float* x, size_t n, float* y)
+{
+    if (this->stages.empty() || x == nullptr || y == nullptr) {
+        LOG_ERROR("pipeline is not set up or no input / output given");
+        return -1;
+    }
+
+    size_t n_in = this->nn.num_inputs(), n_out = this->nn.num_outputs();
+    size_t issued = 0, done = 0;
+    int idle = 0;
+
+    // keep the pipeline full, micro-batches come back in the order they went in
+    while (done < n) {
+        bool progress = false;
+        size_t rows = min(this->micro_batch, n - issued);
+        if (issued < n && submit(x + issued * n_in, rows)) {
+            issued += rows;
+            progress = true;
+        }
+        size_t got = collect(y + done * n_out);
+        if (got > 0) {
+            done += got;
+            progress = true;
+        }
+        if (!progress && ++idle > PIPELINE_SPIN) {
+            this_thread::yield();
+            idle = 0;
+        }
+    }
+
+    return 0;
+}
+
+
+PipelineStats PipelineExecutor::get_stats() const
+{
+    PipelineStats st;
+    if (this->latencies_us.empty())
+        return st;
+
+    vector<double> l = this->latencies_us;
+    sort(l.begin(), l.end());
+    double sum = 0;
+    for (double v : l)
+        sum += v;
+
+    st.micro_batches = l.size();
+    st.mean_us = sum / l.size();
+    st.p50_us = l[l.size() / 2];
+    st.p99_us = l[min(l.size() - 1, l.size() * 99 / 100)];
+    st.max_us = l.back();
+    return st;
+}
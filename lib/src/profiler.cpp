@@ -0,0 +1,314 @@
+#include <cstdarg>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "../include/profiler.hpp"
+#include "../include/log.hpp"
+#include "../include/simd.hpp"
+
+using namespace std;
+
+
+static double seconds_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// 8 independent multiply-add chains, enough to cover the latency of the FMA units
+static double measure_gflops()
+{
+    Vec acc[8];
+    for (int i = 0; i < 8; i++)
+        acc[i] = Vec::set1(float(i));
+    const Vec m = Vec::set1(0.999999f), c = Vec::set1(1e-6f);
+    const size_t iters = 1 << 20;
+
+    double best = 0;
+    for (int rep = 0; rep < 3; rep++) {
+        auto start = chrono::steady_clock::now();
+        for (size_t it = 0; it < iters; it++)
+            for (int i = 0; i < 8; i++)
+                acc[i] = vfma(acc[i], m, c);
+        double s = seconds_since(start);
+        best = max(best, 2.0 * 8 * Vec::W * iters / s / 1e9);
+    }
+
+    // keep the chains alive
+    float sink = 0;
+    for (int i = 0; i < 8; i++)
+        sink += hsum(acc[i]);
+    volatile float keep = sink;
+    (void)keep;
+    return best;
+}
+
+static double measure_gbps()
+{
+    const size_t n = size_t(16) << 20;          // 64 MB
+    vector<float> buf(n, 1.0f);
+
+    double best = 0;
+    float sink = 0;
+    for (int rep = 0; rep < 3; rep++) {
+        auto start = chrono::steady_clock::now();
+        Vec a0 = Vec::set1(0.0f), a1 = a0, a2 = a0, a3 = a0;
+        for (size_t i = 0; i + 4 * Vec::W <= n; i += 4 * Vec::W) {
+            a0 = a0 + Vec::load(&buf[i]);
+            a1 = a1 + Vec::load(&buf[i + Vec::W]);
+            a2 = a2 + Vec::load(&buf[i + 2 * Vec::W]);
+            a3 = a3 + Vec::load(&buf[i + 3 * Vec::W]);
+        }
+        sink += hsum(a0 + a1 + a2 + a3);
+        double s = seconds_since(start);
+        best = max(best, n * sizeof(float) / s / 1e9);
+    }
+    volatile float keep = sink;
+    (void)keep;
+    return best;
+}
+
+HostRoofline measure_roofline()
+{
+    HostRoofline host;
+    host.peak_gflops = measure_gflops();
+    host.peak_gbps = measure_gbps();
+    return host;
+}
+
+
+double LayerProfile::forward_flops() const { return 2.0 * this->n * this->n_in; }
+double LayerProfile::forward_bytes() const { return 4.0 * this->n * this->n_in; }
+
+// per call on average, delta_in is only computed on some
+double LayerProfile::backward_flops() const
+{
+    double frac = this->backward_calls > 0 ? double(this->input_grad_calls) / this->backward_calls : 0;
+    return 2.0 * this->n * this->n_in * (1.0 + frac);
+}
+
+double LayerProfile::backward_bytes() const
+{
+    double frac = this->backward_calls > 0 ? double(this->input_grad_calls) / this->backward_calls : 0;
+    return 4.0 * this->n * this->n_in * (2.0 + frac);
+}
+
+
+Profiler::Profiler(const HostRoofline& host): host(host)
+{
+}
+
+Profiler::~Profiler()
+{
+    detach();
+}
+
+
+int Profiler::attach(FullyConnectedNetwork& nn)
+{
+    if (nn.profiler != nullptr && nn.profiler != this) {
+        LOG_ERROR("network is being profiled by another profiler");
+        return -1;
+    }
+    detach();
+
+    this->shapes.clear();
+    for (uint32_t k = 0; k < nn.get_depth(); k++) {
+        Layer* l = nn.get_layer(k);
+        LayerProfile p;
+        p.index = k;
+        p.name = l->get_name();
+        p.n = l->get_n();
+        p.n_in = l->get_n_in();
+        this->shapes.push_back(p);
+    }
+    this->counters.reset(new Counters[this->shapes.size()]);
+
+    this->nn = &nn;
+    nn.profiler = this;
+    return 0;
+}
+
+
+void Profiler::detach()
+{
+    if (this->nn != nullptr && this->nn->profiler == this)
+        this->nn->profiler = nullptr;
+    this->nn = nullptr;
+}
+
+
+void Profiler::reset()
+{
+    for (size_t k = 0; k < this->shapes.size(); k++) {
+        Counters& c = this->counters[k];
+        c.forward_calls = 0;
+        c.forward_ns = 0;
+        c.backward_calls = 0;
+        c.backward_ns = 0;
+        c.input_grad_calls = 0;
+    }
+}
+
+
+uint64_t Profiler::now_ns()
+{
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+vector<LayerProfile> Profiler::snapshot() const
+{
+    vector<LayerProfile> out;
+    for (size_t k = 0; k < this->shapes.size(); k++) {
+        if (this->shapes[k].n_in == 0)
+            continue;
+        LayerProfile p = this->shapes[k];
+        const Counters& c = this->counters[k];
+        p.forward_calls = c.forward_calls.load(std::memory_order_relaxed);
+        p.forward_ns = c.forward_ns.load(std::memory_order_relaxed);
+        p.backward_calls = c.backward_calls.load(std::memory_order_relaxed);
+        p.backward_ns = c.backward_ns.load(std::memory_order_relaxed);
+        p.input_grad_calls = c.input_grad_calls.load(std::memory_order_relaxed);
+        out.push_back(p);
+    }
+    return out;
+}
+
+
+// Achieved and attainable numbers of one kind of pass through a layer
+struct PassStats
+{
+    uint64_t calls = 0;
+    double avg_us = 0;
+    double gflops = 0;
+    double gbps = 0;
+    double intensity = 0;       // flops per byte
+    double roof_gflops = 0;     // min(peak, intensity * bandwidth)
+    double of_roof = 0;         // gflops / roof_gflops
+    bool memory_bound = false;
+};
+
+static PassStats pass_stats(uint64_t calls, uint64_t ns, double flops, double bytes, const HostRoofline& host)
+{
+    PassStats s;
+    s.calls = calls;
+    s.intensity = bytes > 0 ? flops / bytes : 0;
+    s.roof_gflops = min(host.peak_gflops, s.intensity * host.peak_gbps);
+    s.memory_bound = s.intensity < host.ridge();
+    if (calls == 0 || ns == 0)
+        return s;
+    // flops per ns is GFLOP/s
+    s.avg_us = ns / 1e3 / calls;
+    s.gflops = flops * calls / ns;
+    s.gbps = bytes * calls / ns;
+    s.of_roof = s.roof_gflops > 0 ? s.gflops / s.roof_gflops : 0;
+    return s;
+}
+
+
+void Profiler::report(FILE* out) const
+{
+    fprintf(out, "host roofline (1 thread): %.1f GFLOP/s peak, %.1f GB/s, ridge at %.2f flop/byte\n",
+            this->host.peak_gflops, this->host.peak_gbps, this->host.ridge());
+    fprintf(out, "%-12s %-5s %-11s %8s %10s %9s %8s %7s %9s %7s  %s\n", "layer", "pass", "shape", "calls",
+            "avg us", "GFLOP/s", "GB/s", "flop/B", "roof", "%roof", "bound");
+
+    for (auto &p : snapshot()) {
+        char shape[32];
+        snprintf(shape, sizeof(shape), "%ux%u", p.n, p.n_in);
+        PassStats f = pass_stats(p.forward_calls, p.forward_ns, p.forward_flops(), p.forward_bytes(), this->host);
+        PassStats b = pass_stats(p.backward_calls, p.backward_ns, p.backward_flops(), p.backward_bytes(), this->host);
+        const PassStats* passes[2] = {&f, &b};
+        const char* names[2] = {"fwd", "bwd"};
+        for (int i = 0; i < 2; i++) {
+            const PassStats& s = *passes[i];
+            if (s.calls == 0)
+                continue;
+            fprintf(out, "%-12.12s %-5s %-11s %8lu %10.2f %9.2f %8.2f %7.2f %9.2f %6.1f%%  %s\n", p.name.c_str(),
+                    names[i], shape, (unsigned long)s.calls, s.avg_us, s.gflops, s.gbps, s.intensity,
+                    s.roof_gflops, 100.0 * s.of_roof, s.memory_bound ? "memory" : "compute");
+        }
+    }
+}
+
+
+static void append(string& s, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void append(string& s, const char* fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    s += buf;
+}
+
+static string json_escape(const string& in)
+{
+    string out;
+    for (char ch : in) {
+        if (ch == '"' || ch == '\\') {
+            out += '\\';
+            out += ch;
+        } else if (uint8_t(ch) < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            out += buf;
+        } else {
+            out += ch;
+        }
+    }
+    return out;
+}
+
+static void append_pass(string& s, const char* name, const PassStats& p, double flops, double bytes)
+{
+    append(s, "\"%s\": {\"calls\": %lu, \"avg_us\": %.3f, \"flops\": %.0f, \"bytes\": %.0f, \"gflops\": %.3f, "
+              "\"gbps\": %.3f, \"intensity\": %.4f, \"roofline_gflops\": %.3f, \"of_roofline\": %.4f, \"bound\": \"%s\"}",
+           name, (unsigned long)p.calls, p.avg_us, flops, bytes, p.gflops, p.gbps, p.intensity, p.roof_gflops,
+           p.of_roof, p.memory_bound ? "memory" : "compute");
+}
+
+string Profiler::to_json() const
+{
+    string s = "{\n";
+    append(s, "  \"host\": {\"peak_gflops\": %.3f, \"peak_gbps\": %.3f, \"ridge\": %.4f},\n",
+           this->host.peak_gflops, this->host.peak_gbps, this->host.ridge());
+    s += "  \"layers\": [";
+
+    vector<LayerProfile> layers = snapshot();
+    for (size_t i = 0; i < layers.size(); i++) {
+        const LayerProfile& p = layers[i];
+        PassStats f = pass_stats(p.forward_calls, p.forward_ns, p.forward_flops(), p.forward_bytes(), this->host);
+        PassStats b = pass_stats(p.backward_calls, p.backward_ns, p.backward_flops(), p.backward_bytes(), this->host);
+
+        s += i == 0 ? "\n" : ",\n";
+        append(s, "    {\"index\": %u, \"name\": \"", p.index);
+        s += json_escape(p.name);
+        append(s, "\", \"n\": %u, \"n_in\": %u,\n     ", p.n, p.n_in);
+        append_pass(s, "forward", f, p.forward_flops(), p.forward_bytes());
+        s += ",\n     ";
+        append_pass(s, "backward", b, p.backward_flops(), p.backward_bytes());
+        s += "}";
+    }
+    s += "\n  ]\n}\n";
+    return s;
+}
+
+
+int Profiler::write_json(const string& path) const
+{
+    FILE* f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        LOG_ERROR("cannot write profile to %s", path.c_str());
+        return -1;
+    }
+    string s = to_json();
+    size_t written = fwrite(s.data(), 1, s.size(), f);
+    int rc = fclose(f);
+    if (written != s.size() || rc != 0) {
+        LOG_ERROR("writing profile to %s failed", path.c_str());
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include "../include/quantize.hpp"
+#include "../include/log.hpp"
+#include "../include/simd.hpp"
+
+using namespace std;
+
+
+static inline float quant_activate(float v, Activation act)
+{
+    switch (act) {
+    case Activation::SIGMOID:
+        return 1.0f / (1.0f + exp(-v));
+    case Activation::RELU:
+        return max(0.0f, v);
+    default:
+        return v;
+    }
+}
+
+// v to [0, 127] with scale and zero point, given as 1 / scale
+static inline uint8_t quant_u7(float v, float inv_scale, float zero)
+{
+    float q = min(max(v * inv_scale + zero, 0.0f), 127.0f);
+    return uint8_t(q + 0.5f);
+}
+
+static uint32_t argmax(const float* y, uint32_t n)
+{
+    return uint32_t(max_element(y, y + n) - y);
+}
+
+
+QuantizedNetwork* QuantizedNetwork::calibrate(FullyConnectedNetwork& nn, const float* x, size_t num_samples)
+{
+    uint32_t depth = nn.get_depth();
+    if (depth < 2 || x == nullptr || num_samples == 0) {
+        LOG_ERROR("calibration needs a network with at least 2 layers and some samples");
+        return nullptr;
+    }
+
+    // range of every layer's output over the samples, the input range of the layer after it
+    vector<float> lo(depth, numeric_limits<float>::infinity());
+    vector<float> hi(depth, -numeric_limits<float>::infinity());
+    Workspace ws = nn.make_workspace();
+    for (size_t s = 0; s < num_samples; s++) {
+        nn.forward(x + s * nn.num_inputs(), ws);
+        for (uint32_t k = 0; k + 1 < depth; k++) {
+            auto mm = minmax_element(ws.a[k].begin(), ws.a[k].end());
+            lo[k] = min(lo[k], *mm.first);
+            hi[k] = max(hi[k], *mm.second);
+        }
+    }
+
+    QuantizedNetwork* q = new QuantizedNetwork();
+    q->n_inputs = nn.num_inputs();
+    q->n_outputs = nn.num_outputs();
+
+    for (uint32_t k = 1; k < depth; k++) {
+        Layer* l = nn.get_layer(k);
+        QuantizedLayer ql;
+        ql.n = l->get_n();
+        ql.n_in = l->get_n_in();
+        ql.n_in_pad = (ql.n_in + 31) / 32 * 32;
+        ql.act = l->get_activation();
+
+        // the range always holds 0, so zero inputs (and the padding) are exact
+        float mn = min(lo[k - 1], 0.0f), mx = max(hi[k - 1], 0.0f);
+        ql.in_scale = mx > mn ? (mx - mn) / 127.0f : 1.0f;
+        ql.in_zero = uint8_t(min(max(lrintf(-mn / ql.in_scale), 0L), 127L));
+
+        ql.w.assign(size_t(ql.n) * ql.n_in_pad, 0);
+        ql.w_scale.resize(ql.n);
+        ql.bias.resize(ql.n);
+        ql.acc_scale.resize(ql.n);
+
+        std::span<const float> w = l->weights(), b = l->biases();
+        for (uint32_t i = 0; i < ql.n; i++) {
+            const float* row = w.data() + size_t(i) * ql.n_in;
+            float amax = 0;
+            for (uint32_t j = 0; j < ql.n_in; j++)
+                amax = max(amax, fabsf(row[j]));
+            ql.w_scale[i] = amax > 0.0f ? amax / 127.0f : 1.0f;
+
+            int64_t row_sum = 0;
+            int8_t* qrow = ql.w.data() + size_t(i) * ql.n_in_pad;
+            for (uint32_t j = 0; j < ql.n_in; j++) {
+                qrow[j] = int8_t(min(max(lrintf(row[j] / ql.w_scale[i]), -127L), 127L));
+                row_sum += qrow[j];
+            }
+
+            ql.acc_scale[i] = ql.w_scale[i] * ql.in_scale;
+            double bias = llrint(double(b[i]) / ql.acc_scale[i]) - double(ql.in_zero) * row_sum;
+            ql.bias[i] = int32_t(min(max(bias, double(INT32_MIN)), double(INT32_MAX)));
+        }
+
+        q->layers.push_back(std::move(ql));
+    }
+
+    return q;
+}
+
+
+QuantWorkspace QuantizedNetwork::make_workspace() const
+{
+    QuantWorkspace ws;
+    for (auto &l : this->layers)
+        ws.a.emplace_back(l.n_in_pad, 0);
+    ws.out.resize(this->n_outputs);
+    return ws;
+}
+
+
+int QuantizedNetwork::forward(const float* x, float* y, QuantWorkspace& ws) const
+{
+    if (this->layers.empty() || ws.a.size() != this->layers.size()) {
+        LOG_ERROR("quantized network is empty or the workspace doesn't fit it");
+        return -1;
+    }
+
+    const QuantizedLayer& first = this->layers.front();
+    float inv = 1.0f / first.in_scale, zero = first.in_zero;
+    for (uint32_t j = 0; j < first.n_in; j++)
+        ws.a[0][j] = quant_u7(x[j], inv, zero);
+
+    for (size_t k = 0; k < this->layers.size(); k++) {
+        const QuantizedLayer& l = this->layers[k];
+        const uint8_t* in = ws.a[k].data();
+        bool last = k + 1 == this->layers.size();
+
+        // fused epilogue: int32 accumulator + bias, to float, activation, then either
+        // requantized straight into the next layer's input or written out as float
+        if (last) {
+            for (uint32_t i = 0; i < l.n; i++) {
+                int32_t acc = simd_dot_u8s8(in, l.w.data() + size_t(i) * l.n_in_pad, l.n_in_pad) + l.bias[i];
+                ws.out[i] = quant_activate(float(acc) * l.acc_scale[i], l.act);
+            }
+        } else {
+            const QuantizedLayer& next = this->layers[k + 1];
+            uint8_t* out = ws.a[k + 1].data();
+            inv = 1.0f / next.in_scale;
+            zero = next.in_zero;
+            for (uint32_t i = 0; i < l.n; i++) {
+                int32_t acc = simd_dot_u8s8(in, l.w.data() + size_t(i) * l.n_in_pad, l.n_in_pad) + l.bias[i];
+                out[i] = quant_u7(quant_activate(float(acc) * l.acc_scale[i], l.act), inv, zero);
+            }
+        }
+    }
+
+    if (this->layers.back().act == Activation::SOFTMAX) {
+        float mx = *max_element(ws.out.begin(), ws.out.end());
+        float sum = 0;
+        for (auto &v : ws.out) {
+            v = exp(v - mx);
+            sum += v;
+        }
+        for (auto &v : ws.out)
+            v /= sum;
+    }
+
+    copy(ws.out.begin(), ws.out.end(), y);
+    return 0;
+}
+
+
+size_t QuantizedNetwork::size_bytes() const
+{
+    size_t bytes = 0;
+    for (auto &l : this->layers)
+        bytes += l.w.size() + (l.w_scale.size() + l.bias.size() + l.acc_scale.size()) * 4;
+    return bytes;
+}
+
+
+QuantReport QuantizedNetwork::compare(FullyConnectedNetwork& nn, const QuantizedNetwork& q, const float* x,
+                                      const uint32_t* labels, size_t n)
+{
+    QuantReport r;
+    const uint32_t n_in = nn.num_inputs(), n_out = nn.num_outputs();
+    if (n == 0 || n_in != q.num_inputs() || n_out != q.num_outputs())
+        return r;
+
+    vector<float> fy(n * n_out), qy(n * n_out);
+    Workspace fws = nn.make_workspace();
+    QuantWorkspace qws = q.make_workspace();
+
+    auto start = chrono::steady_clock::now();
+    for (size_t s = 0; s < n; s++) {
+        nn.forward(x + s * n_in, fws);
+        copy(fws.a.back().begin(), fws.a.back().end(), fy.begin() + s * n_out);
+    }
+    auto mid = chrono::steady_clock::now();
+    for (size_t s = 0; s < n; s++)
+        q.forward(x + s * n_in, qy.data() + s * n_out, qws);
+    auto end = chrono::steady_clock::now();
+
+    size_t float_ok = 0, int8_ok = 0, agree = 0;
+    double diff_sum = 0;
+    for (size_t s = 0; s < n; s++) {
+        uint32_t pf = argmax(fy.data() + s * n_out, n_out), pq = argmax(qy.data() + s * n_out, n_out);
+        float_ok += pf == labels[s];
+        int8_ok += pq == labels[s];
+        agree += pf == pq;
+        for (uint32_t i = 0; i < n_out; i++) {
+            float d = fabsf(fy[s * n_out + i] - qy[s * n_out + i]);
+            r.max_abs_diff = max(r.max_abs_diff, d);
+            diff_sum += d;
+        }
+    }
+
+    r.samples = n;
+    r.float_accuracy = float(float_ok) / n;
+    r.int8_accuracy = float(int8_ok) / n;
+    r.agreement = float(agree) / n;
+    r.mean_abs_diff = float(diff_sum / (n * n_out));
+    r.float_us = chrono::duration<double, micro>(mid - start).count() / n;
+    r.int8_us = chrono::duration<double, micro>(end - mid).count() / n;
+    for (uint32_t k = 1; k < nn.get_depth(); k++)
+        r.float_bytes += nn.get_layer(k)->num_params() * sizeof(float);
+    r.int8_bytes = q.size_bytes();
+    return r;
+}
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cmath>
+#include "../include/reduced_precision.hpp"
+#include "../include/log.hpp"
+#include "../include/half.hpp"
+
+using namespace std;
+
+
+template <WeightFormat F>
+static inline Vec load_w(const uint16_t* p)
+{
+    if constexpr (F == WeightFormat::BF16)
+        return load_bf16(p, Vec());
+    else
+        return load_fp16(p, Vec());
+}
+
+// y[r][i] = w[i] • x[r] + b[i] for every row r of the batch (x rows are n_in_pad floats apart, y rows ldy).
+// Four rows go through each weight row together, the widened weights are used four times per load.
+template <WeightFormat F>
+static void half_gemm(const HalfLayer& l, const float* x, size_t rows, float* y, size_t ldy)
+{
+    const size_t ld = l.n_in_pad;
+    size_t r = 0;
+
+    for (; r + 4 <= rows; r += 4) {
+        const float* x0 = x + r * ld;
+        const float* x1 = x0 + ld;
+        const float* x2 = x1 + ld;
+        const float* x3 = x2 + ld;
+        for (uint32_t i = 0; i < l.n; i++) {
+            const uint16_t* w = l.w.data() + size_t(i) * ld;
+            Vec a0 = Vec::set1(0.0f), a1 = a0, a2 = a0, a3 = a0;
+            for (size_t j = 0; j < ld; j += Vec::W) {
+                Vec wv = load_w<F>(w + j);
+                a0 = vfma(wv, Vec::load(x0 + j), a0);
+                a1 = vfma(wv, Vec::load(x1 + j), a1);
+                a2 = vfma(wv, Vec::load(x2 + j), a2);
+                a3 = vfma(wv, Vec::load(x3 + j), a3);
+            }
+            y[r * ldy + i] = hsum(a0) + l.b[i];
+            y[(r + 1) * ldy + i] = hsum(a1) + l.b[i];
+            y[(r + 2) * ldy + i] = hsum(a2) + l.b[i];
+            y[(r + 3) * ldy + i] = hsum(a3) + l.b[i];
+        }
+    }
+
+    for (; r < rows; r++) {
+        const float* x0 = x + r * ld;
+        for (uint32_t i = 0; i < l.n; i++) {
+            const uint16_t* w = l.w.data() + size_t(i) * ld;
+            Vec a0 = Vec::set1(0.0f), a1 = a0;
+            size_t j = 0;
+            for (; j + 2 * Vec::W <= ld; j += 2 * Vec::W) {
+                a0 = vfma(load_w<F>(w + j), Vec::load(x0 + j), a0);
+                a1 = vfma(load_w<F>(w + j + Vec::W), Vec::load(x0 + j + Vec::W), a1);
+            }
+            for (; j < ld; j += Vec::W)
+                a0 = vfma(load_w<F>(w + j), Vec::load(x0 + j), a0);
+            y[r * ldy + i] = hsum(a0 + a1) + l.b[i];
+        }
+    }
+}
+
+static void half_activate(float* y, uint32_t n, Activation act)
+{
+    switch (act) {
+    case Activation::SIGMOID:
+        for (uint32_t i = 0; i < n; i++)
+            y[i] = 1.0f / (1.0f + exp(-y[i]));
+        break;
+    case Activation::RELU:
+        for (uint32_t i = 0; i < n; i++)
+            y[i] = max(0.0f, y[i]);
+        break;
+    case Activation::SOFTMAX: {
+        float mx = *max_element(y, y + n);
+        float sum = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            y[i] = exp(y[i] - mx);
+            sum += y[i];
+        }
+        for (uint32_t i = 0; i < n; i++)
+            y[i] /= sum;
+        break;
+    }
+    case Activation::NONE:
+        break;
+    }
+}
+
+
+ReducedPrecisionNetwork* ReducedPrecisionNetwork::convert(FullyConnectedNetwork& nn, WeightFormat format)
+{
+    if (nn.get_depth() < 2) {
+        LOG_ERROR("nothing to convert, the network has no trainable layers");
+        return nullptr;
+    }
+
+    ReducedPrecisionNetwork* rp = new ReducedPrecisionNetwork();
+    rp->format = format;
+    rp->n_inputs = nn.num_inputs();
+    rp->n_outputs = nn.num_outputs();
+
+    for (uint32_t k = 1; k < nn.get_depth(); k++) {
+        Layer* l = nn.get_layer(k);
+        HalfLayer hl;
+        hl.n = l->get_n();
+        hl.n_in = l->get_n_in();
+        hl.n_in_pad = (hl.n_in + 15) / 16 * 16;
+        hl.act = l->get_activation();
+        hl.w.assign(size_t(hl.n) * hl.n_in_pad, 0);
+        hl.b.assign(l->biases().begin(), l->biases().end());
+
+        std::span<const float> w = l->weights();
+        for (uint32_t i = 0; i < hl.n; i++) {
+            for (uint32_t j = 0; j < hl.n_in; j++) {
+                float v = w[size_t(i) * hl.n_in + j];
+                hl.w[size_t(i) * hl.n_in_pad + j] = format == WeightFormat::BF16 ? float_to_bf16(v) : float_to_fp16(v);
+            }
+        }
+        rp->layers.push_back(std::move(hl));
+    }
+
+    return rp;
+}
+
+
+ReducedPrecisionNetwork* ReducedPrecisionNetwork::load(const string& path, WeightFormat format)
+{
+    FullyConnectedNetwork* nn = FullyConnectedNetwork::load(path);
+    if (nn == nullptr)
+        return nullptr;
+
+    ReducedPrecisionNetwork* rp = convert(*nn, format);
+    delete nn;
+    return rp;
+}
+
+
+HalfWorkspace ReducedPrecisionNetwork::make_workspace(size_t max_rows) const
+{
+    HalfWorkspace ws;
+    ws.max_rows = max_rows;
+    for (auto &l : this->layers)
+        ws.a.emplace_back(max_rows * l.n_in_pad, 0.0f);
+    ws.a.emplace_back(max_rows * this->n_outputs, 0.0f);
+    return ws;
+}
+
+
+int ReducedPrecisionNetwork::forward(const float* x, size_t rows, float* y, HalfWorkspace& ws) const
+{
+    if (this->layers.empty() || rows > ws.max_rows || ws.a.size() != this->layers.size() + 1) {
+        LOG_ERROR("batch of %zu rows doesn't fit the workspace (%zu rows)", rows, ws.max_rows);
+        return -1;
+    }
+
+    // rows padded with zeros, the padding of the weights multiplies them
+    const size_t ld0 = this->layers[0].n_in_pad;
+    for (size_t r = 0; r < rows; r++)
+        copy(x + r * this->n_inputs, x + (r + 1) * this->n_inputs, ws.a[0].begin() + r * ld0);
+
+    for (size_t k = 0; k < this->layers.size(); k++) {
+        const HalfLayer& l = this->layers[k];
+        size_t ldy = k + 1 < this->layers.size() ? this->layers[k + 1].n_in_pad : this->n_outputs;
+        float* out = ws.a[k + 1].data();
+
+        if (this->format == WeightFormat::BF16)
+            half_gemm<WeightFormat::BF16>(l, ws.a[k].data(), rows, out, ldy);
+        else
+            half_gemm<WeightFormat::FP16>(l, ws.a[k].data(), rows, out, ldy);
+
+        for (size_t r = 0; r < rows; r++)
+            half_activate(out + r * ldy, l.n, l.act);
+    }
+
+    copy(ws.a.back().begin(), ws.a.back().begin() + rows * this->n_outputs, y);
+    return 0;
+}
+
+
+size_t ReducedPrecisionNetwork::size_bytes() const
+{
+    size_t bytes = 0;
+    for (auto &l : this->layers)
+        bytes += l.w.size() * sizeof(uint16_t) + l.b.size() * sizeof(float);
+    return bytes;
+}
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "../include/sparse.hpp"
+#include "../include/log.hpp"
+#include "../include/simd.hpp"
+
+using namespace std;
+
+
+static size_t pad4(size_t n) { return (n + 3) / 4 * 4; }
+
+
+int prune(FullyConnectedNetwork& nn, float sparsity, PruneMode mode)
+{
+    if (!(sparsity >= 0.0f && sparsity < 1.0f)) {
+        LOG_ERROR("sparsity must be in [0, 1), got %f", sparsity);
+        return -1;
+    }
+
+    for (uint32_t k = 1; k < nn.get_depth(); k++) {
+        Layer* l = nn.get_layer(k);
+        const size_t n = l->get_n(), n_in = l->get_n_in();
+        std::span<float> w = l->mutable_weights();
+
+        if (mode == PruneMode::MAGNITUDE) {
+            size_t cut = size_t(sparsity * w.size());
+            if (cut == 0)
+                continue;
+            vector<uint32_t> idx(w.size());
+            iota(idx.begin(), idx.end(), 0);
+            nth_element(idx.begin(), idx.begin() + cut, idx.end(),
+                        [&](uint32_t a, uint32_t b) { return fabsf(w[a]) < fabsf(w[b]); });
+            for (size_t i = 0; i < cut; i++)
+                w[idx[i]] = 0.0f;
+            continue;
+        }
+
+        // block (r, j): rows 4r .. 4r+3 at input j, the last block row may be short
+        const size_t block_rows = (n + 3) / 4;
+        size_t cut = size_t(sparsity * block_rows * n_in);
+        if (cut == 0)
+            continue;
+        vector<float> score(block_rows * n_in, 0.0f);
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = 0; j < n_in; j++)
+                score[i / 4 * n_in + j] += fabsf(w[i * n_in + j]);
+
+        vector<uint32_t> idx(score.size());
+        iota(idx.begin(), idx.end(), 0);
+        nth_element(idx.begin(), idx.begin() + cut, idx.end(), [&](uint32_t a, uint32_t b) { return score[a] < score[b]; });
+        for (size_t c = 0; c < cut; c++) {
+            size_t r = idx[c] / n_in, j = idx[c] % n_in;
+            for (size_t i = 4 * r; i < min(n, 4 * r + 4); i++)
+                w[i * n_in + j] = 0.0f;
+        }
+    }
+
+    return 0;
+}
+
+
+SparseNetwork* SparseNetwork::convert(FullyConnectedNetwork& nn, const SparseConfig& cfg)
+{
+    if (nn.get_depth() < 2) {
+        LOG_ERROR("nothing to convert, the network has no trainable layers");
+        return nullptr;
+    }
+
+    SparseNetwork* sn = new SparseNetwork();
+    sn->n_inputs = nn.num_inputs();
+    sn->n_outputs = nn.num_outputs();
+
+    for (uint32_t k = 1; k < nn.get_depth(); k++) {
+        Layer* l = nn.get_layer(k);
+        SparseLayer sl;
+        sl.n = l->get_n();
+        sl.n_in = l->get_n_in();
+        sl.act = l->get_activation();
+        sl.b.assign(l->biases().begin(), l->biases().end());
+
+        std::span<const float> w = l->weights();
+        const size_t n = sl.n, n_in = sl.n_in;
+        sl.nnz = w.size() - count(w.begin(), w.end(), 0.0f);
+
+        size_t blocks = 0;
+        for (size_t r = 0; r < n; r += 4)
+            for (size_t j = 0; j < n_in; j++)
+                for (size_t i = r; i < min(n, r + 4); i++)
+                    if (w[i * n_in + j] != 0.0f) {
+                        blocks++;
+                        break;
+                    }
+
+        float sparsity = 1.0f - float(sl.nnz) / float(w.size());
+        if (sparsity < cfg.min_sparsity) {
+            sl.format = SparseFormat::DENSE;
+            sl.dense.assign(w.begin(), w.end());
+        } else if (blocks > 0 && float(sl.nnz) >= cfg.min_block_fill * 4 * blocks) {
+            sl.format = SparseFormat::BSR_4x1;
+            sl.ptr.push_back(0);
+            for (size_t r = 0; r < n; r += 4) {
+                for (size_t j = 0; j < n_in; j++) {
+                    float v[4] = {0, 0, 0, 0};
+                    bool any = false;
+                    for (size_t i = r; i < min(n, r + 4); i++) {
+                        v[i - r] = w[i * n_in + j];
+                        any |= v[i - r] != 0.0f;
+                    }
+                    if (!any)
+                        continue;
+                    sl.col.push_back(uint32_t(j));
+                    sl.val.insert(sl.val.end(), v, v + 4);
+                }
+                sl.ptr.push_back(uint32_t(sl.col.size()));
+            }
+        } else {
+            sl.format = SparseFormat::CSR;
+            sl.ptr.push_back(0);
+            for (size_t i = 0; i < n; i++) {
+                for (size_t j = 0; j < n_in; j++) {
+                    if (w[i * n_in + j] == 0.0f)
+                        continue;
+                    sl.col.push_back(uint32_t(j));
+                    sl.val.push_back(w[i * n_in + j]);
+                }
+                sl.ptr.push_back(uint32_t(sl.col.size()));
+            }
+        }
+
+        sn->layers.push_back(std::move(sl));
+    }
+
+    return sn;
+}
+
+
+// One sample: y = W x + b, y holds pad4(n) floats
+static void sparse_spmv(const SparseLayer& l, const float* x, float* y)
+{
+    switch (l.format) {
+    case SparseFormat::DENSE:
+        for (uint32_t i = 0; i < l.n; i++)
+            y[i] = simd_dot(l.dense.data() + size_t(i) * l.n_in, x, l.n_in) + l.b[i];
+        break;
+
+    case SparseFormat::CSR:
+        for (uint32_t i = 0; i < l.n; i++) {
+            // two sums so the gathers of the next nonzero don't wait on the add
+            float s0 = 0, s1 = 0;
+            uint32_t k = l.ptr[i], end = l.ptr[i + 1];
+            for (; k + 2 <= end; k += 2) {
+                s0 += l.val[k] * x[l.col[k]];
+                s1 += l.val[k + 1] * x[l.col[k + 1]];
+            }
+            if (k < end)
+                s0 += l.val[k] * x[l.col[k]];
+            y[i] = s0 + s1 + l.b[i];
+        }
+        break;
+
+    case SparseFormat::BSR_4x1:
+        for (uint32_t r = 0; r < l.ptr.size() - 1; r++) {
+            const float* v = l.val.data();
+#if defined(__SSE2__)
+            __m128 acc = _mm_setzero_ps();
+            for (uint32_t k = l.ptr[r]; k < l.ptr[r + 1]; k++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(v + 4 * size_t(k)), _mm_set1_ps(x[l.col[k]])));
+            _mm_storeu_ps(y + 4 * r, acc);
+#else
+            float acc[4] = {0, 0, 0, 0};
+            for (uint32_t k = l.ptr[r]; k < l.ptr[r + 1]; k++) {
+                float xv = x[l.col[k]];
+                for (int q = 0; q < 4; q++)
+                    acc[q] += v[4 * size_t(k) + q] * xv;
+            }
+            copy(acc, acc + 4, y + 4 * r);
+#endif
+            for (uint32_t i = 4 * r; i < min(l.n, 4 * r + 4); i++)
+                y[i] += l.b[i];
+        }
+        break;
+    }
+}
+
+// A batch, feature major: x is [n_in][ld], y is [pad4(n)][ld], rows columns of each are used
+static void sparse_spmm(const SparseLayer& l, const float* x, size_t rows, size_t ld, float* y)
+{
+    switch (l.format) {
+    case SparseFormat::DENSE:
+        for (uint32_t i = 0; i < l.n; i++) {
+            float* yi = y + i * ld;
+            fill(yi, yi + rows, l.b[i]);
+            const float* w = l.dense.data() + size_t(i) * l.n_in;
+            for (uint32_t j = 0; j < l.n_in; j++)
+                simd_axpy(w[j], x + j * ld, yi, rows);
+        }
+        break;
+
+    case SparseFormat::CSR:
+        for (uint32_t i = 0; i < l.n; i++) {
+            float* yi = y + i * ld;
+            fill(yi, yi + rows, l.b[i]);
+            for (uint32_t k = l.ptr[i]; k < l.ptr[i + 1]; k++)
+                simd_axpy(l.val[k], x + size_t(l.col[k]) * ld, yi, rows);
+        }
+        break;
+
+    case SparseFormat::BSR_4x1:
+        for (uint32_t r = 0; r < l.ptr.size() - 1; r++) {
+            float* y0 = y + 4 * r * ld;
+            float* y1 = y0 + ld;
+            float* y2 = y1 + ld;
+            float* y3 = y2 + ld;
+            for (uint32_t q = 0; q < 4; q++)
+                fill(y0 + q * ld, y0 + q * ld + rows, 4 * r + q < l.n ? l.b[4 * r + q] : 0.0f);
+
+            // one pass over the input row updates all 4 outputs
+            for (uint32_t k = l.ptr[r]; k < l.ptr[r + 1]; k++) {
+                const float* xr = x + size_t(l.col[k]) * ld;
+                const float* v = l.val.data() + 4 * size_t(k);
+                Vec v0 = Vec::set1(v[0]), v1 = Vec::set1(v[1]), v2 = Vec::set1(v[2]), v3 = Vec::set1(v[3]);
+                size_t t = 0;
+                for (; t + Vec::W <= rows; t += Vec::W) {
+                    Vec xv = Vec::load(xr + t);
+                    vfma(v0, xv, Vec::load(y0 + t)).store(y0 + t);
+                    vfma(v1, xv, Vec::load(y1 + t)).store(y1 + t);
+                    vfma(v2, xv, Vec::load(y2 + t)).store(y2 + t);
+                    vfma(v3, xv, Vec::load(y3 + t)).store(y3 + t);
+                }
+                for (; t < rows; t++) {
+                    y0[t] += v[0] * xr[t];
+                    y1[t] += v[1] * xr[t];
+                    y2[t] += v[2] * xr[t];
+                    y3[t] += v[3] * xr[t];
+                }
+            }
+        }
+        break;
+    }
+}
+
+// y is [n][ld] with rows columns used (ld = 1 for one sample)
+static void sparse_activate(float* y, uint32_t n, size_t rows, size_t ld, Activation act)
+{
+    switch (act) {
+    case Activation::SIGMOID:
+        for (uint32_t i = 0; i < n; i++)
+            for (size_t t = 0; t < rows; t++)
+                y[i * ld + t] = 1.0f / (1.0f + exp(-y[i * ld + t]));
+        break;
+    case Activation::RELU:
+        for (uint32_t i = 0; i < n; i++)
+            for (size_t t = 0; t < rows; t++)
+                y[i * ld + t] = max(0.0f, y[i * ld + t]);
+        break;
+    case Activation::SOFTMAX:
+        for (size_t t = 0; t < rows; t++) {
+            float mx = y[t];
+            for (uint32_t i = 1; i < n; i++)
+                mx = max(mx, y[i * ld + t]);
+            float sum = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                y[i * ld + t] = exp(y[i * ld + t] - mx);
+                sum += y[i * ld + t];
+            }
+            for (uint32_t i = 0; i < n; i++)
+                y[i * ld + t] /= sum;
+        }
+        break;
+    case Activation::NONE:
+        break;
+    }
+}
+
+
+SparseWorkspace SparseNetwork::make_workspace(size_t max_rows) const
+{
+    SparseWorkspace ws;
+    ws.max_rows = max_rows;
+    ws.a.emplace_back(pad4(this->n_inputs) * max_rows, 0.0f);
+    for (auto &l : this->layers)
+        ws.a.emplace_back(pad4(l.n) * max_rows, 0.0f);
+    return ws;
+}
+
+
+int SparseNetwork::forward(const float* x, size_t rows, float* y, SparseWorkspace& ws) const
+{
+    if (this->layers.empty() || rows == 0 || rows > ws.max_rows || ws.a.size() != this->layers.size() + 1) {
+        LOG_ERROR("batch of %zu rows doesn't fit the workspace (%zu rows)", rows, ws.max_rows);
+        return -1;
+    }
+
+    if (rows == 1) {
+        const float* in = x;
+        for (size_t k = 0; k < this->layers.size(); k++) {
+            sparse_spmv(this->layers[k], in, ws.a[k + 1].data());
+            sparse_activate(ws.a[k + 1].data(), this->layers[k].n, 1, 1, this->layers[k].act);
+            in = ws.a[k + 1].data();
+        }
+        copy(in, in + this->n_outputs, y);
+        return 0;
+    }
+
+    // transposed in and out, the stride is the workspace's row count
+    const size_t ld = ws.max_rows;
+    for (size_t t = 0; t < rows; t++)
+        for (uint32_t j = 0; j < this->n_inputs; j++)
+            ws.a[0][j * ld + t] = x[t * this->n_inputs + j];
+
+    for (size_t k = 0; k < this->layers.size(); k++) {
+        sparse_spmm(this->layers[k], ws.a[k].data(), rows, ld, ws.a[k + 1].data());
+        sparse_activate(ws.a[k + 1].data(), this->layers[k].n, rows, ld, this->layers[k].act);
+    }
+
+    const float* out = ws.a.back().data();
+    for (size_t t = 0; t < rows; t++)
+        for (uint32_t i = 0; i < this->n_outputs; i++)
+            y[t * this->n_outputs + i] = out[i * ld + t];
+    return 0;
+}
+
+
+size_t SparseNetwork::size_bytes() const
+{
+    size_t bytes = 0;
+    for (auto &l : this->layers)
+        bytes += (l.dense.size() + l.val.size() + l.b.size()) * sizeof(float) +
+                 (l.ptr.size() + l.col.size()) * sizeof(uint32_t);
+    return bytes;
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "../include/topk.hpp"
+#include "../include/log.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+
+// Turning network outputs into predictions only ever needs the best k of them,
+// but sorting the whole row costs O(n log n) and moves every element.
+//
+// For small k (the usual case: top 10 of 100k classes) we keep a min-heap of the k best so far.
+// Its root is the threshold a score has to beat to get in. After the first few thousand elements
+// almost nothing beats it, so the scan compares a whole SIMD register of scores against the threshold
+// at once and only falls into the heap code for the rare lanes that pass.
+// That makes the row scan run at close to memory bandwidth.
+//
+// For large k (a sizeable fraction of the row) the heap stops paying off and
+// we partition with quickselect (nth_element) and sort only the first k.
+
+struct Candidate {
+    float    val;
+    uint32_t idx;
+};
+
+// a is a better candidate than b: higher score, or same score and lower index
+static inline bool better(const Candidate& a, const Candidate& b)
+{
+    return a.val > b.val || (a.val == b.val && a.idx < b.idx);
+}
+
+
+// Replace the root (the worst of the k best) and sift it down
+static inline void heap_replace_top(Candidate* heap, uint32_t k, Candidate c)
+{
+    uint32_t i = 0;
+    while (true) {
+        uint32_t child = 2 * i + 1;
+        if (child >= k)
+            break;
+        if (child + 1 < k && better(heap[child], heap[child + 1]))
+            child++;
+        if (!better(c, heap[child]))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = c;
+}
+
+static inline void heap_offer(Candidate* heap, uint32_t k, const float* row, uint32_t j)
+{
+    if (row[j] > heap[0].val)
+        heap_replace_top(heap, k, Candidate{row[j], j});
+}
+
+
+// Scanning in increasing index order, a later score equal to the threshold always loses
+// the tie, so the filter can use a strict greater-than.
+static void topk_heap_row(const float* row, uint32_t cols, uint32_t k, Candidate* heap)
+{
+    uint32_t j;
+
+    for (j = 0; j < k; j++)
+        heap[j] = Candidate{row[j], j};
+    // min-heap on "better": the root is the worst candidate
+    make_heap(heap, heap + k, better);
+
+#if defined(__AVX__)
+    for (; j + 8 <= cols; j += 8) {
+        __m256 v = _mm256_loadu_ps(row + j);
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_set1_ps(heap[0].val), _CMP_GT_OQ));
+        while (mask != 0) {
+            heap_offer(heap, k, row, j + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    for (; j + 4 <= cols; j += 4) {
+        __m128 v = _mm_loadu_ps(row + j);
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(v, _mm_set1_ps(heap[0].val)));
+        while (mask != 0) {
+            heap_offer(heap, k, row, j + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (; j + 4 <= cols; j += 4) {
+        uint32x4_t gt = vcgtq_f32(vld1q_f32(row + j), vdupq_n_f32(heap[0].val));
+        if (vmaxvq_u32(gt) == 0)
+            continue;
+        for (uint32_t l = 0; l < 4; l++)
+            heap_offer(heap, k, row, j + l);
+    }
+#endif
+    for (; j < cols; j++)
+        heap_offer(heap, k, row, j);
+
+    sort(heap, heap + k, better);
+}
+
+
+static void topk_select_row(const float* row, uint32_t cols, uint32_t k, vector<Candidate>& all)
+{
+    for (uint32_t j = 0; j < cols; j++)
+        all[j] = Candidate{row[j], j};
+    nth_element(all.begin(), all.begin() + (k - 1), all.end(), better);
+    sort(all.begin(), all.begin() + k, better);
+}
+
+
+int topk(const float* scores, uint32_t rows, uint32_t cols, uint32_t k, uint32_t* idx, float* vals)
+{
+    if (scores == nullptr || idx == nullptr || vals == nullptr) {
+        LOG_ERROR("topk: null input or output");
+        return -1;
+    }
+    if (k == 0 || k > cols) {
+        LOG_ERROR("topk: k=%u must be in [1, %u]", k, cols);
+        return -1;
+    }
+
+    // quickselect once k is more than ~1/16 of the row
+    bool use_heap = (uint64_t)k * 16 <= cols;
+    vector<Candidate> buf(use_heap ? k : cols);
+
+    for (uint32_t r = 0; r < rows; r++) {
+        const float* row = scores + (size_t)r * cols;
+        if (use_heap) {
+            topk_heap_row(row, cols, k, buf.data());
+        } else {
+            topk_select_row(row, cols, k, buf);
+        }
+        for (uint32_t i = 0; i < k; i++) {
+            idx[(size_t)r * k + i]  = buf[i].idx;
+            vals[(size_t)r * k + i] = buf[i].val;
+        }
+    }
+    return 0;
+}
+
+
+int topk(const matrix_f32_t& scores, uint32_t k, vector<vector<uint32_t>>& idx, matrix_f32_t& vals)
+{
+    idx.assign(scores.size(), vector<uint32_t>(k));
+    vals.assign(scores.size(), vector<float>(k));
+
+    for (size_t r = 0; r < scores.size(); r++) {
+        if (topk(scores[r].data(), 1, scores[r].size(), k, idx[r].data(), vals[r].data()) != 0)
+            return -1;
+    }
+    return 0;
+}
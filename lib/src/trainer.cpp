@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <numeric>
+#include "../include/trainer.hpp"
+#include "../include/log.hpp"
+#include "../include/parallel.hpp"
+#include "../include/simd.hpp"
+#include "../../utils/trace.h"
+
+using namespace std;
+
+
+DataParallelTrainer::DataParallelTrainer(FullyConnectedNetwork& nn, Optimizer& opt, tpool_t* pool, size_t num_workers,
+                                         uint32_t seed): nn(nn),
+                                                         opt(opt),
+                                                         pool(pool),
+                                                         num_workers(num_workers > 0 ? num_workers : 1),
+                                                         gen(seed)
+{
+    for (size_t w = 0; w < this->num_workers; w++) {
+        this->ws.push_back(nn.make_workspace());
+        this->grads.push_back(make_unique<ParamBuffer>(nn.num_params()));
+    }
+}
+
+
+void DataParallelTrainer::reduce_grads(float scale)
+{
+    size_t n = this->nn.num_params();
+    float* out = this->nn.grad_data();
+    size_t per = ParamBuffer::aligned_size((n + this->num_workers - 1) / this->num_workers);
+
+    parallel_run(this->pool, this->num_workers, [&](size_t k) {
+        size_t begin = min(k * per, n);
+        size_t end = min(begin + per, n);
+        Vec s = Vec::set1(scale), zero = Vec::set1(0.0f);
+        size_t i = begin;
+
+        for (; i + Vec::W <= end; i += Vec::W) {
+            Vec sum = zero;
+            for (auto &g : this->grads) {
+                sum = sum + Vec::load(g->data() + i);
+                zero.store(g->data() + i);
+            }
+            (sum * s).store(out + i);
+        }
+        for (; i < end; i++) {
+            float sum = 0;
+            for (auto &g : this->grads) {
+                sum += g->data()[i];
+                g->data()[i] = 0.0f;
+            }
+            out[i] = sum * scale;
+        }
+    });
+}
+
+
+float DataParallelTrainer::train_batch(const float* x, const uint32_t* labels, size_t batch, const uint32_t* idx)
+{
+    if (x == nullptr || labels == nullptr || batch == 0) {
+        LOG_ERROR("empty batch");
+        return -1;
+    }
+    if (this->mode != TrainMode::SYNC) {
+        LOG_ERROR("train_batch is for SYNC mode, use train_epoch");
+        return -1;
+    }
+    if (this->grads.empty() || this->grads[0]->size() != this->nn.num_params()) {
+        LOG_ERROR("network changed shape after the trainer was created");
+        return -1;
+    }
+
+    TRACE_SPAN("trainer", "train_batch", "samples", batch);
+    size_t n_in = this->nn.num_inputs();
+    size_t workers = min(this->num_workers, batch);
+    vector<double> losses(workers * 8, 0.0);     // a cache line per worker
+    vector<int> failed(workers * 16, 0);
+
+    parallel_run(this->pool, workers, [&](size_t k) {
+        TRACE_SPAN("trainer", "shard", "worker", k);
+        size_t begin = batch * k / workers;
+        size_t end = batch * (k + 1) / workers;
+        double loss = 0;
+
+        for (size_t i = begin; i < end; i++) {
+            size_t s = idx != nullptr ? idx[i] : i;
+            float l = this->nn.backprop(x + s * n_in, labels[s], this->ws[k], this->grads[k]->data());
+            if (l < 0) {
+                failed[k * 16] = 1;
+                return;
+            }
+            loss += l;
+        }
+        losses[k * 8] = loss;
+    });
+
+    for (size_t k = 0; k < workers; k++) {
+        if (failed[k * 16]) {
+            // drop the partial sums so the next batch starts clean
+            for (auto &g : this->grads)
+                fill(g->data(), g->data() + g->size(), 0.0f);
+            return -1;
+        }
+    }
+
+    {
+        TRACE_SPAN("trainer", "reduce_grads");
+        reduce_grads(1.0f / float(batch));
+    }
+    {
+        TRACE_SPAN("trainer", "optimizer step");
+        if (this->opt.step(this->nn) != 0)
+            return -1;
+    }
+
+    double total = 0;
+    for (size_t k = 0; k < workers; k++)
+        total += losses[k * 8];
+    return float(total / batch);
+}
+
+
+float DataParallelTrainer::train_epoch(const float* x, const uint32_t* labels, size_t n, size_t batch_size)
+{
+    if (n == 0 || batch_size == 0) {
+        LOG_ERROR("empty epoch");
+        return -1;
+    }
+
+    this->order.resize(n);
+    iota(this->order.begin(), this->order.end(), 0);
+    shuffle(this->order.begin(), this->order.end(), this->gen);
+
+    if (this->mode == TrainMode::HOGWILD)
+        return hogwild_epoch(x, labels, n, batch_size);
+
+    auto start = chrono::steady_clock::now();
+    this->stats = TrainStats();
+
+    double total = 0;
+    for (size_t i = 0; i < n; i += batch_size) {
+        size_t batch = min(batch_size, n - i);
+        float loss = train_batch(x, labels, batch, this->order.data() + i);
+        if (loss < 0)
+            return -1;
+        total += double(loss) * batch;
+        this->stats.updates++;
+    }
+
+    this->stats.samples = n;
+    this->stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return float(total / n);
+}
+
+
+// Per worker counters, each on its own cache line
+struct alignas(64) HogwildCounters
+{
+    double   loss = 0;
+    size_t   updates = 0;
+    uint64_t staleness = 0;
+    uint64_t max_staleness = 0;
+    bool     failed = false;
+};
+
+float DataParallelTrainer::hogwild_epoch(const float* x, const uint32_t* labels, size_t n, size_t batch_size)
+{
+    const OptimizerConfig& cfg = this->opt.get_config();
+    const float clip = cfg.clip_value > 0.0f ? cfg.clip_value : numeric_limits<float>::infinity();
+    const size_t n_in = this->nn.num_inputs();
+    const size_t num_params = this->nn.num_params();
+    float* params = this->nn.mutable_param_data();
+
+    // Global count of applied updates: a worker's staleness is how far it moved while the worker computed
+    atomic<uint64_t> version(0);
+    uint64_t step0 = this->opt.get_step();
+    vector<HogwildCounters> counters(this->num_workers);
+
+    auto start = chrono::steady_clock::now();
+
+    parallel_run(this->pool, this->num_workers, [&](size_t k) {
+        HogwildCounters& c = counters[k];
+        float* g = this->grads[k]->data();
+        size_t begin = n * k / this->num_workers;
+        size_t end = n * (k + 1) / this->num_workers;
+
+        for (size_t i = begin; i < end; i += batch_size) {
+            TRACE_SPAN("trainer", "hogwild batch", "worker", k);
+            size_t batch = min(batch_size, end - i);
+            uint64_t seen = version.load(memory_order_relaxed);
+
+            for (size_t j = i; j < i + batch; j++) {
+                uint32_t s = this->order[j];
+                float l = this->nn.backprop(x + s * n_in, labels[s], this->ws[k], g);
+                if (l < 0) {
+                    c.failed = true;
+                    fill(g, g + num_params, 0.0f);
+                    return;
+                }
+                c.loss += l;
+            }
+
+            uint64_t now = version.fetch_add(1, memory_order_relaxed);
+            float lr = this->opt.learning_rate(step0 + now);
+            float scale = 1.0f / float(batch);
+
+            // Lock free update of the shared weights. The zero entries (inputs that were 0,
+            // relus that were off) are skipped so sparse gradients touch few cache lines,
+            // which also makes the weight decay lazy: it only hits weights that got a gradient.
+            for (size_t p = 0; p < num_params; p++) {
+                if (g[p] == 0.0f)
+                    continue;
+                atomic_ref<float> w(params[p]);
+                float cur = w.load(memory_order_relaxed);
+                float grad = min(max(g[p] * scale, -clip), clip) + cfg.weight_decay * cur;
+                w.store(cur - lr * grad, memory_order_relaxed);
+                g[p] = 0.0f;
+            }
+
+            c.updates++;
+            c.staleness += now - seen;
+            c.max_staleness = max(c.max_staleness, now - seen);
+        }
+    });
+
+    this->stats = TrainStats();
+    this->stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    this->stats.samples = n;
+
+    double total = 0;
+    uint64_t staleness = 0;
+    for (auto &c : counters) {
+        if (c.failed)
+            return -1;
+        total += c.loss;
+        this->stats.updates += c.updates;
+        staleness += c.staleness;
+        this->stats.max_staleness = max(this->stats.max_staleness, c.max_staleness);
+    }
+    if (this->stats.updates > 0)
+        this->stats.mean_staleness = double(staleness) / this->stats.updates;
+    this->opt.skip_steps(this->stats.updates);
+
+    return float(total / n);
+}
+
+
+float DataParallelTrainer::accuracy(const float* x, const uint32_t* labels, size_t n)
+{
+    if (n == 0)
+        return 0;
+
+    size_t n_in = this->nn.num_inputs();
+    size_t workers = min(this->num_workers, n);
+    vector<size_t> correct(workers * 8, 0);
+
+    parallel_run(this->pool, workers, [&](size_t k) {
+        size_t hits = 0;
+        for (size_t i = n * k / workers; i < n * (k + 1) / workers; i++) {
+            this->nn.forward(x + i * n_in, this->ws[k]);
+            const vector<float>& out = this->ws[k].a.back();
+            if (size_t(max_element(out.begin(), out.end()) - out.begin()) == labels[i])
+                hits++;
+        }
+        correct[k * 8] = hits;
+    });
+
+    size_t total = 0;
+    for (size_t k = 0; k < workers; k++)
+        total += correct[k * 8];
+    return float(total) / float(n);
+}
@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "sorting.h"
+#include "tpool.h"
+
+
+using namespace std;
+
+
+// Benchmark of the sorts in utils/sorting against std::sort.
+// usage: bench_sorting [num_elements...]   e.g. bench_sorting 1000000 100000000 1000000000
+
+
+static int cmp_float(const void *a, const void *b)
+{
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+template <class F>
+static double time_ms(F&& f)
+{
+    auto start = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    vector<size_t> sizes;
+    size_t         num_threads = max(2u, thread::hardware_concurrency());
+    bool           is_passed = true;
+    mt19937_64     gen(42);
+
+    for (int i = 1; i < argc; i++)
+        sizes.push_back(strtoull(argv[i], NULL, 10));
+    if (sizes.empty())
+        sizes.push_back(1000000);
+
+    tpool_t *tm = tpool_create(num_threads);
+
+    for (size_t n : sizes) {
+        printf("[!] Sorting %zu float scores (%zu threads)\n", n, num_threads);
+        normal_distribution<float> dist(0.0f, 10.0f);
+        vector<float>    scores(n);
+        vector<float>    expected;
+        vector<float>    work;
+        vector<uint32_t> ids(n);
+
+        for (auto& s : scores)
+            s = dist(gen);
+
+        expected = scores;
+        printf("[*] std::sort:            %9.1f ms\n", time_ms([&] { sort(expected.begin(), expected.end()); }));
+
+        work = scores;
+        printf("[*] merge_sort:           %9.1f ms\n",
+            time_ms([&] { merge_sort(work.data(), n, sizeof(float), cmp_float); }));
+        is_passed &= work == expected;
+
+        work = scores;
+        printf("[*] merge_sort_parallel:  %9.1f ms\n",
+            time_ms([&] { merge_sort_parallel(work.data(), n, sizeof(float), cmp_float, tm, num_threads); }));
+        is_passed &= work == expected;
+
+        work = scores;
+        for (size_t i = 0; i < n; i++)
+            ids[i] = (uint32_t)i;
+        printf("[*] radix_sort_f32 (+ids):%9.1f ms\n", time_ms([&] { is_passed &= radix_sort_f32(work.data(), ids.data(), n) == 0; }));
+        is_passed &= work == expected;
+        for (size_t i = 0; i < n && is_passed; i++)
+            is_passed = scores[ids[i]] == work[i];
+
+        vector<uint64_t> keys(n);
+        vector<uint64_t> keys_expected;
+        for (auto& k : keys)
+            k = gen();
+        keys_expected = keys;
+        printf("[*] std::sort (u64):      %9.1f ms\n",
+            time_ms([&] { sort(keys_expected.begin(), keys_expected.end()); }));
+        printf("[*] radix_sort_u64:       %9.1f ms\n", time_ms([&] { is_passed &= radix_sort_u64(keys.data(), NULL, n) == 0; }));
+        is_passed &= keys == keys_expected;
+
+        printf("[!] Finished sorting %zu elements with result: [%s]\n\n", n, is_passed ? "PASSED": "FAILED");
+    }
+
+    tpool_destroy(tm);
+    return 0;
+}
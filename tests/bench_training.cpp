@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/trainer.hpp"
+#include "../lib/include/mnist_loader.hpp"
+
+
+using namespace std;
+
+
+// Convergence per wall-clock second of synchronous data-parallel training against Hogwild.
+// usage: bench_training [mnist_dir|-] [num_workers] [epochs]
+// mnist_dir holds train-images-idx3-ubyte, train-labels-idx1-ubyte, t10k-images-idx3-ubyte and t10k-labels-idx1-ubyte.
+// With "-" (or no args) a synthetic sparse data set of the same shape is used.
+
+
+// Sparse synthetic digits: every class lights up its own random ~20% of the pixels
+static void make_sparse(size_t n, vector<float>& x, vector<uint32_t>& labels, uint32_t seed)
+{
+    mt19937 gen(seed);
+    mt19937 pattern_gen(1);
+    uniform_real_distribution<float> u(0.0f, 1.0f);
+    vector<float> patterns(10 * MNIST_IMAGE_SIZE);
+    for (auto& p : patterns)
+        p = u(pattern_gen) < 0.2f ? u(pattern_gen) : 0.0f;
+
+    x.resize(n * MNIST_IMAGE_SIZE);
+    labels.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        labels[i] = gen() % 10;
+        for (uint32_t j = 0; j < MNIST_IMAGE_SIZE; j++) {
+            float p = patterns[labels[i] * MNIST_IMAGE_SIZE + j];
+            // drop half of the lit pixels and add a little noise to them
+            x[i * MNIST_IMAGE_SIZE + j] = (p > 0.0f && u(gen) < 0.5f) ? min(1.0f, p + 0.3f * u(gen)) : 0.0f;
+        }
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    string mnist_dir = argc > 1 ? argv[1] : "-";
+    size_t num_workers = argc > 2 ? strtoul(argv[2], NULL, 10) : max(1u, thread::hardware_concurrency());
+    int epochs = argc > 3 ? atoi(argv[3]) : 5;
+    size_t batch_size = 32;
+
+    vector<float> train_x, test_x;
+    vector<uint32_t> train_y, test_y;
+    if (mnist_dir != "-") {
+        MNSITLoader train(mnist_dir + "/train-images-idx3-ubyte", mnist_dir + "/train-labels-idx1-ubyte");
+        MNSITLoader test(mnist_dir + "/t10k-images-idx3-ubyte", mnist_dir + "/t10k-labels-idx1-ubyte");
+        train.load(train_x, train_y);
+        test.load(test_x, test_y);
+    } else {
+        make_sparse(60000, train_x, train_y, 2);
+        make_sparse(10000, test_x, test_y, 3);
+    }
+    printf("[*] %zu train / %zu test samples, %zu workers, batch %zu\n", train_y.size(), test_y.size(), num_workers, batch_size);
+
+    tpool_t* pool = tpool_create(num_workers);
+
+    FullyConnectedNetwork base;
+    base.add_layer(MNIST_IMAGE_SIZE, false, 0, "input");
+    base.add_layer(128, true, 1, "hidden", Activation::RELU);
+    base.add_layer(10, true, 2, "output", Activation::SOFTMAX);
+
+    for (TrainMode mode : {TrainMode::SYNC, TrainMode::HOGWILD}) {
+        const char* name = mode == TrainMode::SYNC ? "sync" : "hogwild";
+        FullyConnectedNetwork nn(base);      // same starting weights for both modes
+
+        OptimizerConfig cfg;
+        cfg.lr = 0.05f;
+        cfg.momentum = 0.0f;
+        Optimizer opt(cfg, pool, num_workers);
+        DataParallelTrainer trainer(nn, opt, pool, num_workers, 1);
+        trainer.set_mode(mode);
+
+        printf("[!] Benchmarking %s training\n", name);
+        printf("    epoch    wall s   samples/s   updates/s   staleness (mean / max)    loss   test acc\n");
+        double wall = 0;
+        for (int e = 1; e <= epochs; e++) {
+            float loss = trainer.train_epoch(train_x.data(), train_y.data(), train_y.size(), batch_size);
+            const TrainStats& s = trainer.get_stats();
+            wall += s.seconds;
+            float acc = trainer.accuracy(test_x.data(), test_y.data(), test_y.size());
+            printf("    %5d  %8.2f  %10.0f  %10.0f   %8.2f / %-8lu    %7.4f  %.4f\n", e, wall, s.samples_per_sec(),
+                   s.updates_per_sec(), s.mean_staleness, (unsigned long)s.max_staleness, loss, acc);
+        }
+    }
+
+    tpool_destroy(pool);
+
+    return 0;
+}
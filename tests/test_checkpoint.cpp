@@ -0,0 +1,268 @@
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../lib/include/checkpoint.hpp"
+
+
+using namespace std;
+
+
+static FullyConnectedNetwork* make_network(uint32_t width)
+{
+    FullyConnectedNetwork* nn = new FullyConnectedNetwork();
+    nn->add_layer(width, false, 0, "input");
+    nn->add_layer(width, true, 1, "hidden", Activation::RELU);
+    nn->add_layer(10, true, 2, "output", Activation::SOFTMAX);
+    return nn;
+}
+
+// A few steps of training on random samples
+static void train(FullyConnectedNetwork* nn, Optimizer& opt, mt19937& gen, int steps)
+{
+    uniform_real_distribution<float> dist(0.0f, 1.0f);
+    Workspace ws = nn->make_workspace();
+    vector<float> x(nn->num_inputs());
+
+    for (int s = 0; s < steps; s++) {
+        for (auto& v : x)
+            v = dist(gen);
+        nn->zero_grads();
+        nn->backprop(x.data(), gen() % 10, ws, nn->grad_data());
+        opt.step(*nn);
+    }
+}
+
+static vector<string> list_dir(const string& dir)
+{
+    vector<string> names;
+    DIR* d = opendir(dir.c_str());
+    struct dirent* e;
+    while (d != nullptr && (e = readdir(d)) != nullptr) {
+        if (e->d_name[0] != '.')
+            names.push_back(e->d_name);
+    }
+    if (d != nullptr)
+        closedir(d);
+    sort(names.begin(), names.end());
+    return names;
+}
+
+static void clear_dir(const string& dir)
+{
+    for (auto& name : list_dir(dir))
+        unlink((dir + "/" + name).c_str());
+    mkdir(dir.c_str(), 0755);
+}
+
+static off_t file_size(const string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+static bool same_state(const Optimizer& a, const Optimizer& b)
+{
+    if (a.state_size() != b.state_size() || a.get_step() != b.get_step())
+        return false;
+    vector<float> sa(a.state_size()), sb(b.state_size());
+    a.export_state(sa.data());
+    b.export_state(sb.data());
+    return sa == sb;
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    string dir = (argc > 1) ? argv[1] : "/tmp/test_checkpoint";
+    uint32_t big_width = (argc > 2) ? strtoul(argv[2], NULL, 10) : 2048;
+    bool is_passed = true;
+    mt19937 gen(1);
+
+    OptimizerConfig adam;
+    adam.type = OptimizerType::ADAM;
+    adam.lr = 0.001f;
+
+    printf("[!] Testing checkpoint round trip with optimizer state\n");
+    {
+        clear_dir(dir);
+        FullyConnectedNetwork* nn = make_network(64);
+        Optimizer opt(adam);
+        CheckpointConfig cfg;
+        cfg.dir = dir;
+        cfg.keep = 2;
+
+        {
+            CheckpointWriter writer(cfg);
+            for (int i = 0; i < 5; i++) {
+                train(nn, opt, gen, 3);
+                is_passed &= writer.save(*nn, &opt, 100 + i) == 0;
+                is_passed &= writer.wait() == 0;
+            }
+            is_passed &= writer.get_stats().written == 5;
+        }
+
+        vector<string> names = list_dir(dir);
+        is_passed &= names.size() == 2 && names[0] == "ckpt-0000000003.ckpt" && names[1] == "ckpt-0000000004.ckpt";
+
+        Optimizer restored_opt(adam);
+        uint64_t step = 0;
+        FullyConnectedNetwork* restored = CheckpointWriter::restore(dir, "ckpt", &restored_opt, &step);
+        if (restored == nullptr) {
+            is_passed = false;
+        } else {
+            is_passed &= step == 104;
+            is_passed &= restored->num_params() == nn->num_params();
+            is_passed &= equal(nn->param_data(), nn->param_data() + nn->num_params(), restored->param_data());
+            is_passed &= same_state(opt, restored_opt);
+
+            // training goes on the same from the restored copy
+            mt19937 g1(7), g2(7);
+            train(nn, opt, g1, 2);
+            train(restored, restored_opt, g2, 2);
+            is_passed &= equal(nn->param_data(), nn->param_data() + nn->num_params(), restored->param_data());
+        }
+        delete restored;
+
+        // a state size that wraps around when turned into bytes: skipped for the checkpoint before
+        {
+            string newest = dir + "/ckpt-0000000004.ckpt";
+            int fd = open(newest.c_str(), O_RDWR);
+            ModelHeader h;
+            pread(fd, &h, sizeof(h), 0);
+            uint64_t state_size = uint64_t(1) << 62;
+            pwrite(fd, &state_size, sizeof(state_size),
+                   h.params_offset + h.params_size * sizeof(float) + offsetof(CheckpointTrailer, state_size));
+            close(fd);
+        }
+        restored = CheckpointWriter::restore(dir, "ckpt", nullptr, &step);
+        is_passed &= restored != nullptr && step == 103;
+        delete restored;
+
+        // a new writer carries on the numbering
+        {
+            CheckpointWriter writer(cfg);
+            writer.save(*nn, &opt, 200);
+            is_passed &= writer.wait() == 0;
+        }
+        names = list_dir(dir);
+        is_passed &= names.size() == 2 && names[1] == "ckpt-0000000005.ckpt";
+        delete nn;
+    }
+    printf("[*] round trip %s\n", is_passed ? "ok" : "failed");
+
+    printf("[!] Testing delta checkpoints\n");
+    {
+        clear_dir(dir);
+        FullyConnectedNetwork* nn = make_network(512);
+        CheckpointConfig cfg;
+        cfg.dir = dir;
+        cfg.delta = true;
+        cfg.full_every = 4;
+        cfg.keep = 3;
+        cfg.block_floats = 1024;
+
+        vector<vector<float>> images;
+        {
+            CheckpointWriter writer(cfg);
+            for (int i = 0; i < 6; i++) {
+                // touch a couple of weights only, as frozen layers would
+                nn->mutable_param_data()[(i * 7919) % nn->num_params()] += 1.0f;
+                nn->mutable_param_data()[nn->num_params() - 1] += 0.5f;
+                images.emplace_back(nn->param_data(), nn->param_data() + nn->num_params());
+                writer.save(*nn, nullptr, i);
+                is_passed &= writer.wait() == 0;
+                CheckpointStats stats = writer.get_stats();
+                if (i % 4 != 0)
+                    is_passed &= stats.last_bytes <= sizeof(CheckpointHeader) + 64 + 2 * 1024 * sizeof(float);
+            }
+        }
+
+        // 0 full, 1-3 deltas, 4 full, 5 delta: keeping 3 keeps 3, 4 and 5 plus 0-2 that 3 builds on
+        vector<string> names = list_dir(dir);
+        is_passed &= names.size() == 6;
+        is_passed &= names.size() == 6 && names[3] == "ckpt-0000000003.delta" && names[4] == "ckpt-0000000004.ckpt";
+        printf("[*] full %lld bytes, delta %lld bytes\n", (long long)file_size(dir + "/ckpt-0000000004.ckpt"),
+               (long long)file_size(dir + "/ckpt-0000000005.delta"));
+
+        uint64_t step = 0;
+        FullyConnectedNetwork* restored = CheckpointWriter::restore(dir, "ckpt", nullptr, &step);
+        is_passed &= restored != nullptr && step == 5 &&
+                     equal(images[5].begin(), images[5].end(), restored->param_data());
+        delete restored;
+
+        // damaged newest delta: falls back to the full one before it
+        int fd = open((dir + "/ckpt-0000000005.delta").c_str(), O_RDWR);
+        char c = 0x55;
+        pwrite(fd, &c, 1, file_size(dir + "/ckpt-0000000005.delta") - 1);
+        close(fd);
+        restored = CheckpointWriter::restore(dir, "ckpt", nullptr, &step);
+        is_passed &= restored != nullptr && step == 4 &&
+                     equal(images[4].begin(), images[4].end(), restored->param_data());
+        delete restored;
+
+        // the deltas of the older chain apply too
+        unlink((dir + "/ckpt-0000000004.ckpt").c_str());
+        unlink((dir + "/ckpt-0000000005.delta").c_str());
+        restored = CheckpointWriter::restore(dir, "ckpt", nullptr, &step);
+        is_passed &= restored != nullptr && step == 3 &&
+                     equal(images[3].begin(), images[3].end(), restored->param_data());
+        delete restored;
+        delete nn;
+    }
+    printf("[*] delta %s\n", is_passed ? "ok" : "failed");
+
+    printf("[!] Testing training stall of a checkpoint\n");
+    {
+        clear_dir(dir);
+        FullyConnectedNetwork* nn = make_network(big_width);
+        Optimizer opt(adam);
+        mt19937 g(3);
+        train(nn, opt, g, 1);
+
+        auto start = chrono::steady_clock::now();
+        is_passed &= nn->save(dir + "/sync.snn") == 0;
+        double sync_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        CheckpointConfig cfg;
+        cfg.dir = dir;
+        CheckpointWriter writer(cfg);
+        is_passed &= writer.save(*nn, &opt, 1) == 0;
+        // the previous one is still being written
+        int again = writer.save(*nn, &opt, 2);
+        is_passed &= writer.wait() == 0;
+        CheckpointStats stats = writer.get_stats();
+
+        printf("[*] %zu params + %zu state floats\n", nn->num_params(), opt.state_size());
+        printf("[*] synchronous save of the params: %.2f ms\n", sync_ms);
+        printf("[*] checkpoint: training blocked %.2f ms, background write %.2f ms (%llu bytes), second save %s\n",
+               stats.last_snapshot_ms, stats.last_write_ms, (unsigned long long)stats.last_bytes,
+               again == 1 ? "skipped" : "queued");
+        // the timings depend on the page cache and page faults, they are only printed
+        is_passed &= stats.written == (again == 1 ? 1 : 2) && stats.skipped == (again == 1 ? 1 : 0);
+        string last;
+        for (auto& name : list_dir(dir)) {
+            if (name.rfind("ckpt-", 0) == 0)
+                last = name;
+        }
+        is_passed &= !last.empty() && file_size(dir + "/" + last) == off_t(stats.last_bytes);
+        delete nn;
+    }
+
+    clear_dir(dir);
+    rmdir(dir.c_str());
+
+    printf("[!] Finished checkpoint tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <utility>
+#include <vector>
+#include "htable.h"
+#include "hash_map.hpp"
+#include "list.hpp"
+
+
+using namespace std;
+
+
+static unsigned int hash_int_key(const void *in, unsigned int seed)
+{
+    return HashMix<size_t>{}((size_t)in ^ seed);
+}
+
+static bool eq_int_key(const void *a, const void *b)
+{
+    return a == b;
+}
+
+static double elapsed_ms(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t num_keys = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    bool   is_passed = true;
+
+    printf("[!] Testing HashMap against the htable callback path: %zu keys\n", num_keys);
+    HashMap<size_t, size_t> map;
+    htable_t *ht = htable_create(hash_int_key, eq_int_key, NULL);
+    size_t    found = 0;
+
+    map.reserve(num_keys);
+    htable_reserve(ht, num_keys);
+    for (size_t k = 1; k <= num_keys; k++) {
+        map.insert(k, k * 2);
+        htable_insert(ht, (void *)k, (void *)(k * 2));
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (size_t k = 1; k <= num_keys; k++)
+        found += htable_get_direct(ht, (void *)k) == (void *)(k * 2);
+    double t_htable = elapsed_ms(start);
+
+    start = chrono::steady_clock::now();
+    for (size_t k = 1; k <= num_keys; k++) {
+        const size_t *v = map.find(k);
+        found += v != nullptr && *v == k * 2;
+    }
+    double t_map = elapsed_ms(start);
+
+    printf("[*] htable (callbacks): %.1f ms, HashMap (inlined): %.1f ms, speedup %.2fx\n",
+        t_htable, t_map, t_htable / t_map);
+    if (found != 2 * num_keys)
+        is_passed = false;
+
+    for (size_t k = 1; k <= num_keys; k += 2)
+        map.remove(k);
+    for (size_t k = 1; k <= num_keys && is_passed; k++) {
+        if (map.contains(k) != (k % 2 == 0))
+            is_passed = false;
+    }
+    found = 0;
+    map.for_each([&](const size_t& k, size_t& v) { found += v == k * 2; });
+    if (found != num_keys / 2 || map.size() != num_keys / 2)
+        is_passed = false;
+
+    // moved-from maps are empty and still usable
+    HashMap<size_t, size_t> moved(std::move(map));
+    if (moved.size() != num_keys / 2 || !moved.contains(2) || map.size() != 0 || map.contains(2))
+        is_passed = false;
+    map.insert(3, 6);
+    map.remove(5);
+    if (map.size() != 1 || map.find(3) == nullptr || *map.find(3) != 6)
+        is_passed = false;
+    moved = std::move(map);
+    if (moved.size() != 1 || !moved.contains(3) || moved.contains(2) || map.size() != 0 || map.contains(3))
+        is_passed = false;
+    map.reserve(100);
+    map.insert(7, 14);
+    if (!map.contains(7))
+        is_passed = false;
+
+    htable_destroy(ht);
+    printf("[!] Finished HashMap test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+
+
+    printf("[!] Testing sorted List\n");
+    List<int> l(LIST_SORT);
+    size_t    idx = 0;
+
+    is_passed = true;
+    for (int v : {5, -3, 9, 5, 0, 12, -7})
+        l.append(v);
+    l.start_bulk_add();
+    for (int v : {4, 4, -1})
+        l.append(v);
+    l.end_bulk_add();
+
+    for (size_t i = 0; i + 1 < l.len(); i++) {
+        if (l[i] > l[i + 1])
+            is_passed = false;
+    }
+    if (l.len() != 10 || !l.index_of(4, idx) || l[idx] != 4 || idx != 4 || l.index_of(100, idx))
+        is_passed = false;
+    printf("[!] Finished List test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/init.hpp"
+
+
+using namespace std;
+
+
+static double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static void moments(const float* x, size_t n, double& mean, double& var)
+{
+    double s = 0, s2 = 0;
+    for (size_t i = 0; i < n; i++) {
+        s += x[i];
+        s2 += double(x[i]) * x[i];
+    }
+    mean = s / n;
+    var = s2 / n - mean * mean;
+}
+
+static FullyConnectedNetwork* make_network()
+{
+    FullyConnectedNetwork* nn = new FullyConnectedNetwork();
+    nn->add_layer(300, false, 0, "input");
+    nn->add_layer(200, false, 1, "hidden", Activation::RELU);
+    nn->add_layer(500, false, 2, "hidden-2", Activation::SIGMOID);
+    nn->add_layer(10, false, 3, "output", Activation::SOFTMAX);
+    return nn;
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t n_bench = (argc > 1) ? strtoul(argv[1], NULL, 10) : (size_t(1) << 25);
+    bool is_passed = true;
+
+    printf("[!] Testing Philox4x32-10\n");
+    {
+        // known answers from the Random123 distribution
+        const uint32_t ctr[3][4] = {{0, 0, 0, 0}, {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                                    {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}};
+        const uint32_t key[3][2] = {{0, 0}, {0xffffffff, 0xffffffff}, {0xa4093822, 0x299f31d0}};
+        const uint32_t want[3][4] = {{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8},
+                                     {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd},
+                                     {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}};
+        for (int t = 0; t < 3; t++) {
+            uint32_t out[4];
+            philox4x32_10(ctr[t], key[t], out);
+            is_passed &= memcmp(out, want[t], sizeof(out)) == 0;
+        }
+
+        // the SIMD batch against the reference, across a carry into the high counter word
+        PhiloxStream s{0x0123456789abcdefULL, 5};
+        const uint32_t k[2] = {uint32_t(s.seed), uint32_t(s.seed >> 32)};
+        for (uint64_t base : {uint64_t(0), uint64_t(1000), uint64_t(0xfffffffc)}) {
+            uint32_t words[PHILOX_BATCH];
+            philox_batch(base, s, words);
+            for (size_t b = 0; b < PHILOX_LANES; b++) {
+                uint64_t blk = base + b;
+                const uint32_t c[4] = {uint32_t(blk), uint32_t(blk >> 32), s.stream, 0};
+                uint32_t ref[4];
+                philox4x32_10(c, k, ref);
+                is_passed &= memcmp(ref, words + 4 * b, sizeof(ref)) == 0;
+            }
+        }
+        printf("[*] %zu blocks per batch\n", PHILOX_LANES);
+    }
+    printf("[!] Finished Philox test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing ranges and thread counts\n");
+    {
+        const size_t n = 300001;
+        PhiloxStream s{42, 3};
+        vector<float> whole(n), part(n), normal(n);
+        philox_fill_uniform(whole.data(), n, -2.0f, 3.0f, s);
+        philox_fill_normal(normal.data(), n, 1.0f, 0.5f, s);
+
+        // any subrange is the same slice of the stream, whatever its alignment
+        for (size_t off : {size_t(0), size_t(1), size_t(7), size_t(33), size_t(4097)}) {
+            size_t len = 1000 + off;
+            philox_fill_uniform(part.data(), len, -2.0f, 3.0f, s, off);
+            is_passed &= memcmp(part.data(), whole.data() + off, len * sizeof(float)) == 0;
+            philox_fill_normal(part.data(), len, 1.0f, 0.5f, s, off);
+            is_passed &= memcmp(part.data(), normal.data() + off, len * sizeof(float)) == 0;
+        }
+
+        for (size_t threads : {2, 3, 7}) {
+            tpool_t* pool = tpool_create(threads);
+            philox_fill_uniform(part.data(), n, -2.0f, 3.0f, s, 0, pool, threads);
+            is_passed &= memcmp(part.data(), whole.data(), n * sizeof(float)) == 0;
+            philox_fill_normal(part.data(), n, 1.0f, 0.5f, s, 0, pool, threads);
+            is_passed &= memcmp(part.data(), normal.data(), n * sizeof(float)) == 0;
+            tpool_destroy(pool);
+        }
+
+        double mean, var;
+        moments(whole.data(), n, mean, var);
+        is_passed &= fabs(mean - 0.5) < 0.02 && fabs(var - 25.0 / 12) < 0.02;
+        is_passed &= *min_element(whole.begin(), whole.end()) >= -2.0f && *max_element(whole.begin(), whole.end()) < 3.0f;
+        printf("[*] uniform [-2, 3): mean %.4f var %.4f\n", mean, var);
+        moments(normal.data(), n, mean, var);
+        is_passed &= fabs(mean - 1.0) < 0.01 && fabs(var - 0.25) < 0.01;
+        printf("[*] normal (1, 0.25): mean %.4f var %.4f\n", mean, var);
+
+        // another stream of the same seed is unrelated
+        philox_fill_uniform(part.data(), n, -2.0f, 3.0f, PhiloxStream{42, 4});
+        size_t same = 0;
+        for (size_t i = 0; i < n; i++)
+            same += part[i] == whole[i];
+        is_passed &= same < 10;
+    }
+    printf("[!] Finished ranges test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing network initialization\n");
+    {
+        FullyConnectedNetwork* a = make_network();
+        FullyConnectedNetwork* b = make_network();
+        FullyConnectedNetwork shared(*a);
+
+        InitConfig cfg;
+        cfg.seed = 7;
+        is_passed &= init_weights(*a, cfg) == 0;
+        tpool_t* pool = tpool_create(4);
+        InitConfig threaded = cfg;
+        threaded.pool = pool;
+        threaded.num_threads = 4;
+        is_passed &= init_weights(*b, threaded) == 0;
+        is_passed &= memcmp(a->param_data(), b->param_data(), a->num_params() * sizeof(float)) == 0;
+        // the copy that shared the zero weights keeps them
+        auto sw = shared.get_layer(1)->weights();
+        is_passed &= count(sw.begin(), sw.end(), 0.0f) == long(sw.size());
+
+        // AUTO: He for the RELU layer, Xavier for the others
+        double mean, var;
+        auto w1 = a->get_layer(1)->weights();
+        moments(w1.data(), w1.size(), mean, var);
+        is_passed &= fabs(var / (2.0 / 300) - 1.0) < 0.05;
+        auto w2 = a->get_layer(2)->weights();
+        moments(w2.data(), w2.size(), mean, var);
+        is_passed &= fabs(var / (2.0 / 700) - 1.0) < 0.05;
+
+        cfg.scheme = InitScheme::HE_NORMAL;
+        init_weights(*a, cfg);
+        moments(w2.data(), w2.size(), mean, var);
+        is_passed &= fabs(var / (2.0 / 200) - 1.0) < 0.05 && fabs(mean) < 0.01;
+        auto bias = a->get_layer(2)->biases();
+        is_passed &= count(bias.begin(), bias.end(), 0.0f) == long(bias.size());
+
+        cfg.seed = 8;
+        init_weights(*b, cfg);
+        is_passed &= memcmp(a->param_data(), b->param_data(), a->num_params() * sizeof(float)) != 0;
+
+        // orthogonal: 200 x 300 has orthonormal rows, 500 x 200 orthonormal columns
+        cfg.scheme = InitScheme::ORTHOGONAL;
+        cfg.gain = 2.0f;
+        init_weights(*a, cfg);
+        float worst = 0;
+        for (uint32_t i = 0; i < 200; i += 17) {
+            for (uint32_t j = i; j < 200; j += 13) {
+                float d = 0;
+                for (uint32_t c = 0; c < 300; c++)
+                    d += w1[i * 300 + c] * w1[j * 300 + c];
+                worst = max(worst, fabsf(d - (i == j ? 4.0f : 0.0f)));
+            }
+        }
+        for (uint32_t i = 0; i < 200; i += 17) {
+            for (uint32_t j = i; j < 200; j += 13) {
+                float d = 0;
+                for (uint32_t r = 0; r < 500; r++)
+                    d += w2[r * 200 + i] * w2[r * 200 + j];
+                worst = max(worst, fabsf(d - (i == j ? 4.0f : 0.0f)));
+            }
+        }
+        is_passed &= worst < 1e-4f;
+        printf("[*] orthogonal: max |W W^T - gain^2 I| %.2e\n", worst);
+
+        FullyConnectedNetwork empty;
+        is_passed &= init_weights(empty, cfg) == -1;
+        tpool_destroy(pool);
+        delete a;
+        delete b;
+    }
+    printf("[!] Finished network initialization test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking %zu weights\n", n_bench);
+    {
+        vector<float> w(n_bench);
+        auto start = chrono::steady_clock::now();
+        mt19937 gen(1);
+        uniform_real_distribution<float> dist(-1.0f, 1.0f);
+        for (auto &v : w)
+            v = dist(gen);
+        double mt_ms = ms_since(start);
+
+        start = chrono::steady_clock::now();
+        philox_fill_uniform(w.data(), n_bench, -1.0f, 1.0f, PhiloxStream{1, 0});
+        double uni_ms = ms_since(start);
+
+        start = chrono::steady_clock::now();
+        philox_fill_normal(w.data(), n_bench, 0.0f, 1.0f, PhiloxStream{1, 0});
+        double norm_ms = ms_since(start);
+
+        printf("[*] mt19937 %.1f ms, philox uniform %.1f ms (%.2fx, %.2f Gfloat/s), philox normal %.1f ms, 1 thread\n",
+               mt_ms, uni_ms, mt_ms / uni_ms, n_bench / uni_ms / 1e6, norm_ms);
+        is_passed &= uni_ms < mt_ms;
+    }
+
+    printf("[!] Finished init tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
@@ -11,7 +11,7 @@ int main(int argc, char **argv)
 {
     printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
 
-    Layer* l = new Layer(4, true, 0, "layer 0");
+    Layer* l = new Layer(4, true, 0, "layer 0", 3);
 
     l->print_layer(l->get_name());
 
@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../lib/include/log.hpp"
+#include "../lib/include/layer.hpp"
+
+
+using namespace std;
+
+
+static double ns_per(chrono::steady_clock::time_point start, size_t n)
+{
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / n;
+}
+
+// Everything written to f so far, one string per line
+static vector<string> read_lines(FILE* f)
+{
+    vector<string> lines;
+    char buf[512];
+    fflush(f);
+    rewind(f);
+    while (fgets(buf, sizeof(buf), f) != nullptr) {
+        buf[strcspn(buf, "\n")] = 0;
+        lines.push_back(buf);
+    }
+    return lines;
+}
+
+static int side_effects = 0;
+static int count_call() { return ++side_effects; }
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t n_bench = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200000;
+    bool is_passed = true;
+
+    printf("[!] Testing levels\n");
+    {
+        FILE* f = tmpfile();
+        log_set_output(f);
+        log_set_level(LogLevel::INFO);
+
+        LOG_TRACE("compiled out %d", count_call());
+        LOG_DEBUG("below the runtime level %d", count_call());
+        is_passed &= side_effects == 0;
+        LOG_INFO("info %d", 1);
+        LOG_WARN("warn %s", "two");
+        LOG_ERROR("error %u", 3u);
+
+        log_set_level(LogLevel::DEBUG);
+        is_passed &= log_get_level() == LogLevel::DEBUG;
+        LOG_DEBUG("debug %d", count_call());
+        is_passed &= side_effects == 1;
+
+        log_set_level(LogLevel::OFF);
+        LOG_ERROR("off");
+
+        // long messages are cut, not overflowed
+        log_set_level(LogLevel::INFO);
+        LOG_INFO("%s", string(1000, 'x').c_str());
+
+        log_flush();
+        vector<string> lines = read_lines(f);
+        is_passed &= lines.size() == 5;
+        if (lines.size() == 5) {
+            is_passed &= lines[0] == "info 1" && lines[1] == "warning: warn two" && lines[2] == "error: error 3";
+            is_passed &= lines[3] == "debug 1" && lines[4] == string(LOG_MSG_MAX - 1, 'x');
+        }
+        for (auto &l : lines)
+            printf("[*] %.60s\n", l.c_str());
+
+        log_set_output(stdout);
+        fclose(f);
+    }
+    printf("[!] Finished levels test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing producers on several threads\n");
+    {
+        FILE* f = tmpfile();
+        log_set_output(f);
+        const int threads = 4, per_thread = 2000;
+        uint64_t dropped_before = log_dropped();
+
+        vector<thread> th;
+        for (int t = 0; t < threads; t++)
+            th.emplace_back([t] {
+                for (int i = 0; i < per_thread; i++)
+                    LOG_INFO("t%d m%d", t, i);
+            });
+        for (auto &t : th)
+            t.join();
+        log_flush();
+
+        // every message arrives or is counted as dropped, each thread's in the order it logged them
+        vector<string> lines = read_lines(f);
+        vector<int> last(threads, -1);
+        size_t got = 0;
+        for (auto &l : lines) {
+            int t, i;
+            if (sscanf(l.c_str(), "t%d m%d", &t, &i) != 2 || t < 0 || t >= threads || i <= last[t]) {
+                is_passed = false;
+                continue;
+            }
+            last[t] = i;
+            got++;
+        }
+        uint64_t dropped = log_dropped() - dropped_before;
+        is_passed &= got + dropped == size_t(threads * per_thread);
+        printf("[*] %zu written, %lu dropped\n", got, (unsigned long)dropped);
+
+        // constructing and destroying layers is quiet now
+        for (int i = 0; i < 1000; i++) {
+            Layer l(16, true, 1, "tmp", 16);
+        }
+        log_flush();
+        is_passed &= read_lines(f).size() == lines.size();
+
+        log_set_output(stdout);
+        fclose(f);
+    }
+    printf("[!] Finished producers test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking %zu messages\n", n_bench);
+    {
+        FILE* f = fopen("/dev/null", "w");
+        log_set_output(f);
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n_bench; i++)
+            LOG_DEBUG("sample %zu label %d", i, int(i % 10));
+        double disabled = ns_per(start, n_bench);
+
+        // what the loader did per sample: format, write and flush on the calling thread
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n_bench; i++) {
+            fprintf(f, "sample %zu label %d\n", i, int(i % 10));
+            fflush(f);
+        }
+        double direct = ns_per(start, n_bench);
+
+        // in bursts the writer can keep up with, so nothing is dropped: the time on the calling thread,
+        // and the total with the writing out
+        uint64_t dropped_before = log_dropped();
+        double caller_ns = 0;
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n_bench; i += 1024) {
+            auto burst = chrono::steady_clock::now();
+            for (size_t j = i; j < i + 1024 && j < n_bench; j++)
+                LOG_INFO("sample %zu label %d", j, int(j % 10));
+            caller_ns += chrono::duration<double, nano>(chrono::steady_clock::now() - burst).count();
+            log_flush();
+        }
+        double total = ns_per(start, n_bench);
+        double queued = caller_ns / n_bench;
+        uint64_t dropped = log_dropped() - dropped_before;
+
+        printf("[*] disabled %.1f ns, queued %.1f ns on the caller (%.1f ns with the writing, %lu dropped), "
+               "fprintf + fflush %.1f ns per message\n", disabled, queued, total, (unsigned long)dropped, direct);
+        is_passed &= disabled < 5.0 && queued < direct && dropped == 0;
+
+        log_set_output(stdout);
+        fclose(f);
+    }
+
+    printf("[!] Finished log tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../lib/include/model_io.hpp"
+
+
+using namespace std;
+
+
+static FullyConnectedNetwork* make_network(uint32_t width)
+{
+    FullyConnectedNetwork* nn = new FullyConnectedNetwork();
+    nn->add_layer(width, false, 0, "input");
+    nn->add_layer(width, true, 1, "hidden", Activation::RELU);
+    nn->add_layer(10, true, 2, "output", Activation::SOFTMAX);
+    return nn;
+}
+
+static bool same_outputs(FullyConnectedNetwork* a, FullyConnectedNetwork* b, const vector<float>& x)
+{
+    vector<float> in(x), ya, yb;
+    a->forward_propagation(in, ya);
+    b->forward_propagation(in, yb);
+    return ya == yb;
+}
+
+static void flip_byte(const string& path, off_t at)
+{
+    int fd = open(path.c_str(), O_RDWR);
+    char c;
+    pread(fd, &c, 1, at);
+    c ^= 0x40;
+    pwrite(fd, &c, 1, at);
+    close(fd);
+}
+
+// Rewrite the parameter blob offset and fix up the header checksum, so only the bounds checks can catch it
+static void patch_params_offset(const string& path, uint64_t params_offset)
+{
+    int fd = open(path.c_str(), O_RDWR);
+    ModelHeader h;
+    pread(fd, &h, sizeof(h), 0);
+    vector<char> meta(sizeof(ModelHeader) + h.num_layers * sizeof(LayerRecord));
+    pread(fd, meta.data(), meta.size(), 0);
+
+    h.params_offset = params_offset;
+    h.meta_checksum = 0;
+    memcpy(meta.data(), &h, sizeof(h));
+    h.meta_checksum = model_checksum(meta.data(), meta.size());
+    pwrite(fd, &h, sizeof(h), 0);
+    close(fd);
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    string path = (argc > 1) ? argv[1] : "/tmp/test_model_io.snn";
+    uint32_t big_width = (argc > 2) ? strtoul(argv[2], NULL, 10) : 4096;
+    bool is_passed = true;
+
+    vector<float> x(64);
+    mt19937 gen(1);
+    uniform_real_distribution<float> dist(0.0f, 1.0f);
+    for (auto& v : x)
+        v = dist(gen);
+
+    printf("[!] Testing save / load round trip\n");
+    {
+        FullyConnectedNetwork* nn = make_network(64);
+        is_passed &= nn->save(path) == 0;
+
+        FullyConnectedNetwork* loaded = FullyConnectedNetwork::load(path);
+        if (loaded == nullptr || loaded->get_depth() != nn->get_depth() || loaded->num_params() != nn->num_params()) {
+            is_passed = false;
+        } else {
+            is_passed &= equal(nn->param_data(), nn->param_data() + nn->num_params(), loaded->param_data());
+            is_passed &= loaded->get_layer(1)->get_name() == "hidden";
+            is_passed &= loaded->get_layer(2)->get_activation() == Activation::SOFTMAX;
+            is_passed &= reinterpret_cast<uintptr_t>(loaded->get_layer(1)->weights().data()) % ParamBuffer::ALIGN == 0;
+            is_passed &= same_outputs(nn, loaded, x);
+
+            // writing to a read only load copies the weights out of the mapping instead of faulting
+            const float* mapped = loaded->param_data();
+            loaded->get_layer(1)->mutable_weights()[0] += 1.0f;
+            is_passed &= loaded->param_data() != mapped;
+            is_passed &= loaded->get_layer(1)->weights()[0] == nn->param_data()[0] + 1.0f;
+            is_passed &= equal(nn->param_data() + 1, nn->param_data() + nn->num_params(), loaded->param_data() + 1);
+        }
+        delete loaded;
+
+        // a writable load can be trained, the file stays as it was
+        loaded = FullyConnectedNetwork::load(path, true);
+        if (loaded == nullptr) {
+            is_passed = false;
+        } else {
+            loaded->mutable_param_data()[0] += 1.0f;
+            FullyConnectedNetwork* again = FullyConnectedNetwork::load(path);
+            is_passed &= again != nullptr && again->param_data()[0] == nn->param_data()[0];
+            delete again;
+        }
+        delete loaded;
+        delete nn;
+    }
+    printf("[!] Finished round trip test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing corrupt files are rejected\n");
+    {
+        FullyConnectedNetwork* nn = make_network(64);
+        nn->save(path);
+
+        // a weight: only caught when verifying
+        flip_byte(path, sizeof(ModelHeader) + 3 * sizeof(LayerRecord) + 100);
+        FullyConnectedNetwork* loaded = FullyConnectedNetwork::load(path);
+        is_passed &= loaded == nullptr;
+        loaded = FullyConnectedNetwork::load(path, false, false);
+        is_passed &= loaded != nullptr;
+        delete loaded;
+
+        // the topology: always caught
+        nn->save(path);
+        flip_byte(path, sizeof(ModelHeader) + sizeof(LayerRecord) + 1);
+        loaded = FullyConnectedNetwork::load(path, false, false);
+        is_passed &= loaded == nullptr;
+
+        // an offset that wraps around to the real end of the blob when the blob size is added
+        nn->save(path);
+        {
+            int fd = open(path.c_str(), O_RDONLY);
+            ModelHeader h;
+            pread(fd, &h, sizeof(h), 0);
+            close(fd);
+            patch_params_offset(path, h.params_offset - h.params_size * sizeof(float));
+        }
+        loaded = FullyConnectedNetwork::load(path, false, false);
+        is_passed &= loaded == nullptr;
+
+        // truncated
+        nn->save(path);
+        truncate(path.c_str(), 1000);
+        loaded = FullyConnectedNetwork::load(path, false, false);
+        is_passed &= loaded == nullptr;
+
+        is_passed &= FullyConnectedNetwork::load(path + ".missing") == nullptr;
+        delete nn;
+    }
+    printf("[!] Finished corrupt file test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking a %ux%u model\n", big_width, big_width);
+    {
+        FullyConnectedNetwork* nn = make_network(big_width);
+        auto start = chrono::steady_clock::now();
+        nn->save(path);
+        double t_save = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        FullyConnectedNetwork* fast = FullyConnectedNetwork::load(path, false, false);
+        double t_load = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        FullyConnectedNetwork* checked = FullyConnectedNetwork::load(path);
+        double t_verify = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        printf("[*] %.1f MB: save %.2f ms, mmap load %.3f ms, load + verify %.2f ms\n",
+               nn->num_params() * 4 / 1e6, t_save, t_load, t_verify);
+        is_passed &= fast != nullptr && checked != nullptr && same_outputs(nn, fast, vector<float>(big_width, 0.5f));
+        delete fast;
+        delete checked;
+        delete nn;
+    }
+
+    unlink(path.c_str());
+    printf("[!] Finished model io tests with result: [%s]\n", is_passed ? "PASSED" : "FAILED");
+
+    return is_passed ? 0 : 1;
+}
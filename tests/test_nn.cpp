@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 #include "../lib/include/nn.hpp"
 
@@ -9,6 +10,8 @@ using namespace std;
 
 int main()
 {
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
     FullyConnectedNetwork* nn = new FullyConnectedNetwork();
 
     nn->add_layer(4, false, 0, "input");
@@ -16,7 +19,84 @@ int main()
     nn->add_layer(2, true,  2, "hidden-2");
     nn->add_layer(2, true,  3, "output");
 
+    printf("[!] Testing flat parameter buffer\n");
+    bool passed = true;
+    size_t expected = 0;
+    for (uint32_t i = 0; i < nn->get_depth(); i++) {
+        Layer* l = nn->get_layer(i);
+        expected += l->num_params();
+
+        // every view must lie inside the flat buffers and start on a cache line
+        for (auto s : {l->weights(), l->biases()}) {
+            if (s.empty())
+                continue;
+            if (s.data() < nn->param_data() || s.data() + s.size() > nn->param_data() + nn->num_params())
+                passed = false;
+            if (reinterpret_cast<uintptr_t>(s.data()) % ParamBuffer::ALIGN != 0)
+                passed = false;
+        }
+        if (l->num_params() > 0 && l->weight_grads().data() - nn->grad_data() != l->weights().data() - nn->param_data())
+            passed = false;
+    }
+    // 3x4 + 3, 2x3 + 2, 2x2 + 2
+    if (expected != 29)
+        passed = false;
+    printf("[*] %zu parameters in a flat buffer of %zu floats\n", expected, nn->num_params());
+
+    // writing through the flat buffer is seen by the layer
+    nn->mutable_param_data()[0] = 42.0f;
+    if (nn->get_layer(1)->weights()[0] != 42.0f)
+        passed = false;
+
+    printf("[!] Finished testing flat parameter buffer with result: [%s]\n", passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing copy on write replicas\n");
+    {
+        vector<float> x = {0.1f, 0.2f, 0.3f, 0.4f}, y0, y1;
+        nn->forward_propagation(x, y0);
+
+        // growing the vector moves the replicas, the weights are never copied
+        vector<FullyConnectedNetwork> replicas;
+        for (int i = 0; i < 8; i++)
+            replicas.emplace_back(*nn);
+        for (auto& r : replicas) {
+            if (r.param_data() != nn->param_data() || r.get_layer(1)->weights().data() != nn->get_layer(1)->weights().data())
+                passed = false;
+            r.forward_propagation(x, y1);
+            if (y1 != y0)
+                passed = false;
+        }
+        if (!nn->shares_params())
+            passed = false;
+
+        // a write only copies for the writer
+        replicas[3].get_layer(2)->mutable_biases()[0] += 1.0f;
+        const float* moved = replicas[3].param_data();
+        if (moved == nn->param_data() || replicas[3].get_layer(1)->weights().data() < moved ||
+            replicas[3].get_layer(2)->biases()[0] == nn->get_layer(2)->biases()[0] ||
+            replicas[2].param_data() != nn->param_data())
+            passed = false;
+
+        FullyConnectedNetwork taken(std::move(replicas[3]));
+        if (taken.param_data() != moved || replicas[3].num_params() != 0 || replicas[3].get_depth() != 0)
+            passed = false;
+
+        // a standalone copy of a layer shares too, and copies only its own part on write
+        Layer copy(*nn->get_layer(1));
+        if (copy.weights().data() != nn->get_layer(1)->weights().data())
+            passed = false;
+        copy.mutable_weights()[0] = -1.0f;
+        if (copy.weights().data() == nn->get_layer(1)->weights().data() || nn->get_layer(1)->weights()[0] != 42.0f ||
+            !equal(copy.weights().begin() + 1, copy.weights().end(), nn->get_layer(1)->weights().begin() + 1))
+            passed = false;
+
+        replicas.clear();
+        if (nn->shares_params())
+            passed = false;
+    }
+    printf("[!] Finished testing copy on write replicas with result: [%s]\n", passed ? "PASSED" : "FAILED");
+
     delete nn;
 
-    return 0;
+    return passed ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/optimizer.hpp"
+
+
+using namespace std;
+
+
+// Straightforward multi-pass reference of the same update rules
+static void reference_step(const OptimizerConfig& cfg, uint64_t t, float lr,
+                           vector<float>& p, vector<float>& g, vector<float>& m, vector<float>& v)
+{
+    size_t n = p.size();
+
+    if (cfg.clip_norm > 0) {
+        double sum = 0;
+        for (float x : g)
+            sum += double(x) * x;
+        double norm = sqrt(sum);
+        if (norm > cfg.clip_norm)
+            for (auto& x : g)
+                x *= float(cfg.clip_norm / norm);
+    }
+    if (cfg.clip_value > 0)
+        for (auto& x : g)
+            x = min(max(x, -cfg.clip_value), cfg.clip_value);
+    if (cfg.type != OptimizerType::ADAMW)
+        for (size_t i = 0; i < n; i++)
+            g[i] += cfg.weight_decay * p[i];
+
+    for (size_t i = 0; i < n; i++) {
+        switch (cfg.type) {
+        case OptimizerType::SGD:
+            m[i] = cfg.momentum * m[i] + g[i];
+            p[i] -= lr * m[i];
+            break;
+        case OptimizerType::NESTEROV:
+            m[i] = cfg.momentum * m[i] + g[i];
+            p[i] -= lr * (g[i] + cfg.momentum * m[i]);
+            break;
+        case OptimizerType::ADAMW:
+            p[i] -= lr * cfg.weight_decay * p[i];
+            [[fallthrough]];
+        case OptimizerType::ADAM: {
+            m[i] = cfg.beta1 * m[i] + (1 - cfg.beta1) * g[i];
+            v[i] = cfg.beta2 * v[i] + (1 - cfg.beta2) * g[i] * g[i];
+            float mhat = m[i] / (1 - powf(cfg.beta1, float(t)));
+            float vhat = v[i] / (1 - powf(cfg.beta2, float(t)));
+            p[i] -= lr * mhat / (sqrtf(vhat) + cfg.eps);
+            break;
+        }
+        }
+        g[i] = 0;
+    }
+}
+
+
+static bool test_against_reference(const char* name, OptimizerConfig cfg, tpool_t* pool, size_t num_threads, size_t n)
+{
+    mt19937 gen(3);
+    normal_distribution<float> dist(0.0f, 1.0f);
+    vector<float> p(n), g(n), rp, rg, rm(n, 0.0f), rv(n, 0.0f);
+    bool passed = true;
+
+    for (auto& x : p)
+        x = dist(gen);
+    rp = p;
+
+    Optimizer opt(cfg, pool, num_threads);
+    for (uint64_t t = 1; t <= 5; t++) {
+        for (auto& x : g)
+            x = dist(gen);
+        rg = g;
+        float lr = opt.learning_rate(t - 1);
+        opt.step(p.data(), g.data(), n);
+        reference_step(cfg, t, lr, rp, rg, rm, rv);
+    }
+
+    float max_err = 0;
+    for (size_t i = 0; i < n; i++) {
+        max_err = max(max_err, fabsf(p[i] - rp[i]) / (1.0f + fabsf(rp[i])));
+        if (g[i] != 0.0f)
+            passed = false;
+    }
+    if (max_err > 1e-4f)
+        passed = false;
+
+    printf("[*] %-40s max rel err %.2e  [%s]\n", name, max_err, passed ? "PASSED" : "FAILED");
+    return passed;
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t num_params = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000000;
+    size_t num_threads = 4;
+    tpool_t* pool = tpool_create(num_threads);
+    bool is_passed = true;
+
+    printf("[!] Testing fused optimizers against a multi-pass reference\n");
+    {
+        OptimizerConfig cfg;
+        cfg.type = OptimizerType::SGD;
+        cfg.momentum = 0.9f;
+        cfg.lr = 0.05f;
+        is_passed &= test_against_reference("sgd momentum", cfg, nullptr, 1, 1001);
+
+        cfg.type = OptimizerType::NESTEROV;
+        cfg.weight_decay = 0.01f;
+        cfg.clip_value = 1.0f;
+        is_passed &= test_against_reference("nesterov, weight decay, clip value", cfg, pool, num_threads, 200003);
+
+        cfg = OptimizerConfig();
+        cfg.type = OptimizerType::ADAM;
+        cfg.lr = 1e-3f;
+        cfg.clip_norm = 10.0f;
+        cfg.schedule = LrSchedule::COSINE;
+        cfg.warmup_steps = 2;
+        cfg.total_steps = 10;
+        is_passed &= test_against_reference("adam, clip norm, warmup + cosine", cfg, pool, num_threads, 200003);
+
+        cfg.type = OptimizerType::ADAMW;
+        cfg.weight_decay = 0.1f;
+        cfg.clip_norm = 0.0f;
+        cfg.schedule = LrSchedule::STEP;
+        cfg.step_size = 2;
+        cfg.gamma = 0.5f;
+        is_passed &= test_against_reference("adamw, step schedule", cfg, pool, num_threads, 200003);
+    }
+    printf("[!] Finished optimizer test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing optimizer step on a network\n");
+    {
+        FullyConnectedNetwork nn;
+        nn.add_layer(8, false, 0, "input");
+        nn.add_layer(4, true, 1, "output");
+
+        OptimizerConfig cfg;
+        cfg.momentum = 0.0f;
+        cfg.lr = 0.5f;
+        Optimizer opt(cfg);
+
+        float w0 = nn.get_layer(1)->weights()[0];
+        nn.get_layer(1)->weight_grads()[0] = 2.0f;
+        opt.step(nn);
+        if (fabsf(nn.get_layer(1)->weights()[0] - (w0 - 1.0f)) > 1e-6f || nn.get_layer(1)->weight_grads()[0] != 0.0f)
+            is_passed = false;
+    }
+    printf("[!] Finished network step test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking one step over %zu params\n", num_params);
+    {
+        vector<float> p(num_params, 0.5f), g(num_params, 0.1f);
+        OptimizerType types[] = {OptimizerType::SGD, OptimizerType::NESTEROV, OptimizerType::ADAM, OptimizerType::ADAMW};
+        const char* names[] = {"sgd momentum", "nesterov", "adam", "adamw"};
+        // bytes moved per param: p, g, m (+ v) read and written
+        size_t bytes[] = {24, 24, 32, 32};
+
+        for (size_t threads : {size_t(1), num_threads}) {
+            for (int i = 0; i < 4; i++) {
+                OptimizerConfig cfg;
+                cfg.type = types[i];
+                Optimizer opt(cfg, threads > 1 ? pool : nullptr, threads);
+                opt.step(p.data(), g.data(), num_params);   // first touch of the state
+
+                const int steps = 5;
+                auto start = chrono::steady_clock::now();
+                for (int s = 0; s < steps; s++)
+                    opt.step(p.data(), g.data(), num_params);
+                double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / steps;
+                printf("[*] %-14s %zu threads: %7.2f ms/step  %6.2f GB/s\n", names[i], threads, ms,
+                       double(bytes[i]) * num_params / ms / 1e6);
+            }
+        }
+    }
+
+    tpool_destroy(pool);
+    printf("[!] Finished optimizer tests with result: [%s]\n", is_passed ? "PASSED" : "FAILED");
+
+    return is_passed ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/perceptron_store.hpp"
+
+
+using namespace std;
+
+
+static double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t n_units = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    bool is_passed = true;
+
+    printf("[!] Testing units and edges\n");
+    {
+        PerceptronStore s;
+        uint32_t in = s.add_units(3, false);
+        uint32_t hidden = s.add_units(4, true, 7);
+        uint32_t out = s.add_units(2, true, 8);
+        is_passed &= in == 0 && hidden == 3 && out == 7 && s.num_units() == 9;
+        for (uint32_t i = hidden; i < s.num_units(); i++)
+            is_passed &= s.weights()[i] >= -1.0f && s.weights()[i] <= 1.0f && s.weights()[i] != 0.0f;
+
+        s.connect_dense(in, 3, hidden, 4);
+        s.add_edge(hidden + 3, out + 1);
+        s.connect_dense(hidden, 3, out, 2);
+        is_passed &= s.num_edges() == 0 && s.num_pending_edges() == 19;
+        is_passed &= s.build_edges() == 0 && s.num_edges() == 19;
+
+        // grouped by source, in the order added
+        auto next = s.next_units(hidden + 3);
+        is_passed &= next.size() == 1 && next[0] == out + 1;
+        next = s.next_units(1);
+        is_passed &= next.size() == 4 && next[0] == hidden && next[3] == hidden + 3;
+        is_passed &= s.next_units(out).empty() && s.next_units(100).empty();
+
+        // later edges go after the built ones
+        s.add_edge(1, out);
+        is_passed &= s.build_edges() == 0 && s.num_edges() == 20;
+        next = s.next_units(1);
+        is_passed &= next.size() == 5 && next[4] == out && next[0] == hidden;
+
+        s.add_edge(0, 9);
+        is_passed &= s.build_edges() == -1 && s.num_edges() == 20 && s.num_pending_edges() == 0;
+
+        // a forward pass layer by layer against the same sums done by hand
+        vector<float> x = {0.5f, -1.0f, 2.0f};
+        is_passed &= s.set_inputs(in, x) == 0;
+        s.compute(in, 3, Activation::NONE);
+        s.propagate(in, 3);
+        s.compute(hidden, 4, Activation::SIGMOID);
+        s.propagate(hidden, 4);
+        s.compute(out, 2, Activation::SOFTMAX);
+
+        auto w = s.weights(), b = s.biases(), y = s.outputs();
+        float h[4], o[2] = {0, 0};
+        float sum_in = 0;
+        for (int i = 0; i < 3; i++)
+            sum_in += w[i] * x[i] + b[i];
+        for (int j = 0; j < 4; j++)
+            h[j] = 1.0f / (1.0f + exp(-(w[hidden + j] * sum_in + b[hidden + j])));
+        // unit 1 also feeds out[0] directly
+        float y1 = w[1] * x[1] + b[1];
+        float a_out[2] = {y1 + h[0] + h[1] + h[2], h[0] + h[1] + h[2] + h[3]};
+        float mx = 0, z = 0;
+        for (int k = 0; k < 2; k++) {
+            o[k] = w[out + k] * a_out[k] + b[out + k];
+            mx = k == 0 ? o[k] : max(mx, o[k]);
+        }
+        for (int k = 0; k < 2; k++)
+            z += exp(o[k] - mx);
+        for (int k = 0; k < 2; k++)
+            is_passed &= fabsf(y[out + k] - exp(o[k] - mx) / z) < 1e-6f;
+        is_passed &= fabsf(y[out] + y[out + 1] - 1.0f) < 1e-6f;
+
+        is_passed &= s.compute(8, 2, Activation::NONE) == -1 && s.propagate(0, 10) == -1;
+    }
+    printf("[!] Finished units and edges test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing the mlp_t adapter\n");
+    {
+        vector<mlp_t*> units;
+        for (int i = 0; i < 5; i++) {
+            units.push_back(mlp_create(true));
+            units.back()->w = float(i);
+            units.back()->b = -float(i);
+            units.back()->a = 0.5f * i;
+        }
+        // reseeding per unit used to give these all the same values
+        mlp_t* a = mlp_create(true);
+        mlp_t* b = mlp_create(true);
+        is_passed &= a->w != b->w && a->next_layer_perc.empty();
+
+        units[0]->next_layer_perc = {units[2], units[3]};
+        units[1]->next_layer_perc = {units[3], units[4], a};      // a isn't in the list
+        units[2]->next_layer_perc = {units[4]};
+        a->next_layer_perc = {b};
+
+        PerceptronStore s = PerceptronStore::from_mlp(units);
+        is_passed &= s.num_units() == 7 && s.num_edges() == 7;
+        for (uint32_t i = 0; i < 5; i++) {
+            PerceptronRef r = s.unit(i);
+            is_passed &= r.w == units[i]->w && r.b == units[i]->b && r.a == units[i]->a;
+            is_passed &= r.next_layer_perc.size() == units[i]->next_layer_perc.size();
+        }
+        auto next = s.next_units(1);
+        is_passed &= next[0] == 3 && next[1] == 4 && next[2] == 5;
+        is_passed &= s.unit(5).w == a->w && s.next_units(5)[0] == 6 && s.unit(6).b == b->b;
+
+        // writes through the reference land in the arrays
+        s.unit(2).a = 9.0f;
+        is_passed &= s.inputs()[2] == 9.0f;
+
+        Layer layer(3, false, 0, "in");
+        is_passed &= layer.copy_vector({1.0f, 2.0f, 3.0f}, s, 4) == 0;
+        is_passed &= s.inputs()[4] == 1.0f && s.inputs()[6] == 3.0f;
+        is_passed &= layer.copy_vector({1.0f, 2.0f}, s, 6) == -1;
+
+        for (auto p : units)
+            mlp_destroy(p);
+        mlp_destroy(a);
+        mlp_destroy(b);
+    }
+    printf("[!] Finished adapter test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking %zu units\n", n_units);
+    {
+        auto start = chrono::steady_clock::now();
+        PerceptronStore s(n_units);
+        s.add_units(n_units, true);
+        double store_ms = ms_since(start);
+
+        start = chrono::steady_clock::now();
+        vector<mlp_t*> units(n_units);
+        for (auto& p : units)
+            p = mlp_create(true);
+        double mlp_ms = ms_since(start);
+        printf("[*] create: store %.1f ms, mlp_create %.1f ms\n", store_ms, mlp_ms);
+        is_passed &= store_ms < mlp_ms && store_ms < 100.0;
+
+        // 4 edges per unit to random later units, the same graph both ways
+        mt19937 gen(5);
+        for (size_t i = 0; i + 1 < n_units; i++) {
+            uniform_int_distribution<size_t> to(i + 1, n_units - 1);
+            for (int k = 0; k < 4; k++) {
+                size_t j = to(gen);
+                units[i]->next_layer_perc.push_back(units[j]);
+                s.add_edge(uint32_t(i), uint32_t(j));
+            }
+        }
+        start = chrono::steady_clock::now();
+        s.build_edges();
+        printf("[*] build %zu edges: %.1f ms\n", s.num_edges(), ms_since(start));
+
+        // one pass: every unit's output added to the inputs of its next units
+        for (size_t i = 0; i < n_units; i++) {
+            units[i]->y = s.outputs()[i] = float(i % 7);
+            units[i]->a = s.inputs()[i] = 0.0f;
+        }
+        start = chrono::steady_clock::now();
+        for (auto p : units)
+            for (auto next : p->next_layer_perc)
+                next->a += p->y;
+        double chase_ms = ms_since(start);
+
+        start = chrono::steady_clock::now();
+        s.propagate(0, uint32_t(n_units));
+        double scan_ms = ms_since(start);
+
+        bool same = true;
+        for (size_t i = 0; i < n_units; i++)
+            same &= units[i]->a == s.inputs()[i];
+        is_passed &= same;
+        printf("[*] propagate: pointers %.1f ms, store %.1f ms (%.2fx), %zu -> %zu bytes\n", chase_ms, scan_ms,
+               chase_ms / scan_ms, n_units * (sizeof(mlp_t) + 4 * sizeof(mlp_t*)), s.size_bytes());
+
+        for (auto p : units)
+            mlp_destroy(p);
+    }
+
+    printf("[!] Finished perceptron store tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
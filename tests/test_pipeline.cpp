@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/pipeline.hpp"
+
+
+using namespace std;
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t num_samples = (argc > 1) ? strtoul(argv[1], NULL, 10) : 4096;
+    uint32_t width = 256, depth = 9;
+    bool is_passed = true;
+
+    printf("[!] Testing SPSC queue\n");
+    {
+        SpscQueue<uint64_t> q(64);
+        const uint64_t count = 1000000;
+        thread producer([&]() {
+            for (uint64_t i = 0; i < count; i++)
+                while (!q.push(i))
+                    this_thread::yield();
+        });
+        uint64_t expected = 0, v;
+        while (expected < count) {
+            if (!q.pop(v)) {
+                this_thread::yield();
+                continue;
+            }
+            if (v != expected)
+                is_passed = false;
+            expected++;
+        }
+        producer.join();
+        if (q.pop(v))
+            is_passed = false;
+    }
+    printf("[!] Finished SPSC queue test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    FullyConnectedNetwork nn;
+    nn.add_layer(width, false, 0, "input");
+    for (uint32_t k = 1; k < depth - 1; k++)
+        nn.add_layer(width, true, k, "hidden-" + to_string(k), Activation::RELU);
+    nn.add_layer(10, true, depth - 1, "output", Activation::SOFTMAX);
+
+    mt19937 gen(5);
+    uniform_real_distribution<float> dist(0.0f, 1.0f);
+    vector<float> x(num_samples * width);
+    for (auto& v : x)
+        v = dist(gen);
+
+    // sequential reference
+    vector<float> expected(num_samples * 10);
+    Workspace ws = nn.make_workspace();
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < num_samples; i++) {
+        nn.forward(x.data() + i * width, ws);
+        copy(ws.a.back().begin(), ws.a.back().end(), expected.begin() + i * 10);
+    }
+    double t_seq = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("[*] sequential forward: %.2f ms, %.0f samples/s\n\n", t_seq, num_samples / t_seq * 1000);
+
+    for (size_t stages : {1, 2, 4, 8}) {
+        printf("[!] Testing pipeline with %zu stages, micro-batch 8\n", stages);
+        PipelineExecutor pipe(nn, stages, 8);
+        for (size_t s = 0; s < pipe.get_num_stages(); s++)
+            printf("[*] stage %zu: layers [%u, %u)\n", s, pipe.stage_first(s), pipe.stage_last(s));
+
+        vector<float> y(num_samples * 10);
+        start = chrono::steady_clock::now();
+        pipe.run(x.data(), num_samples, y.data());
+        double t = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        bool ok = equal(y.begin(), y.end(), expected.begin());
+        is_passed &= ok;
+        PipelineStats st = pipe.get_stats();
+        printf("[*] %.2f ms, %.0f samples/s, micro-batch latency mean %.1f us, p50 %.1f us, p99 %.1f us\n",
+               t, num_samples / t * 1000, st.mean_us, st.p50_us, st.p99_us);
+        printf("[!] Finished pipeline test with result: [%s]\n\n", ok ? "PASSED" : "FAILED");
+    }
+
+    printf("[!] Testing idle stages park\n");
+    {
+        PipelineExecutor pipe(nn, 4, 8);
+        vector<float> y(num_samples * 10);
+        bool ok = pipe.run(x.data(), num_samples, y.data()) == 0;
+
+        // spinning stages would take about 4 cores for the whole sleep
+        clock_t cpu = clock();
+        this_thread::sleep_for(chrono::milliseconds(200));
+        double cpu_ms = double(clock() - cpu) * 1000 / CLOCKS_PER_SEC;
+        ok &= cpu_ms < 100;
+
+        // and wake up for the next request
+        fill(y.begin(), y.end(), 0.0f);
+        ok &= pipe.run(x.data(), num_samples, y.data()) == 0 && equal(y.begin(), y.end(), expected.begin());
+        printf("[*] %.1f ms of CPU in 200 ms idle\n", cpu_ms);
+        is_passed &= ok;
+        printf("[!] Finished idle test with result: [%s]\n\n", ok ? "PASSED" : "FAILED");
+    }
+
+    printf("[!] Finished pipeline tests with result: [%s]\n", is_passed ? "PASSED" : "FAILED");
+
+    return is_passed ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/reduced_precision.hpp"
+#include "../lib/include/half.hpp"
+#include "../lib/include/trainer.hpp"
+#include "../lib/include/mnist_loader.hpp"
+
+
+using namespace std;
+
+
+// bf16 / fp16 weights against float32: conversions, accuracy and throughput.
+// usage: test_precision [mnist_dir|-]
+// mnist_dir holds train-images-idx3-ubyte, train-labels-idx1-ubyte, t10k-images-idx3-ubyte and t10k-labels-idx1-ubyte.
+// With "-" (or no args) a synthetic sparse data set of the same shape is used.
+
+
+// Sparse synthetic digits: every class lights up its own random ~20% of the pixels
+static void make_sparse(size_t n, vector<float>& x, vector<uint32_t>& labels, uint32_t seed)
+{
+    mt19937 gen(seed);
+    mt19937 pattern_gen(1);
+    uniform_real_distribution<float> u(0.0f, 1.0f);
+    vector<float> patterns(10 * MNIST_IMAGE_SIZE);
+    for (auto& p : patterns)
+        p = u(pattern_gen) < 0.2f ? u(pattern_gen) : 0.0f;
+
+    x.resize(n * MNIST_IMAGE_SIZE);
+    labels.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        labels[i] = gen() % 10;
+        for (uint32_t j = 0; j < MNIST_IMAGE_SIZE; j++) {
+            float p = patterns[labels[i] * MNIST_IMAGE_SIZE + j];
+            x[i * MNIST_IMAGE_SIZE + j] = (p > 0.0f && u(gen) < 0.04f) ? min(1.0f, p + 0.3f * u(gen)) : 0.0f;
+        }
+    }
+}
+
+static FullyConnectedNetwork* make_network(uint32_t h1, uint32_t h2)
+{
+    FullyConnectedNetwork* nn = new FullyConnectedNetwork();
+    nn->add_layer(MNIST_IMAGE_SIZE, false, 0, "input");
+    nn->add_layer(h1, true, 1, "hidden", Activation::RELU);
+    nn->add_layer(h2, true, 2, "hidden-2", Activation::RELU);
+    nn->add_layer(10, true, 3, "output", Activation::SOFTMAX);
+    return nn;
+}
+
+static float float_accuracy(FullyConnectedNetwork& nn, const vector<float>& x, const vector<uint32_t>& y)
+{
+    Workspace ws = nn.make_workspace();
+    size_t ok = 0;
+    for (size_t i = 0; i < y.size(); i++) {
+        nn.forward(x.data() + i * MNIST_IMAGE_SIZE, ws);
+        ok += uint32_t(max_element(ws.a.back().begin(), ws.a.back().end()) - ws.a.back().begin()) == y[i];
+    }
+    return float(ok) / y.size();
+}
+
+static float half_accuracy(ReducedPrecisionNetwork& rp, const vector<float>& x, const vector<uint32_t>& y, float& max_diff,
+                           FullyConnectedNetwork& nn)
+{
+    HalfWorkspace ws = rp.make_workspace(32);
+    Workspace fws = nn.make_workspace();
+    vector<float> out(32 * 10);
+    size_t ok = 0;
+    max_diff = 0;
+    for (size_t i = 0; i < y.size(); i += 32) {
+        size_t rows = min<size_t>(32, y.size() - i);
+        rp.forward(x.data() + i * MNIST_IMAGE_SIZE, rows, out.data(), ws);
+        for (size_t r = 0; r < rows; r++) {
+            ok += uint32_t(max_element(out.begin() + r * 10, out.begin() + r * 10 + 10) - out.begin() - r * 10) == y[i + r];
+            nn.forward(x.data() + (i + r) * MNIST_IMAGE_SIZE, fws);
+            for (int c = 0; c < 10; c++)
+                max_diff = max(max_diff, fabsf(out[r * 10 + c] - fws.a.back()[c]));
+        }
+    }
+    return float(ok) / y.size();
+}
+
+static double float_us(FullyConnectedNetwork& nn, const vector<float>& x, size_t n)
+{
+    Workspace ws = nn.make_workspace();
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++)
+        nn.forward(x.data() + i * MNIST_IMAGE_SIZE, ws);
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / n;
+}
+
+static double half_us(ReducedPrecisionNetwork& rp, const vector<float>& x, size_t n, size_t batch)
+{
+    HalfWorkspace ws = rp.make_workspace(batch);
+    vector<float> out(batch * 10);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i + batch <= n; i += batch)
+        rp.forward(x.data() + i * MNIST_IMAGE_SIZE, batch, out.data(), ws);
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / (n / batch * batch);
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    string mnist_dir = argc > 1 ? argv[1] : "-";
+    bool is_passed = true;
+
+    printf("[!] Testing bf16 / fp16 conversions\n");
+    {
+        is_passed &= float_to_bf16(1.0f) == 0x3f80 && float_to_bf16(-2.0f) == 0xc000;
+        // ties to even
+        is_passed &= float_to_bf16(1.0f + 1.0f / 256) == 0x3f80 && float_to_bf16(1.0f + 3.0f / 256) == 0x3f82;
+        is_passed &= std::isnan(bf16_to_float(float_to_bf16(NAN)));
+
+        is_passed &= float_to_fp16(1.0f) == 0x3c00 && float_to_fp16(-2.0f) == 0xc000;
+        is_passed &= float_to_fp16(65504.0f) == 0x7bff && float_to_fp16(65520.0f) == 0x7c00;
+        is_passed &= float_to_fp16(ldexpf(1.0f, -24)) == 0x0001 && float_to_fp16(ldexpf(1.0f, -26)) == 0;
+        is_passed &= float_to_fp16(ldexpf(1.0f, -14)) == 0x0400 && float_to_fp16(ldexpf(3.0f, -25)) == 0x0002;
+        is_passed &= std::isnan(fp16_to_float(float_to_fp16(NAN))) && std::isinf(fp16_to_float(0xfc00));
+
+        // every fp16 value converts exactly, both in scalar and widened in registers
+        vector<uint16_t> all(65536);
+        for (uint32_t h = 0; h < 65536; h++)
+            all[h] = uint16_t(h);
+        size_t bad = 0;
+        for (uint32_t h = 0; h < 65536; h += Vec::W) {
+            float lanes[Vec::W], blanes[Vec::W];
+            load_fp16(all.data() + h, Vec()).store(lanes);
+            load_bf16(all.data() + h, Vec()).store(blanes);
+            for (uint32_t i = 0; i < Vec::W; i++) {
+                uint16_t v = uint16_t(h + i);
+                float f = fp16_to_float(v);
+                bool nan = (v & 0x7fff) > 0x7c00;
+                if (!nan && (float_to_fp16(f) != v || float_bits(lanes[i]) != float_bits(f)))
+                    bad++;
+                if (nan && !std::isnan(lanes[i]))
+                    bad++;
+                if (float_bits(blanes[i]) != float_bits(bf16_to_float(v)))
+                    bad++;
+            }
+        }
+        is_passed &= bad == 0;
+        printf("[*] %zu of 65536 16-bit patterns convert wrong\n", bad);
+    }
+    printf("[!] Finished conversion test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    vector<float> train_x, test_x;
+    vector<uint32_t> train_y, test_y;
+    if (mnist_dir != "-") {
+        MNSITLoader train(mnist_dir + "/train-images-idx3-ubyte", mnist_dir + "/train-labels-idx1-ubyte");
+        MNSITLoader test(mnist_dir + "/t10k-images-idx3-ubyte", mnist_dir + "/t10k-labels-idx1-ubyte");
+        train.load(train_x, train_y);
+        test.load(test_x, test_y);
+    } else {
+        make_sparse(20000, train_x, train_y, 2);
+        make_sparse(5000, test_x, test_y, 3);
+    }
+
+    printf("[!] Testing accuracy of 16-bit weights (%zu train / %zu test samples)\n", train_y.size(), test_y.size());
+    {
+        FullyConnectedNetwork* nn = make_network(256, 128);
+        OptimizerConfig cfg;
+        cfg.type = OptimizerType::ADAM;
+        cfg.lr = 0.001f;
+        Optimizer opt(cfg);
+        DataParallelTrainer trainer(*nn, opt);
+        for (int e = 0; e < 2; e++)
+            trainer.train_epoch(train_x.data(), train_y.data(), train_y.size(), 32);
+
+        float acc = float_accuracy(*nn, test_x, test_y);
+        printf("[*] float32: accuracy %.4f, %zu bytes\n", acc, nn->num_params() * sizeof(float));
+        for (WeightFormat fmt : {WeightFormat::BF16, WeightFormat::FP16}) {
+            ReducedPrecisionNetwork* rp = ReducedPrecisionNetwork::convert(*nn, fmt);
+            float diff;
+            float half_acc = half_accuracy(*rp, test_x, test_y, diff, *nn);
+            printf("[*] %s: accuracy %.4f (%+.4f), max output difference %.5f, %zu bytes\n",
+                   fmt == WeightFormat::BF16 ? "bf16" : "fp16", half_acc, half_acc - acc, diff, rp->size_bytes());
+            is_passed &= fabsf(half_acc - acc) < 0.005f;
+            is_passed &= diff < (fmt == WeightFormat::BF16 ? 0.05f : 0.01f);
+            delete rp;
+        }
+
+        // converting while loading a saved model gives the same weights
+        string path = "/tmp/test_precision.snn";
+        nn->save(path);
+        ReducedPrecisionNetwork* a = ReducedPrecisionNetwork::convert(*nn, WeightFormat::FP16);
+        ReducedPrecisionNetwork* b = ReducedPrecisionNetwork::load(path, WeightFormat::FP16);
+        is_passed &= b != nullptr && a->get_layers()[1].w == b->get_layers()[1].w;
+        is_passed &= ReducedPrecisionNetwork::load(path + ".missing", WeightFormat::BF16) == nullptr;
+        remove(path.c_str());
+        delete a;
+        delete b;
+        delete nn;
+    }
+    printf("[!] Finished accuracy test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking a bandwidth bound network\n");
+    {
+        FullyConnectedNetwork* nn = make_network(2048, 2048);
+        size_t n = 256;
+        double f32 = float_us(*nn, test_x, n);
+        printf("[*] 784-2048-2048-10, %zu MB of float32 weights: %.1f us per sample\n",
+               nn->num_params() * sizeof(float) >> 20, f32);
+        for (WeightFormat fmt : {WeightFormat::BF16, WeightFormat::FP16}) {
+            ReducedPrecisionNetwork* rp = ReducedPrecisionNetwork::convert(*nn, fmt);
+            double b1 = half_us(*rp, test_x, n, 1), b32 = half_us(*rp, test_x, n, 32);
+            printf("[*] %s: batch 1 %.1f us (%.2fx), batch 32 %.1f us per sample (%.2fx)\n",
+                   fmt == WeightFormat::BF16 ? "bf16" : "fp16", b1, f32 / b1, b32, f32 / b32);
+            delete rp;
+        }
+        delete nn;
+    }
+
+    printf("[!] Finished precision tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
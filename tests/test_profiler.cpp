@@ -0,0 +1,163 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "../lib/include/profiler.hpp"
+#include "test_util.hpp"
+
+
+using namespace std;
+
+
+static double ns_per_forward(FullyConnectedNetwork* nn, const vector<float>& x, Workspace& ws, size_t n)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++)
+        nn->forward(x.data(), ws);
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / n;
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t n_bench = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+    uint32_t num_inputs = 64, hidden = 128, num_classes = 10;
+    bool is_passed = true;
+
+    mt19937 gen(5);
+    uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    vector<float> x(num_inputs);
+    for (auto &v : x)
+        v = dist(gen);
+
+    // a fixed host keeps the roofline numbers checkable
+    HostRoofline host;
+    host.peak_gflops = 32;
+    host.peak_gbps = 16;
+
+    printf("[!] Testing per layer counters\n");
+    {
+        FullyConnectedNetwork* nn = make_network(num_inputs, hidden, num_classes);
+        Workspace ws = nn->make_workspace();
+        vector<float> grads(nn->num_params(), 0.0f);
+        const size_t n_fwd = 50, n_bwd = 20;
+
+        Profiler prof(host);
+        is_passed &= prof.attach(*nn) == 0 && nn->get_profiler() == &prof;
+        for (size_t i = 0; i < n_fwd; i++)
+            nn->forward(x.data(), ws);
+        for (size_t i = 0; i < n_bwd; i++)
+            nn->backprop(x.data(), i % num_classes, ws, grads.data());
+
+        // backprop runs a forward pass of its own
+        vector<LayerProfile> layers = prof.snapshot();
+        is_passed &= layers.size() == 3;
+        for (auto &p : layers) {
+            is_passed &= p.forward_calls == n_fwd + n_bwd && p.backward_calls == n_bwd;
+            is_passed &= p.forward_ns > 0 && p.backward_ns > 0;
+            is_passed &= p.input_grad_calls == (p.index > 1 ? n_bwd : 0);
+            is_passed &= p.forward_flops() == 2.0 * p.n * p.n_in && p.forward_bytes() == 4.0 * p.n * p.n_in;
+            double grad_passes = p.index > 1 ? 2.0 : 1.0;
+            is_passed &= p.backward_flops() == 2.0 * p.n * p.n_in * grad_passes;
+            printf("[*] %-8s %ux%-3u fwd %lu calls %lu ns, bwd %lu calls %lu ns\n", p.name.c_str(), p.n, p.n_in,
+                   (unsigned long)p.forward_calls, (unsigned long)p.forward_ns, (unsigned long)p.backward_calls,
+                   (unsigned long)p.backward_ns);
+        }
+        is_passed &= layers.size() == 3 && layers[0].name == "hidden" && layers[0].n_in == num_inputs
+                     && layers[2].name == "output" && layers[2].n == num_classes;
+
+        // a second profiler can't take the network over
+        Profiler other(host);
+        is_passed &= other.attach(*nn) == -1 && nn->get_profiler() == &prof;
+
+        prof.reset();
+        is_passed &= prof.snapshot()[0].forward_calls == 0;
+
+        // detached, nothing is counted
+        prof.detach();
+        is_passed &= nn->get_profiler() == nullptr;
+        nn->forward(x.data(), ws);
+        is_passed &= prof.snapshot()[0].forward_calls == 0;
+
+        // destroying the network detaches it
+        is_passed &= prof.attach(*nn) == 0;
+        delete nn;
+        nn = make_network(num_inputs, hidden, num_classes);
+        is_passed &= nn->get_profiler() == nullptr && other.attach(*nn) == 0;
+        prof.detach();
+        is_passed &= nn->get_profiler() == &other;
+        delete nn;
+    }
+    printf("[!] Finished counters test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing report and JSON\n");
+    {
+        FullyConnectedNetwork* nn = make_network(num_inputs, hidden, num_classes);
+        Workspace ws = nn->make_workspace();
+        vector<float> grads(nn->num_params(), 0.0f);
+
+        Profiler prof(host);
+        prof.attach(*nn);
+        for (size_t i = 0; i < 200; i++)
+            nn->backprop(x.data(), i % num_classes, ws, grads.data());
+        prof.report();
+
+        string json = prof.to_json();
+        is_passed &= json.find("\"host\": {\"peak_gflops\": 32.000, \"peak_gbps\": 16.000, \"ridge\": 2.0000}")
+                     != string::npos;
+        is_passed &= json.find("\"name\": \"hidden-2\", \"n\": 128, \"n_in\": 128") != string::npos;
+        // 0.5 flop per byte forward, below the ridge of 2
+        is_passed &= json.find("\"intensity\": 0.5000, \"roofline_gflops\": 8.000") != string::npos;
+        is_passed &= json.find("\"bound\": \"memory\"") != string::npos;
+
+        int depth = 0, min_depth = 0;
+        for (char ch : json) {
+            depth += (ch == '{' || ch == '[') - (ch == '}' || ch == ']');
+            min_depth = min(min_depth, depth);
+        }
+        is_passed &= depth == 0 && min_depth == 0;
+
+        const string path = "/tmp/test_profiler.json";
+        is_passed &= prof.write_json(path) == 0;
+        FILE* f = fopen(path.c_str(), "r");
+        string read;
+        if (f != nullptr) {
+            char buf[4096];
+            size_t got;
+            while ((got = fread(buf, 1, sizeof(buf), f)) > 0)
+                read.append(buf, got);
+            fclose(f);
+        }
+        is_passed &= read == json;
+        remove(path.c_str());
+        is_passed &= prof.write_json("/nonexistent/dir/profile.json") == -1;
+        delete nn;
+    }
+    printf("[!] Finished report test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking %zu forward passes\n", n_bench);
+    {
+        FullyConnectedNetwork* nn = make_network(num_inputs, hidden, num_classes);
+        Workspace ws = nn->make_workspace();
+
+        HostRoofline measured = measure_roofline();
+        printf("[*] host: %.1f GFLOP/s, %.1f GB/s\n", measured.peak_gflops, measured.peak_gbps);
+        is_passed &= measured.peak_gflops > 0 && measured.peak_gbps > 0;
+
+        ns_per_forward(nn, x, ws, n_bench / 10);
+        double detached = ns_per_forward(nn, x, ws, n_bench);
+        Profiler prof(measured);
+        prof.attach(*nn);
+        double attached = ns_per_forward(nn, x, ws, n_bench);
+        prof.detach();
+        printf("[*] forward %.1f ns detached, %.1f ns profiled\n", detached, attached);
+        delete nn;
+    }
+
+    printf("[!] Finished profiler tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
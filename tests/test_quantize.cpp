@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/quantize.hpp"
+#include "../lib/include/trainer.hpp"
+#include "../lib/include/simd.hpp"
+#include "test_util.hpp"
+
+
+using namespace std;
+
+
+static void print_report(const QuantReport& r)
+{
+    printf("[*] %zu samples: float accuracy %.4f, int8 accuracy %.4f, agreement %.4f\n",
+           r.samples, r.float_accuracy, r.int8_accuracy, r.agreement);
+    printf("[*] output difference: max %.4f, mean %.5f\n", r.max_abs_diff, r.mean_abs_diff);
+    printf("[*] weights %zu -> %zu bytes, forward %.2f -> %.2f us (%.2fx)\n",
+           r.float_bytes, r.int8_bytes, r.float_us, r.int8_us, r.float_us / r.int8_us);
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t num_samples = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+    uint32_t num_inputs = 64, hidden = 128, num_classes = 10;
+    bool is_passed = true;
+
+    printf("[!] Testing the u8 x s8 dot product\n");
+    {
+        mt19937 gen(5);
+        for (size_t n : {32, 64, 96, 1024}) {
+            vector<uint8_t> a(n);
+            vector<int8_t> b(n);
+            int32_t expected = 0;
+            for (size_t i = 0; i < n; i++) {
+                // the extremes, where pmaddubsw would saturate with 8-bit inputs
+                a[i] = i % 3 == 0 ? 127 : gen() % 128;
+                b[i] = i % 3 == 0 ? (i % 2 ? 127 : -127) : int8_t(gen() % 255 - 127);
+                expected += int32_t(a[i]) * b[i];
+            }
+            is_passed &= simd_dot_u8s8(a.data(), b.data(), n) == expected;
+        }
+    }
+    printf("[!] Finished dot product test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    vector<float> x, test_x;
+    vector<uint32_t> labels, test_labels;
+    make_blobs(num_samples, num_inputs, num_classes, x, labels, 1.5f);
+    make_blobs(num_samples / 4, num_inputs, num_classes, test_x, test_labels, 1.5f);
+
+    FullyConnectedNetwork* nn = make_network(num_inputs, hidden, num_classes);
+    OptimizerConfig cfg;
+    cfg.type = OptimizerType::ADAM;
+    cfg.lr = 0.002f;
+    Optimizer opt(cfg);
+    DataParallelTrainer trainer(*nn, opt);
+    for (int e = 0; e < 3; e++)
+        trainer.train_epoch(x.data(), labels.data(), num_samples, 32);
+
+    printf("[!] Testing INT8 post-training quantization\n");
+    {
+        // calibrate on a slice of the training data, evaluate on held out samples
+        QuantizedNetwork* q = QuantizedNetwork::calibrate(*nn, x.data(), min<size_t>(num_samples, 1000));
+        if (q == nullptr) {
+            is_passed = false;
+        } else {
+            QuantReport r = QuantizedNetwork::compare(*nn, *q, test_x.data(), test_labels.data(), test_labels.size());
+            print_report(r);
+            is_passed &= r.float_accuracy > 0.8f;
+            is_passed &= fabsf(r.float_accuracy - r.int8_accuracy) < 0.01f;
+            is_passed &= r.agreement > 0.98f;
+            is_passed &= r.int8_bytes * 3 < r.float_bytes;
+            for (auto& l : q->get_layers())
+                is_passed &= l.n_in_pad % 32 == 0;
+        }
+        delete q;
+
+        is_passed &= QuantizedNetwork::calibrate(*nn, x.data(), 0) == nullptr;
+    }
+    printf("[!] Finished quantization test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+    delete nn;
+
+    printf("[!] Benchmarking a wide network\n");
+    {
+        FullyConnectedNetwork* wide = make_network(1024, 1024, num_classes);
+        vector<float> wx, wl_x;
+        vector<uint32_t> wl;
+        make_blobs(256, 1024, num_classes, wx, wl, 1.5f);
+        QuantizedNetwork* q = QuantizedNetwork::calibrate(*wide, wx.data(), 64);
+        if (q == nullptr) {
+            is_passed = false;
+        } else {
+            QuantReport r = QuantizedNetwork::compare(*wide, *q, wx.data(), wl.data(), wl.size());
+            print_report(r);
+            is_passed &= r.agreement > 0.9f;
+        }
+        delete q;
+        delete wide;
+    }
+
+    printf("[!] Finished quantization tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include "list.h"
 #include "htable.h"
+#include "chtable.h"
 #include "sorting.h"
 #include "binary_search.h"
 #include "tpool.h"
@@ -31,6 +32,84 @@ int cmp_int(const void * a, const void * b)
 }
 
 
+// 12 byte element to exercise the generic width path, seq checks stability
+typedef struct {
+    int key;
+    int seq;
+    int pad;
+} sort_rec_t;
+
+int cmp_rec(const void * a, const void * b)
+{
+    return ((sort_rec_t *)a)->key - ((sort_rec_t *)b)->key;
+}
+
+int cmp_long(const void * a, const void * b)
+{
+    long long x = *(long long *)a;
+    long long y = *(long long *)b;
+    return (x > y) - (x < y);
+}
+
+int cmp_float_key(const void * a, const void * b)
+{
+    float x = **(const float **)a;  // binary search passes &key
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// classic branchy lower bound for reference
+size_t ref_lower_bound(const float *base, size_t len, float key)
+{
+    size_t lo = 0;
+    size_t hi = len;
+    size_t mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (base[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// list elements are integers stored in the pointer, cmp gets pointers to the elements
+int cmp_ptr_int(const void * a, const void * b)
+{
+    size_t x = (size_t)*(void **)a;
+    size_t y = (size_t)*(void **)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    chtable_t *cht;
+    size_t     first;
+    size_t     last;
+} chtable_job_t;
+
+// each worker inserts and reads back its own range of keys
+void chtable_worker(void *arg)
+{
+    chtable_job_t *job = arg;
+    void          *val;
+    size_t         k;
+
+    for (k=job->first; k <= job->last; k++)
+        chtable_insert(job->cht, (void *)k, (void *)(k * 2));
+    for (k=job->first; k <= job->last; k++) {
+        if (!chtable_get(job->cht, (void *)k, &val) || val != (void *)(k * 2))
+            job->first = 0;  // flag the failure
+    }
+}
+
+double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+
 int main(int argc, char **argv)
 {
     printf("%s:%s:%d \n", __FILE__, __FUNCTION__, __LINE__);
@@ -64,6 +143,165 @@ int main(int argc, char **argv)
     printf("[!] Finished sorting test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
 /*----------------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+    size_t           num_sort = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1000000;
+    size_t           n;
+    struct timespec  start;
+    struct timespec  end;
+
+    printf("[!] Testing merge_sort on %zu elements: random, sorted, reversed, 4/8/12 byte elements\n", num_sort);
+    int        *ia = malloc(num_sort * sizeof(*ia));
+    long long  *la = malloc(num_sort * sizeof(*la));
+    sort_rec_t *ra = malloc(num_sort * sizeof(*ra));
+
+    is_passed = true;
+    for (n=0; n < num_sort; n++) {
+        ia[n] = rand();
+        la[n] = ((long long)rand() << 31) ^ rand();
+        ra[n].key = rand() % 1000;  // lots of duplicates
+        ra[n].seq = (int)n;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    merge_sort(ia, num_sort, sizeof(*ia), cmp_int);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] int32 random:    %.1f ms\n", elapsed_ms(&start, &end));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    merge_sort(la, num_sort, sizeof(*la), cmp_long);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] int64 random:    %.1f ms\n", elapsed_ms(&start, &end));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    merge_sort(ra, num_sort, sizeof(*ra), cmp_rec);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] 12 byte random:  %.1f ms\n", elapsed_ms(&start, &end));
+
+    for (n=1; n < num_sort; n++) {
+        if (ia[n - 1] > ia[n] || la[n - 1] > la[n] || ra[n - 1].key > ra[n].key ||
+            (ra[n - 1].key == ra[n].key && ra[n - 1].seq > ra[n].seq)) {
+            is_passed = false;
+            break;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    merge_sort(ia, num_sort, sizeof(*ia), cmp_int);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] int32 sorted:    %.1f ms\n", elapsed_ms(&start, &end));
+
+    for (n=0; n < num_sort; n++)
+        ia[n] = (int)(num_sort - n);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    merge_sort(ia, num_sort, sizeof(*ia), cmp_int);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] int32 reversed:  %.1f ms\n", elapsed_ms(&start, &end));
+
+    for (n=0; n < num_sort; n++) {
+        if (ia[n] != (int)(n + 1)) {
+            is_passed = false;
+            break;
+        }
+    }
+
+    free(ia);
+    free(la);
+    free(ra);
+    printf("[!] Finished merge_sort test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+
+
+    printf("[!] Testing radix_sort_f32 on %zu signed floats with ids\n", num_sort);
+    {
+        float    *fk  = malloc(num_sort * sizeof(*fk));
+        float    *org = malloc(num_sort * sizeof(*org));
+        uint32_t *ids = malloc(num_sort * sizeof(*ids));
+
+        for (n=0; n < num_sort; n++) {
+            fk[n]  = (float)(rand() % 20001 - 10000) / 7.0f;
+            org[n] = fk[n];
+            ids[n] = (uint32_t)n;
+        }
+        fk[0] = -0.0f;
+        org[0] = -0.0f;
+
+        if (radix_sort_f32(fk, ids, num_sort) != 0)
+            is_passed = false;
+        for (n=0; n < num_sort && is_passed; n++) {
+            if ((n > 0 && fk[n - 1] > fk[n]) || org[ids[n]] != fk[n])
+                is_passed = false;
+        }
+
+        free(fk);
+        free(org);
+        free(ids);
+    }
+    printf("[!] Finished radix_sort_f32 test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+    printf("[!] Testing lower bound searches: %zu sorted edges, %zu queries\n", num_sort, num_sort);
+    float    *edges = malloc(num_sort * sizeof(*edges));
+    float    *qs    = malloc(num_sort * sizeof(*qs));
+    float    *tree  = malloc((num_sort + 1) * sizeof(*tree));
+    uint32_t *ranks = malloc((num_sort + 1) * sizeof(*ranks));
+    size_t   *ref   = malloc(num_sort * sizeof(*ref));
+    size_t   *res   = malloc(num_sort * sizeof(*res));
+
+    is_passed = true;
+    for (n=0; n < num_sort; n++) {
+        edges[n] = (float)n * 2;
+        qs[n]    = (float)(rand() % (num_sort * 2 + 2)) - 1;
+    }
+    eytzinger_build_f32(edges, num_sort, tree, ranks);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n=0; n < num_sort; n++)
+        ref[n] = ref_lower_bound(edges, num_sort, qs[n]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] branchy:             %.1f ms\n", elapsed_ms(&start, &end));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n=0; n < num_sort; n++)
+        res[n] = lower_bound_f32(edges, num_sort, qs[n]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] branchless:          %.1f ms\n", elapsed_ms(&start, &end));
+    is_passed = is_passed && memcmp(ref, res, num_sort * sizeof(*res)) == 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    lower_bound_f32_batch(edges, num_sort, qs, num_sort, res);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] branchless batched:  %.1f ms\n", elapsed_ms(&start, &end));
+    is_passed = is_passed && memcmp(ref, res, num_sort * sizeof(*res)) == 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n=0; n < num_sort; n++)
+        res[n] = eytzinger_lower_bound_f32(tree, ranks, num_sort, qs[n]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] eytzinger:           %.1f ms\n", elapsed_ms(&start, &end));
+    is_passed = is_passed && memcmp(ref, res, num_sort * sizeof(*res)) == 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    eytzinger_lower_bound_f32_batch(tree, ranks, num_sort, qs, num_sort, res);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] eytzinger batched:   %.1f ms\n", elapsed_ms(&start, &end));
+    is_passed = is_passed && memcmp(ref, res, num_sort * sizeof(*res)) == 0;
+
+    for (n=0; n < 1000 && is_passed; n++)
+        is_passed = binary_lower_bound(edges, num_sort, sizeof(*edges), qs + n, cmp_float_key) == ref[n];
+
+    free(edges);
+    free(qs);
+    free(tree);
+    free(ranks);
+    free(ref);
+    free(res);
+    printf("[!] Finished lower bound test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------------*/
 
     printf("[!] Testing thread pool: 4 threads and 100 work items\n");
@@ -97,7 +335,211 @@ int main(int argc, char **argv)
 /*----------------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------------*/
 
-    // printf("Testing generic list\n");
+    // number of keys for the hashtable benchmark, e.g. ./test 10000000
+    size_t num_keys = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    printf("[!] Testing hashtable: insert, get, remove and enumerate %zu keys\n", num_keys);
+    htable_t        *ht;
+    htable_enum_t   *he;
+    void            *val;
+    size_t           k;
+    size_t           found;
+
+    is_passed = true;
+    ht = htable_create(htable_hash_int, htable_int_eq, NULL);
+    htable_reserve(ht, num_keys);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k=1; k <= num_keys; k++)
+        htable_insert(ht, (void *)k, (void *)(k * 2));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] %zu inserts in %.1f ms\n", num_keys, elapsed_ms(&start, &end));
+
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k=1; k <= num_keys; k++)
+        found += htable_get_direct(ht, (void *)k) == (void *)(k * 2);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] %zu lookups (hits) in %.1f ms, %.1f Mops/s\n", num_keys, elapsed_ms(&start, &end),
+        num_keys / elapsed_ms(&start, &end) / 1e3);
+    if (found != num_keys)
+        is_passed = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k=num_keys + 1; k <= 2 * num_keys; k++)
+        found += htable_get(ht, (void *)k, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] %zu lookups (misses) in %.1f ms, %.1f Mops/s\n", num_keys, elapsed_ms(&start, &end),
+        num_keys / elapsed_ms(&start, &end) / 1e3);
+    if (found != num_keys)
+        is_passed = false;
+
+    void **keys = malloc(num_keys * sizeof(*keys));
+    void **outs = malloc(num_keys * sizeof(*outs));
+    for (k=0; k < num_keys; k++)
+        keys[k] = (void *)(((k * 7919) % num_keys) + 1);  // same keys, scattered order
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    found = htable_get_many(ht, keys, num_keys, outs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] %zu batched lookups (htable_get_many) in %.1f ms, %.1f Mops/s\n", num_keys, elapsed_ms(&start, &end),
+        num_keys / elapsed_ms(&start, &end) / 1e3);
+    if (found != num_keys || outs[0] != (void *)((size_t)keys[0] * 2))
+        is_passed = false;
+    free(keys);
+    free(outs);
+
+    // remove the odd keys, the even ones must survive the backward shifts
+    for (k=1; k <= num_keys; k += 2)
+        htable_remove(ht, (void *)k);
+    for (k=1; k <= num_keys; k++) {
+        if (htable_get(ht, (void *)k, &val) != (k % 2 == 0) || (k % 2 == 0 && val != (void *)(k * 2))) {
+            is_passed = false;
+            break;
+        }
+    }
+
+    found = 0;
+    he = htable_enum_create(ht);
+    while (htable_enum_next(he, NULL, &val))
+        found++;
+    htable_enum_destroy(he);
+    if (found != num_keys / 2)
+        is_passed = false;
+
+    htable_destroy(ht);
+    printf("[!] Finished hashtable test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+
+    printf("[!] Testing hashtable with string keys\n");
+    char *words[] = {"the", "quick", "brown", "fox", "jumps", "over", "the", "lazy", "dog"};
+
+    is_passed = true;
+    ht = htable_create(htable_hash_str, htable_str_eq, NULL);
+    for (k=0; k < sizeof(words) / sizeof(words[0]); k++)
+        htable_insert(ht, words[k], (void *)(k + 1));
+
+    char lookup[] = "the";  // a different pointer with the same contents
+    if (htable_get_direct(ht, lookup) != (void *)7 || htable_get(ht, "cat", NULL))
+        is_passed = false;
+    if (htable_hash_str("fox", 1) == htable_hash_str("fox", 2))
+        is_passed = false;
+    htable_destroy(ht);
+    printf("[!] Finished string keys test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+
+    printf("[!] Testing concurrent hashtable: %zu threads inserting %zu keys\n", num_threads, num_keys);
+    chtable_t      *cht;
+    chtable_enum_t *che;
+    chtable_job_t   jobs[num_threads];
+
+    is_passed = true;
+    cht = chtable_create(htable_hash_int, htable_int_eq, NULL, 0);
+    chtable_reserve(cht, num_keys);
+    tm  = tpool_create(num_threads);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k=0; k < num_threads; k++) {
+        jobs[k].cht   = cht;
+        jobs[k].first = k * (num_keys / num_threads) + 1;
+        jobs[k].last  = (k + 1 == num_threads) ? num_keys : (k + 1) * (num_keys / num_threads);
+        tpool_add_work(tm, chtable_worker, jobs + k);
+    }
+
+    // enumerate while the writers are still going, every pair seen must be a valid one
+    che = chtable_enum_create(cht);
+    while (chtable_enum_next(che, &val, NULL)) {
+        if ((size_t)val == 0 || (size_t)val > num_keys) {
+            is_passed = false;
+            break;
+        }
+    }
+    chtable_enum_destroy(che);
+
+    tpool_wait(tm);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] %zu concurrent inserts + lookups in %.1f ms\n", num_keys, elapsed_ms(&start, &end));
+    tpool_destroy(tm);
+
+    for (k=0; k < num_threads; k++) {
+        if (jobs[k].first == 0)
+            is_passed = false;
+    }
+
+    found = 0;
+    che = chtable_enum_create(cht);
+    while (chtable_enum_next(che, NULL, &val))
+        found++;
+    chtable_enum_destroy(che);
+    if (found != num_keys)
+        is_passed = false;
+
+    for (k=1; k <= num_keys; k += 2)
+        chtable_remove(cht, (void *)k);
+    if (chtable_get(cht, (void *)1, NULL) || !chtable_get(cht, (void *)2, NULL))
+        is_passed = false;
+
+    chtable_destroy(cht);
+    printf("[!] Finished concurrent hashtable test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------------*/
+
+    size_t num_list = num_sort / 20;  // one at a time sorted inserts are O(n^2), keep that part small
+
+    printf("[!] Testing generic list: sorted inserts of %zu elements, bulk load of %zu\n", num_list, num_sort);
+    list_cbs_t  lcbs = { cmp_ptr_int, NULL, NULL };
+    list_t     *l;
+
+    is_passed = true;
+    l = list_create(&lcbs, LIST_SORT);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n=0; n < num_list; n++)
+        list_append(l, (void *)(size_t)(rand() % 1000 + 1));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] %zu sorted inserts: %.1f ms\n", num_list, elapsed_ms(&start, &end));
+
+    for (n=1; n < list_len(l); n++) {
+        if ((size_t)list_get(l, n - 1) > (size_t)list_get(l, n)) {
+            is_passed = false;
+            break;
+        }
+    }
+    list_insert(l, (void *)(size_t)5000, 0);  // sorted lists ignore the index
+    if (list_get(l, list_len(l) - 1) != (void *)(size_t)5000)
+        is_passed = false;
+    if (!list_index_of(l, (void *)(size_t)5000, &k) || k != list_len(l) - 1 || list_index_of(l, (void *)(size_t)4999, &k))
+        is_passed = false;
+    list_destroy(l);
+
+    l = list_create(&lcbs, LIST_SORT);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    list_reserve(l, num_sort);
+    list_start_bulk_add(l);
+    for (n=0; n < num_sort; n++)
+        list_append(l, (void *)(size_t)(rand() + 1));
+    list_end_bulk_add(l);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[*] %zu bulk loaded inserts: %.1f ms\n", num_sort, elapsed_ms(&start, &end));
+
+    list_shrink(l);
+    for (n=1; n < list_len(l); n++) {
+        if ((size_t)list_get(l, n - 1) > (size_t)list_get(l, n)) {
+            is_passed = false;
+            break;
+        }
+    }
+    if (list_len(l) != num_sort || !list_index_of(l, list_get(l, num_sort / 2), &k) ||
+        list_get(l, k) != list_get(l, num_sort / 2))
+        is_passed = false;
+    list_destroy(l);
+    printf("[!] Finished generic list test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
 
 
     return 0;
@@ -0,0 +1,164 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/sparse.hpp"
+#include "test_util.hpp"
+
+
+using namespace std;
+
+
+static float max_diff(FullyConnectedNetwork& nn, SparseNetwork& sn, const vector<float>& x, size_t n, size_t batch)
+{
+    Workspace fws = nn.make_workspace();
+    SparseWorkspace ws = sn.make_workspace(batch);
+    vector<float> y(batch * sn.num_outputs());
+    float diff = 0;
+    for (size_t i = 0; i + batch <= n; i += batch) {
+        if (sn.forward(x.data() + i * sn.num_inputs(), batch, y.data(), ws) != 0)
+            return INFINITY;
+        for (size_t r = 0; r < batch; r++) {
+            nn.forward(x.data() + (i + r) * sn.num_inputs(), fws);
+            for (uint32_t c = 0; c < sn.num_outputs(); c++)
+                diff = max(diff, fabsf(y[r * sn.num_outputs() + c] - fws.a.back()[c]));
+        }
+    }
+    return diff;
+}
+
+static double sparse_us(SparseNetwork& sn, const vector<float>& x, size_t n, size_t batch)
+{
+    SparseWorkspace ws = sn.make_workspace(batch);
+    vector<float> y(batch * sn.num_outputs());
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i + batch <= n; i += batch)
+        sn.forward(x.data() + i * sn.num_inputs(), batch, y.data(), ws);
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / (n / batch * batch);
+}
+
+static double dense_us(FullyConnectedNetwork& nn, const vector<float>& x, size_t n)
+{
+    Workspace ws = nn.make_workspace();
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++)
+        nn.forward(x.data() + i * nn.num_inputs(), ws);
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / n;
+}
+
+static const char* format_name(SparseFormat f)
+{
+    return f == SparseFormat::DENSE ? "dense" : f == SparseFormat::CSR ? "csr" : "bsr 4x1";
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    uint32_t width = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2048;
+    bool is_passed = true;
+
+    mt19937 gen(3);
+    uniform_real_distribution<float> dist(0.0f, 1.0f);
+    vector<float> x(256 * 784);
+    for (auto& v : x)
+        v = dist(gen);
+
+    printf("[!] Testing pruning\n");
+    {
+        FullyConnectedNetwork* nn = make_network(64, 70, 10);
+        FullyConnectedNetwork shared(*nn);
+        is_passed &= prune(*nn, 1.0f) == -1 && prune(*nn, -0.1f) == -1;
+        is_passed &= prune(*nn, 0.9f, PruneMode::MAGNITUDE) == 0;
+        for (uint32_t k = 1; k < nn->get_depth(); k++) {
+            auto w = nn->get_layer(k)->weights();
+            size_t zeros = count(w.begin(), w.end(), 0.0f);
+            is_passed &= zeros == size_t(0.9f * w.size());
+        }
+        // the copy that shared the weights keeps them
+        auto w = shared.get_layer(1)->weights();
+        is_passed &= count(w.begin(), w.end(), 0.0f) == 0;
+
+        is_passed &= prune(shared, 0.5f, PruneMode::BLOCK_4x1) == 0;
+        for (uint32_t k = 1; k < shared.get_depth(); k++) {
+            Layer* l = shared.get_layer(k);
+            auto lw = l->weights();
+            uint32_t n = l->get_n(), n_in = l->get_n_in();
+            size_t blocks = 0, empty = 0;
+            for (uint32_t r = 0; r < n; r += 4) {
+                for (uint32_t j = 0; j < n_in; j++) {
+                    size_t z = 0, len = min(n, r + 4) - r;
+                    for (uint32_t i = r; i < r + len; i++)
+                        z += lw[i * n_in + j] == 0.0f;
+                    // a block is either gone or whole
+                    is_passed &= z == 0 || z == len;
+                    empty += z == len;
+                    blocks++;
+                }
+            }
+            is_passed &= empty == size_t(0.5f * blocks);
+        }
+        delete nn;
+    }
+    printf("[!] Finished pruning test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing sparse kernels against the float network\n");
+    {
+        for (PruneMode mode : {PruneMode::MAGNITUDE, PruneMode::BLOCK_4x1}) {
+            FullyConnectedNetwork* nn = make_network(784, 130, 10);
+            prune(*nn, 0.8f, mode);
+
+            SparseConfig dense_cfg;
+            dense_cfg.min_sparsity = 2.0f;
+            for (SparseConfig cfg : {SparseConfig(), dense_cfg}) {
+                SparseNetwork* sn = SparseNetwork::convert(*nn, cfg);
+                SparseFormat f = sn->get_layers()[1].format;
+                is_passed &= f == (cfg.min_sparsity > 1.0f ? SparseFormat::DENSE :
+                                   mode == PruneMode::MAGNITUDE ? SparseFormat::CSR : SparseFormat::BSR_4x1);
+                for (size_t batch : {1, 13, 32}) {
+                    float d = max_diff(*nn, *sn, x, 64, batch);
+                    is_passed &= d < 1e-5f;
+                    printf("[*] %-7s batch %2zu: max difference %.2e\n", format_name(f), batch, d);
+                }
+                delete sn;
+            }
+            delete nn;
+        }
+    }
+    printf("[!] Finished kernel test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking 784-%u-%u-10\n", width, width);
+    {
+        FullyConnectedNetwork* nn = make_network(784, width, 10);
+        double base = dense_us(*nn, x, 64);
+        printf("[*] float network: %.1f us per sample\n", base);
+
+        for (PruneMode mode : {PruneMode::MAGNITUDE, PruneMode::BLOCK_4x1}) {
+            FullyConnectedNetwork pruned(*nn);
+            prune(pruned, 0.9f, mode);
+            SparseNetwork* sn = SparseNetwork::convert(pruned);
+            double b1 = sparse_us(*sn, x, 64, 1), b32 = sparse_us(*sn, x, 256, 32);
+            printf("[*] 90%% %s: %zu -> %zu bytes, batch 1 %.1f us (%.2fx), batch 32 %.1f us per sample (%.2fx)\n",
+                   format_name(sn->get_layers()[1].format), pruned.num_params() * sizeof(float), sn->size_bytes(),
+                   b1, base / b1, b32, base / b32);
+            is_passed &= b1 < base;
+            delete sn;
+        }
+
+        // not sparse enough: falls back to dense kernels
+        FullyConnectedNetwork pruned(*nn);
+        prune(pruned, 0.5f);
+        SparseNetwork* sn = SparseNetwork::convert(pruned);
+        is_passed &= sn->get_layers()[1].format == SparseFormat::DENSE;
+        printf("[*] 50%% pruned stays %s: batch 1 %.1f us\n", format_name(sn->get_layers()[1].format), sparse_us(*sn, x, 64, 1));
+        delete sn;
+        delete nn;
+    }
+
+    printf("[!] Finished sparse tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
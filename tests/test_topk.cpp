@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/topk.hpp"
+
+
+using namespace std;
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    uint32_t rows = 64;
+    uint32_t cols = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100000;
+    bool     is_passed = true;
+
+    mt19937 gen(7);
+    normal_distribution<float> dist(0.0f, 1.0f);
+    vector<float> scores((size_t)rows * cols);
+    for (auto& s : scores)
+        s = dist(gen);
+    // a tie to check the lower index wins
+    scores[5] = scores[9] = 100.0f;
+
+    for (uint32_t k : {1u, 10u, cols / 4}) {
+        printf("[!] Testing topk: %u rows x %u outputs, k=%u\n", rows, cols, k);
+        vector<uint32_t> idx((size_t)rows * k);
+        vector<float>    vals((size_t)rows * k);
+
+        auto start = chrono::steady_clock::now();
+        topk(scores.data(), rows, cols, k, idx.data(), vals.data());
+        double t_topk = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        // reference: sort every row completely
+        start = chrono::steady_clock::now();
+        vector<uint32_t> order(cols);
+        for (uint32_t r = 0; r < rows && is_passed; r++) {
+            const float* row = scores.data() + (size_t)r * cols;
+            for (uint32_t j = 0; j < cols; j++)
+                order[j] = j;
+            stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return row[a] > row[b]; });
+            for (uint32_t i = 0; i < k; i++) {
+                if (idx[(size_t)r * k + i] != order[i] || vals[(size_t)r * k + i] != row[order[i]]) {
+                    is_passed = false;
+                    break;
+                }
+            }
+        }
+        double t_sort = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        printf("[*] topk: %.2f ms, full sort: %.2f ms\n", t_topk, t_sort);
+        printf("[!] Finished topk test with result: [%s]\n\n", is_passed ? "PASSED": "FAILED");
+    }
+
+    if (topk(scores.data(), rows, cols, 0, nullptr, nullptr) != -1)
+        is_passed = false;
+
+    return is_passed ? 0 : 1;
+}
@@ -0,0 +1,326 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../lib/include/mnist_loader.hpp"
+#include "../lib/include/pipeline.hpp"
+#include "../lib/include/trainer.hpp"
+#include "../utils/trace.h"
+
+
+using namespace std;
+
+
+struct Event
+{
+    char ph = 0;
+    string cat;
+    string name;
+    double ts = 0;
+    double dur = 0;
+    uint32_t tid = 0;
+};
+
+static string str_field(const string& line, const char* key)
+{
+    string k = string("\"") + key + "\": \"";
+    size_t p = line.find(k);
+    if (p == string::npos)
+        return "";
+    p += k.size();
+    return line.substr(p, line.find('"', p) - p);
+}
+
+static double num_field(const string& line, const char* key)
+{
+    string k = string("\"") + key + "\": ";
+    size_t p = line.find(k);
+    return p == string::npos ? -1 : strtod(line.c_str() + p + k.size(), NULL);
+}
+
+// The writer puts one event per line
+static vector<Event> read_trace(const string& path, string& all)
+{
+    vector<Event> events;
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+        return events;
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), f) != nullptr) {
+        string line = buf;
+        all += line;
+        if (line.find("\"ph\": ") == string::npos)
+            continue;
+        Event e;
+        e.ph = str_field(line, "ph")[0];
+        e.cat = str_field(line, "cat");
+        e.name = str_field(line, "name");
+        e.ts = num_field(line, "ts");
+        e.dur = num_field(line, "dur");
+        e.tid = uint32_t(num_field(line, "tid"));
+        events.push_back(e);
+    }
+    fclose(f);
+    return events;
+}
+
+static map<string, size_t> count_spans(const vector<Event>& events)
+{
+    map<string, size_t> n;
+    for (auto &e : events) {
+        if (e.ph == 'X')
+            n[e.name]++;
+    }
+    return n;
+}
+
+static bool balanced(const string& json)
+{
+    int depth = 0;
+    bool in_str = false;
+    for (size_t i = 0; i < json.size(); i++) {
+        char ch = json[i];
+        if (in_str) {
+            if (ch == '\\')
+                i++;
+            else if (ch == '"')
+                in_str = false;
+            continue;
+        }
+        if (ch == '"')
+            in_str = true;
+        depth += (ch == '{' || ch == '[') - (ch == '}' || ch == ']');
+        if (depth < 0)
+            return false;
+    }
+    return depth == 0 && !in_str;
+}
+
+static void busy(void* arg)
+{
+    volatile float* x = static_cast<float*>(arg);
+    for (int i = 0; i < 2000; i++)
+        *x = *x * 0.999f + 1.0f;
+}
+
+// A small MNIST pair of files in the big endian IDX format
+static void write_mnist(const string& images, const string& labels, uint32_t n)
+{
+    auto be = [](FILE* f, uint32_t v) {
+        uint8_t b[4] = {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)};
+        fwrite(b, 1, 4, f);
+    };
+    FILE* f = fopen(images.c_str(), "wb");
+    be(f, 2051); be(f, n); be(f, MNIST_ROWS); be(f, MNIST_COLS);
+    vector<uint8_t> px(size_t(n) * MNIST_IMAGE_SIZE);
+    for (size_t i = 0; i < px.size(); i++)
+        px[i] = uint8_t(i * 7);
+    fwrite(px.data(), 1, px.size(), f);
+    fclose(f);
+
+    f = fopen(labels.c_str(), "wb");
+    be(f, 2049); be(f, n);
+    for (uint32_t i = 0; i < n; i++)
+        fputc(int(i % 10), f);
+    fclose(f);
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t n_bench = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    const string path = "/tmp/test_trace.json";
+    bool is_passed = true;
+    trace_set_thread_name("main");
+
+    printf("[!] Testing task pool spans\n");
+    {
+        const size_t tasks = 64;
+        tpool_t* pool = tpool_create(3);
+        vector<float> x(tasks * 16, 1.0f);
+
+        // nothing is recorded while stopped
+        trace_start(0);
+        trace_stop();
+        tpool_add_work(pool, busy, &x[0]);
+        tpool_wait(pool);
+        is_passed &= trace_event_count() == 0;
+
+        trace_start(0);
+        for (size_t i = 0; i < tasks; i++)
+            tpool_add_work(pool, busy, &x[i * 16]);
+        tpool_wait(pool);
+        trace_stop();
+        is_passed &= trace_write_json(path.c_str()) == 0;
+        tpool_destroy(pool);
+
+        string json;
+        vector<Event> events = read_trace(path, json);
+        map<string, size_t> spans = count_spans(events);
+        size_t flow_begin = 0, flow_end = 0;
+        for (auto &e : events) {
+            flow_begin += e.ph == 's';
+            flow_end += e.ph == 'f';
+            is_passed &= e.ph == 'M' || (e.ts >= 0 && (e.ph != 'X' || e.dur >= 0));
+        }
+        is_passed &= spans["enqueue"] == tasks && spans["dequeue"] == tasks && spans["execute"] == tasks;
+        is_passed &= flow_begin == tasks && flow_end == tasks;
+        is_passed &= json.find("\"name\": \"tpool worker\"") != string::npos;
+        is_passed &= balanced(json) && trace_dropped() == 0;
+        printf("[*] %zu events: %zu enqueue, %zu dequeue, %zu execute, %zu idle, %zu flows\n", events.size(),
+               spans["enqueue"], spans["dequeue"], spans["execute"], spans["idle"], flow_begin);
+    }
+    printf("[!] Finished task pool test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing loader, trainer and layer spans\n");
+    {
+        const uint32_t n = 64;
+        const string images = "/tmp/test_trace_images.idx", labels = "/tmp/test_trace_labels.idx";
+        write_mnist(images, labels, n);
+
+        tpool_t* pool = tpool_create(2);
+        FullyConnectedNetwork nn;
+        nn.add_layer(MNIST_IMAGE_SIZE, false, 0, "input");
+        nn.add_layer(32, true, 1, "hidden", Activation::RELU);
+        nn.add_layer(10, true, 2, "output", Activation::SOFTMAX);
+        OptimizerConfig cfg;
+        Optimizer opt(cfg);
+        DataParallelTrainer trainer(nn, opt, pool, 2);
+
+        trace_start(0);
+        vector<float> x;
+        vector<uint32_t> y;
+        uint32_t loaded = 0;
+        try {
+            MNSITLoader loader(images, labels);
+            loaded = loader.load(x, y);
+        } catch (const std::exception& e) {
+            printf("[*] %s\n", e.what());
+        }
+        is_passed &= loaded == n;
+        float loss = loaded == n ? trainer.train_batch(x.data(), y.data(), 16) : -1;
+        trace_stop();
+        is_passed &= loss > 0;
+        is_passed &= trace_write_json(path.c_str()) == 0;
+        tpool_destroy(pool);
+        remove(images.c_str());
+        remove(labels.c_str());
+
+        string json;
+        vector<Event> events = read_trace(path, json);
+        map<string, size_t> spans = count_spans(events);
+        is_passed &= spans["load"] == 1 && spans["read"] == 1 && spans["convert"] == 1;
+        is_passed &= spans["train_batch"] == 1 && spans["shard"] == 2 && spans["reduce_grads"] == 1;
+        is_passed &= spans["optimizer step"] == 1;
+        is_passed &= spans["hidden fwd"] == 16 && spans["output fwd"] == 16;
+        is_passed &= spans["hidden bwd"] == 16 && spans["output bwd"] == 16;
+        is_passed &= balanced(json);
+
+        // every kernel runs inside the batch
+        double batch_begin = 0, batch_end = 0;
+        for (auto &e : events) {
+            if (e.ph == 'X' && e.name == "train_batch") {
+                batch_begin = e.ts;
+                batch_end = e.ts + e.dur;
+            }
+        }
+        for (auto &e : events) {
+            if (e.ph == 'X' && e.cat == "layer")
+                is_passed &= e.ts >= batch_begin - 1e-3 && e.ts + e.dur <= batch_end + 1e-3;
+        }
+        for (auto &s : spans)
+            printf("[*] %-16s %zu\n", s.first.c_str(), s.second);
+    }
+    printf("[!] Finished loader and trainer test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing pipeline spans\n");
+    {
+        FullyConnectedNetwork nn;
+        nn.add_layer(16, false, 0, "input");
+        nn.add_layer(32, true, 1, "a", Activation::RELU);
+        nn.add_layer(32, true, 2, "b", Activation::RELU);
+        nn.add_layer(4, true, 3, "c", Activation::SOFTMAX);
+        vector<float> x(40 * 16, 0.5f), y(40 * 4);
+
+        trace_start(0);
+        {
+            PipelineExecutor pipe(nn, 2, 8);
+            is_passed &= pipe.run(x.data(), 40, y.data()) == 0;
+        }
+        trace_stop();
+        is_passed &= trace_write_json(path.c_str()) == 0;
+
+        string json;
+        vector<Event> events = read_trace(path, json);
+        map<string, size_t> spans = count_spans(events);
+        is_passed &= spans["submit"] == 5 && spans["collect"] == 5 && spans["stage"] == 10;
+        is_passed &= spans["a"] == 5 && spans["b"] == 5 && spans["c"] == 5;
+        is_passed &= json.find("\"name\": \"pipeline stage 1\"") != string::npos;
+        printf("[*] %zu submit, %zu stage, %zu collect\n", spans["submit"], spans["stage"], spans["collect"]);
+    }
+    printf("[!] Finished pipeline test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing the event limit and timestamps\n");
+    {
+        trace_start(2 * TRACE_CHUNK_EVENTS);
+        for (int i = 0; i < 5000; i++)
+            trace_instant("test", "tick", "i", i);
+        {
+            TRACE_SPAN("test", "sleep \"20 ms\"");
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
+        trace_stop();
+        is_passed &= trace_event_count() == 2 * TRACE_CHUNK_EVENTS && trace_dropped() == 5001 - 2 * TRACE_CHUNK_EVENTS;
+
+        // a new session starts empty, the span lands in the first chunk again
+        trace_start(0);
+        {
+            TRACE_SPAN("test", "sleep \"20 ms\"");
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
+        trace_stop();
+        is_passed &= trace_event_count() == 1 && trace_dropped() == 0;
+        is_passed &= trace_write_json(path.c_str()) == 0;
+
+        string json;
+        vector<Event> events = read_trace(path, json);
+        double dur = events.empty() ? 0 : events.back().dur;
+        is_passed &= balanced(json) && json.find("\"name\": \"sleep \\\"20 ms\\\"\"") != string::npos;
+        is_passed &= dur > 19000 && dur < 40000;
+        printf("[*] 20 ms sleep traced as %.1f us\n", dur);
+        is_passed &= trace_write_json("/nonexistent/dir/trace.json") == -1;
+        remove(path.c_str());
+    }
+    printf("[!] Finished limit test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Benchmarking %zu spans\n", n_bench);
+    {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n_bench; i++) {
+            TRACE_SPAN("bench", "off");
+        }
+        double off = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / n_bench;
+
+        trace_start(n_bench);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n_bench; i++) {
+            TRACE_SPAN("bench", "on");
+        }
+        double on = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / n_bench;
+        trace_stop();
+        is_passed &= trace_event_count() == n_bench;
+        trace_start(0);
+        trace_stop();
+
+        // timings only printed, sanitizer builds run this too
+        printf("[*] %.1f ns per span stopped, %.1f ns recording\n", off, on);
+    }
+
+    printf("[!] Finished trace tests with result: %s\n", is_passed ? "[PASSED]" : "[FAILED]");
+    return is_passed ? 0 : 1;
+}
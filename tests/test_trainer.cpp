@@ -0,0 +1,132 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../lib/include/trainer.hpp"
+#include "test_util.hpp"
+
+
+using namespace std;
+
+
+int main(int argc, char **argv)
+{
+    printf("%s:%s:%d\n", __FILE__, __FUNCTION__, __LINE__);
+
+    size_t num_samples = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+    uint32_t num_inputs = 64, hidden = 128, num_classes = 10;
+    size_t max_workers = 4;
+    tpool_t* pool = tpool_create(max_workers);
+    bool is_passed = true;
+
+    vector<float> x;
+    vector<uint32_t> labels;
+    make_blobs(num_samples, num_inputs, num_classes, x, labels);
+
+    printf("[!] Testing backprop against numerical gradients\n");
+    {
+        FullyConnectedNetwork* nn = make_network(num_inputs, 8, num_classes);
+        Workspace ws = nn->make_workspace();
+        vector<float> grads(nn->num_params(), 0.0f);
+        nn->backprop(x.data(), labels[0], ws, grads.data());
+
+        float max_err = 0;
+        vector<float> dummy(nn->num_params());
+        for (uint32_t k = 1; k < nn->get_depth(); k++) {
+            Layer* l = nn->get_layer(k);
+            std::span<float> w = l->mutable_weights();
+            for (float* p : {&w[0], &w[w.size() - 1], &l->mutable_biases()[0]}) {
+                const float h = 1e-2f;
+                float keep = *p;
+                *p = keep + h;
+                float up = nn->backprop(x.data(), labels[0], ws, dummy.data());
+                *p = keep - h;
+                float down = nn->backprop(x.data(), labels[0], ws, dummy.data());
+                *p = keep;
+                float numeric = (up - down) / (2 * h);
+                float analytic = grads[p - nn->param_data()];
+                max_err = max(max_err, fabsf(numeric - analytic) / max(1e-2f, fabsf(numeric) + fabsf(analytic)));
+            }
+        }
+        if (max_err > 2e-2f)
+            is_passed = false;
+        printf("[*] max relative error %.2e\n", max_err);
+        delete nn;
+    }
+    printf("[!] Finished backprop test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing network copy constructor\n");
+    {
+        FullyConnectedNetwork* nn = make_network(num_inputs, hidden, num_classes);
+        FullyConnectedNetwork copy(*nn);
+        // the weights are shared until one side writes
+        if (copy.num_params() != nn->num_params() || copy.param_data() != nn->param_data() || !copy.shares_params())
+            is_passed = false;
+        copy.mutable_param_data()[0] += 1.0f;
+        if (copy.param_data() == nn->param_data() || copy.shares_params() || nn->shares_params() ||
+            copy.param_data()[0] == nn->param_data()[0] ||
+            !equal(nn->param_data() + 1, nn->param_data() + nn->num_params(), copy.param_data() + 1))
+            is_passed = false;
+        delete nn;
+    }
+    printf("[!] Finished copy constructor test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Testing the gradient reduction: 1 worker vs %zu workers\n", max_workers);
+    {
+        FullyConnectedNetwork* a = make_network(num_inputs, hidden, num_classes);
+        FullyConnectedNetwork b(*a);
+        OptimizerConfig cfg;
+        cfg.momentum = 0.0f;
+        cfg.lr = 0.1f;
+        cfg.zero_grads = false;
+        Optimizer opt_a(cfg), opt_b(cfg);
+        DataParallelTrainer ta(*a, opt_a, nullptr, 1);
+        DataParallelTrainer tb(b, opt_b, pool, max_workers);
+
+        ta.train_batch(x.data(), labels.data(), 64);
+        tb.train_batch(x.data(), labels.data(), 64);
+
+        float max_diff = 0;
+        for (size_t i = 0; i < a->num_params(); i++) {
+            max_diff = max(max_diff, fabsf(a->grad_data()[i] - b.grad_data()[i]));
+            max_diff = max(max_diff, fabsf(a->param_data()[i] - b.param_data()[i]));
+        }
+        if (max_diff > 1e-5f)
+            is_passed = false;
+        printf("[*] max difference %.2e\n", max_diff);
+        delete a;
+    }
+    printf("[!] Finished reduction test with result: [%s]\n\n", is_passed ? "PASSED" : "FAILED");
+
+    printf("[!] Training %zu samples, %u inputs, %u classes\n", num_samples, num_inputs, num_classes);
+    for (size_t workers = 1; workers <= max_workers; workers *= 2) {
+        FullyConnectedNetwork* nn = make_network(num_inputs, hidden, num_classes);
+        OptimizerConfig cfg;
+        cfg.type = OptimizerType::ADAM;
+        cfg.lr = 1e-3f;
+        Optimizer opt(cfg, pool, workers);
+        DataParallelTrainer trainer(*nn, opt, workers > 1 ? pool : nullptr, workers, 1);
+
+        const int epochs = 3;
+        float loss = 0;
+        auto start = chrono::steady_clock::now();
+        for (int e = 0; e < epochs; e++)
+            loss = trainer.train_epoch(x.data(), labels.data(), num_samples, 64);
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        float acc = trainer.accuracy(x.data(), labels.data(), num_samples);
+
+        printf("[*] %zu workers: %8.0f samples/s, loss %.4f, accuracy %.3f\n", workers,
+               epochs * num_samples / secs, loss, acc);
+        if (acc < 0.9f)
+            is_passed = false;
+        delete nn;
+    }
+
+    tpool_destroy(pool);
+    printf("[!] Finished training test with result: [%s]\n", is_passed ? "PASSED" : "FAILED");
+
+    return is_passed ? 0 : 1;
+}
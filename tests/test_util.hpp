@@ -0,0 +1,45 @@
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+#pragma once
+
+// Fixtures shared by the tests
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+#include "../lib/include/nn.hpp"
+
+
+// Gaussian blobs: every class has its own random center in num_inputs dimensions,
+// samples are spread around it with a standard deviation of spread
+static inline void make_blobs(size_t n, uint32_t num_inputs, uint32_t num_classes, std::vector<float>& x,
+                              std::vector<uint32_t>& labels, float spread=1.0f)
+{
+    std::mt19937 gen(11);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::vector<float> centers(size_t(num_classes) * num_inputs);
+    for (auto& c : centers)
+        c = 2.0f * dist(gen);
+
+    x.resize(n * num_inputs);
+    labels.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        labels[i] = gen() % num_classes;
+        for (uint32_t j = 0; j < num_inputs; j++)
+            x[i * num_inputs + j] = centers[labels[i] * num_inputs + j] + spread * dist(gen);
+    }
+}
+
+// input -> hidden (RELU) -> hidden-2 (SIGMOID) -> output (SOFTMAX)
+static inline FullyConnectedNetwork* make_network(uint32_t num_inputs, uint32_t hidden, uint32_t num_outputs)
+{
+    FullyConnectedNetwork* nn = new FullyConnectedNetwork();
+    nn->add_layer(num_inputs, false, 0, "input");
+    nn->add_layer(hidden, true, 1, "hidden", Activation::RELU);
+    nn->add_layer(hidden, true, 2, "hidden-2", Activation::SIGMOID);
+    nn->add_layer(num_outputs, true, 3, "output", Activation::SOFTMAX);
+    return nn;
+}
+
+
+#endif
@@ -174,3 +174,234 @@ bool binary_search_and_insert(const void *base, size_t len, size_t width, const
     *idx = mid;
     return true;
 }
+
+
+/*
+-----------------
+Branchless lower bound
+-----------------
+The searches above branch on every comparison. For random keys that branch is a coin flip,
+so about half the probes pay a full pipeline flush, and on top of that every probe is an indirect call to cmp.
+
+The branchless variant always halves the range by the same amount and only moves the base forward
+by a conditional amount (the compiler emits a cmov), so there is nothing to mispredict.
+The loop runs exactly ceil(log2(len)) times for every key.
+While the current probe is loading, the two possible next probes are prefetched.
+
+lower bound = index of the first element that is not less than key (len if there is none).
+*/
+
+// Generic version, cmp is called like in binary_search: cmp(&key, element)
+size_t binary_lower_bound(const void *base, size_t len, size_t width, const void *key, int (*cmp)(const void *, const void *))
+{
+	const char *b = base;
+	size_t      half;
+
+	if (base == NULL || len == 0 || key == NULL || cmp == NULL)
+		return 0;
+
+	while (len > 1) {
+		half = len / 2;
+		b += (cmp(&key, b + (half * width)) > 0) ? half * width : 0;
+		len -= half;
+	}
+
+	return (size_t)(b - (const char *)base) / width + (cmp(&key, b) > 0);
+}
+
+// Same walk but moving past equal elements: index of the first element greater than key.
+// That is where a stable sorted insert goes.
+size_t binary_upper_bound(const void *base, size_t len, size_t width, const void *key, int (*cmp)(const void *, const void *))
+{
+	const char *b = base;
+	size_t      half;
+
+	if (base == NULL || len == 0 || key == NULL || cmp == NULL)
+		return 0;
+
+	while (len > 1) {
+		half = len / 2;
+		b += (cmp(&key, b + (half * width)) >= 0) ? half * width : 0;
+		len -= half;
+	}
+
+	return (size_t)(b - (const char *)base) / width + (cmp(&key, b) >= 0);
+}
+
+size_t lower_bound_f32(const float *base, size_t len, float key)
+{
+	const float *b = base;
+	size_t       half;
+
+	if (base == NULL || len == 0)
+		return 0;
+
+	while (len > 1) {
+		half = len / 2;
+		__builtin_prefetch(b + len / 4);
+		__builtin_prefetch(b + half + len / 4);
+		b = (b[half] < key) ? b + half : b;
+		len -= half;
+	}
+
+	return (size_t)(b - base) + (*b < key);
+}
+
+size_t lower_bound_u32(const uint32_t *base, size_t len, uint32_t key)
+{
+	const uint32_t *b = base;
+	size_t          half;
+
+	if (base == NULL || len == 0)
+		return 0;
+
+	while (len > 1) {
+		half = len / 2;
+		__builtin_prefetch(b + len / 4);
+		__builtin_prefetch(b + half + len / 4);
+		b = (b[half] < key) ? b + half : b;
+		len -= half;
+	}
+
+	return (size_t)(b - base) + (*b < key);
+}
+
+
+/**
+ * Batched search.
+ * A single search is a chain of dependent loads: the next probe address isn't known until the current one arrives,
+ * so on an array bigger than the cache every level is a full memory latency.
+ * Independent searches don't depend on each other though, so we run BSEARCH_BATCH of them in lockstep,
+ * one level at a time. The loads of all of them are in flight together and the latency is paid once per level
+ * instead of once per level per key.
+*/
+#define BSEARCH_BATCH 16
+
+void lower_bound_f32_batch(const float *base, size_t len, const float *keys, size_t n, size_t *out)
+{
+	const float *b[BSEARCH_BATCH];
+	size_t       cnt;
+	size_t       start;
+	size_t       rem;
+	size_t       half;
+	size_t       i;
+
+	if (base == NULL || keys == NULL || out == NULL)
+		return;
+
+	if (len == 0) {
+		for (i=0; i < n; i++)
+			out[i] = 0;
+		return;
+	}
+
+	for (start=0; start < n; start += cnt) {
+		cnt = (n - start < BSEARCH_BATCH) ? n - start : BSEARCH_BATCH;
+		for (i=0; i < cnt; i++)
+			b[i] = base;
+
+		// every search in the batch walks the same sequence of range sizes
+		for (rem=len; rem > 1; rem -= half) {
+			half = rem / 2;
+			for (i=0; i < cnt; i++) {
+				__builtin_prefetch(b[i] + half + rem / 4);
+				b[i] = (b[i][half] < keys[start + i]) ? b[i] + half : b[i];
+			}
+		}
+
+		for (i=0; i < cnt; i++)
+			out[start + i] = (size_t)(b[i] - base) + (*b[i] < keys[start + i]);
+	}
+}
+
+
+/*
+-----------------
+Eytzinger layout
+-----------------
+A sorted array is a terrible layout for binary search: the first probes of every search are spread
+over the whole array, one cache line each, and only the last few levels share a line.
+
+The Eytzinger (BFS) layout stores the implicit search tree level by level, like a binary heap:
+the root at 1 and the children of k at 2k and 2k+1. The top levels of the tree are packed together
+at the front (and stay hot in cache), and the 16 descendants four levels below k are contiguous
+at 16k, so one prefetch per step fetches the line four levels ahead and the loads stop being
+on the critical path.
+
+tree has len + 1 entries (index 0 is unused), ranks maps a tree index back to the
+position in the sorted array, which is what the lower bound functions return.
+*/
+
+static size_t eytzinger_fill(const float *sorted, size_t i, float *tree, uint32_t *ranks, size_t k, size_t len)
+{
+	if (k <= len) {
+		i = eytzinger_fill(sorted, i, tree, ranks, 2 * k, len);
+		tree[k]  = sorted[i];
+		ranks[k] = (uint32_t)i;
+		i++;
+		i = eytzinger_fill(sorted, i, tree, ranks, 2 * k + 1, len);
+	}
+	return i;
+}
+
+void eytzinger_build_f32(const float *sorted, size_t len, float *tree, uint32_t *ranks)
+{
+	if (sorted == NULL || tree == NULL || ranks == NULL)
+		return;
+
+	tree[0]  = 0;
+	ranks[0] = (uint32_t)len;
+	eytzinger_fill(sorted, 0, tree, ranks, 1, len);
+}
+
+/**
+ * Walk down: go right (2k+1) while the node is less than key, left (2k) otherwise.
+ * When we fall off the tree, the answer is the last node where we went left. Going left appends a 0 bit
+ * to k and going right a 1 bit, so we strip the trailing ones plus that last zero (ffs of ~k).
+ * If we never went left, k ends up 0 and the answer is "past the end" (ranks[0] = len).
+*/
+size_t eytzinger_lower_bound_f32(const float *tree, const uint32_t *ranks, size_t len, float key)
+{
+	size_t k = 1;
+
+	while (k <= len) {
+		__builtin_prefetch(tree + 16 * k);
+		k = 2 * k + (tree[k] < key);
+	}
+	k >>= __builtin_ffsll(~(long long)k);
+
+	return ranks[k];
+}
+
+void eytzinger_lower_bound_f32_batch(const float *tree, const uint32_t *ranks, size_t len,
+	const float *keys, size_t n, size_t *out)
+{
+	size_t k[BSEARCH_BATCH];
+	size_t cnt;
+	size_t start;
+	size_t levels;
+	size_t l;
+	size_t i;
+
+	// number of levels of the tree, every key steps this many times (or stops below the leaves)
+	for (levels=0; ((size_t)1 << levels) <= len; levels++)
+		;
+
+	for (start=0; start < n; start += cnt) {
+		cnt = (n - start < BSEARCH_BATCH) ? n - start : BSEARCH_BATCH;
+		for (i=0; i < cnt; i++)
+			k[i] = 1;
+
+		for (l=0; l < levels; l++) {
+			for (i=0; i < cnt; i++) {
+				if (k[i] <= len) {
+					__builtin_prefetch(tree + 16 * k[i]);
+					k[i] = 2 * k[i] + (tree[k[i]] < keys[start + i]);
+				}
+			}
+		}
+
+		for (i=0; i < cnt; i++)
+			out[start + i] = ranks[k[i] >> __builtin_ffsll(~(long long)k[i])];
+	}
+}
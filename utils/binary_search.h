@@ -4,10 +4,31 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void * binary_search(const void *base, size_t len, size_t width, const void *key, int (*cmp)(const void *, const void *));
 size_t binary_insert(const void *base, size_t len, size_t width, const void *key, int (*cmp)(const void *, const void *));
 bool binary_search_and_insert(const void *base, size_t len, size_t width, const void *key, size_t *idx, bool is_insert, int (*cmp)(const void *, const void *));
 
-#endif /* __LIST_H__ */
\ No newline at end of file
+// branchless lower bound: index of the first element not less than key, len if none
+size_t binary_lower_bound(const void *base, size_t len, size_t width, const void *key, int (*cmp)(const void *, const void *));
+size_t binary_upper_bound(const void *base, size_t len, size_t width, const void *key, int (*cmp)(const void *, const void *));
+size_t lower_bound_f32(const float *base, size_t len, float key);
+size_t lower_bound_u32(const uint32_t *base, size_t len, uint32_t key);
+void lower_bound_f32_batch(const float *base, size_t len, const float *keys, size_t n, size_t *out);
+
+// Eytzinger (BFS order) layout: tree and ranks hold len + 1 entries
+void eytzinger_build_f32(const float *sorted, size_t len, float *tree, uint32_t *ranks);
+size_t eytzinger_lower_bound_f32(const float *tree, const uint32_t *ranks, size_t len, float key);
+void eytzinger_lower_bound_f32_batch(const float *tree, const uint32_t *ranks, size_t len,
+	const float *keys, size_t n, size_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BINSEARACH_H__ */
\ No newline at end of file
@@ -0,0 +1,299 @@
+/*
+-----------------
+ Introduction
+-----------------
+The plain hashtable has no thread safety at all.
+Wrapping it in one big mutex works but then every thread that touches the table
+serializes on that one lock, readers included.
+
+The concurrent hashtable splits the key space into N independent shards (lock striping).
+Each shard is a regular htable_t guarded by its own reader/writer lock.
+A key always lives in the same shard, picked from its hash, so two threads only ever
+contend when they touch the same shard. Readers never block each other,
+and with enough shards (a few times the number of cores) writers rarely meet either.
+
+-----------------
+ Design
+-----------------
+The shard is picked with the table's own seed, the inner table hashes again with its own seed.
+That costs a second hash per operation but keeps the shard bits independent of the bits
+the inner table uses to pick a slot, which would otherwise cluster every shard.
+
+Each shard is padded to a cache line so the locks of neighbouring shards don't false share.
+
+Values handed out by get and by the enumerator are copied (with val_copy) while
+the shard lock is held if copy callbacks were given. Otherwise they are the raw pointers
+stored in the table, and it is up to the caller to not free them behind the table's back.
+
+-----------------
+ Enumeration
+-----------------
+The enumerator walks one shard at a time. It takes the shard's read lock just long enough
+to snapshot the shard's pairs and then hands them out without holding any lock.
+Writers are never stopped: pairs added or removed while enumerating may or may not be seen
+(weakly consistent), but every pair that was in the table for the whole enumeration is seen exactly once.
+*/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chtable.h"
+#include "hash.h"
+
+
+static const size_t SHARDS_DEFAULT = 64;
+
+struct chtable_shard {
+    pthread_rwlock_t  lock;
+    htable_t         *ht;
+} __attribute__((aligned(64)));
+typedef struct chtable_shard chtable_shard_t;
+
+struct chtable {
+    htable_hash       hfunc;
+    htable_keq        keq;
+    htable_cbs        cbs;         // as given by the user, entries can be NULL
+    chtable_shard_t  *shards;
+    size_t            num_shards;  // always a power of 2
+    unsigned int      seed;
+};
+
+struct chtable_enum {
+    chtable_t  *ht;
+    size_t      shard;   // next shard to snapshot
+    void      **keys;
+    void      **vals;
+    size_t      len;
+    size_t      alloced;
+    size_t      idx;
+};
+
+
+static chtable_shard_t *chtable_shard(chtable_t *ht, void *key)
+{
+    unsigned int hash = ht->hfunc(key, ht->seed);
+
+    // fold the high bits in, a weak user hash may only vary in those
+    hash ^= hash >> 16;
+    return ht->shards + (hash & (ht->num_shards - 1));
+}
+
+
+chtable_t *chtable_create(htable_hash hfunc, htable_keq keq, htable_cbs *cbs, size_t num_shards)
+{
+    chtable_t *ht;
+    size_t     i;
+
+    if (hfunc == NULL || keq == NULL)
+        return NULL;
+
+    if (num_shards == 0)
+        num_shards = SHARDS_DEFAULT;
+
+    ht = calloc(1, sizeof(*ht));
+    ht->hfunc = hfunc;
+    ht->keq   = keq;
+    if (cbs != NULL)
+        ht->cbs = *cbs;
+
+    ht->num_shards = 1;
+    while (ht->num_shards < num_shards)
+        ht->num_shards <<= 1;
+
+    if (posix_memalign((void **)&ht->shards, 64, ht->num_shards * sizeof(*ht->shards)) != 0) {
+        free(ht);
+        return NULL;
+    }
+    for (i=0; i < ht->num_shards; i++) {
+        pthread_rwlock_init(&(ht->shards[i].lock), NULL);
+        ht->shards[i].ht = htable_create(hfunc, keq, cbs);
+    }
+
+    // Same as the inner tables, a random seed per table.
+    ht->seed = (unsigned int)hash_random_seed();
+
+    return ht;
+}
+
+
+void chtable_destroy(chtable_t *ht)
+{
+    size_t i;
+
+    if (ht == NULL)
+        return;
+
+    for (i=0; i < ht->num_shards; i++) {
+        htable_destroy(ht->shards[i].ht);
+        pthread_rwlock_destroy(&(ht->shards[i].lock));
+    }
+
+    free(ht->shards);
+    free(ht);
+}
+
+
+// Keys spread evenly over the shards so every shard gets its share of n.
+void chtable_reserve(chtable_t *ht, size_t n)
+{
+    size_t per_shard;
+    size_t i;
+
+    if (ht == NULL)
+        return;
+
+    per_shard = n / ht->num_shards + n / ht->num_shards / 16 + 1;
+    for (i=0; i < ht->num_shards; i++) {
+        pthread_rwlock_wrlock(&(ht->shards[i].lock));
+        htable_reserve(ht->shards[i].ht, per_shard);
+        pthread_rwlock_unlock(&(ht->shards[i].lock));
+    }
+}
+
+
+void chtable_insert(chtable_t *ht, void *key, void *val)
+{
+    chtable_shard_t *shard;
+
+    if (ht == NULL || key == NULL)
+        return;
+
+    shard = chtable_shard(ht, key);
+    pthread_rwlock_wrlock(&(shard->lock));
+    htable_insert(shard->ht, key, val);
+    pthread_rwlock_unlock(&(shard->lock));
+}
+
+
+void chtable_remove(chtable_t *ht, void *key)
+{
+    chtable_shard_t *shard;
+
+    if (ht == NULL || key == NULL)
+        return;
+
+    shard = chtable_shard(ht, key);
+    pthread_rwlock_wrlock(&(shard->lock));
+    htable_remove(shard->ht, key);
+    pthread_rwlock_unlock(&(shard->lock));
+}
+
+
+/**
+ * Readers only take the shard's read lock so any number of them run in parallel.
+ * The copy is made before unlocking, after that a writer is free to replace or free the stored value.
+*/
+bool chtable_get(chtable_t *ht, void *key, void **val)
+{
+    chtable_shard_t *shard;
+    void            *myval = NULL;
+    bool             found;
+
+    if (ht == NULL || key == NULL)
+        return false;
+
+    shard = chtable_shard(ht, key);
+    pthread_rwlock_rdlock(&(shard->lock));
+    found = htable_get(shard->ht, key, &myval);
+    if (found && myval != NULL && ht->cbs.val_copy != NULL)
+        myval = ht->cbs.val_copy(myval);
+    pthread_rwlock_unlock(&(shard->lock));
+
+    if (found && val != NULL)
+        *val = myval;
+    return found;
+}
+
+
+
+chtable_enum_t *chtable_enum_create(chtable_t *ht)
+{
+    chtable_enum_t *he;
+
+    if (ht == NULL)
+        return NULL;
+
+    he = calloc(1, sizeof(*he));
+    he->ht = ht;
+
+    return he;
+}
+
+// Drop the snapshot of the current shard, freeing the copies we made of it.
+static void chtable_enum_release(chtable_enum_t *he)
+{
+    size_t i;
+
+    for (i=0; i < he->len; i++) {
+        if (he->ht->cbs.key_copy != NULL && he->ht->cbs.key_free != NULL)
+            he->ht->cbs.key_free(he->keys[i]);
+        if (he->ht->cbs.val_copy != NULL && he->ht->cbs.val_free != NULL && he->vals[i] != NULL)
+            he->ht->cbs.val_free(he->vals[i]);
+    }
+    he->len = 0;
+    he->idx = 0;
+}
+
+// Copy out every pair of one shard while holding its read lock.
+static void chtable_enum_snapshot(chtable_enum_t *he, chtable_shard_t *shard)
+{
+    htable_enum_t *inner;
+    void          *key;
+    void          *val;
+
+    pthread_rwlock_rdlock(&(shard->lock));
+    inner = htable_enum_create(shard->ht);
+    while (htable_enum_next(inner, &key, &val)) {
+        if (he->len == he->alloced) {
+            he->alloced = he->alloced ? he->alloced * 2 : 64;
+            he->keys = realloc(he->keys, he->alloced * sizeof(*he->keys));
+            he->vals = realloc(he->vals, he->alloced * sizeof(*he->vals));
+        }
+        if (he->ht->cbs.key_copy != NULL)
+            key = he->ht->cbs.key_copy(key);
+        if (he->ht->cbs.val_copy != NULL && val != NULL)
+            val = he->ht->cbs.val_copy(val);
+        he->keys[he->len] = key;
+        he->vals[he->len] = val;
+        he->len++;
+    }
+    htable_enum_destroy(inner);
+    pthread_rwlock_unlock(&(shard->lock));
+}
+
+/**
+ * Hand out the pairs of the current snapshot, moving on to the next shard when it runs out.
+ * The returned key and value stay valid until the next call (or destroy).
+*/
+bool chtable_enum_next(chtable_enum_t *he, void **key, void **val)
+{
+    if (he == NULL)
+        return false;
+
+    while (he->idx >= he->len) {
+        chtable_enum_release(he);
+        if (he->shard >= he->ht->num_shards)
+            return false;
+        chtable_enum_snapshot(he, he->ht->shards + he->shard);
+        he->shard++;
+    }
+
+    if (key != NULL)
+        *key = he->keys[he->idx];
+    if (val != NULL)
+        *val = he->vals[he->idx];
+    he->idx++;
+
+    return true;
+}
+
+void chtable_enum_destroy(chtable_enum_t *he)
+{
+    if (he == NULL)
+        return;
+
+    chtable_enum_release(he);
+    free(he->keys);
+    free(he->vals);
+    free(he);
+}
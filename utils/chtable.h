@@ -0,0 +1,46 @@
+#ifndef __CHTABLE_H__
+#define __CHTABLE_H__
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "htable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Concurrent hashtable.
+ * Same callbacks as htable_t, but safe to use from many threads at once.
+ * NULL keys are ignored the same way, so integer keys can't be 0.
+*/
+struct chtable;
+typedef struct chtable chtable_t;
+
+struct chtable_enum;
+typedef struct chtable_enum chtable_enum_t;
+
+// basic create & destroy (num_shards is rounded up to a power of 2, 0 picks a default)
+chtable_t *chtable_create(htable_hash hfunc, htable_keq keq, htable_cbs *cbs, size_t num_shards);
+void chtable_destroy(chtable_t *ht);
+
+void chtable_reserve(chtable_t *ht, size_t n);
+
+// basic insert & remove
+void chtable_insert(chtable_t *ht, void *key, void *val);
+void chtable_remove(chtable_t *ht, void *key);
+
+// basic retrieval. if a val_copy callback was given *val is a copy the caller must free
+bool chtable_get(chtable_t *ht, void *key, void **val);
+
+// weakly consistent enumeration that runs alongside writers
+chtable_enum_t *chtable_enum_create(chtable_t *ht);
+bool chtable_enum_next(chtable_enum_t *he, void **key, void **val);
+void chtable_enum_destroy(chtable_enum_t *he);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CHTABLE_H__ */
@@ -0,0 +1,162 @@
+/*
+-----------------
+ Introduction
+-----------------
+A hashtable is only as good as its hash function.
+A weak hash clusters keys into the same slots, and a predictable one lets anyone who
+controls the keys (user input, file contents) pick keys that all collide on purpose
+and turn every lookup into a linear scan.
+
+These are the built-in hashes used by the hashtables:
+ - hash_bytes for byte strings. It follows the structure of wyhash: the input is consumed
+   8 or 16 bytes at a time and each pair of words is folded with a 64x64->128 bit multiply
+   ("mum", multiply and xor the halves). That is one multiply per 16 bytes, which is as fast
+   as hashing gets without SIMD and passes the usual avalanche tests.
+ - hash_u64 for integers. The murmur3 finalizer (xor-shift-multiply rounds), keyed with the seed.
+
+Both take a seed, and every table picks a random one at creation, so the
+collision pattern of one table (or one run) tells an attacker nothing about another.
+*/
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <sys/random.h>
+#elif defined(__APPLE__)
+#include <stdlib.h>
+#endif
+
+#include "hash.h"
+
+
+static const uint64_t HASH_P0 = 0xa0761d6478bd642fULL;
+static const uint64_t HASH_P1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t HASH_P2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t HASH_P3 = 0x589965cc75374cc3ULL;
+
+
+// 64x64 -> 128 bit multiply, returned as the two halves in a and b
+static inline void hash_mum128(uint64_t *a, uint64_t *b)
+{
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+    hash_mum128(&a, &b);
+    return a ^ b;
+}
+
+// unaligned little endian reads
+static inline uint64_t hash_rd64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t hash_rd32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// 1 to 3 bytes, read the first, middle and last byte
+static inline uint64_t hash_rd3(const uint8_t *p, size_t len)
+{
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+}
+
+
+/**
+ * Short keys (the common case for vocabularies) are read with at most four
+ * overlapping loads and no loop. Long keys run three independent lanes
+ * of 16 bytes so the multiplies don't wait on each other.
+*/
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = data;
+    uint64_t       a;
+    uint64_t       b;
+    uint64_t       s1;
+    uint64_t       s2;
+    size_t         i;
+
+    seed ^= hash_mix(seed ^ HASH_P0, HASH_P1);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (hash_rd32(p) << 32) | hash_rd32(p + ((len >> 3) << 2));
+            b = (hash_rd32(p + len - 4) << 32) | hash_rd32(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = hash_rd3(p, len);
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        i = len;
+        if (i > 48) {
+            s1 = seed;
+            s2 = seed;
+            do {
+                seed = hash_mix(hash_rd64(p) ^ HASH_P1, hash_rd64(p + 8) ^ seed);
+                s1   = hash_mix(hash_rd64(p + 16) ^ HASH_P2, hash_rd64(p + 24) ^ s1);
+                s2   = hash_mix(hash_rd64(p + 32) ^ HASH_P3, hash_rd64(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= s1 ^ s2;
+        }
+        while (i > 16) {
+            seed = hash_mix(hash_rd64(p) ^ HASH_P1, hash_rd64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_rd64(p + i - 16);
+        b = hash_rd64(p + i - 8);
+    }
+
+    a ^= HASH_P1;
+    b ^= seed;
+    hash_mum128(&a, &b);
+    return hash_mix(a ^ HASH_P0 ^ len, b ^ HASH_P1);
+}
+
+
+uint64_t hash_u64(uint64_t x, uint64_t seed)
+{
+    x ^= seed;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+
+/**
+ * Ask the OS for random bytes. If that isn't available (or fails) fall back
+ * to time plus a few addresses (ASLR), mixed so every bit depends on all of them.
+*/
+uint64_t hash_random_seed(void)
+{
+    uint64_t seed = 0;
+
+#if defined(__linux__)
+    if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == sizeof(seed))
+        return seed;
+#elif defined(__APPLE__)
+    arc4random_buf(&seed, sizeof(seed));
+    return seed;
+#endif
+
+    seed = hash_u64((uint64_t)time(NULL), (uint64_t)(size_t)&seed);
+    seed = hash_u64(seed ^ (uint64_t)clock(), (uint64_t)(size_t)hash_random_seed);
+    return seed;
+}
@@ -0,0 +1,25 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 64-bit hash of len bytes (wyhash style)
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
+
+// 64-bit integer mixer, a bijection for a fixed seed
+uint64_t hash_u64(uint64_t x, uint64_t seed);
+
+// seed that is hard to guess, from the OS random source when there is one
+uint64_t hash_random_seed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HASH_H__ */
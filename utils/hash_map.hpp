@@ -0,0 +1,331 @@
+#ifndef __HASH_MAP_H__
+#define __HASH_MAP_H__
+#pragma once
+
+/**
+ * Type safe, header only version of the generic hashtable (htable.h).
+ *
+ * It uses the same layout and algorithm as htable.c (Robin Hood probing over a flat
+ * slot array, one control byte per slot, SIMD group matching, backward shift deletion)
+ * but keys and values are stored inline in the slot instead of behind void pointers,
+ * and Hash/Eq are functor types so the compiler can inline them into the probe loop.
+ *
+ * Hash must return a well mixed 32-bit value: the low bits pick the home slot
+ * and the top 7 bits go in the control byte.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// Default hash: a strong 64-bit mixer on top of std::hash (which is the identity for integers).
+template <class K>
+struct HashMix
+{
+    uint32_t operator()(const K& key) const
+    {
+        uint64_t x = static_cast<uint64_t>(std::hash<K>{}(key));
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return static_cast<uint32_t>(x);
+    }
+};
+
+
+template <class K, class V, class Hash = HashMix<K>, class Eq = std::equal_to<K>>
+class HashMap
+{
+    private:
+        struct Slot {
+            K        key;
+            V        val;
+            uint32_t hash;
+        };
+
+        static constexpr uint8_t CTRL_EMPTY = 0x80;
+        static constexpr size_t  SLOT_START = 16;
+#if defined(__SSE2__)
+        static constexpr size_t  GROUP = 16;
+        static constexpr size_t  MASK_SHIFT = 0;
+        typedef uint32_t mask_t;
+#else
+        static constexpr size_t  GROUP = 8;
+        static constexpr size_t  MASK_SHIFT = 3;
+        typedef uint64_t mask_t;
+#endif
+
+        Slot*    slots = nullptr;
+        uint8_t* ctrl = nullptr;      // num_slots + GROUP bytes, the first GROUP mirrored at the end
+        size_t   num_slots = 0;       // always a power of 2
+        size_t   num_used = 0;
+        [[no_unique_address]] Hash hasher;
+        [[no_unique_address]] Eq   eq;
+
+        static uint8_t h2(uint32_t hash) { return static_cast<uint8_t>(hash >> 25); }
+        size_t home(uint32_t hash) const { return hash & (num_slots - 1); }
+        size_t dist(size_t idx) const { return (idx - home(slots[idx].hash)) & (num_slots - 1); }
+
+        void set_ctrl(size_t idx, uint8_t c)
+        {
+            ctrl[idx] = c;
+            if (idx < GROUP)
+                ctrl[num_slots + idx] = c;
+        }
+
+#if defined(__SSE2__)
+        static mask_t group_match(const uint8_t* g, uint8_t tag)
+        {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g));
+            return static_cast<mask_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(static_cast<char>(tag)))));
+        }
+        static mask_t group_empty(const uint8_t* g)
+        {
+            return static_cast<mask_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(g))));
+        }
+        static size_t mask_idx(mask_t m) { return static_cast<size_t>(__builtin_ctz(m)); }
+#else
+        static uint64_t group_load(const uint8_t* g) { uint64_t w; std::memcpy(&w, g, sizeof(w)); return w; }
+        static mask_t group_match(const uint8_t* g, uint8_t tag)
+        {
+            uint64_t x = group_load(g) ^ (0x0101010101010101ULL * tag);
+            return (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+        }
+        static mask_t group_empty(const uint8_t* g) { return group_load(g) & 0x8080808080808080ULL; }
+        static size_t mask_idx(mask_t m) { return static_cast<size_t>(__builtin_ctzll(m)) >> MASK_SHIFT; }
+#endif
+
+        // Slot index of key or num_slots if missing (also for a moved-from map, which has no slots)
+        size_t find_idx(const K& key, uint32_t hash) const
+        {
+            if (num_slots == 0)
+                return 0;
+
+            const uint8_t tag = h2(hash);
+            const size_t mask = num_slots - 1;
+            size_t pos = home(hash);
+
+            __builtin_prefetch(slots + pos);
+            while (true) {
+                mask_t match = group_match(ctrl + pos, tag);
+                mask_t empty = group_empty(ctrl + pos);
+                if (empty != 0)
+                    match &= (empty & -empty) - 1;
+
+                while (match != 0) {
+                    size_t idx = (pos + mask_idx(match)) & mask;
+                    if (slots[idx].hash == hash && eq(slots[idx].key, key))
+                        return idx;
+                    match &= match - 1;
+                }
+
+                if (empty != 0)
+                    return num_slots;
+                pos = (pos + GROUP) & mask;
+            }
+        }
+
+        // Robin Hood placement of a key that is not in the map yet, returns where it ended up
+        size_t place(Slot&& in)
+        {
+            const size_t mask = num_slots - 1;
+            size_t pos = home(in.hash);
+            size_t d = 0;
+            size_t landed = num_slots;
+
+            while (ctrl[pos] != CTRL_EMPTY) {
+                size_t rd = dist(pos);
+                if (rd < d) {
+                    std::swap(slots[pos], in);
+                    set_ctrl(pos, h2(slots[pos].hash));
+                    if (landed == num_slots)
+                        landed = pos;
+                    d = rd;
+                }
+                pos = (pos + 1) & mask;
+                d++;
+            }
+
+            new (slots + pos) Slot(std::move(in));
+            set_ctrl(pos, h2(slots[pos].hash));
+            return landed == num_slots ? pos : landed;
+        }
+
+        void allocate(size_t n)
+        {
+            num_slots = n;
+            slots = static_cast<Slot*>(::operator new(n * sizeof(Slot), std::align_val_t(alignof(Slot))));
+            ctrl  = static_cast<uint8_t*>(std::malloc(n + GROUP));
+            std::memset(ctrl, CTRL_EMPTY, n + GROUP);
+        }
+
+        void release()
+        {
+            if (slots == nullptr)
+                return;
+            for (size_t i = 0; i < num_slots; i++) {
+                if (ctrl[i] != CTRL_EMPTY)
+                    slots[i].~Slot();
+            }
+            ::operator delete(slots, std::align_val_t(alignof(Slot)));
+            std::free(ctrl);
+            slots = nullptr;
+            ctrl = nullptr;
+            num_slots = 0;
+            num_used = 0;
+        }
+
+        // Take other's table, other is left empty without slots (the first insert allocates them)
+        void take(HashMap& other)
+        {
+            slots = other.slots;
+            ctrl = other.ctrl;
+            num_slots = other.num_slots;
+            num_used = other.num_used;
+            other.slots = nullptr;
+            other.ctrl = nullptr;
+            other.num_slots = 0;
+            other.num_used = 0;
+        }
+
+        void resize(size_t n)
+        {
+            Slot*    old_slots = slots;
+            uint8_t* old_ctrl = ctrl;
+            size_t   old_num = num_slots;
+
+            allocate(n);
+            for (size_t i = 0; i < old_num; i++) {
+                if (old_ctrl[i] == CTRL_EMPTY)
+                    continue;
+                place(std::move(old_slots[i]));
+                old_slots[i].~Slot();
+            }
+            ::operator delete(old_slots, std::align_val_t(alignof(Slot)));
+            std::free(old_ctrl);
+        }
+
+        static size_t slots_for(size_t n)
+        {
+            size_t s = SLOT_START;
+            while (n > s - s / 8)
+                s <<= 1;
+            return s;
+        }
+
+    public:
+        HashMap() { allocate(SLOT_START); }
+
+        HashMap(const HashMap&) = delete;
+        HashMap& operator=(const HashMap&) = delete;
+
+        HashMap(HashMap&& other) noexcept { take(other); }
+
+        HashMap& operator=(HashMap&& other) noexcept
+        {
+            if (this != &other) {
+                release();
+                take(other);
+            }
+            return *this;
+        }
+
+        ~HashMap() { release(); }
+
+        size_t size() const { return num_used; }
+
+        void reserve(size_t n)
+        {
+            size_t s = slots_for(n);
+            if (s > num_slots)
+                resize(s);
+        }
+
+        // Insert or replace the value of key
+        V& insert(const K& key, V val)
+        {
+            uint32_t hash = hasher(key);
+            size_t idx = find_idx(key, hash);
+            if (idx != num_slots) {
+                slots[idx].val = std::move(val);
+                return slots[idx].val;
+            }
+
+            if (num_slots == 0)
+                allocate(SLOT_START);
+            else if (num_used + 1 > num_slots - num_slots / 8)
+                resize(num_slots << 1);
+            num_used++;
+            return slots[place(Slot{key, std::move(val), hash})].val;
+        }
+
+        // Pointer to the stored value or nullptr when key is not in the map
+        V* find(const K& key)
+        {
+            size_t idx = find_idx(key, hasher(key));
+            return idx == num_slots ? nullptr : &slots[idx].val;
+        }
+
+        const V* find(const K& key) const
+        {
+            size_t idx = find_idx(key, hasher(key));
+            return idx == num_slots ? nullptr : &slots[idx].val;
+        }
+
+        bool get(const K& key, V& out) const
+        {
+            const V* v = find(key);
+            if (v == nullptr)
+                return false;
+            out = *v;
+            return true;
+        }
+
+        bool contains(const K& key) const { return find(key) != nullptr; }
+
+        // Backward shift deletion, no tombstones
+        bool remove(const K& key)
+        {
+            const size_t mask = num_slots - 1;
+            size_t idx = find_idx(key, hasher(key));
+            if (idx == num_slots)
+                return false;
+
+            size_t next = (idx + 1) & mask;
+            while (ctrl[next] != CTRL_EMPTY && dist(next) != 0) {
+                slots[idx] = std::move(slots[next]);
+                set_ctrl(idx, ctrl[next]);
+                idx = next;
+                next = (next + 1) & mask;
+            }
+
+            slots[idx].~Slot();
+            set_ctrl(idx, CTRL_EMPTY);
+            num_used--;
+            return true;
+        }
+
+        // Call f(key, value) for every pair, in slot order
+        template <class F>
+        void for_each(F&& f)
+        {
+            for (size_t i = 0; i < num_slots; i++) {
+                if (ctrl[i] != CTRL_EMPTY)
+                    f(static_cast<const K&>(slots[i].key), slots[i].val);
+            }
+        }
+};
+
+
+#endif /* __HASH_MAP_H__ */
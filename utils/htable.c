@@ -2,61 +2,118 @@
 -----------------
  Introduction
 -----------------
-The hashtable object is an array of buckets which will be expanded as needed.
-A bucket holds a key value pair and can point to a chain of buckets outside of the hashtable’s array.
-A bucket in the array is considered empty when the key is set to NULL.
+The hashtable object is a flat array of slots which will be expanded as needed.
+A slot holds a key value pair and the full hash of the key.
+Next to the slots there is a parallel array of one byte control words (the metadata).
+A slot is considered empty when its control byte is set to CTRL_EMPTY.
 
 When a key is hashed, it produces a number which will be reduced to an index in the array.
-This is where we either put or find a given key value pair.
+This is where we either put or start looking for a given key value pair.
 
-Since hashes aren’t unique two inputs can hash (then reduce) to the same index in our bucket array.
-This is why a bucket can point to another bucket via a linked list.
-We’re building a chain of elements when there is a hash collision.
+Since hashes aren’t unique two inputs can hash (then reduce) to the same index in our slot array.
+Instead of chaining a separately allocated node off the bucket (a malloc per collision and a cache miss
+per hop) we use open addressing: the pair is stored in the next free slot after its home index (linear probing).
 
-Choosing a good hash algorithm will keep everything dispersed evenly in the array and
-produce few collisions so there shouldn’t be many chains and they should be very short.
+-----------------
+ Design
+-----------------
+Robin Hood hashing:
+While inserting we walk forward from the home index. Whenever the resident of a slot is closer to its own
+home than we are to ours ("richer"), we take its slot and continue inserting the evicted pair instead.
+This keeps the probe sequences short and, more importantly, of similar length.
+It also means a removal never needs tombstones: the pairs after the removed one are shifted one slot
+back (backward shift deletion) until we hit an empty slot or a pair that already sits at its home index.
+
+Metadata probing:
+The control byte of an occupied slot holds 7 bits of the hash (h2), an empty slot holds CTRL_EMPTY (high bit set).
+A lookup loads a whole group of control bytes at once and compares all of them against h2 with SIMD
+(SSE2 when available, a portable 64-bit SWAR fallback otherwise). Only slots whose h2 matches are checked
+with the (expensive, indirect) key equality callback, and the probe stops at the first empty slot of a group.
+The first GROUP control bytes are mirrored past the end of the array so a group load never has to wrap.
 
 Big-O complexity:
 
 | | Best | Average | Worst | Time | O(1) | O(1) | O(n) | Space | | | O(n)
 */
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
+#include "hash.h"
 #include "htable.h"
 
 
 /**
- * The hashtable object is an array of buckets which
- * can be expanded if needed.
- * A bucket holds a key,value pair and points to a chain
- * of buckets outside of the hashtable's array.
+ * The hashtable object is an array of slots and an array of control bytes
+ * which can be expanded if needed.
+ * The hash is stored with the key,value pair so growing and
+ * Robin Hood displacement never have to call the hash function again.
 */
-struct htable_bucket {
-    void *key;
-    void *val;
-    struct htable_bucket *next;
+struct htable_slot {
+    void         *key;
+    void         *val;
+    unsigned int  hash;
 };
-typedef struct htable_bucket htable_bucket_t;
+typedef struct htable_slot htable_slot_t;
 
 struct htable {
     htable_hash      hfunc;
     htable_keq       keq;
     htable_cbs       cbs;
-    htable_bucket_t *buckets;
-    size_t           num_buckets;
+    htable_slot_t   *slots;
+    uint8_t         *ctrl;         // num_slots + HTABLE_GROUP bytes
+    size_t           num_slots;    // always a power of 2
     size_t           num_used;
     unsigned int     seed;
 };
 
 struct htable_enum {
     htable_t        *ht;
-    htable_bucket_t *cur;
     size_t           idx;
 };
 
-static const size_t BUCKET_START = 16;
+static const size_t SLOT_START = 16;
+static const size_t SLOT_MAX   = (size_t)1 << 31;
+
+#define CTRL_EMPTY ((uint8_t)0x80)
+
+#if defined(__SSE2__)
+#define HTABLE_GROUP      16
+#define HTABLE_MASK_SHIFT 0   // one mask bit per control byte
+#else
+#define HTABLE_GROUP      8
+#define HTABLE_MASK_SHIFT 3   // one mask bit (the high bit) per 8 bits
+#endif
+
+
+/**
+ * Built-in callbacks.
+ * The 32 bit table seed is spread over 64 bits before use.
+*/
+unsigned int htable_hash_str(const void *in, unsigned int seed)
+{
+    return (unsigned int)hash_bytes(in, strlen(in), seed * 0x9e3779b97f4a7c15ULL);
+}
+
+unsigned int htable_hash_int(const void *in, unsigned int seed)
+{
+    return (unsigned int)hash_u64((uint64_t)(size_t)in, seed * 0x9e3779b97f4a7c15ULL);
+}
+
+bool htable_str_eq(const void *a, const void *b)
+{
+    return strcmp(a, b) == 0;
+}
+
+bool htable_int_eq(const void *a, const void *b)
+{
+    return a == b;
+}
 
 
 // Default callbacks
@@ -70,120 +127,214 @@ static void htable_passthough_destroy(void *v)
     return;
 }
 
+
 /**
- * When we get a hash we need to reduce it to fit into the number
- * of buckets we currently have.
+ * The low bits of the hash select the home slot, the top 7 bits are kept
+ * in the control byte so most mismatches are rejected without calling keq.
 */
-static size_t htable_bucket_idx(htable_t *ht, void *key)
+static inline uint8_t htable_h2(unsigned int hash)
+{
+    return (uint8_t)(hash >> (sizeof(hash) * CHAR_BIT - 7));
+}
+
+static inline size_t htable_home(const htable_t *ht, unsigned int hash)
+{
+    return hash & (ht->num_slots - 1);
+}
+
+// How far is the pair stored at idx from its home slot.
+static inline size_t htable_dist(const htable_t *ht, size_t idx)
+{
+    return (idx - htable_home(ht, ht->slots[idx].hash)) & (ht->num_slots - 1);
+}
+
+static inline void htable_set_ctrl(htable_t *ht, size_t idx, uint8_t c)
 {
-    return ht->hfunc(key, ht->seed) % ht->num_buckets;
+    ht->ctrl[idx] = c;
+    if (idx < HTABLE_GROUP)
+        ht->ctrl[ht->num_slots + idx] = c;
 }
 
 
 /**
- * First check if the index in the bucket has something already.
- * If not then add the key,value pair to the bucket.
- * 
- * Second, check if the key is a match and if so replace the value.
- * 
- * Third, the key isn’t in a bucket, but there is something already at that index.
- * So, traverse the chain checking each node if we have the key already.
- * If we do, replace the value and we’re done.
- * If we don’t have the key in the chain, we’ll hit the end and create a new node to add to the chain.
- */
-static void htable_add_to_bucket(htable_t *ht, void *key, void *val, bool isrehash)
-{
-    htable_bucket_t *cur;
-    htable_bucket_t *last;
-    size_t           idx;
+ * Group probing.
+ * Both functions return a bitmask with a bit set for every control byte in the group
+ * that matches h2 (or is empty). Use htable_mask_idx to turn the lowest set bit into
+ * an offset within the group.
+*/
+#if defined(__SSE2__)
+typedef unsigned int htable_mask_t;
 
-    idx = htable_bucket_idx(ht, key);
-    if (ht->buckets[idx].key == NULL) {
-        if (!isrehash) {
-            key = ht->cbs.key_copy(key);
-            if (val != NULL)
-                val = ht->cbs.val_copy(val);
-        }
-        ht->buckets[idx].key = key;
-        ht->buckets[idx].val = val;
-        if (!isrehash)
-            ht->num_used++;
-    } else {
-        last = ht->buckets + idx;
-        cur  = ht->buckets + idx;
-        do {
-            if (ht->keq(key, cur->key)) {
-                if (cur->val != NULL)
-                    ht->cbs.val_free(cur->val);
-                if (!isrehash && val != NULL)
-                    val = ht->cbs.val_copy(val);
-                cur->val = val;
-                last = NULL;
-                break;
-            }
-            last = cur;
-            cur  = cur->next;
-        } while (cur != NULL);
- 
-        if (last != NULL) {
-            cur = calloc(1, sizeof(*cur->next));
-            if (!isrehash) {
-                key = ht->cbs.key_copy(key);
-                if (val != NULL)
-                    val = ht->cbs.val_copy(val);
-            }
-            cur->key = key;
-            cur->val = val;
-            last->next = cur;
-            if (!isrehash)
-                ht->num_used++;
+static inline htable_mask_t htable_group_match(const uint8_t *g, uint8_t h2)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+    return (htable_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+}
+
+static inline htable_mask_t htable_group_empty(const uint8_t *g)
+{
+    return (htable_mask_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+}
+#else
+typedef uint64_t htable_mask_t;
+
+static const uint64_t SWAR_LSB = 0x0101010101010101ULL;
+static const uint64_t SWAR_MSB = 0x8080808080808080ULL;
+
+static inline uint64_t htable_group_load(const uint8_t *g)
+{
+    uint64_t w;
+    memcpy(&w, g, sizeof(w));
+    return w;
+}
+
+// The classic "has zero byte" trick. It can report a false positive right after a real match,
+// which is harmless because every candidate is confirmed with the stored hash and keq.
+static inline htable_mask_t htable_group_match(const uint8_t *g, uint8_t h2)
+{
+    uint64_t x = htable_group_load(g) ^ (SWAR_LSB * h2);
+    return (x - SWAR_LSB) & ~x & SWAR_MSB;
+}
+
+static inline htable_mask_t htable_group_empty(const uint8_t *g)
+{
+    return htable_group_load(g) & SWAR_MSB;
+}
+#endif
+
+static inline size_t htable_mask_idx(htable_mask_t m)
+{
+#if defined(__SSE2__)
+    return (size_t)__builtin_ctz(m) >> HTABLE_MASK_SHIFT;
+#else
+    return (size_t)__builtin_ctzll(m) >> HTABLE_MASK_SHIFT;
+#endif
+}
+
+
+/**
+ * Find the slot holding key. Returns num_slots if the key is not in the table.
+ *
+ * Linear probing keeps every key before the first empty slot after its home,
+ * so once a group contains an empty slot we only have to look at the matches before it.
+*/
+static size_t htable_find(htable_t *ht, const void *key, unsigned int hash)
+{
+    const uint8_t h2   = htable_h2(hash);
+    const size_t  mask = ht->num_slots - 1;
+    size_t        pos  = htable_home(ht, hash);
+    htable_mask_t match;
+    htable_mask_t empty;
+    size_t        idx;
+
+    // The control bytes and the slots live in different arrays.
+    // Start pulling in the home slot now so the two cache misses overlap.
+    __builtin_prefetch(ht->slots + pos);
+
+    while (1) {
+        match = htable_group_match(ht->ctrl + pos, h2);
+        empty = htable_group_empty(ht->ctrl + pos);
+        if (empty != 0)
+            match &= (empty & -empty) - 1;
+
+        while (match != 0) {
+            idx = (pos + htable_mask_idx(match)) & mask;
+            if (ht->slots[idx].hash == hash && ht->keq(key, ht->slots[idx].key))
+                return idx;
+            match &= match - 1;
         }
+
+        if (empty != 0)
+            return ht->num_slots;
+        pos = (pos + HTABLE_GROUP) & mask;
     }
 }
 
 
 /**
- * We want to keep from creating chains as much as possible so we periodically grow the bucket array.
- * A good rule of thumb is to grow when it gets 75% full.
- * Also, we don’t want to to grow larger than 1<<31 buckets otherwise we’ll run into problems.
- * Having a hard limit isn’t a problem because we really don’t have a hard limit.
- * 
- * Since we’re transferring the data from one array to another we use the isrehash parameter
- * for htable_add_to_bucket to prevent making any copies.
+ * Place a pair we know is not in the table yet.
+ * Walk forward from the home slot and steal the slot of any resident that is
+ * closer to its home than we are to ours, then keep going with the evicted pair.
 */
-static void htable_rehash(htable_t *ht)
+static void htable_place(htable_t *ht, void *key, void *val, unsigned int hash)
 {
-    htable_bucket_t *buckets;
-    htable_bucket_t *cur;
-    htable_bucket_t *next;
-    size_t           num_buckets;
-    size_t           i;
+    const size_t   mask = ht->num_slots - 1;
+    size_t         pos  = htable_home(ht, hash);
+    size_t         dist = 0;
+    size_t         rdist;
+    htable_slot_t  cur  = { key, val, hash };
+    htable_slot_t  tmp;
+
+    while (ht->ctrl[pos] != CTRL_EMPTY) {
+        rdist = htable_dist(ht, pos);
+        if (rdist < dist) {
+            tmp = ht->slots[pos];
+            ht->slots[pos] = cur;
+            htable_set_ctrl(ht, pos, htable_h2(cur.hash));
+            cur  = tmp;
+            dist = rdist;
+        }
+        pos = (pos + 1) & mask;
+        dist++;
+    }
 
-    if (ht->num_used + 1 < (size_t)(ht->num_buckets * 0.75) || ht->num_buckets >= 1 << 31)
-        return;
+    ht->slots[pos] = cur;
+    htable_set_ctrl(ht, pos, htable_h2(cur.hash));
+}
 
-    num_buckets = ht->num_buckets;
-    buckets     = ht->buckets;
-    ht->num_buckets <<= 1;  // grow by a factor of 2
-    ht->buckets = calloc(ht->num_buckets, sizeof(*buckets));
 
-    for (i=0; i < num_buckets; i++) {
-        if (buckets[i].key == NULL)
+/**
+ * Move everything over to a new pair of arrays with num_slots slots.
+ * The stored hashes are reused and no copies of keys or values are made.
+*/
+static void htable_resize(htable_t *ht, size_t num_slots)
+{
+    htable_slot_t *slots;
+    uint8_t       *ctrl;
+    size_t         old_num;
+    size_t         i;
+
+    slots   = ht->slots;
+    ctrl    = ht->ctrl;
+    old_num = ht->num_slots;
+
+    ht->num_slots = num_slots;
+    ht->slots     = malloc(num_slots * sizeof(*ht->slots));
+    ht->ctrl      = malloc(num_slots + HTABLE_GROUP);
+    memset(ht->ctrl, CTRL_EMPTY, num_slots + HTABLE_GROUP);
+
+    for (i=0; i < old_num; i++) {
+        if (ctrl[i] == CTRL_EMPTY)
             continue;
-
-        htable_add_to_bucket(ht, buckets[i].key, buckets[i].val, true);
-        if (buckets[i].next != NULL) {
-            cur = buckets[i].next;
-            do {
-                htable_add_to_bucket(ht, cur->key, cur->val, true);
-                next = cur->next;
-                free(cur);
-                cur = next;
-            } while (cur != NULL);
-        }
+        htable_place(ht, slots[i].key, slots[i].val, slots[i].hash);
     }
 
-    free(buckets);
+    free(slots);
+    free(ctrl);
+}
+
+
+// Smallest power of two number of slots that holds n pairs below the maximum load factor.
+static size_t htable_slots_for(size_t n)
+{
+    size_t num_slots = SLOT_START;
+
+    while (num_slots < SLOT_MAX && n > num_slots - num_slots / 8)
+        num_slots <<= 1;
+    return num_slots;
+}
+
+
+/**
+ * Robin Hood hashing stays fast up to a high load so we grow
+ * when the table gets 87.5% full (7/8), by a factor of 2.
+ * Also, we don’t want to grow larger than 1<<31 slots otherwise we’ll run into problems.
+*/
+static void htable_rehash(htable_t *ht)
+{
+    if (ht->num_used + 1 <= ht->num_slots - ht->num_slots / 8 || ht->num_slots >= SLOT_MAX)
+        return;
+    htable_resize(ht, ht->num_slots << 1);
 }
 
 
@@ -209,18 +360,17 @@ htable_t *htable_create(htable_hash hfunc, htable_keq keq, htable_cbs *cbs)
         if (cbs->val_free != NULL) ht->cbs.val_free = cbs->val_free;
     }
 
-    ht->num_buckets = BUCKET_START;
-    ht->buckets     = calloc(BUCKET_START, sizeof(*ht->buckets));
+    ht->num_slots = SLOT_START;
+    ht->slots     = malloc(SLOT_START * sizeof(*ht->slots));
+    ht->ctrl      = malloc(SLOT_START + HTABLE_GROUP);
+    memset(ht->ctrl, CTRL_EMPTY, SLOT_START + HTABLE_GROUP);
 
     /**
-     * We only need a seed that changes per hashtable and isn’t easily guessable.
-     * Time plus a few addresses is sufficient for this purpose.
-     * When creating the seed we push the htable_create pointer to the left
-     * to ensure we’re filling the high bits with something.
+     * We need a seed that changes per hashtable and isn’t easily guessable,
+     * otherwise whoever controls the keys can make them all collide on purpose.
+     * It comes from the OS random source (see hash.c).
      */
-    ht->seed = (unsigned int)time(NULL);
-    ht->seed ^= ((unsigned int)htable_create << 16) | (unsigned int)ht;
-    ht->seed ^= (unsigned int)&ht->seed;
+    ht->seed = (unsigned int)hash_random_seed();
 
     return ht;
 }
@@ -228,123 +378,123 @@ htable_t *htable_create(htable_hash hfunc, htable_keq keq, htable_cbs *cbs)
 
 void htable_destroy(htable_t *ht)
 {
-    htable_bucket_t *next;
-    htable_bucket_t *cur;
-    size_t           i;
+    size_t i;
 
     if (ht == NULL)
         return;
 
-    // Iterate the chain of each bucket and free the nodes
-    for (i=0; i<ht->num_buckets; i++) {
-        if (ht->buckets[i].key == NULL)
+    for (i=0; i<ht->num_slots; i++) {
+        if (ht->ctrl[i] == CTRL_EMPTY)
             continue;
-        ht->cbs.key_free(ht->buckets[i].key);
-        ht->cbs.val_free(ht->buckets[i].val);
-
-        next = ht->buckets[i].next;
-        while (next != NULL) {
-            cur = next;
-            ht->cbs.key_free(cur->key);
-            ht->cbs.val_free(cur->val);
-            next = cur->next;
-            free(cur);
-         }
+        ht->cbs.key_free(ht->slots[i].key);
+        ht->cbs.val_free(ht->slots[i].val);
     }
 
-    free(ht->buckets);
+    free(ht->slots);
+    free(ht->ctrl);
     free(ht);
 }
 
 
+/**
+ * Make room for n pairs up front so building a large table
+ * (vocabularies, feature id maps) doesn't rehash log(n) times on the way.
+*/
+void htable_reserve(htable_t *ht, size_t n)
+{
+    size_t num_slots;
+
+    if (ht == NULL)
+        return;
+
+    num_slots = htable_slots_for(n);
+    if (num_slots > ht->num_slots)
+        htable_resize(ht, num_slots);
+}
+
+
+/**
+ * First check if the key is in the table already and if so replace the value.
+ * Otherwise grow if needed, copy the key,value pair and place it.
+*/
 void htable_insert(htable_t *ht, void *key, void *val)
 {
-    void *ckey;
-    void *cval;
+    unsigned int hash;
+    size_t       idx;
 
     if (ht == NULL || key == NULL)
         return;
 
+    hash = ht->hfunc(key, ht->seed);
+    idx  = htable_find(ht, key, hash);
+    if (idx != ht->num_slots) {
+        if (ht->slots[idx].val != NULL)
+            ht->cbs.val_free(ht->slots[idx].val);
+        if (val != NULL)
+            val = ht->cbs.val_copy(val);
+        ht->slots[idx].val = val;
+        return;
+    }
+
     htable_rehash(ht);
-    htable_add_to_bucket(ht, key, val, false);
+
+    key = ht->cbs.key_copy(key);
+    if (val != NULL)
+        val = ht->cbs.val_copy(val);
+    htable_place(ht, key, val, hash);
+    ht->num_used++;
 }
 
 
+/**
+ * Removing leaves a hole in some probe sequences.
+ * Rather than marking it with a tombstone we shift the following pairs one slot back
+ * until we find an empty slot or a pair that is already at its home slot.
+*/
 void htable_remove(htable_t *ht, void *key)
 {
-    htable_bucket_t *cur;
-    htable_bucket_t *last;
-    size_t           idx;
+    const size_t mask = ht != NULL ? ht->num_slots - 1 : 0;
+    size_t       idx;
+    size_t       next;
 
     if (ht == NULL || key == NULL)
         return;
 
-    // Get the index using the hash
-    idx = htable_bucket_idx(ht, key);
-    if (ht->buckets[idx].key == NULL)
+    idx = htable_find(ht, key, ht->hfunc(key, ht->seed));
+    if (idx == ht->num_slots)
         return;
 
-    // Check the bucket and chains.
-    // Remove the entry if it exists.
-    if (ht->keq(ht->buckets[idx].key, key)) {
-        ht->cbs.key_free(ht->buckets[idx].key);
-        ht->cbs.val_free(ht->buckets[idx].val);
-        ht->buckets[idx].key = NULL;
-
-        cur = ht->buckets[idx].next; 
-        if (cur != NULL) {
-            ht->buckets[idx].key  = cur->key ;
-            ht->buckets[idx].val  = cur->val;
-            ht->buckets[idx].next = cur->next;
-            free(cur);
-        }
-        ht->num_used--;
-        return;
-    }
+    ht->cbs.key_free(ht->slots[idx].key);
+    ht->cbs.val_free(ht->slots[idx].val);
 
-    // Relink the chain if necessary
-    last = ht->buckets+idx;
-    cur  = last->next;
-    while (cur != NULL) {
-        if (ht->keq(key, cur->key)) {
-            last->next = cur->next;
-            ht->cbs.key_free(cur->key);
-            ht->cbs.val_free(cur->val);
-            free(cur);
-            ht->num_used--;
-            break;
-        }
-        last = cur;
-        cur  = cur->next;
+    next = (idx + 1) & mask;
+    while (ht->ctrl[next] != CTRL_EMPTY && htable_dist(ht, next) != 0) {
+        ht->slots[idx] = ht->slots[next];
+        htable_set_ctrl(ht, idx, ht->ctrl[next]);
+        idx  = next;
+        next = (next + 1) & mask;
     }
+
+    htable_set_ctrl(ht, idx, CTRL_EMPTY);
+    ht->num_used--;
 }
 
 
 // Tells us if the key exists and the value is NULL or if the key doesn’t exist at all.
 bool htable_get(htable_t *ht, void *key, void **val)
 {
-    htable_bucket_t *cur;
-    size_t           idx;
+    size_t idx;
 
     if (ht == NULL || key == NULL)
         return false;
 
-    idx = htable_bucket_idx(ht, key);
-    if (ht->buckets[idx].key == NULL)
+    idx = htable_find(ht, key, ht->hfunc(key, ht->seed));
+    if (idx == ht->num_slots)
         return false;
 
-    cur = ht->buckets + idx;
-    while (cur != NULL) {
-        if (ht->keq(key, cur->key)) {
-            if (val != NULL) {
-                *val = cur->val;
-            }
-            return true;
-        }
-        cur = cur->next;
-    }
-
-    return false;
+    if (val != NULL)
+        *val = ht->slots[idx].val;
+    return true;
 }
 
 // This function allows the return of NULL. Happens when the key doesn't exists.
@@ -356,6 +506,53 @@ void *htable_get_direct(htable_t *ht, void *key)
 }
 
 
+/**
+ * A single lookup in a big table is two dependent cache misses (control bytes, then the slot),
+ * and the CPU can't start on the next key until the branch on this one resolves.
+ * Here a batch of keys is hashed up front and the control bytes and home slots of all of them
+ * are prefetched, so by the time we probe, the misses of the whole batch have been overlapping.
+*/
+#define HTABLE_BATCH 16
+
+size_t htable_get_many(htable_t *ht, void **keys, size_t n, void **vals)
+{
+    unsigned int hashes[HTABLE_BATCH];
+    size_t       found = 0;
+    size_t       start;
+    size_t       cnt;
+    size_t       idx;
+    size_t       i;
+
+    if (ht == NULL || keys == NULL || vals == NULL)
+        return 0;
+
+    for (start=0; start < n; start += cnt) {
+        cnt = (n - start < HTABLE_BATCH) ? n - start : HTABLE_BATCH;
+
+        for (i=0; i < cnt; i++) {
+            if (keys[start + i] == NULL)
+                continue;
+            hashes[i] = ht->hfunc(keys[start + i], ht->seed);
+            __builtin_prefetch(ht->ctrl + htable_home(ht, hashes[i]));
+            __builtin_prefetch(ht->slots + htable_home(ht, hashes[i]));
+        }
+
+        for (i=0; i < cnt; i++) {
+            vals[start + i] = NULL;
+            if (keys[start + i] == NULL)
+                continue;
+            idx = htable_find(ht, keys[start + i], hashes[i]);
+            if (idx != ht->num_slots) {
+                vals[start + i] = ht->slots[idx].val;
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
+
 
 htable_enum_t *htable_enum_create(htable_t *ht)
 {
@@ -371,36 +568,24 @@ htable_enum_t *htable_enum_create(htable_t *ht)
 }
 
 /**
- * Go though each bucket in the bucket array and check if there is something there. 
- * If so return the bucket data, and move to the next bucket.
- * However, if the bucket has a chain we store the pointer to the first node in that bucket’s chain.
+ * Go though each slot in the slot array and check if there is something there.
+ * If so return the slot data, and move to the next slot.
 */
 bool htable_enum_next(htable_enum_t *he, void **key, void **val)
 {
-    void *mykey;
-    void *myval;
-
-    if (he == NULL || he->idx >= he->ht->num_buckets)
+    if (he == NULL)
         return false;
 
-    if (key == NULL)
-        key = &mykey;
-    if (val == NULL)
-        val = &myval;
-
-    if (he->cur == NULL) {
-        while (he->idx < he->ht->num_buckets && he->ht->buckets[he->idx].key == NULL) {
-            he->idx++;
-        }
-        if (he->idx >= he->ht->num_buckets)
-            return false;
-        he->cur = he->ht->buckets + he->idx;
+    while (he->idx < he->ht->num_slots && he->ht->ctrl[he->idx] == CTRL_EMPTY)
         he->idx++;
-    }
+    if (he->idx >= he->ht->num_slots)
+        return false;
 
-    *key = he->cur->key;
-    *val = he->cur->val;
-    he->cur = he->cur->next;
+    if (key != NULL)
+        *key = he->ht->slots[he->idx].key;
+    if (val != NULL)
+        *val = he->ht->slots[he->idx].val;
+    he->idx++;
 
     return true;
 }
@@ -413,4 +598,3 @@ void htable_enum_destroy(htable_enum_t *he)
         return;
     free(he);
 }
-
@@ -3,7 +3,11 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 struct htable;
 typedef struct htable htable_t;
@@ -27,21 +31,39 @@ typedef struct {
     htable_vfree val_free;
 } htable_cbs;
 
+// built-in hash and equality callbacks
+// A NULL key is rejected by insert / get / remove, so with integer keys (stored in the pointer itself)
+// 0 is not a valid key: offset the keys (k + 1) if 0 can occur.
+unsigned int htable_hash_str(const void *in, unsigned int seed);  // NUL terminated strings
+unsigned int htable_hash_int(const void *in, unsigned int seed);  // integers stored in the key pointer, not 0
+bool htable_str_eq(const void *a, const void *b);
+bool htable_int_eq(const void *a, const void *b);
+
 // basic create & destroy
 htable_t *htable_create(htable_hash hfunc, htable_keq keq, htable_cbs *cbs);
 void htable_destroy(htable_t *ht);
 
-// basic insert & remove
+// pre-size the table for n pairs so it doesn't grow while filling
+void htable_reserve(htable_t *ht, size_t n);
+
+// basic insert & remove (NULL keys are ignored)
 void htable_insert(htable_t *ht, void *key, void *val);
 void htable_remove(htable_t *ht, void *key);
 
-// basic retrieval
+// basic retrieval (a NULL key is never found)
 bool htable_get(htable_t *ht, void *key, void **val);
 void *htable_get_direct(htable_t *ht, void *key);
 
+// batched retrieval, vals[i] is set to the value of keys[i] or NULL. returns how many were found
+size_t htable_get_many(htable_t *ht, void **keys, size_t n, void **vals);
+
 // allows to get back data without specifying a key
 htable_enum_t *htable_enum_create(htable_t *ht);
 bool htable_enum_next(htable_enum_t *he, void **key, void **val);
 void htable_enum_destroy(htable_enum_t *he);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __HTABLE_H__ */
@@ -27,6 +27,18 @@ we can abstract them so we don’t get into the mess of realloc and memmove.
 Plus having one generic data type means we will have less error prone and easier to understand code.
 Not to mention just like the generic hashtable, we can wrap it for type safety.
 
+-----------------
+ Growth and sorted lists
+-----------------
+The array doubles when it runs out of space, so n appends cost O(n) copying in total
+(growing by a fixed block would make it O(n^2)). list_reserve sizes it up front when
+the final length is known and list_shrink gives back the slack.
+
+A sorted list (LIST_SORT) finds the insert position with a branchless binary search, but every insert
+still memmoves the tail, so building a large sorted list one insert at a time is O(n^2).
+Between list_start_bulk_add and list_end_bulk_add inserts are plain appends and the list is sorted
+once at the end (stable merge sort, which also picks up any runs that are already in order).
+
 */
 #include <stdlib.h>
 #include <string.h>
@@ -35,7 +47,7 @@ Not to mention just like the generic hashtable, we can wrap it for type safety.
 #include "sorting.h"
 
 
-// block size that represents the size of an element/some generic object/item
+// initial capacity of a list, in elements
 static const size_t list_block_size = 32;
 
 
@@ -60,7 +72,22 @@ static int list_passthrough_eq(const void *a, const void *b)
     void *sa = *(void **)a;
     void *sb = *(void **)b;
 
-    return (char *)sa - (char *)sb;  // TODO: revisit this, this is problematic
+    // don't subtract, the difference of two addresses doesn't fit in an int
+    return (sa > sb) - (sa < sb);
+}
+
+
+// grow (or shrink) the element array to exactly alloced elements
+static bool list_realloc(list_t *l, size_t alloced)
+{
+    void **elements;
+
+    elements = realloc(l->elements, sizeof(*l->elements) * alloced);
+    if (elements == NULL)
+        return false;
+    l->elements = elements;
+    l->alloced  = alloced;
+    return true;
 }
 
 
@@ -69,7 +96,7 @@ list_t *list_create(const list_cbs_t *cbs, list_flags_t flags)
     list_t *l;
 
     /* basic initialization */
-    l           = malloc(sizeof(*l));
+    l           = calloc(1, sizeof(*l));
     l->elements = malloc(sizeof(*l->elements) * list_block_size);
     l->alloced  = list_block_size;
     l->len      = 0;
@@ -134,20 +161,17 @@ bool list_insert(list_t *l, void *v, size_t idx)
     if (l == NULL || v == NULL)
         return false;
 
-    // ran out of space, list need to grow
-    if (l->alloced == l->len) {
-        l->alloced += list_block_size;
-        l->elements = realloc(l->elements, sizeof(*l->elements)*l->alloced);
-        // multiply by size of void * pointer! (8 bytes on 64-machines, 4 bytes on 32-bit machines)
-    }
+    // ran out of space, list need to grow (geometrically)
+    if (l->alloced == l->len && !list_realloc(l, l->alloced * 2))
+        return false;
 
     // if necessary, copy the new element v into the the list
     if (l->cbs.lcopy != NULL)
         v = l->cbs.lcopy(v);
 
-    // if sorted list, first determine the index of insertion
+    // if sorted list, first determine the index of insertion (after any equal elements)
     if (l->flags & LIST_SORT && !l->inbulk)
-        binary_search(l->elements, l->len, sizeof(*l->elements), v, l->cbs.leq);
+        idx = binary_upper_bound(l->elements, l->len, sizeof(*l->elements), v, l->cbs.leq);
 
     if (idx > l->len) {
         idx = l->len;
@@ -201,12 +225,13 @@ bool list_index_of(list_t *l, void *v, size_t *idx)
 {
     size_t i;
 
-    if (l == NULL || v == NULL)
+    if (l == NULL || v == NULL || idx == NULL)
         return false;
 
     if (l->flags & LIST_SORT && !l->inbulk) {
-        idx = binary_search(l->elements, l->len, sizeof(*l->elements), v, l->cbs.leq);
-        if (idx != NULL) {
+        i = binary_lower_bound(l->elements, l->len, sizeof(*l->elements), v, l->cbs.leq);
+        if (i < l->len && l->cbs.leq(&v, &l->elements[i]) == 0) {
+            *idx = i;
             return true;
         }
         return false;
@@ -273,7 +298,28 @@ bool list_sort(list_t *l, list_eq e)
 
     // stable sorting method. has a memory penalty for large lists though,
     // so keep in mind.
-    mergesort(l->elements, l->len, sizeof(*l->elements), e);
+    merge_sort(l->elements, l->len, sizeof(*l->elements), e);
+    return true;
+}
+
+
+// make room for at least n elements so appending up to n never reallocates
+bool list_reserve(list_t *l, size_t n)
+{
+    if (l == NULL)
+        return false;
+    if (n <= l->alloced)
+        return true;
+    return list_realloc(l, n);
+}
+
+
+// give back the unused capacity
+void list_shrink(list_t *l)
+{
+    if (l == NULL)
+        return;
+    list_realloc(l, l->len > 0 ? l->len : 1);
 }
 
 
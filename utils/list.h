@@ -5,6 +5,10 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct list;
 typedef struct list list_t;
 
@@ -31,6 +35,9 @@ void list_destroy(list_t *l);
 
 size_t list_len(list_t *l);
 
+bool list_reserve(list_t *l, size_t n);
+void list_shrink(list_t *l);
+
 bool list_append(list_t *l, void *v);
 bool list_insert(list_t *l, void *v, size_t idx);
 bool list_remove(list_t *l, size_t idx);
@@ -42,6 +49,10 @@ void *list_take(list_t *l, size_t idx);
 void list_start_bulk_add(list_t *l);
 void list_end_bulk_add(list_t *l);
 
-void list_sort(list_t *l, list_eq e);
+bool list_sort(list_t *l, list_eq e);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* __LIST_H__ */
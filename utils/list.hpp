@@ -0,0 +1,111 @@
+#ifndef __LIST_HPP__
+#define __LIST_HPP__
+#pragma once
+
+/**
+ * Type safe, header only version of the generic list (list.h).
+ *
+ * Elements are stored inline in one contiguous array instead of as an array of void pointers,
+ * and the comparison is a functor type (Less) so sorted inserts and lookups inline it
+ * instead of going through the list_eq callback.
+ *
+ * Like list_t, a list created with LIST_SORT keeps its elements ordered (stable: equal
+ * elements keep insertion order) and bulk adds defer the sorting to one pass at the end.
+ */
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "list.h"
+
+
+template <class T, class Less = std::less<T>>
+class List
+{
+    private:
+        std::vector<T>          elements;
+        list_flags_t            flags = LIST_NONE;
+        bool                    inbulk = false;
+        [[no_unique_address]] Less less;
+
+        bool sorted() const { return (flags & LIST_SORT) && !inbulk; }
+
+    public:
+        explicit List(list_flags_t flags = LIST_NONE): flags(flags) {}
+
+        size_t len() const { return elements.size(); }
+        void reserve(size_t n) { elements.reserve(n); }
+        void shrink() { elements.shrink_to_fit(); }
+
+        // With LIST_SORT the index is ignored and v goes after the last element equal to it
+        void insert(T v, size_t idx)
+        {
+            if (sorted())
+                idx = std::upper_bound(elements.begin(), elements.end(), v, less) - elements.begin();
+            idx = std::min(idx, elements.size());
+            elements.insert(elements.begin() + idx, std::move(v));
+        }
+
+        void append(T v) { insert(std::move(v), elements.size()); }
+
+        bool remove(size_t idx)
+        {
+            if (idx >= elements.size())
+                return false;
+            elements.erase(elements.begin() + idx);
+            return true;
+        }
+
+        // Index of the first element equal to v. O(log n) when sorted, O(n) otherwise
+        bool index_of(const T& v, size_t& idx) const
+        {
+            if (sorted()) {
+                auto it = std::lower_bound(elements.begin(), elements.end(), v, less);
+                if (it == elements.end() || less(v, *it))
+                    return false;
+                idx = it - elements.begin();
+                return true;
+            }
+
+            for (size_t i = 0; i < elements.size(); i++) {
+                if (!less(elements[i], v) && !less(v, elements[i])) {
+                    idx = i;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        T& get(size_t idx) { return elements[idx]; }
+        const T& get(size_t idx) const { return elements[idx]; }
+        T& operator[](size_t idx) { return elements[idx]; }
+        const T& operator[](size_t idx) const { return elements[idx]; }
+
+        T take(size_t idx)
+        {
+            T out = std::move(elements[idx]);
+            elements.erase(elements.begin() + idx);
+            return out;
+        }
+
+        void start_bulk_add() { inbulk = true; }
+
+        void end_bulk_add()
+        {
+            inbulk = false;
+            if (flags & LIST_SORT)
+                sort();
+        }
+
+        // Stable, like list_sort
+        void sort() { std::stable_sort(elements.begin(), elements.end(), less); }
+
+        T* begin() { return elements.data(); }
+        T* end() { return elements.data() + elements.size(); }
+        const T* begin() const { return elements.data(); }
+        const T* end() const { return elements.data() + elements.size(); }
+};
+
+
+#endif /* __LIST_HPP__ */
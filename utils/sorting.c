@@ -16,74 +16,563 @@ A general rule of thumb is to use Quicksort unless you need a stable sort, then
 
 Big-O complexity:
 
-| | Best | Average | Worst | Time | O(n log n) | O(n log n) | O(n log n) | Space | | | O(n)
+| | Best | Average | Worst | Time | O(n) | O(n log n) | O(n log n) | Space | | | O(n)
+
+-----------------
+ Design
+-----------------
+The textbook top-down version splits, mallocs two temporary halves at every level of the recursion and merges back.
+That is O(n) allocations (and the allocator dominates the run time) just to get the bookkeeping of the split for free.
+
+This one works bottom-up instead and allocates exactly once:
+1) Walk the array and find the runs that are already in order (natural merge sort).
+   Strictly descending runs are reversed in place (strict, so reversing keeps it stable).
+   Runs shorter than SORT_MIN_RUN are extended with insertion sort, which is faster than merging for small n.
+2) Merge neighbouring runs pairwise, pass after pass, ping-ponging between the array and one scratch buffer
+   until a single run is left. If the last element of the left run is not greater than the first
+   element of the right run the pair is already in order and is just copied.
+
+Already sorted input is one run and costs n-1 comparisons.
+
+Elements are moved with memcpy(dst, src, width). The whole sort is inlined once per element width
+we care about (4 and 8 bytes: ints, floats, pointers) so for those the memcpy is a single load/store
+instead of a call, and the generic width path is kept for everything else.
 
 */
 #include "sorting.h"
 
 
-void merge_sort(void *base, size_t len, size_t width, int (*cmp)(const void *, const void *))
+#define SORT_MIN_RUN 32
+
+
+static inline void sort_reverse(char *base, size_t lo, size_t hi, size_t width, char *tmp)
 {
-    char   *left;
-    char   *right;
-    size_t  ls;
-    size_t  rs;
-    size_t  mid;
-    size_t  i;
-    size_t  j;
-    size_t  k;
+    while (hi > lo + 1) {
+        hi--;
+        memcpy(tmp, base + (lo * width), width);
+        memcpy(base + (lo * width), base + (hi * width), width);
+        memcpy(base + (hi * width), tmp, width);
+        lo++;
+    }
+}
 
-    if (base == NULL || len < 2 || width == 0 || cmp == NULL)
+// Insertion sort of base[lo, hi) where base[lo, sorted) is already in order.
+static inline void sort_insertion(char *base, size_t lo, size_t sorted, size_t hi, size_t width,
+    int (*cmp)(const void *, const void *), char *tmp)
+{
+    size_t i;
+    size_t j;
+
+    for (i=sorted; i < hi; i++) {
+        if (cmp(base + ((i - 1) * width), base + (i * width)) <= 0)
+            continue;
+
+        memcpy(tmp, base + (i * width), width);
+        j = i;
+        do {
+            memcpy(base + (j * width), base + ((j - 1) * width), width);
+            j--;
+        } while (j > lo && cmp(base + ((j - 1) * width), tmp) > 0);
+        memcpy(base + (j * width), tmp, width);
+    }
+}
+
+// Stable merge of a[0, na) and b[0, nb) into dst. Elements of a go first on ties.
+static inline void sort_merge(char *dst, const char *a, size_t na, const char *b, size_t nb, size_t width,
+    int (*cmp)(const void *, const void *))
+{
+    size_t i = 0;
+    size_t j = 0;
+    size_t k = 0;
+
+    // Already in order, nothing to interleave
+    if (na == 0 || nb == 0 || cmp(a + ((na - 1) * width), b) <= 0) {
+        memcpy(dst, a, na * width);
+        memcpy(dst + (na * width), b, nb * width);
         return;
+    }
 
-    /* Find the mid and deal with an odd number of elements */
-    mid = len / 2;
-    ls  = mid;
-    rs  = mid;
-
-    if (len > 2 && len % 2 != 0)
-        ls++;
-
-    /* Copy the elements into tmp arrays */
-    left  = malloc(ls * width);
-    right = malloc(rs * width);
-    memcpy(left, base, ls * width);
-    memcpy(right, base + (ls * width), rs * width);
-
-    merge_sort(left, ls, width, cmp);
-    merge_sort(right, rs, width, cmp);
-
-    i = 0;
-    j = 0;
-    k = 0;
-    /* Merge the tmp arrays back into the base array in sorted order */
-    while (i < ls && j < rs) {
-        if (cmp(left + (i * width), right + (j * width)) <= 0) {
-            memcpy(base + (k * width), left + (i * width), width);
+    while (i < na && j < nb) {
+        if (cmp(a + (i * width), b + (j * width)) <= 0) {
+            memcpy(dst + (k * width), a + (i * width), width);
             i++;
         } else {
-            memcpy(base + (k * width), right + (j * width), width);
+            memcpy(dst + (k * width), b + (j * width), width);
             j++;
         }
         k++;
     }
 
-    /* If left is longer than right copy the remaining elements
-     * over */
-    while (i < ls) {
-        memcpy(base + (k * width), left + (i * width), width);
-        i++;
-        k++;
+    // Whichever side is left over is already in order
+    memcpy(dst + (k * width), a + (i * width), (na - i) * width);
+    k += na - i;
+    memcpy(dst + (k * width), b + (j * width), (nb - j) * width);
+}
+
+
+/**
+ * The whole algorithm, always inlined so each caller with a constant width gets its own copy.
+ * scratch holds len elements, runs has room for a boundary per run plus one.
+*/
+static inline __attribute__((always_inline)) void merge_sort_impl(char *base, size_t len, size_t width,
+    int (*cmp)(const void *, const void *), char *scratch, size_t *runs)
+{
+    size_t  num_runs = 0;
+    size_t  start;
+    size_t  end;
+    size_t  i;
+    char   *src;
+    char   *dst;
+    char   *tmp;
+
+    // 1) find the natural runs, scratch is free until the merge so use it for the temporary element
+    start = 0;
+    while (start < len) {
+        end = start + 1;
+        if (end < len && cmp(base + (end * width), base + (start * width)) < 0) {
+            while (end + 1 < len && cmp(base + ((end + 1) * width), base + (end * width)) < 0)
+                end++;
+            end++;
+            sort_reverse(base, start, end, width, scratch);
+        } else {
+            while (end < len && cmp(base + ((end - 1) * width), base + (end * width)) <= 0)
+                end++;
+        }
+
+        if (end - start < SORT_MIN_RUN && end < len) {
+            i   = end;
+            end = (start + SORT_MIN_RUN < len) ? start + SORT_MIN_RUN : len;
+            sort_insertion(base, start, i, end, width, cmp, scratch);
+        }
+
+        runs[num_runs++] = start;
+        start = end;
     }
+    runs[num_runs] = len;
 
-    /* If right is longer than right copy the remaining elements
-     * over */
-    while (j < rs) {
-        memcpy(base + (k * width), right + (j * width), width);
-        j++;
-        k++;
+    // 2) merge pairs of runs until only one is left
+    src = base;
+    dst = scratch;
+    while (num_runs > 1) {
+        for (i=0; i + 1 < num_runs; i += 2)
+            sort_merge(dst + (runs[i] * width), src + (runs[i] * width), runs[i + 1] - runs[i],
+                src + (runs[i + 1] * width), runs[i + 2] - runs[i + 1], width, cmp);
+        if (num_runs % 2 != 0)
+            memcpy(dst + (runs[num_runs - 1] * width), src + (runs[num_runs - 1] * width),
+                (len - runs[num_runs - 1]) * width);
+
+        // keep every other boundary
+        for (i=0; 2 * i < num_runs; i++)
+            runs[i] = runs[2 * i];
+        num_runs = (num_runs + 1) / 2;
+        runs[num_runs] = len;
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != base)
+        memcpy(base, src, len * width);
+}
+
+
+void merge_sort(void *base, size_t len, size_t width, int (*cmp)(const void *, const void *))
+{
+    char   *scratch;
+    size_t *runs;
+    size_t  scratch_size;
+
+    if (base == NULL || len < 2 || width == 0 || cmp == NULL)
+        return;
+
+    // one allocation for everything: the scratch copy and the run boundaries behind it
+    scratch_size = (len * width + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+    scratch = malloc(scratch_size + (len / SORT_MIN_RUN + 2) * sizeof(*runs));
+    if (scratch == NULL)
+        return;
+    runs = (size_t *)(scratch + scratch_size);
+
+    switch (width) {
+        case 4:
+            merge_sort_impl(base, len, 4, cmp, scratch, runs);
+            break;
+        case 8:
+            merge_sort_impl(base, len, 8, cmp, scratch, runs);
+            break;
+        default:
+            merge_sort_impl(base, len, width, cmp, scratch, runs);
+            break;
+    }
+
+    free(scratch);
+}
+
+
+/*
+-----------------
+ Parallel merge sort
+-----------------
+The array is cut into one chunk per thread and every chunk is sorted with merge_sort on the pool.
+The sorted chunks are then merged pairwise, round after round, like the bottom-up passes above.
+
+Merging two halves on one thread would leave all the other threads idle in the last rounds
+(the final merge alone touches every element), so every merge is itself split across the threads
+with merge path partitioning: the output of merging a and b is cut into equal slices, and for every
+cut point d a binary search finds how many elements of a (i) and of b (d - i) end up before it.
+Each slice is then an independent, equally sized, stable merge of a[i0, i1) and b[j0, j1).
+*/
+
+// Below this many elements per thread the pool overhead isn't worth it
+#define SORT_PARALLEL_MIN 4096
+
+typedef struct {
+    char        *dst;
+    const char  *a;
+    size_t       na;
+    const char  *b;
+    size_t       nb;
+    size_t       width;
+    int        (*cmp)(const void *, const void *);
+} sort_task_t;
+
+static void sort_chunk_worker(void *arg)
+{
+    sort_task_t *t = arg;
+    merge_sort((void *)t->a, t->na, t->width, t->cmp);
+}
+
+static void sort_merge_worker(void *arg)
+{
+    sort_task_t *t = arg;
+    sort_merge(t->dst, t->a, t->na, t->b, t->nb, t->width, t->cmp);
+}
+
+// How many elements of a are among the first d elements of the stable merge of a and b.
+static size_t sort_merge_path(const char *a, size_t na, const char *b, size_t nb, size_t d, size_t width,
+    int (*cmp)(const void *, const void *))
+{
+    size_t lo = (d > nb) ? d - nb : 0;
+    size_t hi = (d < na) ? d : na;
+    size_t i;
+
+    while (lo < hi) {
+        i = lo + (hi - lo) / 2;
+        // a wins ties, so a[i] is in the prefix if it doesn't compare greater than b[d - i - 1]
+        if (cmp(a + (i * width), b + ((d - i - 1) * width)) <= 0) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+
+/**
+ * Stable, like merge_sort. tpool_wait is used between rounds
+ * so the pool must not be running anything else at the same time.
+ * Falls back to the sequential merge_sort if the buffers can't be allocated.
+*/
+void merge_sort_parallel(void *base, size_t len, size_t width, int (*cmp)(const void *, const void *),
+    tpool_t *tm, size_t num_threads)
+{
+    sort_task_t *tasks;
+    size_t      *bounds;
+    size_t       num_chunks;
+    size_t       num_tasks;
+    size_t       parts;
+    size_t       total;
+    size_t       p;
+    size_t       k;
+    size_t       d;
+    size_t       i;
+    size_t       prev_d;
+    size_t       prev_i;
+    char        *scratch;
+    char        *src;
+    char        *dst;
+    char        *tmp;
+
+    if (base == NULL || len < 2 || width == 0 || cmp == NULL)
+        return;
+
+    if (tm == NULL || num_threads < 2 || len < num_threads * SORT_PARALLEL_MIN) {
+        merge_sort(base, len, width, cmp);
+        return;
+    }
+
+    scratch = malloc(len * width);
+    tasks   = malloc(num_threads * sizeof(*tasks));
+    bounds  = malloc((num_threads + 1) * sizeof(*bounds));
+    if (scratch == NULL || tasks == NULL || bounds == NULL) {
+        free(bounds);
+        free(tasks);
+        free(scratch);
+        merge_sort(base, len, width, cmp);
+        return;
+    }
+
+    // 1) sort one chunk per thread
+    num_chunks = num_threads;
+    for (k=0; k <= num_chunks; k++)
+        bounds[k] = len * k / num_chunks;
+    for (k=0; k < num_chunks; k++) {
+        tasks[k].a     = (char *)base + (bounds[k] * width);
+        tasks[k].na    = bounds[k + 1] - bounds[k];
+        tasks[k].width = width;
+        tasks[k].cmp   = cmp;
+        tpool_add_work(tm, sort_chunk_worker, tasks + k);
+    }
+    tpool_wait(tm);
+
+    // 2) merge pairs of chunks, every merge split into slices with merge path
+    src = base;
+    dst = scratch;
+    while (num_chunks > 1) {
+        parts     = num_threads / (num_chunks / 2);
+        num_tasks = 0;
+        for (p=0; p + 1 < num_chunks; p += 2) {
+            const char *a  = src + (bounds[p] * width);
+            const char *b  = src + (bounds[p + 1] * width);
+            size_t      na = bounds[p + 1] - bounds[p];
+            size_t      nb = bounds[p + 2] - bounds[p + 1];
+
+            total  = na + nb;
+            prev_d = 0;
+            prev_i = 0;
+            for (k=1; k <= parts; k++) {
+                d = total * k / parts;
+                i = (k == parts) ? na : sort_merge_path(a, na, b, nb, d, width, cmp);
+
+                tasks[num_tasks].dst   = dst + ((bounds[p] + prev_d) * width);
+                tasks[num_tasks].a     = a + (prev_i * width);
+                tasks[num_tasks].na    = i - prev_i;
+                tasks[num_tasks].b     = b + ((prev_d - prev_i) * width);
+                tasks[num_tasks].nb    = (d - i) - (prev_d - prev_i);
+                tasks[num_tasks].width = width;
+                tasks[num_tasks].cmp   = cmp;
+                tpool_add_work(tm, sort_merge_worker, tasks + num_tasks);
+                num_tasks++;
+
+                prev_d = d;
+                prev_i = i;
+            }
+        }
+        if (num_chunks % 2 != 0)
+            memcpy(dst + (bounds[num_chunks - 1] * width), src + (bounds[num_chunks - 1] * width),
+                (len - bounds[num_chunks - 1]) * width);
+        tpool_wait(tm);
+
+        for (k=0; 2 * k < num_chunks; k++)
+            bounds[k] = bounds[2 * k];
+        num_chunks = (num_chunks + 1) / 2;
+        bounds[num_chunks] = len;
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != base)
+        memcpy(base, src, len * width);
+
+    free(bounds);
+    free(tasks);
+    free(scratch);
+}
+
+
+/*
+-----------------
+ Radix sort
+-----------------
+Comparison sorts can't beat O(n log n) comparisons, and with a callback every comparison is an indirect call.
+For plain numeric keys (scores, ids) LSD radix sort does a fixed number of linear passes instead:
+one pass per 8-bit digit from the least significant up, each pass a stable counting sort on that digit.
+4 passes for 32-bit keys, 8 for 64-bit keys, whatever n is.
+
+The histograms of all digits are built in a single read pass, and a pass is skipped entirely
+when every key has the same digit (common for the high bytes of small ids).
+
+The optional vals array (e.g. sample ids) is moved along with the keys, so it ends up
+ordered by key. Equal keys keep their original order.
+
+Floats are sorted as their bit patterns after the sign-flip trick: flip all bits of negative numbers
+(so more negative sorts lower) and only the sign bit of positive numbers (so they sort above the negatives).
+The result is the IEEE total order, -0.0 before +0.0 and NaNs at the ends.
+
+They return 0, or -1 with keys and vals untouched if the scratch buffer can't be allocated.
+*/
+
+#define RADIX_BITS    8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+int radix_sort_u32(uint32_t *keys, uint32_t *vals, size_t len)
+{
+    size_t     hist[4][RADIX_BUCKETS];
+    size_t     offset;
+    size_t     count;
+    size_t     pos;
+    size_t     i;
+    unsigned   p;
+    unsigned   d;
+    uint32_t  *scratch;
+    uint32_t  *sk;
+    uint32_t  *sv;
+    uint32_t  *dk;
+    uint32_t  *dv;
+    uint32_t  *tmp;
+
+    if (keys == NULL || len < 2)
+        return 0;
+
+    memset(hist, 0, sizeof(hist));
+    for (i=0; i < len; i++) {
+        for (p=0; p < 4; p++)
+            hist[p][(keys[i] >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    scratch = malloc(len * sizeof(*keys) * (vals != NULL ? 2 : 1));
+    if (scratch == NULL)
+        return -1;
+    sk = keys;
+    sv = vals;
+    dk = scratch;
+    dv = vals != NULL ? scratch + len : NULL;
+
+    for (p=0; p < 4; p++) {
+        if (hist[p][(keys[0] >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)] == len)
+            continue;
+
+        offset = 0;
+        for (d=0; d < RADIX_BUCKETS; d++) {
+            count = hist[p][d];
+            hist[p][d] = offset;
+            offset += count;
+        }
+
+        for (i=0; i < len; i++) {
+            pos = hist[p][(sk[i] >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+            dk[pos] = sk[i];
+            if (sv != NULL)
+                dv[pos] = sv[i];
+        }
+
+        tmp = sk; sk = dk; dk = tmp;
+        tmp = sv; sv = dv; dv = tmp;
+    }
+
+    if (sk != keys) {
+        memcpy(keys, sk, len * sizeof(*keys));
+        if (vals != NULL)
+            memcpy(vals, sv, len * sizeof(*vals));
+    }
+
+    free(scratch);
+    return 0;
+}
+
+
+int radix_sort_u64(uint64_t *keys, uint32_t *vals, size_t len)
+{
+    size_t     hist[8][RADIX_BUCKETS];
+    size_t     offset;
+    size_t     count;
+    size_t     pos;
+    size_t     i;
+    unsigned   p;
+    unsigned   d;
+    uint64_t  *scratch;
+    uint64_t  *sk;
+    uint64_t  *dk;
+    uint64_t  *tk;
+    uint32_t  *sv;
+    uint32_t  *dv;
+    uint32_t  *tv;
+
+    if (keys == NULL || len < 2)
+        return 0;
+
+    memset(hist, 0, sizeof(hist));
+    for (i=0; i < len; i++) {
+        for (p=0; p < 8; p++)
+            hist[p][(keys[i] >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    scratch = malloc(len * (sizeof(*keys) + (vals != NULL ? sizeof(*vals) : 0)));
+    if (scratch == NULL)
+        return -1;
+    sk = keys;
+    sv = vals;
+    dk = scratch;
+    dv = vals != NULL ? (uint32_t *)(scratch + len) : NULL;
+
+    for (p=0; p < 8; p++) {
+        if (hist[p][(keys[0] >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)] == len)
+            continue;
+
+        offset = 0;
+        for (d=0; d < RADIX_BUCKETS; d++) {
+            count = hist[p][d];
+            hist[p][d] = offset;
+            offset += count;
+        }
+
+        for (i=0; i < len; i++) {
+            pos = hist[p][(sk[i] >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+            dk[pos] = sk[i];
+            if (sv != NULL)
+                dv[pos] = sv[i];
+        }
+
+        tk = sk; sk = dk; dk = tk;
+        tv = sv; sv = dv; dv = tv;
+    }
+
+    if (sk != keys) {
+        memcpy(keys, sk, len * sizeof(*keys));
+        if (vals != NULL)
+            memcpy(vals, sv, len * sizeof(*vals));
+    }
+
+    free(scratch);
+    return 0;
+}
+
+
+/**
+ * The float bits are copied out (memcpy, so no float is read through a uint32_t lvalue)
+ * into a key buffer where they are flipped to sort as unsigned, and copied back after.
+*/
+int radix_sort_f32(float *keys, uint32_t *vals, size_t len)
+{
+    uint32_t *bits;
+    uint32_t  b;
+    size_t    i;
+
+    if (keys == NULL || len < 2)
+        return 0;
+
+    bits = malloc(len * sizeof(*bits));
+    if (bits == NULL)
+        return -1;
+
+    for (i=0; i < len; i++) {
+        memcpy(&b, &keys[i], sizeof(b));
+        bits[i] = b ^ ((uint32_t)(-(int32_t)(b >> 31)) | 0x80000000u);
+    }
+
+    if (radix_sort_u32(bits, vals, len) != 0) {
+        free(bits);
+        return -1;
+    }
+
+    for (i=0; i < len; i++) {
+        b = bits[i] ^ (((bits[i] >> 31) - 1) | 0x80000000u);
+        memcpy(&keys[i], &b, sizeof(b));
     }
 
-    free(right);
-    free(left);
+    free(bits);
+    return 0;
 }
@@ -2,9 +2,27 @@
 #define __SORTING_H__
 #pragma once
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include "tpool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void merge_sort(void *base, size_t len, size_t width, int (*cmp)(const void *, const void *));
+void merge_sort_parallel(void *base, size_t len, size_t width, int (*cmp)(const void *, const void *),
+    tpool_t *tm, size_t num_threads);
+
+// LSD radix sorts for numeric keys, vals (can be NULL) is reordered along with the keys.
+// Return 0, or -1 (nothing sorted) when out of memory.
+int radix_sort_u32(uint32_t *keys, uint32_t *vals, size_t len);
+int radix_sort_u64(uint64_t *keys, uint32_t *vals, size_t len);
+int radix_sort_f32(float *keys, uint32_t *vals, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* __SORTING_H__ */
\ No newline at end of file
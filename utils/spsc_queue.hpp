@@ -0,0 +1,85 @@
+#ifndef __SPSC_QUEUE_HPP__
+#define __SPSC_QUEUE_HPP__
+#pragma once
+
+/**
+ * Bounded, lock free, single producer / single consumer ring buffer.
+ *
+ * Exactly one thread may push and exactly one (other) thread may pop.
+ * The producer only writes tail and the consumer only writes head, each on its own cache line,
+ * so the two sides never fight over a line except to publish. Each side also keeps a cached copy
+ * of the other side's index and only re-reads the shared one when the cached copy says the
+ * queue is full (producer) or empty (consumer), so in steady state a push or pop touches no
+ * line the other thread is writing.
+ */
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+
+template <class T>
+class SpscQueue
+{
+    private:
+        static constexpr size_t LINE = 64;
+
+        std::vector<T> buf;
+        size_t mask = 0;
+
+        alignas(LINE) std::atomic<size_t> head{0};      // next slot to pop, written by the consumer
+        size_t tail_cache = 0;                          // consumer's view of tail
+
+        alignas(LINE) std::atomic<size_t> tail{0};      // next slot to push, written by the producer
+        size_t head_cache = 0;                          // producer's view of head
+
+    public:
+        // Holds at least capacity elements (rounded up to a power of 2)
+        explicit SpscQueue(size_t capacity)
+        {
+            size_t n = 2;
+            while (n < capacity)
+                n <<= 1;
+            buf.resize(n);
+            mask = n - 1;
+        }
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        // Producer side. False when full.
+        bool push(T v)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head_cache > mask) {
+                head_cache = head.load(std::memory_order_acquire);
+                if (t - head_cache > mask)
+                    return false;
+            }
+            buf[t & mask] = std::move(v);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side. False when empty.
+        bool pop(T& out)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail_cache) {
+                tail_cache = tail.load(std::memory_order_acquire);
+                if (h == tail_cache)
+                    return false;
+            }
+            out = std::move(buf[h & mask]);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t capacity() const { return mask + 1; }
+
+        // Only exact when neither side is running
+        size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+};
+
+
+#endif /* __SPSC_QUEUE_HPP__ */
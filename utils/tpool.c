@@ -27,11 +27,13 @@ Another option would be to set a fixed size queue and have tpool_add_work block
 If you’re worried about memory usage you should think about this.
 */
 #include "tpool.h"
+#include "trace.h"
 
 
 struct tpool_work {
     thread_func_t      func;
     void              *arg;
+    uint64_t           trace_id;    // links the enqueue to the execution in a trace, 0 when not traced
     struct tpool_work *next;
 };
 typedef struct tpool_work tpool_work_t;
@@ -75,6 +77,7 @@ static tpool_work_t *tpool_work_create(thread_func_t func, void *arg)
     work       = malloc(sizeof(*work));
     work->func = func;
     work->arg  = arg;
+    work->trace_id = 0;
     work->next = NULL;
     return work;
 }
@@ -122,17 +125,30 @@ static void *tpool_worker(void *arg)
 {
     tpool_t      *tm = arg;
     tpool_work_t *work;
+    uint64_t      t_lock, t_work, t_exec;
+    bool          waited;
+
+    trace_set_thread_name("tpool worker");
 
     // This will keep the tread running and as long as it doesn’t exit it can be used
     while (1) {
+        t_lock = trace_enabled() ? trace_now() : 0;
+        waited = false;
+
         // The first thing that happens is locking the mutex
         // so we can be sure nothing else manipulates the pool’s members
         pthread_mutex_lock(&(tm->work_mutex));
 
         // Check if there is any work available for processing and we are still running
         // We’ll wait in a conditional until we’re signaled and run our check again.
-        while (tm->work_first == NULL && !tm->stop)
+        while (tm->work_first == NULL && !tm->stop) {
             pthread_cond_wait(&(tm->work_cond), &(tm->work_mutex));
+            waited = true;
+        }
+
+        // Tracing may have been started while we slept, the time from here on is the dequeue.
+        // A wait that was traced from its start shows up as idle.
+        t_work = trace_enabled() ? trace_now() : 0;
 
         // Now we check if the pool has requested that all threads stop running and exit
         // The stop check is all the way up here because we want to stop before pulling any work.
@@ -154,7 +170,18 @@ static void *tpool_worker(void *arg)
         // It is possible that there was no work at this point
         // so there isn’t anything that needs to be done.
         if (work != NULL) {
-            work->func(work->arg);
+            if (t_work != 0) {
+                if (waited && t_lock != 0)
+                    trace_complete("tpool", "idle", t_lock, t_work, NULL, 0);
+                t_exec = trace_now();
+                trace_complete("tpool", "dequeue", waited || t_lock == 0 ? t_work : t_lock, t_exec, NULL, 0);
+                if (work->trace_id != 0)
+                    trace_flow_end("tpool", "task", work->trace_id);
+                work->func(work->arg);
+                trace_complete("tpool", "execute", t_exec, trace_now(), "task", work->trace_id);
+            } else {
+                work->func(work->arg);
+            }
             tpool_work_destroy(work);
         }
 
@@ -285,13 +312,21 @@ void tpool_destroy(tpool_t *tm)
 bool tpool_add_work(tpool_t *tm, thread_func_t func, void *arg)
 {
     tpool_work_t *work;
+    uint64_t      t_begin;
+    uint64_t      id = 0;
 
     if (tm == NULL)
         return false;
 
+    t_begin = trace_enabled() ? trace_now() : 0;
     work = tpool_work_create(func, arg);
     if (work == NULL)
         return false;
+    if (t_begin != 0) {
+        id = trace_next_id();
+        work->trace_id = id;
+        trace_flow_begin("tpool", "task", id);
+    }
 
     pthread_mutex_lock(&(tm->work_mutex));
     if (tm->work_first == NULL) {
@@ -304,6 +339,10 @@ bool tpool_add_work(tpool_t *tm, thread_func_t func, void *arg)
 
     pthread_cond_broadcast(&(tm->work_cond));
     pthread_mutex_unlock(&(tm->work_mutex));
+
+    // work may be done and freed by now
+    if (t_begin != 0)
+        trace_complete("tpool", "enqueue", t_begin, trace_now(), "task", id);
     return true;
 }
 
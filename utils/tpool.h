@@ -7,6 +7,10 @@
 #include <pthread.h>
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct tpool;
 typedef struct tpool tpool_t;
 
@@ -18,4 +22,8 @@ void tpool_destroy(tpool_t *tm);
 bool tpool_add_work(tpool_t *tm, thread_func_t func, void *arg);
 void tpool_wait(tpool_t *tm);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __TPOOL_H__ */
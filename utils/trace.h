@@ -0,0 +1,132 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+#pragma once
+
+/*
+Span tracing in the Chrome trace event format (opens in Perfetto / chrome://tracing).
+
+Events go to per thread buffers without locks: a thread appends to a chunk it owns and only takes the
+registry lock to get a fresh chunk every TRACE_CHUNK_EVENTS events. Timestamps are TSC ticks (rdtsc)
+on x86 and CLOCK_MONOTONIC nanoseconds elsewhere, converted to microseconds when the trace is written.
+
+While tracing is stopped (the default) every trace point costs one relaxed load and a branch.
+Building with NN_TRACE=0 compiles them out altogether.
+
+    trace_start(0);
+    ... train ...
+    trace_stop();
+    trace_write_json("step.json");
+
+trace_start, trace_stop and trace_write_json must not run concurrently with traced work
+(call them between steps, with the pools idle).
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef NN_TRACE
+#define NN_TRACE 1
+#endif
+
+#define TRACE_CHUNK_EVENTS 1024
+#define TRACE_NAME_MAX     27          // longer names are cut
+#define TRACE_DEFAULT_EVENTS (1u << 20)
+
+extern int trace_on;
+
+static inline bool trace_enabled(void)
+{
+#if NN_TRACE
+    return __atomic_load_n(&trace_on, __ATOMIC_RELAXED) != 0;
+#else
+    return false;
+#endif
+}
+
+// Raw timestamp, only meaningful to the functions below
+static inline uint64_t trace_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+// Drop what was recorded so far and record at most max_events (0: TRACE_DEFAULT_EVENTS) from now on.
+// Events past the limit are counted in trace_dropped.
+void trace_start(size_t max_events);
+void trace_stop(void);
+
+// Name of the calling thread in the trace (copied), can be set whether tracing or not
+void trace_set_thread_name(const char *name);
+
+// A span of the calling thread from begin to end (trace_now values), arg_name may be NULL
+void trace_complete(const char *cat, const char *name, uint64_t begin, uint64_t end, const char *arg_name, uint64_t arg);
+void trace_instant(const char *cat, const char *name, const char *arg_name, uint64_t arg);
+
+// An arrow from the span around trace_flow_begin to the span starting at the trace_flow_end of the same id
+// (e.g. from a task's enqueue to its execution on another thread)
+void trace_flow_begin(const char *cat, const char *name, uint64_t id);
+void trace_flow_end(const char *cat, const char *name, uint64_t id);
+uint64_t trace_next_id(void);
+
+size_t trace_event_count(void);
+size_t trace_dropped(void);
+
+// Returns 0 on success, -1 if path can't be written
+int trace_write_json(const char *path);
+
+#ifdef __cplusplus
+}
+
+
+// Records a span from construction to destruction, if tracing was on when it started.
+// cat, name and arg_name must outlive the span (string literals), name is copied when it ends.
+class TraceSpan
+{
+    private:
+        const char* cat;
+        const char* name;
+        const char* arg_name;
+        uint64_t    arg;
+        uint64_t    begin;
+        bool        on;
+
+    public:
+        TraceSpan(const char* cat, const char* name, const char* arg_name=nullptr, uint64_t arg=0):
+            cat(cat), name(name), arg_name(arg_name), arg(arg), begin(0), on(trace_enabled())
+        {
+            if (this->on)
+                this->begin = trace_now();
+        }
+
+        ~TraceSpan()
+        {
+            if (this->on)
+                trace_complete(this->cat, this->name, this->begin, trace_now(), this->arg_name, this->arg);
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(...) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(__VA_ARGS__)
+
+#endif
+
+#endif /* __TRACE_H__ */